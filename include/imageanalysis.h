@@ -0,0 +1,124 @@
+/*
+ * Module: Image Analysis
+ *
+ * Objective:
+ * - Cheap measurements on 8-bit grayscale pages that let OCRProcessor decide
+ *   how to prepare an image before handing it to Tesseract.
+ * - Work directly on a pointer/stride view so the same code serves QImage
+ *   buffers, decoder output and shared-memory slots without copies.
+ *
+ * Text scale estimation uses horizontal projection profiles: rows containing
+ * ink form text-line bands, and inside each band the rows whose ink density
+ * reaches half of the band's peak are the x-height core (ascenders and
+ * descenders are much sparser than the x-band).
+ *
+ * Ink measurement is a single streaming pass with an SSE2 kernel (scalar
+ * fallback elsewhere) so blank pages can be rejected before recognition.
+ */
+
+#ifndef IMAGEANALYSIS_H
+#define IMAGEANALYSIS_H
+
+#include <cstdint>
+
+/**
+ * @brief Read-only view of an 8-bit grayscale image
+ */
+struct GrayImageView {
+    const uint8_t* pixels = nullptr;  ///< First scan line
+    int width = 0;
+    int height = 0;
+    int bytesPerLine = 0;
+
+    const uint8_t* scanLine(int y) const {
+        return pixels + static_cast<intptr_t>(y) * bytesPerLine;
+    }
+};
+
+/**
+ * @brief Fast page measurements used to choose processing parameters
+ */
+class ImageAnalysis {
+   public:
+    /**
+     * @brief Text size measured on a page
+     */
+    struct TextMetrics {
+        int lineCount = 0;        ///< Text-line bands that contributed to the estimate
+        double xHeight = 0.0;     ///< Median x-height in pixels of the analysed image
+        double lineHeight = 0.0;  ///< Median band height (ascender to descender)
+        int inkThreshold = 0;     ///< Gray level separating ink from background
+
+        /**
+         * @brief True when enough lines were found to trust the estimate
+         */
+        bool isReliable() const { return lineCount >= kMinReliableLines && xHeight > 0.0; }
+    };
+
+    static constexpr int kMinReliableLines = 2;
+
+    /**
+     * @brief Ink coverage and gray-level spread of a page
+     */
+    struct InkStatistics {
+        int64_t samples = 0;             ///< Pixels examined
+        double inkRatio = 0.0;           ///< Fraction of samples darker than the ink level
+        double mean = 0.0;               ///< Mean gray level
+        double standardDeviation = 0.0;  ///< Gray-level standard deviation
+
+        /**
+         * @brief True when (almost) nothing on the page differs from the background
+         * @param maxInkRatio Coverage below which a page counts as blank
+         */
+        bool isBlank(double maxInkRatio) const {
+            return samples > 0 && (inkRatio < maxInkRatio || 1.0 - inkRatio < maxInkRatio);
+        }
+    };
+
+    /**
+     * @brief Measure ink coverage and gray-level statistics
+     *
+     * Every pixel of every `rowStep`-th row is examined; text glyphs are far
+     * taller than four rows at any usable resolution.
+     *
+     * @param image Grayscale page
+     * @param inkLevel Pixels strictly darker than this count as ink
+     * @param rowStep Vertical sampling step (1 = every row)
+     */
+    static InkStatistics measureInk(const GrayImageView& image, int inkLevel = 128,
+                                    int rowStep = 4);
+
+    /**
+     * @brief Estimate the x-height of the text on a page
+     *
+     * Every row is examined; columns are sampled every `columnStep` pixels,
+     * which keeps the pass well under the cost of a single resampling step.
+     *
+     * @param image Grayscale page, dark text on a light background (inverted
+     *        pages are detected and handled)
+     * @param columnStep Horizontal sampling step (1 = every pixel)
+     * @return Measured metrics; check isReliable() before using them
+     */
+    static TextMetrics estimateTextMetrics(const GrayImageView& image, int columnStep = 2);
+
+    /**
+     * @brief Otsu threshold of a sampled grayscale histogram
+     * @return Gray level in [0, 255]; pixels at or below it are the darker class
+     */
+    static int otsuThreshold(const GrayImageView& image, int columnStep = 2, int rowStep = 2);
+
+    /**
+     * @brief Ink level for measureInk() that adapts to the page
+     *
+     * The Otsu threshold, kept at least `minContrast` gray levels away from
+     * the paper (the most common gray level), so faint pencil or light gray
+     * print counts as ink while the noise of an empty page does not. On dark
+     * paper the level lies above the paper, and measureInk() then counts the
+     * paper as ink, which InkStatistics::isBlank() accepts either way.
+     */
+    static int inkLevel(const GrayImageView& image, int minContrast = kMinInkContrast);
+
+    static constexpr int kMinInkContrast = 40;  ///< Gray levels between paper and faintest ink
+};
+
+#endif  // IMAGEANALYSIS_H
@@ -0,0 +1,60 @@
+/*
+ * Module: Latency Histogram
+ *
+ * Objective:
+ * - Record latencies, sizes and other non-negative samples in constant
+ *   memory and report percentiles with a bounded relative error.
+ * - Depend on nothing but Qt's integer types, so every tool and test can
+ *   use it without the OCR engine.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Log-linear histogram of non-negative integer samples
+ *
+ * Values below 32 are counted exactly; larger values fall into one of 16
+ * buckets per power of two, giving a worst-case relative error of about 3%
+ * with a footprint of at most ~1000 counters.
+ */
+class LatencyHistogram {
+   public:
+    /**
+     * @brief Record one sample (negative values are clamped to zero)
+     */
+    void record(qint64 value);
+
+    /**
+     * @brief Fold another histogram into this one
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * @brief Value at the given percentile
+     * @param percentile Percentile in the range [0, 100]
+     * @return Representative value of the bucket holding that rank, 0 if empty
+     */
+    qint64 percentile(double percentile) const;
+
+    qint64 count() const { return m_count; }
+    qint64 min() const { return m_count ? m_min : 0; }
+    qint64 max() const { return m_max; }
+    double mean() const { return m_count ? static_cast<double>(m_sum) / m_count : 0.0; }
+
+   private:
+    static int bucketIndex(uint64_t value);
+    static uint64_t bucketValue(int index);
+
+    std::vector<uint64_t> m_buckets;
+    qint64 m_count = 0;
+    qint64 m_min = 0;
+    qint64 m_max = 0;
+    qint64 m_sum = 0;
+};
+
+#endif  // LATENCYHISTOGRAM_H
@@ -31,8 +31,12 @@
 
 #ifdef TESSERACT_AVAILABLE
 #include "ocrprocessor.h"
+#ifdef Q_OS_LINUX
+#include "ocrprocesspool.h"
+#endif
 #endif
 #include <QPushButton>
+#include <QRubberBand>
 #include <QSplitter>
 #include <QStatusBar>
 #include <QTextEdit>
@@ -93,6 +97,14 @@ class MainWindow : public QMainWindow {
      */
     void closeEvent(QCloseEvent *event) override;
 
+    /**
+     * @brief Rubber-band region selection on the image preview
+     * @param watched Object receiving the event
+     * @param event Event to inspect
+     * @return true if the event was consumed
+     */
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
    private slots:
     // File operations
     void onOpenFile();
@@ -135,6 +147,20 @@ class MainWindow : public QMainWindow {
     void setOperationEnabled(bool enabled);
     void logMessage(const QString &message, bool isError = false);
 
+#ifdef TESSERACT_AVAILABLE
+    // Interactive OCR through a running ocr_daemon
+    bool recognizeWithDaemon(const QString &filePath, const QRect &region,
+                             OCRProcessor::OCRResult &result) const;
+    // OCR in a worker process, so a crashing engine cannot take the window down
+    bool recognizeIsolated(const QString &filePath, const QRect &region,
+                           OCRProcessor::OCRResult &result);
+#endif
+
+    // Image preview and region selection
+    void showImagePreview(const QString &filePath);
+    QRect previewToSourceRect(const QRect &previewRect) const;
+    void clearRegionSelection();
+
     // Central widget and main layout
     QWidget *m_centralWidget;
     QSplitter *m_mainSplitter;
@@ -146,6 +172,7 @@ class MainWindow : public QMainWindow {
     QPushButton *m_configureButton;
     QLabel *m_filePathLabel;
     QLabel *m_imagePreviewLabel;
+    QRubberBand *m_selectionBand;
 
     // OCR processing section
     QGroupBox *m_processingGroup;
@@ -184,11 +211,17 @@ class MainWindow : public QMainWindow {
     // Settings and state management
     QSettings *m_settings;
     QString m_currentFilePath;
+    QSize m_currentImageSize;  ///< Source pixel size of the previewed image
+    QPoint m_selectionOrigin;  ///< Press position in preview coordinates
+    QRect m_selectedRegion;    ///< Selected region in source pixels (null = whole page)
     bool m_operationInProgress;
 
 #ifdef TESSERACT_AVAILABLE
     // OCR processing
     std::unique_ptr<OCRProcessor> m_ocrProcessor;
+#ifdef Q_OS_LINUX
+    std::unique_ptr<OCRProcessPool> m_processPool;  ///< Started on first use (ocr/isolate_engine)
+#endif
     OCRProcessor::ProcessingMode m_currentOCRMode;
     QString m_lastOCRResult;
     float m_lastOCRConfidence;
@@ -200,6 +233,7 @@ class MainWindow : public QMainWindow {
     static constexpr int MINIMUM_WINDOW_WIDTH = 600;
     static constexpr int MINIMUM_WINDOW_HEIGHT = 400;
     static constexpr int SPLITTER_HANDLE_WIDTH = 5;
+    static constexpr int MIN_SELECTION_SIZE = 4;  ///< Smaller drags count as a click
 };
 
 #endif  // MAINWINDOW_H
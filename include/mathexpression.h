@@ -0,0 +1,139 @@
+/*
+ * Module: Math Expression
+ *
+ * Objective:
+ * - Turn one recognized equation line into an expression tree and LaTeX, so
+ *   downstream consumers do not re-parse the flat OCR text.
+ * - Recover superscripts and subscripts from glyph placement: a linear OCR
+ *   pass reads "x^{2}" as "x2", but the 2 sits above the baseline.
+ * - Work on plain glyph boxes and baselines, independent of Qt and Tesseract.
+ *
+ * The accepted language is the one MathGrammar describes, plus explicit "^"
+ * and "_" operators. Multiplication without an operator ("2x", "(a+b)(a-b)")
+ * becomes a product node. Relations may only appear outside brackets.
+ */
+
+#ifndef MATHEXPRESSION_H
+#define MATHEXPRESSION_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Expression tree and LaTeX for one equation line
+ *
+ * Nodes live in one vector and reference each other by index; an instance
+ * can be reused for many lines without giving its buffers back.
+ */
+class MathExpression {
+   public:
+    /**
+     * @brief One recognized glyph of the line
+     */
+    struct Symbol {
+        std::string text;         ///< UTF-8 text, normally one character
+        int left = 0;             ///< Box in any pixel space (all zero = unknown)
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+        double baseline = 0.0;    ///< Line baseline y at the symbol's centre
+        bool startsWord = false;  ///< First symbol of a word (ends a number)
+    };
+
+    enum class NodeKind {
+        Number,       ///< Decimal literal
+        Variable,     ///< Single letter
+        Negate,       ///< Unary minus; one child
+        Binary,       ///< Operator or relation in text (+ - * / = < >); two children
+        Product,      ///< Implicit multiplication; two or more children
+        Group,        ///< Bracketed list; text is the opening bracket
+        Superscript,  ///< Base and exponent
+        Subscript     ///< Base and index
+    };
+
+    /**
+     * @brief Tree node; children form a singly linked list
+     */
+    struct Node {
+        NodeKind kind = NodeKind::Number;
+        std::string text;
+        int firstChild = -1;
+        int nextSibling = -1;
+    };
+
+    /**
+     * @brief Build the tree from the glyphs of one line
+     *
+     * Letters and digits placed above the baseline after an operand become its
+     * exponent, those hanging below it its index. Operators between two script
+     * glyphs join the script when they are placed like them.
+     *
+     * @return False if the line is not an expression; error() says why
+     */
+    bool parse(const std::vector<Symbol>& symbols);
+
+    /**
+     * @brief Build the tree from text alone; scripts need explicit ^ or _
+     */
+    bool parse(const std::string& utf8);
+
+    bool isValid() const { return m_root >= 0; }
+    int root() const { return m_root; }
+    const std::vector<Node>& nodes() const { return m_nodes; }
+    const std::string& error() const { return m_error; }
+
+    /**
+     * @brief LaTeX for the parsed expression (empty if none)
+     */
+    std::string toLatex() const;
+
+    /**
+     * @brief Prefix S-expression, e.g. "(= (+ (^ x 2) 1) 5)" (empty if none)
+     */
+    std::string toTree() const;
+
+   private:
+    enum class TokenType { Number, Variable, Operator, Open, Close, Comma };
+
+    struct Token {
+        TokenType type = TokenType::Number;
+        std::string text;
+        int level = 0;  ///< +1 superscript, -1 subscript, 0 on the baseline
+    };
+
+    void assignLevels(const std::vector<Symbol>& symbols);
+    bool tokenize(const std::vector<Symbol>& symbols);
+    bool parseTokens();
+
+    int parseRelation();
+    int parseSum();
+    int parseTerm();
+    int parseUnary();
+    int parseProduct();
+    int parsePostfix();
+    int parsePrimary();
+    int parseScript(int base);
+
+    bool atLevel() const;
+    bool startsOperand() const;
+    bool isOperator(const char* op) const;
+    int fail(const std::string& message);
+    int addNode(NodeKind kind, const std::string& text);
+    void appendChild(int parent, int child);
+
+    void appendLatex(int node, std::string& out) const;
+    void appendTree(int node, std::string& out) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<Token> m_tokens;
+    std::vector<int> m_levels;      ///< Script level per input symbol
+    std::vector<int> m_heights;     ///< Scratch for the reference glyph height
+    std::vector<Symbol> m_scratch;  ///< Symbols built by parse(const std::string&)
+    std::string m_error;
+    int m_root = -1;
+    int m_pos = 0;    ///< Next token
+    int m_end = 0;    ///< End of the token range being parsed
+    int m_level = 0;  ///< Script level of the range being parsed
+};
+
+#endif  // MATHEXPRESSION_H
@@ -0,0 +1,199 @@
+/*
+ * Module: Math Grammar
+ *
+ * Objective:
+ * - Decide, one character at a time, whether recognized equation text can
+ *   still grow into a well-formed expression, with a fixed-size parser state
+ *   that is copied rather than allocated.
+ * - Search the recognizer's per-symbol alternatives for the most confident
+ *   sequence the grammar accepts, within a fixed time budget.
+ *
+ * Grammar (whitespace is ignored except that it ends a number):
+ *
+ *   equation := expr (relation expr)*          relation := '=' | '<' | '>'
+ *   expr     := ['+' | '-'] term (binop ['+' | '-'] term)*
+ *   binop    := '+' | '-' | '*' | '/' | '^'
+ *   term     := factor+                        (implicit multiplication: 2x, ab, (x+1)(x-1))
+ *   factor   := number | variable | group | factor digits   (x2, (a+b)2: a lost superscript)
+ *   group    := '(' list ')' | '[' list ']' | '{' list '}'
+ *   list     := expr (',' expr)*
+ *   number   := digits ['.' digits]
+ *
+ * Variables are single ASCII letters. Relations are not allowed inside groups.
+ *
+ * l, I and O are variables too (ln x, O(n), I = V/R), but where they stand
+ * alone they are more often misread 1 and 0, so the beam search scores them
+ * lower unless they touch another letter.
+ */
+
+#ifndef MATHGRAMMAR_H
+#define MATHGRAMMAR_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Incremental recognizer for the equation grammar
+ */
+class MathGrammar {
+   public:
+    static constexpr int kMaxDepth = 8;  ///< Deepest bracket nesting accepted
+
+    /**
+     * @brief Parser state after a prefix; trivially copyable and comparable
+     */
+    struct State {
+        uint8_t phase = 0;
+        uint8_t depth = 0;
+        uint8_t relations = 0;
+        char stack[kMaxDepth] = {};  ///< Open brackets, unused slots zeroed
+
+        bool operator==(const State& other) const;
+    };
+
+    /**
+     * @brief Advance the state by one code point
+     * @return False if no valid equation starts with the extended prefix;
+     *         the state is then unspecified
+     */
+    static bool feed(State& state, char32_t c);
+
+    /**
+     * @brief True when the prefix read so far is a complete equation
+     */
+    static bool accepts(const State& state);
+
+    /**
+     * @brief Parse a whole UTF-8 string
+     */
+    static bool parses(const std::string& utf8);
+
+    /**
+     * @brief True for code points the grammar reads as a variable
+     */
+    static bool isVariable(char32_t c);
+
+    /**
+     * @brief True for l, I and O, the letters easily confused with 1 and 0
+     */
+    static bool isDigitLike(char32_t c);
+
+    /**
+     * @brief Fold typographic variants (minus sign, times, divide) onto ASCII
+     */
+    static char32_t canonical(char32_t c);
+
+    /**
+     * @brief Decode one UTF-8 code point and advance; invalid bytes give U+FFFD
+     * @param utf8 Points at a non-zero byte
+     */
+    static char32_t readCodePoint(const char*& utf8);
+};
+
+/**
+ * @brief Beam search over recognition alternatives constrained by MathGrammar
+ *
+ * Symbols are added in reading order, each with its alternatives. run()
+ * extends at most `beamWidth` hypotheses per symbol, drops every extension
+ * the grammar rejects, and merges hypotheses whose parser states are equal
+ * (only the better one can win). Buffers are kept between equations, so
+ * steady-state searches do not allocate.
+ */
+class MathBeamSearch {
+   public:
+    static constexpr int kMaxCodePoints = 4;              ///< Longest alternative kept
+    static constexpr double kLoneDigitLikePenalty = 0.5;  ///< Lone l, I, O (see MathGrammar)
+
+    /**
+     * @brief One recognition alternative for a symbol
+     */
+    struct Choice {
+        char32_t codePoints[kMaxCodePoints] = {};
+        int length = 0;
+        float confidence = 0.0f;  ///< Recognizer confidence (0-100)
+    };
+
+    /**
+     * @brief Search limits
+     */
+    struct Options {
+        int beamWidth = 8;                       ///< Hypotheses kept per symbol
+        int maxChoices = 6;                      ///< Alternatives considered per symbol
+        std::chrono::microseconds budget{2000};  ///< Wall time allowed per run()
+    };
+
+    /**
+     * @brief Result of run()
+     */
+    struct Outcome {
+        bool parsed = false;      ///< A grammatical sequence was found
+        bool overBudget = false;  ///< The time budget ran out first
+        bool changed = false;     ///< The sequence differs from the top choices
+        double score = 0.0;       ///< Sum of log-probabilities of the chosen alternatives
+    };
+
+    MathBeamSearch();
+    explicit MathBeamSearch(const Options& options);
+
+    /**
+     * @brief Start a new equation, keeping the buffers
+     */
+    void clear();
+
+    /**
+     * @brief Append a symbol with its alternatives, best first
+     * @param utf8 Alternative texts
+     * @param confidences Matching confidences (0-100)
+     * @param count Number of alternatives; extra ones beyond maxChoices are ignored
+     * @return Index of the symbol
+     */
+    int addSymbol(const char* const* utf8, const float* confidences, int count);
+
+    /**
+     * @brief Append a word break
+     */
+    void addSpace();
+
+    /**
+     * @brief Search for the best grammatical sequence
+     * @param utf8 Receives the chosen text when Outcome::parsed is set
+     */
+    Outcome run(std::string& utf8);
+
+    /**
+     * @brief Append the alternative the last run() chose for a symbol
+     *
+     * Without a parsed run this is the symbol's first alternative.
+     */
+    void appendSelectedText(int symbol, std::string& utf8) const;
+
+    int symbolCount() const { return static_cast<int>(m_offsets.size()) - 1; }
+    const Options& options() const { return m_options; }
+
+   private:
+    struct Hypothesis {
+        MathGrammar::State state;
+        double score = 0.0;
+        int back = -1;  ///< Index into m_history of the previous step (-1 = start)
+    };
+
+    struct Step {
+        int previous = -1;  ///< m_history index of the predecessor
+        int choice = 0;     ///< Index into m_choices
+    };
+
+    bool touchesLetter(int symbol) const;
+
+    Options m_options;
+    std::vector<Choice> m_choices;  ///< All alternatives, symbol after symbol
+    std::vector<int> m_offsets;     ///< m_choices range of each symbol
+    std::vector<Hypothesis> m_beam;
+    std::vector<Hypothesis> m_candidates;
+    std::vector<Step> m_history;
+    std::vector<int> m_path;      ///< Choice indices of the best hypothesis, last first
+    std::vector<int> m_selected;  ///< Chosen m_choices index per symbol (-1 = none)
+};
+
+#endif  // MATHGRAMMAR_H
@@ -0,0 +1,113 @@
+/*
+ * Module: OCR Folder Watcher
+ *
+ * Objective:
+ * - Report image files that land in a hot folder as soon as they are
+ *   complete, so a watch-mode batch starts on a page within milliseconds of
+ *   the scanner or copy finishing rather than on the next cron run.
+ * - Learn about new files only from inotify: IN_CLOSE_WRITE (a writer closed
+ *   the file) and IN_MOVED_TO (a file was renamed into the folder). Nothing
+ *   polls the folder and nothing rescans it.
+ * - Debounce each file: it is reported once no further event for it has
+ *   arrived for the debounce interval, so a file written in several passes
+ *   is recognized once, after the last one.
+ *
+ * A directory is only rescanned when the kernel's event queue overflowed
+ * (IN_Q_OVERFLOW), because events, and therefore files, were lost; recursive
+ * watches are rescanned recursively, picking up subdirectories created in the
+ * meantime. A rescan reports every file again, including ones reported
+ * before, so callers skip files they already took (ocr_batch compares
+ * fingerprints).
+ *
+ * Linux only.
+ */
+
+#ifndef OCRFOLDERWATCHER_H
+#define OCRFOLDERWATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+Q_DECLARE_LOGGING_CATEGORY(ocrFolderWatcher)
+
+/**
+ * @brief inotify-driven source of completed files in watched directories
+ *
+ * wait() is called from one thread; stop() may be called from any thread or
+ * from a signal handler.
+ */
+class OCRFolderWatcher {
+   public:
+    /**
+     * @brief A file ready for OCR
+     */
+    struct Ready {
+        QString path;          ///< Absolute path of the file
+        QElapsedTimer landed;  ///< Started at the file's first event
+    };
+
+    /**
+     * @brief Watch for files whose lower-case suffix is in `suffixes`
+     * @param debounceMs Quiet time after a file's last event before it is reported
+     * @throws std::runtime_error if inotify is unavailable
+     */
+    OCRFolderWatcher(const QStringList& suffixes, int debounceMs = kDefaultDebounceMs);
+
+    ~OCRFolderWatcher();
+
+    OCRFolderWatcher(const OCRFolderWatcher&) = delete;
+    OCRFolderWatcher& operator=(const OCRFolderWatcher&) = delete;
+
+    /**
+     * @brief Start watching `directory` (and, if `recursive`, every subdirectory)
+     *
+     * Subdirectories created later are watched as they appear; files already
+     * in them by then are reported once.
+     */
+    bool addDirectory(const QString& directory, bool recursive, QString* error = nullptr);
+
+    /**
+     * @brief Block until at least one file is ready; empty once stop() was called
+     */
+    std::vector<Ready> wait();
+
+    /**
+     * @brief Make wait() return empty; async-signal-safe
+     */
+    void stop();
+
+    /**
+     * @brief Times the kernel event queue overflowed and directories were rescanned
+     */
+    int overflows() const { return m_overflows; }
+
+    static constexpr int kDefaultDebounceMs = 50;
+
+   private:
+    struct Pending {
+        QElapsedTimer landed;     ///< Since the first event
+        QElapsedTimer lastEvent;  ///< Since the most recent event
+    };
+
+    bool watch(const QString& directory, bool recursive, QString* error);
+    void readEvents();
+    void scan(const QString& directory, bool recursive);
+    void notice(const QString& path);
+    bool accepts(const QString& fileName) const;
+
+    int m_inotifyFd = -1;
+    int m_wakePipe[2] = {-1, -1};       ///< stop() writes here to interrupt poll()
+    QStringList m_suffixes;             ///< Accepted lower-case suffixes
+    int m_debounceMs;                   ///< See kDefaultDebounceMs
+    QHash<int, QString> m_directories;  ///< Watch descriptor -> directory
+    QHash<int, bool> m_recursive;       ///< Watch descriptor -> watch new subdirectories
+    QHash<QString, Pending> m_pending;  ///< Files waiting out the debounce interval
+    int m_overflows = 0;                ///< See overflows()
+    bool m_stopped = false;             ///< stop() was seen by wait()
+};
+
+#endif  // OCRFOLDERWATCHER_H
@@ -0,0 +1,150 @@
+/*
+ * Module: OCR Batch Journal
+ *
+ * Objective:
+ * - Record every page a batch run has finished in an append-only journal,
+ *   so a run that crashed or was killed can be restarted and skip the pages
+ *   that were already done.
+ * - Recognize finished inputs by a stat() fingerprint (device and inode,
+ *   size, modification time) rather than by hashing file contents; looking
+ *   an input up costs one stat() and one hash lookup.
+ * - Keep the recognized text next to the journal, so a resumed run can
+ *   restore output files without recognizing the page again.
+ *
+ * Every record is written to the operating system as soon as its page is
+ * done, so a crash of the process loses nothing. fsync() is batched (every
+ * kSyncRecords records or kSyncIntervalMs), so a power failure can lose at
+ * most one batch; those pages are recognized again on the next run.
+ */
+
+#ifndef OCRJOURNAL_H
+#define OCRJOURNAL_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QString>
+
+#include "ocrprocessor.h"
+
+Q_DECLARE_LOGGING_CATEGORY(ocrJournal)
+
+/**
+ * @brief Append-only record of the finished pages of a batch run
+ *
+ * The journal file holds one JSON object per line. The recognized text goes
+ * to a companion file (journal path + ".text"), and each line records the
+ * offset and length of its page's text there. The text is written before the
+ * line that points at it, and lines pointing past the end of the text file
+ * are ignored when the journal is opened.
+ *
+ * Not thread-safe; callers serialize record() and sync().
+ */
+class OCRJournal {
+   public:
+    /**
+     * @brief Identity and version of an input file, from one stat() call
+     */
+    struct Fingerprint {
+        QByteArray identity;  ///< "device:inode" (absolute path where inodes are unavailable)
+        qint64 size = -1;     ///< File size in bytes (-1 = file missing)
+        qint64 mtimeNs = 0;   ///< Modification time in nanoseconds since the epoch
+
+        bool isValid() const { return size >= 0; }
+        bool operator==(const Fingerprint& other) const {
+            return identity == other.identity && size == other.size && mtimeNs == other.mtimeNs;
+        }
+    };
+
+    /**
+     * @brief One finished page
+     */
+    struct Entry {
+        Fingerprint fingerprint;  ///< Input as it was when recognized
+        QString path;             ///< Input path at the time (for humans; lookups use identity)
+        bool blank = false;       ///< Page was skipped as blank
+        float confidence = 0.0f;  ///< Overall confidence of the result
+        qint64 textOffset = 0;    ///< Offset of the text in the text file
+        qint64 textBytes = 0;     ///< Length of the UTF-8 text
+    };
+
+    /**
+     * @brief Fingerprint `path`; invalid if the file cannot be stat()ed
+     */
+    static Fingerprint fingerprint(const QString& path);
+
+    /**
+     * @brief Journal stored at `path`; nothing is read until open()
+     */
+    explicit OCRJournal(const QString& path);
+
+    /**
+     * @brief Syncs outstanding records
+     */
+    ~OCRJournal();
+
+    OCRJournal(const OCRJournal&) = delete;
+    OCRJournal& operator=(const OCRJournal&) = delete;
+
+    /**
+     * @brief Load existing records and open both files for appending
+     *
+     * A torn last line (the process died mid-write) is cut off the journal.
+     * @return false with `error` set if either file cannot be opened
+     */
+    bool open(QString* error = nullptr);
+
+    /**
+     * @brief The record for this exact file version, or nullptr
+     *
+     * A file that was modified or replaced since it was recorded does not
+     * match and is recognized again.
+     */
+    const Entry* find(const Fingerprint& fingerprint) const;
+
+    /**
+     * @brief Append a finished page; syncs when a batch is due
+     * @return false if the record could not be written
+     */
+    bool record(const QString& path, const Fingerprint& fingerprint,
+                const OCRProcessor::OCRResult& result);
+
+    /**
+     * @brief Read back the text recorded for `entry`
+     */
+    QString text(const Entry& entry);
+
+    /**
+     * @brief fsync both files now
+     */
+    bool sync();
+
+    /**
+     * @brief Pages recorded, including those loaded by open()
+     */
+    int size() const { return static_cast<int>(m_entries.size()); }
+
+    /**
+     * @brief Records discarded by open() as torn or pointing past the text file
+     */
+    int discardedRecords() const { return m_discarded; }
+
+    QString path() const { return m_journal.fileName(); }
+
+    static constexpr int kSyncRecords = 64;       ///< Records per fsync batch
+    static constexpr int kSyncIntervalMs = 2000;  ///< Sync at the next record after this long
+
+   private:
+    bool load(QString* error);
+
+    QFile m_journal;                     ///< One JSON line per finished page
+    QFile m_text;                        ///< Recognized text, back to back
+    QHash<QByteArray, Entry> m_entries;  ///< By Fingerprint::identity
+    qint64 m_textSize = 0;               ///< Append position in m_text
+    int m_unsynced = 0;                  ///< Records written since the last fsync
+    QElapsedTimer m_sinceSync;           ///< Age of the oldest unsynced record
+    int m_discarded = 0;                 ///< See discardedRecords()
+};
+
+#endif  // OCRJOURNAL_H
@@ -0,0 +1,165 @@
+/*
+ * Module: OCRLayout
+ *
+ * Objective:
+ * - Keep the geometry Tesseract produces (lines, words, symbols) instead of
+ *   collapsing it into a flat string.
+ * - Store every level in struct-of-arrays form so that consumers iterating over
+ *   thousands of symbols touch only the columns they need.
+ * - Allocate all columns from a single per-page arena that is released in one
+ *   step when the layout is destroyed.
+ *
+ * Coordinates are expressed in pixels of the source image handed to OCRProcessor,
+ * i.e. any scaling applied during preprocessing has already been undone.
+ */
+
+#ifndef OCRLAYOUT_H
+#define OCRLAYOUT_H
+
+#include <QRect>
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * @brief Columnar page layout made of text lines, words and symbols
+ *
+ * Elements are appended in reading order. Each word references the line that
+ * contains it and each symbol references its word through the parent column,
+ * so the hierarchy can be walked without pointer chasing.
+ */
+class OCRLayout {
+   public:
+    /**
+     * @brief Granularity of a layout element
+     */
+    enum class Level {
+        Line,   ///< Text line
+        Word,   ///< Whitespace separated word
+        Symbol  ///< Single recognized glyph
+    };
+
+    /**
+     * @brief Column storage for all elements of one level
+     */
+    struct Columns {
+        std::pmr::vector<int32_t> left;         ///< Left edge (inclusive)
+        std::pmr::vector<int32_t> top;          ///< Top edge (inclusive)
+        std::pmr::vector<int32_t> right;        ///< Right edge (exclusive)
+        std::pmr::vector<int32_t> bottom;       ///< Bottom edge (exclusive)
+        std::pmr::vector<float> confidence;     ///< Recognition confidence (0-100)
+        std::pmr::vector<int32_t> parent;       ///< Index of the enclosing element, -1 for lines
+        std::pmr::vector<uint32_t> textOffset;  ///< Byte offset of the UTF-8 text
+        std::pmr::vector<uint32_t> textLength;  ///< Byte length of the UTF-8 text
+
+        explicit Columns(std::pmr::memory_resource* resource);
+        void reserve(size_t count);
+        size_t size() const { return left.size(); }
+    };
+
+    /**
+     * @brief Create an empty layout
+     * @param initialArenaBytes Size of the first arena block, sized for a typical page
+     */
+    explicit OCRLayout(size_t initialArenaBytes = kDefaultArenaBytes);
+
+    // The columns point into the arena owned by this object
+    OCRLayout(const OCRLayout&) = delete;
+    OCRLayout& operator=(const OCRLayout&) = delete;
+
+    /**
+     * @brief Pre-size the columns to avoid regrowth inside the arena
+     */
+    void reserve(size_t lines, size_t words, size_t symbols);
+
+    /**
+     * @brief Append an element
+     * @param level Element level
+     * @param box Bounding box in source image pixels
+     * @param confidence Recognition confidence (0-100)
+     * @param parent Index of the enclosing element (ignored for lines)
+     * @param utf8 Recognized text, may be nullptr
+     * @return Index of the new element within its level
+     */
+    int append(Level level, const QRect& box, float confidence, int parent, const char* utf8);
+
+    /**
+     * @brief Append every element of another layout after this one's
+     *
+     * Parent indices are rebased so the appended hierarchy stays intact.
+     * @param offset Added to every appended box, e.g. a band's page position
+     */
+    void appendLayout(const OCRLayout& other, const QPoint& offset = QPoint());
+
+    /**
+     * @brief Number of elements stored for a level
+     */
+    int count(Level level) const;
+
+    /**
+     * @brief Bounding box of an element in source image pixels
+     */
+    QRect boundingBox(Level level, int index) const;
+
+    /**
+     * @brief Recognition confidence of an element (0-100)
+     */
+    float confidence(Level level, int index) const;
+
+    /**
+     * @brief Index of the enclosing element (line for words, word for symbols)
+     */
+    int parent(Level level, int index) const;
+
+    /**
+     * @brief Recognized text of an element
+     */
+    QString text(Level level, int index) const;
+
+    /**
+     * @brief Direct access to the column storage for bulk iteration
+     */
+    const Columns& columns(Level level) const;
+
+    /**
+     * @brief Raw UTF-8 text pool referenced by the textOffset/textLength columns
+     */
+    const char* textData() const { return m_text.data(); }
+
+    /**
+     * @brief Total bytes requested from the system by the arena
+     */
+    size_t arenaBytes() const { return m_upstream.allocatedBytes(); }
+
+    static constexpr size_t kDefaultArenaBytes = 64 * 1024;
+
+   private:
+    /**
+     * @brief Upstream resource that records how much the arena has requested
+     */
+    class CountingResource : public std::pmr::memory_resource {
+       public:
+        size_t allocatedBytes() const { return m_allocated; }
+
+       private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+        size_t m_allocated = 0;
+    };
+
+    Columns& columnsFor(Level level);
+
+    // Declaration order matters: the arena must outlive every column
+    CountingResource m_upstream;
+    std::pmr::monotonic_buffer_resource m_arena;
+    Columns m_lines;
+    Columns m_words;
+    Columns m_symbols;
+    std::pmr::vector<char> m_text;
+};
+
+#endif  // OCRLAYOUT_H
@@ -0,0 +1,127 @@
+/*
+ * Module: OCR Memory Budget
+ *
+ * Objective:
+ * - Keep the OCR pipeline of one process within a memory budget, so several
+ *   engines working on large scans do not push a container past its memory
+ *   limit and get the whole process killed.
+ * - Account for the memory the pipeline controls: the working set of pages
+ *   being decoded and preprocessed, the prepared pages engines keep for
+ *   re-recognition, and the engines themselves.
+ * - Admit a page only when its working set fits. Otherwise it waits until
+ *   other pages finish (backpressure), or, if it could never fit, it is
+ *   decoded at a smaller scale.
+ * - Report current and peak usage per pool and how often pages waited or
+ *   were downscaled.
+ *
+ * The budget comes from OCRConfig::memoryBudgetBytes, or by default from the
+ * cgroup memory limit (kCgroupShare of it, leaving room for everything the
+ * budget does not see: Qt, the heap of Tesseract's recognizer, thread stacks).
+ * Engine footprints are measured as the growth of the resident set while an
+ * engine initializes, which is only available on Linux.
+ */
+
+#ifndef OCRMEMORYBUDGET_H
+#define OCRMEMORYBUDGET_H
+
+#include <QtGlobal>
+#include <array>
+
+/**
+ * @brief Process-wide accounting and admission control for OCR memory
+ *
+ * All members are static and thread-safe.
+ */
+class OCRMemoryBudget {
+   public:
+    enum class Pool {
+        Working,   ///< Decoded and preprocessed pixels of pages in flight
+        Prepared,  ///< Prepared pages cached by engines
+        Engines,   ///< Initialized Tesseract engines
+        Count
+    };
+    static constexpr int kPoolCount = static_cast<int>(Pool::Count);
+
+    /**
+     * @brief Snapshot of the accounting
+     */
+    struct Usage {
+        qint64 limitBytes = 0;                       ///< Budget in force (0 = none)
+        std::array<qint64, kPoolCount> bytes{};      ///< Charged now, per pool
+        std::array<qint64, kPoolCount> peakBytes{};  ///< Highest charge seen, per pool
+        qint64 peakTotalBytes = 0;                   ///< Highest sum of all pools
+        qint64 admissions = 0;                       ///< Pages admitted
+        qint64 waits = 0;                            ///< Admissions that had to wait
+        qint64 waitNs = 0;                           ///< Time spent waiting, all admissions
+        qint64 downscales = 0;                       ///< Pages decoded smaller to fit the budget
+        qint64 overcommits = 0;                      ///< Pages admitted over budget at minimum size
+
+        qint64 totalBytes() const { return bytes[0] + bytes[1] + bytes[2]; }
+    };
+
+    /**
+     * @brief Bytes charged to one pool until the charge is destroyed or reset
+     *
+     * Charging never blocks; only admit() waits for room.
+     */
+    class Charge {
+       public:
+        Charge() = default;
+        Charge(Pool pool, qint64 bytes);
+        ~Charge() { reset(); }
+
+        Charge(Charge&& other) noexcept;
+        Charge& operator=(Charge&& other) noexcept;
+        Charge(const Charge&) = delete;
+        Charge& operator=(const Charge&) = delete;
+
+        /**
+         * @brief Change the amount charged (0 releases it)
+         */
+        void resize(qint64 bytes);
+        void reset() { resize(0); }
+        qint64 bytes() const { return m_bytes; }
+
+       private:
+        friend class OCRMemoryBudget;
+
+        Pool m_pool = Pool::Working;
+        qint64 m_bytes = 0;
+    };
+
+    /**
+     * @brief Set the budget from OCRConfig::memoryBudgetBytes
+     * @param requestedBytes Budget in bytes; 0 = kCgroupShare of the cgroup
+     *                       memory limit (none without one); negative = none
+     */
+    static void configure(qint64 requestedBytes);
+
+    static qint64 limit();
+
+    /**
+     * @brief Admit a page whose working set is `bytes`, waiting for room if needed
+     *
+     * A page that would not fit even with no other page in flight is granted
+     * what does fit, but not less than `minimumBytes`; the caller shrinks the
+     * page to match. When no other page is in flight the page is always
+     * admitted, over budget if need be, so admission cannot deadlock.
+     * @return Working-pool charge for the granted bytes, held until the page is prepared
+     */
+    static Charge admit(qint64 bytes, qint64 minimumBytes);
+
+    /**
+     * @brief Whether the pools together exceed the budget
+     */
+    static bool overLimit();
+
+    static Usage usage();
+
+    /**
+     * @brief Resident set size of this process (0 where it cannot be read)
+     */
+    static qint64 residentBytes();
+
+    static constexpr double kCgroupShare = 0.75;  ///< Part of the cgroup limit used by default
+};
+
+#endif  // OCRMEMORYBUDGET_H
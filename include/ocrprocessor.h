@@ -19,11 +19,24 @@
 #ifndef OCRPROCESSOR_H
 #define OCRPROCESSOR_H
 
+#include <QDateTime>
+#include <QFileInfo>
 #include <QImage>
 #include <QLoggingCategory>
 #include <QMutex>
+#include <QRect>
 #include <QString>
+#include <array>
+#include <atomic>
+#include <list>
 #include <memory>
+#include <vector>
+
+#include "mathexpression.h"
+#include "mathgrammar.h"
+#include "ocrlayout.h"
+#include "ocrmemorybudget.h"
+#include "pagesplitter.h"
 
 // Forward declarations to avoid exposing Tesseract headers in the interface
 typedef struct TessBaseAPI TessBaseAPI;
@@ -60,6 +73,86 @@ class OCRProcessor {
         bool preprocessImage = true;          ///< Enable image preprocessing
         bool enableConfidenceScoring = true;  ///< Enable confidence scoring
         int minimumConfidence = 60;           ///< Minimum confidence threshold (0-100)
+        bool extractLayout = true;            ///< Collect line/word/symbol bounding boxes
+        int maxDecodeLongEdge = 3508;         ///< Longest edge worth decoding (0 = unlimited)
+        int targetXHeight = 24;               ///< Rescale so text x-height lands here (0 = by dpi)
+        double blankPageInkRatio = 0.00002;   ///< Skip pages with less ink coverage (0 = off)
+        bool cascade = false;                 ///< Fast pass, escalate weak lines (not Equations)
+        QString fastDataPath;                 ///< tessdata_fast directory (empty = reduced scale)
+        double fastScale = 0.5;               ///< First-pass resolution without fast models
+        qint64 pageCacheBytes = 64 << 20;     ///< Prepared pages kept for re-recognition
+        bool grammarSearch = true;            ///< Parse-constrained correction of equation lines
+        int grammarBudgetUs = 2000;           ///< Search time allowed per equation line
+        int grammarBeamWidth = 8;             ///< Hypotheses kept per symbol
+        bool equationLatex = true;            ///< Expression tree and LaTeX per equation line
+        qint64 memoryBudgetBytes = 0;         ///< Process budget (0 = from cgroup, -1 = none)
+    };
+
+    /**
+     * @brief Pipeline stages measured for every OCR call
+     */
+    enum class Stage {
+        Decode,       ///< Reading and decoding the image file
+        Preprocess,   ///< preprocessImage (grayscale conversion, scaling)
+        Convert,      ///< convertImageForTesseract
+        Layout,       ///< Thresholding and page layout analysis
+        Recognition,  ///< LSTM recognition and result extraction
+        Postprocess,  ///< Equation-line correction and LaTeX conversion
+        Count
+    };
+    static constexpr int kStageCount = static_cast<int>(Stage::Count);
+
+    /**
+     * @brief Per-tier outcome of the two-tier cascade (OCRConfig::cascade)
+     */
+    struct CascadeMetrics {
+        bool used = false;            ///< Result was produced by the cascade
+        int words = 0;                ///< Words found by the fast tier
+        int escalatedWords = 0;       ///< Fast-tier words below minimumConfidence
+        int escalatedLines = 0;       ///< Lines re-recognized with the main engine
+        qint64 fastNs = 0;            ///< Fast tier layout and recognition time
+        qint64 escalationNs = 0;      ///< Main engine time spent on escalated lines
+        float fastConfidence = 0.0f;  ///< Mean word confidence after the fast tier alone
+        QString fastText;             ///< Fast tier text before escalation
+    };
+
+    /**
+     * @brief Prose/math routing of a Mixed page
+     */
+    struct SplitMetrics {
+        bool used = false;     ///< Result was produced by the Mixed-mode splitter
+        int proseRegions = 0;  ///< Regions recognized by the text engine
+        int mathRegions = 0;   ///< Regions recognized by the equation engine
+        qint64 proseNs = 0;    ///< Text engine time, runs in parallel with mathNs
+        qint64 mathNs = 0;     ///< Equation engine time
+    };
+
+    /**
+     * @brief Outcome of the grammar-constrained search over equation lines
+     */
+    struct GrammarMetrics {
+        int lines = 0;            ///< Equation lines searched
+        int parsedLines = 0;      ///< Lines with a grammatical reading
+        int correctedLines = 0;   ///< Lines whose text the search changed
+        int overBudgetLines = 0;  ///< Lines left as recognized when time ran out
+    };
+
+    /**
+     * @brief One recognized equation line in structured form
+     */
+    struct Equation {
+        QString text;   ///< Line text after grammar correction
+        QString latex;  ///< LaTeX, empty when the line is not an expression
+        QString tree;   ///< Expression tree as a prefix S-expression, empty likewise
+        QRect box;      ///< Line box in source pixels
+    };
+
+    /**
+     * @brief Cost of a single pipeline stage
+     */
+    struct StageMetrics {
+        qint64 durationNs = 0;      ///< Wall-clock duration in nanoseconds
+        qint64 bytesAllocated = 0;  ///< Bytes of buffers allocated by the stage
     };
 
     /**
@@ -70,8 +163,28 @@ class OCRProcessor {
         float confidence = 0.0f;   ///< Overall confidence score (0-100)
         bool success = false;      ///< Processing success flag
         QString errorMessage;      ///< Error message if processing failed
-        QSize imageSize;           ///< Size of processed image
+        QSize imageSize;           ///< Size of the source image
         int processingTimeMs = 0;  ///< Processing time in milliseconds
+        qint64 processingTimeNs = 0;  ///< Wall time of the call; stages may overlap or leave gaps
+        std::shared_ptr<const OCRLayout> layout;  ///< Line/word/symbol geometry (if enabled)
+        std::array<StageMetrics, kStageCount> stages{};  ///< Per-stage cost breakdown
+        QSize decodedSize;          ///< Size actually decoded (smaller if decode-time scaled)
+        qint64 decodeBytesSaved = 0;  ///< Bytes a full-resolution RGB32 decode would have added
+        double estimatedXHeight = 0.0;  ///< Measured x-height in source pixels (0 = not measured)
+        double appliedScale = 1.0;      ///< Source-to-recognition scale chosen for this page
+        bool isBlankPage = false;       ///< Page was skipped as blank; text is empty
+        QRect region;                   ///< Recognized region in source pixels (null = page)
+        bool reusedPreparedImage = false;  ///< Decode and preprocessing were served from cache
+        bool reusedLayout = false;         ///< Page layout analysis was served from cache
+        bool cancelled = false;            ///< Recognition stopped early (setCancelFlag)
+        CascadeMetrics cascade;            ///< Tier breakdown when the cascade ran
+        SplitMetrics split;                ///< Region breakdown of Mixed pages
+        GrammarMetrics grammar;            ///< Equation-line corrections
+        std::vector<Equation> equations;   ///< Equation lines in reading order
+        double budgetScale = 1.0;          ///< Extra scale to fit the memory budget (1 = none)
+
+        StageMetrics& stage(Stage s) { return stages[static_cast<int>(s)]; }
+        const StageMetrics& stage(Stage s) const { return stages[static_cast<int>(s)]; }
     };
 
    public:
@@ -108,6 +221,36 @@ class OCRProcessor {
      */
     OCRResult performOCR(const QString& imagePath);
 
+    /**
+     * @brief Perform OCR on a rectangle of the image at the given file path
+     *
+     * The decoded and preprocessed page is kept after every file-based call, so
+     * further regions of the same unchanged file only pay for recognizing the
+     * region itself.
+     *
+     * @param imagePath Path to the image file to process
+     * @param region Rectangle in source-image pixels (null = whole page)
+     * @return OCRResult for the region; layout boxes remain in page coordinates
+     */
+    OCRResult performOCR(const QString& imagePath, const QRect& region);
+
+    /**
+     * @brief Perform OCR on one band of a large page, decoding only the band
+     *
+     * Used for tiled pages: each engine decodes its own band through
+     * QImageReader's clip rectangle instead of decoding and preparing the
+     * whole page. The size cap comes from the whole page, so every band is
+     * decoded at the scale an untiled run would use (automatic text scaling
+     * still measures the band). The band is not kept as a prepared page.
+     * Files with an EXIF orientation fall back to performOCR(imagePath, band).
+     *
+     * @param imagePath Path to the image file to process
+     * @param band Rectangle in source-image pixels
+     * @return OCRResult for the band; equation and layout boxes are in page
+     *         coordinates
+     */
+    OCRResult performOCRBand(const QString& imagePath, const QRect& band);
+
     /**
      * @brief Perform OCR on a QImage object
      * @param image QImage to process
@@ -123,6 +266,17 @@ class OCRProcessor {
      */
     OCRResult performOCR(const QString& imagePath, ProcessingMode mode);
 
+    /**
+     * @brief Let another thread stop recognition of the current page early
+     *
+     * While `*flag` is true, Tesseract stops at the next word it checks and
+     * performOCR() returns unsuccessfully with OCRResult::cancelled set. The
+     * flag is only read; it must outlive the calls it is attached to. Set it
+     * from the thread that calls performOCR(), between calls.
+     * @param flag Flag to watch, or nullptr to detach
+     */
+    void setCancelFlag(const std::atomic<bool>* flag);
+
     /**
      * @brief Get current OCR configuration
      * @return Current OCRConfig
@@ -167,6 +321,22 @@ class OCRProcessor {
      */
     static QStringList getSupportedFormats();
 
+    /**
+     * @brief Human-readable name of a pipeline stage
+     */
+    static const char* stageName(Stage stage);
+
+    /**
+     * @brief Name of a processing mode: "auto", "text", "equations" or "mixed"
+     */
+    static const char* modeName(ProcessingMode mode);
+
+    /**
+     * @brief Parse a mode name as given on command lines and in daemon requests
+     * @return False (and `mode` unchanged) for an unknown name; case is ignored
+     */
+    static bool modeFromName(const QString& name, ProcessingMode& mode);
+
    private:
     /**
      * @brief Initialize Tesseract OCR engine
@@ -185,33 +355,294 @@ class OCRProcessor {
      */
     bool applyConfiguration();
 
+    /**
+     * @brief Apply the mode-dependent Tesseract variables to one engine
+     * @param mode Mode to configure for; Mixed sets up the prose side only
+     */
+    void configureEngine(TessBaseAPI& api, ProcessingMode mode) const;
+
+    /**
+     * @brief Initialize and configure an additional engine
+     * @return Ready engine, or nullptr if Init() failed
+     */
+    std::unique_ptr<TessBaseAPI> createEngine(const QString& dataPath, ProcessingMode mode) const;
+
+    /**
+     * @brief Create or re-create the fast-tier engine for the current configuration
+     * @return true if m_fastAPI is ready
+     */
+    bool ensureFastEngine();
+
+    /**
+     * @brief Create or re-create the Mixed-mode equation engine
+     * @return true if m_equationAPI is ready
+     */
+    bool ensureEquationEngine();
+
+    /**
+     * @brief Decode an image file at the resolution OCR will actually use
+     *
+     * Uses QImageReader's scaled decode (DCT-domain reduction for JPEG) when the
+     * target scale is below 1 and converts to Grayscale8 immediately.
+     *
+     * @param imagePath Image file to decode
+     * @param result Receives decode metrics, decodedSize and the source imageSize
+     * @param working Receives the page's admission to the memory budget
+     * @param clip Rectangle of the stored image to decode (null = whole image)
+     * @return Decoded image (null on failure)
+     */
+    QImage loadImage(const QString& imagePath, OCRResult& result,
+                     OCRMemoryBudget::Charge& working, const QRect& clip = QRect()) const;
+
+    /**
+     * @brief Admit a page decoded at `decodedSize` to the memory budget
+     *
+     * Sets result.budgetScale below 1 when the page only fits smaller. A page
+     * that is not `shrinkable` (its decode cannot be reduced) waits for room
+     * for all of it instead.
+     * @return Working-set charge, to be held until the page is prepared
+     */
+    OCRMemoryBudget::Charge admitPage(const QSize& decodedSize, bool shrinkable,
+                                      OCRResult& result) const;
+
+    /**
+     * @brief Scale from source pixels to the pixels handed to Tesseract
+     * @param sourceSize Size of the source image
+     * @param textScale Scale suggested by text-size analysis (0 = use dpi / 300)
+     */
+    double targetScale(const QSize& sourceSize, double textScale) const;
+
+    /**
+     * @brief Cheap ink-coverage test run before any recognition work
+     * @param gray Grayscale8 image as decoded
+     * @return True when coverage is below OCRConfig::blankPageInkRatio
+     */
+    bool isBlankPage(const QImage& gray) const;
+
+    /**
+     * @brief Measure the text on a grayscale page and derive the scale that
+     *        brings its x-height to OCRConfig::targetXHeight
+     * @param gray Grayscale8 image as decoded
+     * @param sourceSize Size of the original source image
+     * @param result Receives estimatedXHeight
+     * @return Source-relative scale, or 0 when no reliable estimate was found
+     */
+    double estimateTextScale(const QImage& gray, const QSize& sourceSize,
+                             OCRResult& result) const;
+
+    /**
+     * @brief Run preprocessing, conversion and recognition on a decoded image
+     * @param image Decoded image (possibly already downscaled at decode time)
+     * @param sourceSize Size of the original source image
+     * @param result Result to fill; stage metrics already recorded are preserved
+     * @note Caller must hold m_mutex
+     */
+    void processImage(const QImage& image, const QSize& sourceSize, OCRResult& result);
+
+    /**
+     * @brief Preprocess and convert a decoded image into a new m_pageCache entry
+     * @param image Decoded image (possibly already downscaled at decode time)
+     * @param sourceSize Size of the original source image
+     * @param result Receives preprocessing/convert metrics and the blank-page flag
+     * @param pageSize Page that `sourceSize` is a band of, whose size caps the
+     *        scale (null = the image is the whole page)
+     * @return False for blank pages and failures; recognition should not run
+     * @note Caller must hold m_mutex
+     */
+    bool prepareImage(const QImage& image, const QSize& sourceSize, OCRResult& result,
+                      const QSize& pageSize = QSize());
+
+    /**
+     * @brief Look up an unchanged file in m_pageCache and make it the current page
+     * @return True on a hit; stale entries for the same path are dropped
+     */
+    bool usePreparedPage(const QFileInfo& fileInfo);
+
     /**
      * @brief Preprocess image for better OCR results
      * @param image Input image
+     * @param scaleFactor Remaining scale to apply (1.0 = keep size)
      * @return Preprocessed image
      */
-    QImage preprocessImage(const QImage& image) const;
+    QImage preprocessImage(const QImage& image, double scaleFactor) const;
 
     /**
      * @brief Convert QImage to format suitable for Tesseract
      * @param image Input QImage
      * @return Processed image data and metadata
+     *
+     * Grayscale8 and RGB32 images are passed through without copying; the
+     * QImage member keeps the shared pixel buffer alive.
      */
     struct ImageData {
-        std::unique_ptr<unsigned char[]> data;
-        int width;
-        int height;
-        int bytesPerPixel;
-        int bytesPerLine;
+        QImage buffer;                          ///< Owner of the pixel data
+        const unsigned char* pixels = nullptr;  ///< First scan line
+        int width = 0;
+        int height = 0;
+        int bytesPerPixel = 0;
+        int bytesPerLine = 0;
+        double sourceScale = 1.0;  ///< Factor mapping these pixels back to the source image
     };
     ImageData convertImageForTesseract(const QImage& image) const;
 
     /**
-     * @brief Extract text from image data using Tesseract
-     * @param imageData Image data prepared for Tesseract
-     * @return OCRResult with extracted text and metadata
+     * @brief Decoded, preprocessed page kept for re-recognition
+     *
+     * Besides the pixels, the result of automatic page segmentation is kept as
+     * text blocks (Auto and Text) and prose/math regions (Mixed). Both come
+     * from the same AnalyseLayout and do not depend on the mode's whitelist,
+     * so whichever of these modes runs first fills both, and later runs skip
+     * AnalyseLayout. Equations mode treats the page as one block and neither
+     * uses nor fills them.
+     */
+    struct PreparedPage {
+        quint64 id = 0;                 ///< Unique per prepared page, never reused
+        QString path;                   ///< Absolute source path (empty for in-memory images)
+        QDateTime lastModified;         ///< Source modification time when prepared
+        qint64 fileSize = -1;           ///< Source size when prepared
+        QSize sourceSize;               ///< Source image size
+        ImageData imageData;            ///< Pixels handed to Tesseract
+        ImageData fastImageData;        ///< Pixels handed to the fast tier (built on demand)
+        double appliedScale = 1.0;      ///< Copied into results served from the cache
+        double estimatedXHeight = 0.0;
+        bool hasLayout = false;         ///< textBlocks holds the segmentation of layoutArea
+        QRect layoutArea;               ///< Rectangle that was segmented, prepared pixels
+        std::vector<QRect> textBlocks;  ///< Text blocks in reading order, prepared pixels
+
+        bool hasSplit = false;                           ///< splitRegions is valid for splitArea
+        QRect splitArea;                                 ///< Rectangle that was split
+        std::vector<PageSplitter::Region> splitRegions;  ///< Prose/math regions, reading order
+
+        /**
+         * @brief Pixel bytes charged against OCRConfig::pageCacheBytes
+         */
+        qint64 bytes() const;
+    };
+
+    /**
+     * @brief Most recently used cache entry, the page being recognized
+     */
+    PreparedPage& currentPage() { return m_pageCache.front(); }
+
+    /**
+     * @brief Evict least recently used pages beyond OCRConfig::pageCacheBytes
+     *
+     * Also evicts while the process is over its memory budget. The current
+     * page is always kept, even when it alone exceeds either budget.
+     */
+    void trimPageCache();
+
+    /**
+     * @brief Charge the resident-set growth since `residentBefore` to m_engineCharge
+     */
+    void chargeEngine(qint64 residentBefore);
+
+    /**
+     * @brief SetImage() unless the engine already holds this page
+     * @param heldPageId Id of the page the engine holds; updated
+     */
+    void loadIntoEngine(TessBaseAPI& api, const ImageData& imageData, quint64 pageId,
+                        quint64& heldPageId) const;
+
+    /**
+     * @brief Recognize the prepared page, or a rectangle of it
+     * @param region Rectangle in prepared-image pixels (null = whole page)
+     * @param result Result receiving text, confidence and layout/recognition metrics
+     */
+    void extractText(const QRect& region, OCRResult& result);
+
+    /**
+     * @brief Single-engine recognition of a rectangle of the prepared page
+     * @param area Rectangle in prepared-image pixels
+     * @param result Receives text and layout/recognition metrics
+     * @return Mean confidence, or a negative value if recognition failed
+     */
+    float recognizeSingle(const QRect& area, OCRResult& result);
+
+    /**
+     * @brief Recognize the current page's cached text blocks one by one
+     * @param result Receives text and layout/recognition metrics
+     * @return Mean confidence weighted by recognized characters
+     */
+    float recognizeCachedBlocks(OCRResult& result);
+
+    /**
+     * @brief Mixed-mode recognition: prose and math regions on separate engines
+     *
+     * Layout analysis on the main engine yields the text lines, PageSplitter
+     * classifies them, and the prose regions (main engine) and math regions
+     * (m_equationAPI) are recognized on two threads. Text, confidence and layout
+     * are merged in reading order.
+     *
+     * @param area Rectangle in prepared-image pixels
+     * @param result Receives text, split metrics and layout/recognition metrics
+     * @return Mean confidence weighted by recognized characters
+     */
+    float recognizeMixed(const QRect& area, OCRResult& result);
+
+    /**
+     * @brief Two-tier recognition: fast pass over the area, main engine on weak lines
+     * @param area Rectangle in prepared-image pixels
+     * @param result Receives text, cascade metrics and layout/recognition metrics
+     * @return Mean word confidence, or a negative value if recognition failed
+     */
+    float recognizeCascade(const QRect& area, OCRResult& result);
+
+    /**
+     * @brief Equation-line search set up for the current grammar options
+     */
+    MathBeamSearch& mathSearch();
+
+    /**
+     * @brief Correct and convert the equation lines an engine just recognized
+     *
+     * With OCRConfig::grammarSearch, every line's symbol alternatives
+     * (lstm_choice_mode) go through MathBeamSearch, and the line text becomes
+     * the most confident grammatical reading; lines without one within
+     * grammarBudgetUs keep the recognized text. With OCRConfig::equationLatex,
+     * MathExpression then parses the line's symbols, placed against the line
+     * baseline, into a tree and LaTeX. Layout symbols are not rewritten.
+     *
+     * @param api Engine that just recognized equation text
+     * @param sourceScale Factor mapping recognized pixels back to the source image
+     * @param text Text returned by GetUTF8Text(); corrected in place
+     * @param equations Receives one entry per line when equationLatex is set
+     * @param metrics Receives grammar search counts
+     */
+    void postprocessEquations(TessBaseAPI& api, double sourceScale, QString& text,
+                              std::vector<Equation>& equations, GrammarMetrics& metrics);
+
+    /**
+     * @brief Walk an engine's result iterator after recognition and collect geometry
+     * @param api Engine that ran the recognition
+     * @param sourceScale Factor mapping recognized pixels back to the source image
+     * @param text Recognized page text, used to size the layout columns up front
+     * @param lineReplacements Per text line, geometry to use instead of the
+     *        engine's (null = keep the engine's line)
+     * @return Populated layout, or nullptr if Tesseract produced no results
+     */
+    std::shared_ptr<const OCRLayout> buildLayout(
+        TessBaseAPI& api, double sourceScale, const QString& text,
+        const std::vector<const OCRLayout*>& lineReplacements = {}) const;
+
+    /**
+     * @brief Append an engine's recognized lines, words and symbols to a layout
+     * @param lineReplacements As for buildLayout()
+     * @return False if the engine produced no symbols
+     */
+    bool appendLayout(TessBaseAPI& api, double sourceScale, OCRLayout& layout,
+                      const std::vector<const OCRLayout*>& lineReplacements = {}) const;
+
+    /**
+     * @brief Run Recognize() on an engine, stopping early when the cancel flag is set
+     * @return true if recognition completed
+     */
+    bool recognize(TessBaseAPI& api) const;
+
+    /**
+     * @brief Whether the attached cancel flag is set
      */
-    OCRResult extractText(const ImageData& imageData);
+    bool cancelRequested() const;
 
     /**
      * @brief Log OCR operation details
@@ -221,11 +652,26 @@ class OCRProcessor {
     void logOCROperation(const QString& operation, const OCRResult& result) const;
 
    private:
-    std::unique_ptr<TessBaseAPI> m_tesseractAPI;  ///< Tesseract API instance
-    OCRConfig m_config;                           ///< Current OCR configuration
-    mutable QMutex m_mutex;                       ///< Thread safety mutex
-    bool m_initialized;                           ///< Initialization status flag
-    QString m_tesseractDataPath;                  ///< Path to Tesseract training data
+    std::unique_ptr<TessBaseAPI> m_tesseractAPI;   ///< Tesseract API instance
+    std::unique_ptr<TessBaseAPI> m_fastAPI;        ///< Cascade first-pass engine (lazy)
+    QString m_fastEngineKey;                       ///< Data path and language of m_fastAPI
+    OCRConfig m_config;                            ///< Current OCR configuration
+    mutable QMutex m_mutex;                        ///< Thread safety mutex
+    bool m_initialized;                            ///< Initialization status flag
+    QString m_tesseractDataPath;                   ///< Path to Tesseract training data
+    std::list<PreparedPage> m_pageCache;           ///< Prepared pages, most recently used first
+    quint64 m_nextPageId = 1;                      ///< Id for the next prepared page
+    quint64 m_enginePageId = 0;                    ///< Page m_tesseractAPI holds (0 = none)
+    quint64 m_fastEnginePageId = 0;                ///< Page m_fastAPI holds (0 = none)
+    std::unique_ptr<TessBaseAPI> m_equationAPI;    ///< Mixed-mode math engine (lazy)
+    QString m_equationEngineKey;                   ///< Data path and language of m_equationAPI
+    quint64 m_equationEnginePageId = 0;            ///< Page m_equationAPI holds (0 = none)
+    std::unique_ptr<MathBeamSearch> m_mathSearch;  ///< Equation-line search buffers (lazy)
+    MathExpression m_mathExpression;               ///< Equation-line parser, reused per line
+    OCRMemoryBudget::Charge m_engineCharge;        ///< Footprint of this processor's engines
+    OCRMemoryBudget::Charge m_pageCacheCharge;     ///< Pixel bytes of m_pageCache
+
+    const std::atomic<bool>* m_cancelFlag = nullptr;  ///< Stops recognize() early when set
 
     // Static members for shared resources
     static QStringList s_supportedFormats;      ///< Cached list of supported formats
@@ -0,0 +1,130 @@
+/*
+ * Module: OCR Process Pool
+ *
+ * Objective:
+ * - Run OCR engines in separate worker processes, so a page that crashes
+ *   Tesseract or Leptonica (a malformed image, a decoder bug) fails only
+ *   that page instead of taking down the batch or the GUI with it.
+ * - Restart a worker that died, and report the crash (the signal, or the
+ *   exit status) as the failed page's error.
+ * - Cap each worker's memory (RLIMIT_AS), so a page that makes an engine
+ *   balloon fails on its own instead of pushing the machine into swap or
+ *   waking the OOM killer on an innocent process.
+ *
+ * Every worker is an ocr_daemon started in a hidden mode (--worker-fd) that
+ * serves one end of a socket pair with the daemon protocol (ocrprotocol.h).
+ * Workers are started with fork() and exec(), never by forking alone: the
+ * parent is multithreaded, and only a freshly executed program may safely
+ * initialize engines. Pages on disk are sent by path and decoded by the
+ * worker; decoded images go through a shared-memory ring (OCRSharedRing)
+ * per worker, so pixels are written once and never copied through the
+ * socket.
+ *
+ * Linux only.
+ */
+
+#ifndef OCRPROCESSPOOL_H
+#define OCRPROCESSPOOL_H
+
+#include <QImage>
+#include <QLoggingCategory>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "ocrprocessor.h"
+#include "ocrprotocol.h"
+
+Q_DECLARE_LOGGING_CATEGORY(ocrProcessPool)
+
+/**
+ * @brief Supervised worker processes, one page at a time each
+ *
+ * recognize() may be called from any number of threads; each call takes an
+ * idle worker, waiting for one if all are busy.
+ */
+class OCRProcessPool {
+   public:
+    struct Options {
+        QString workerProgram;         ///< Empty = ocr_daemon next to this executable
+        QStringList workerArguments;   ///< Engine options passed on, e.g. {"--language", "deu"}
+        int workers = 1;               ///< Worker processes
+        qint64 memoryLimitBytes = 0;   ///< Address-space limit per worker (0 = none)
+        int timeoutMs = 0;             ///< Kill a worker that takes longer on a page (0 = never)
+        size_t ringBytes = 16u << 20;  ///< Initial shared ring per worker; grows for larger images
+    };
+
+    /**
+     * @brief ocr_daemon options that give a worker's engine this configuration
+     *
+     * The processing mode is not included; every request names its own.
+     */
+    static QStringList engineArguments(const OCRProcessor::OCRConfig& config, int engineThreads);
+
+    /**
+     * @brief Start the workers and wait until each answers a ping
+     * @throws std::runtime_error if a worker cannot be started
+     */
+    explicit OCRProcessPool(const Options& options);
+
+    /**
+     * @brief Closes the workers' sockets and reaps them
+     */
+    ~OCRProcessPool();
+
+    OCRProcessPool(const OCRProcessPool&) = delete;
+    OCRProcessPool& operator=(const OCRProcessPool&) = delete;
+
+    /**
+     * @brief Recognize an image file, or a region of it, in a worker
+     *
+     * A worker that crashes, exceeds its memory limit or times out fails
+     * only this call, with the reason in errorMessage; it is restarted for
+     * the next page. With `band` set the region is a band of a tiled page,
+     * and the worker decodes only the band (OCRProcessor::performOCRBand).
+     */
+    OCRProcessor::OCRResult recognize(const QString& imagePath, const QRect& region,
+                                      OCRProcessor::ProcessingMode mode, bool band = false);
+
+    /**
+     * @brief Recognize a decoded image, passed through the worker's shared ring
+     */
+    OCRProcessor::OCRResult recognize(const QImage& image, OCRProcessor::ProcessingMode mode);
+
+    int size() const { return static_cast<int>(m_workers.size()); }
+
+    /**
+     * @brief Workers restarted after a crash, a memory-limit failure or a timeout
+     */
+    int restarts() const { return m_restarts.load(); }
+
+   private:
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;                          ///< Supervisor end of the socket pair
+        std::shared_ptr<OCRSharedRing> ring;  ///< Attached on first image submission
+        bool busy = false;
+    };
+
+    bool spawn(Worker& worker, QString* error);
+    QString reap(Worker& worker, bool kill);
+    bool attachRing(Worker& worker, size_t bytes, QString* error);
+    OCRProcessor::OCRResult submit(OCRProtocol::Message& request, const QImage* image);
+    Worker& acquire();
+    void release(Worker& worker);
+
+    Options m_options;
+    std::vector<Worker> m_workers;
+    std::mutex m_mutex;              ///< Guards Worker::busy
+    std::condition_variable m_idle;  ///< Signalled when a worker is released
+    std::atomic<int> m_restarts{0};
+};
+
+#endif  // OCRPROCESSPOOL_H
@@ -0,0 +1,166 @@
+/*
+ * Module: OCR Protocol
+ *
+ * Objective:
+ * - Define the messages exchanged with the OCR daemon (ocr_daemon) over a
+ *   Unix domain socket, so callers pay for Qt startup and engine
+ *   initialization once instead of per image.
+ * - Keep framing cheap: one sendmsg() per message, no per-message allocation
+ *   beyond the payload itself.
+ * - Depend on Qt Core only, so clients need no Tesseract to talk to the daemon.
+ *
+ * Every message is a frame:
+ *
+ *   uint32 magic        "OCR1" (0x3152434F, native byte order: the socket is local)
+ *   uint32 headerBytes  length of the JSON header
+ *   uint32 bodyBytes    length of the binary body (0 = none)
+ *   header              UTF-8 JSON object
+ *   body                raw bytes, e.g. an encoded image
+ *
+ * Request header fields:
+ *   id      integer echoed in the response (clients may pipeline requests)
+ *   op      "recognize", "ping" (answered without touching an engine), "stats",
+ *           or "attach" (the frame carries a sealed memfd, see OCRSharedRing)
+ *   path    absolute image path
+ *   shared  decoded pixels in the attached ring: {offset, width, height,
+ *           bytesPerLine, format: "gray8" or "rgb32"}
+ *   mode    "auto", "text", "equations" or "mixed" (default: daemon's mode)
+ *   language, dpi, minConfidence, preprocess
+ *           OCRConfig settings for this request (default: the daemon's)
+ *   region  [x, y, width, height] in source pixels (optional)
+ *   band    true when region is a band of a tiled page: only the band is decoded
+ * Without path or shared, the body holds the encoded image.
+ *
+ * Response header fields:
+ *   id, ok, error, text, confidence, equations (LaTeX strings),
+ *   processingMs and processingNs (engine), queueUs (waiting for an engine), serviceUs
+ *   (receipt to reply), plus blank, stages and the other OCRResult fields
+ *   written by OCRResultJson (ocrresultjson.h).
+ */
+
+#ifndef OCRPROTOCOL_H
+#define OCRPROTOCOL_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Framing and socket helpers shared by the OCR daemon and its clients
+ */
+class OCRProtocol {
+   public:
+    static constexpr uint32_t kMagic = 0x3152434F;         ///< "OCR1"
+    static constexpr uint32_t kMaxHeaderBytes = 1u << 20;  ///< Larger headers are rejected
+    static constexpr uint32_t kMaxBodyBytes = 256u << 20;  ///< Larger bodies are rejected
+
+    /**
+     * @brief One frame: JSON header plus optional binary body
+     */
+    struct Message {
+        QJsonObject header;
+        QByteArray body;
+        int descriptor = -1;  ///< Passed with the frame (SCM_RIGHTS); the receiver closes it
+    };
+
+    /**
+     * @brief $XDG_RUNTIME_DIR/mathscan-ocr.sock, or /tmp/mathscan-ocr-<uid>.sock
+     */
+    static QString defaultSocketPath();
+
+    /**
+     * @brief Bind and listen on a socket path, replacing a stale socket file
+     * @return Listening descriptor, or -1 with `error` set
+     */
+    static int listen(const QString& path, QString* error = nullptr);
+
+    /**
+     * @brief Connect to a listening daemon
+     * @return Connected descriptor, or -1 with `error` set
+     */
+    static int connect(const QString& path, QString* error = nullptr);
+
+    /**
+     * @brief Whether the process at the other end of `fd` runs as this user (SO_PEERCRED)
+     */
+    static bool peerIsSameUser(int fd);
+
+    /**
+     * @brief Write one frame, with `message.descriptor` if set; never raises SIGPIPE
+     * @return False if the peer is gone or the message is too large
+     */
+    static bool send(int fd, const Message& message);
+
+    /**
+     * @brief Read one frame, blocking, with the descriptor passed along with it
+     * @return False on end of stream, error, or a malformed frame
+     */
+    static bool receive(int fd, Message& message);
+};
+
+/**
+ * @brief Shared-memory ring a client writes decoded pixels into
+ *
+ * The client creates the ring (memfd_create), seals its size and passes the
+ * descriptor once with an "attach" request; recognize requests then carry
+ * only an offset and the image geometry, and the daemon reads the pixels in
+ * place instead of receiving and decoding an encoded image. The seals let the
+ * daemon map the ring without risking SIGBUS from a client that shrinks it.
+ *
+ * A slot must not be rewritten before the reply for the request using it has
+ * arrived; reserve() simply wraps around, so clients keep the images they have
+ * in flight within the ring's size.
+ */
+class OCRSharedRing {
+   public:
+    static constexpr size_t kAlignment = 64;  ///< Slot and scanline alignment
+
+    /**
+     * @brief Create a writable, size-sealed ring (client side)
+     * @return Null with `error` set if memfd or mmap fails
+     */
+    static std::shared_ptr<OCRSharedRing> create(size_t bytes, QString* error = nullptr);
+
+    /**
+     * @brief Map a ring received from a client read-only (daemon side)
+     *
+     * Takes ownership of `fd`. Rings that are not sealed against shrinking
+     * are refused.
+     * @return Null with `error` set on failure
+     */
+    static std::shared_ptr<OCRSharedRing> attach(int fd, QString* error = nullptr);
+
+    ~OCRSharedRing();
+
+    OCRSharedRing(const OCRSharedRing&) = delete;
+    OCRSharedRing& operator=(const OCRSharedRing&) = delete;
+
+    /**
+     * @brief Offset of the next free slot of `bytes`, wrapping to the start
+     * @return -1 if `bytes` exceeds the ring
+     */
+    qint64 reserve(size_t bytes);
+
+    /**
+     * @brief Whether [offset, offset + bytes) lies inside the ring
+     */
+    bool contains(qint64 offset, qint64 bytes) const;
+
+    int descriptor() const { return m_fd; }
+    size_t size() const { return m_size; }
+    uchar* data() { return m_data; }
+    const uchar* constData() const { return m_data; }
+
+   private:
+    OCRSharedRing(int fd, uchar* data, size_t size) : m_fd(fd), m_data(data), m_size(size) {}
+
+    const int m_fd;
+    uchar* const m_data;
+    const size_t m_size;
+    size_t m_next = 0;  ///< Client side: where reserve() continues
+};
+
+#endif  // OCRPROTOCOL_H
@@ -0,0 +1,38 @@
+/*
+ * Module: OCR Result JSON
+ *
+ * Objective:
+ * - Carry an OCRProcessor::OCRResult across the daemon protocol (ocrprotocol.h)
+ *   without losing what callers act on: the blank-page flag, per-stage costs,
+ *   cascade, grammar and Mixed-split counters and the structured equations.
+ * - Keep one encoder, used by the daemon, and one decoder, used by every
+ *   client that has an OCRProcessor (the GUI, OCRProcessPool).
+ *
+ * The line/word/symbol layout is not transferred; results decoded from a
+ * reply have no layout.
+ */
+
+#ifndef OCRRESULTJSON_H
+#define OCRRESULTJSON_H
+
+#include <QJsonObject>
+
+#include "ocrprocessor.h"
+
+/**
+ * @brief Conversion between OCRResult and the fields of a recognize reply
+ */
+class OCRResultJson {
+   public:
+    /**
+     * @brief Reply fields for a result (the caller adds id and timing)
+     */
+    static QJsonObject toJson(const OCRProcessor::OCRResult& result);
+
+    /**
+     * @brief Result from a reply header; unknown or missing fields keep their defaults
+     */
+    static OCRProcessor::OCRResult fromJson(const QJsonObject& reply);
+};
+
+#endif  // OCRRESULTJSON_H
@@ -0,0 +1,172 @@
+/*
+ * Module: OCR Server
+ *
+ * Objective:
+ * - Keep OCRProcessor engines initialized in a long-running process and serve
+ *   recognition requests from local clients over a Unix domain socket
+ *   (OCRProtocol), so a request costs a socket round trip instead of Qt
+ *   startup plus TessBaseAPI::Init().
+ * - Hand requests to the first idle engine with a queue wake-up as the only
+ *   dispatch cost; pings are answered without an engine, which measures that
+ *   cost directly.
+ *
+ * One I/O thread accepts connections and reads requests from all of them
+ * with poll(); each engine has a worker thread that writes its replies.
+ * Clients may pipeline requests on one connection; replies carry the request
+ * id and can arrive out of order when several engines work for one client.
+ *
+ * A client may attach an OCRSharedRing to its connection and submit decoded
+ * pixels by offset; the engine then reads them straight from the mapping.
+ *
+ * Instead of listening, the server can serve one socket it was handed (an
+ * OCRProcessPool worker); serve() then returns when that socket closes.
+ *
+ * Requests are "interactive" (someone is waiting at a screen) or "batch"
+ * (the default). Interactive requests are dispatched first. When one arrives
+ * and every engine is busy, a batch page in progress is cancelled through
+ * Tesseract's cancel callback and put back at the head of the batch queue.
+ */
+
+#ifndef OCRSERVER_H
+#define OCRSERVER_H
+
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ocrprocessor.h"
+#include "ocrprotocol.h"
+#include "ocrstatistics.h"
+#include "ocrthreading.h"
+
+Q_DECLARE_LOGGING_CATEGORY(ocrServer)
+
+/**
+ * @brief Warm-engine OCR service on a Unix domain socket
+ */
+class OCRServer {
+   public:
+    struct Options {
+        QString socketPath;              ///< Empty = OCRProtocol::defaultSocketPath()
+        int workers = 1;                 ///< Engines, each with its own thread
+        OCRProcessor::OCRConfig config;  ///< Configuration of every engine
+        int connectedFd = -1;            ///< Serve only this connected socket, without listening
+    };
+
+    /**
+     * @brief Initialize all engines
+     * @throws std::runtime_error if an engine cannot be initialized
+     */
+    explicit OCRServer(const Options& options);
+    ~OCRServer();
+
+    OCRServer(const OCRServer&) = delete;
+    OCRServer& operator=(const OCRServer&) = delete;
+
+    /**
+     * @brief Create the socket
+     * @return False with `error` set if the path is taken or unusable
+     */
+    bool listen(QString* error = nullptr);
+
+    /**
+     * @brief Serve requests until stop(); queued requests are finished first
+     */
+    void serve();
+
+    /**
+     * @brief Make serve() return; safe to call from a signal handler
+     */
+    void stop();
+
+    const QString& socketPath() const { return m_socketPath; }
+
+    /**
+     * @brief Scheduling class of a request, most urgent first
+     */
+    enum class Priority { Interactive, Batch };
+    static constexpr int kPriorityCount = 2;
+
+    /**
+     * @brief Priority as named in requests ("interactive", "batch")
+     */
+    static const char* priorityName(Priority priority);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Client connection, shared by the I/O thread and the workers replying on it
+     */
+    struct Connection {
+        explicit Connection(int socket) : fd(socket) {}
+        ~Connection();
+
+        bool send(const OCRProtocol::Message& message);
+
+        const int fd;
+        std::mutex writeMutex;                ///< Serializes replies from different workers
+        std::shared_ptr<OCRSharedRing> ring;  ///< Attached image ring; I/O thread only
+    };
+
+    struct Job {
+        std::shared_ptr<Connection> connection;
+        std::shared_ptr<OCRSharedRing> ring;  ///< Ring attached when the request arrived
+        OCRProtocol::Message request;
+        Clock::time_point received;
+        Priority priority = Priority::Batch;
+        int preemptions = 0;  ///< Times the page was cancelled for interactive work
+    };
+
+    /**
+     * @brief What one engine is doing; guarded by m_queueMutex except `cancel`
+     */
+    struct WorkerState {
+        bool busy = false;
+        Priority priority = Priority::Batch;
+        std::atomic<bool> cancel{false};  ///< Watched by the engine (setCancelFlag)
+    };
+
+    /**
+     * @brief Requests of one class and the cost of serving them
+     */
+    struct ClassStatistics {
+        qint64 requests = 0;
+        qint64 failures = 0;
+        LatencyHistogram queueUs;    ///< Wait for an engine, including cancelled runs
+        LatencyHistogram serviceUs;  ///< Receipt to reply
+    };
+
+    void work(int worker);
+    void preemptBatchWork();
+    QJsonObject recognize(OCRProcessor& engine, const Job& job);
+    QJsonObject statistics();
+    bool handleRequest(const std::shared_ptr<Connection>& connection);
+
+    OCRWorkerPool m_engines;
+    OCRProcessor::OCRConfig m_defaultConfig;  ///< For settings a request does not name
+    QString m_socketPath;
+    int m_listenFd = -1;
+    int m_connectedFd = -1;        ///< Options::connectedFd until serve() adopts it
+    int m_wakePipe[2] = {-1, -1};  ///< stop() writes here to interrupt poll()
+
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueReady;
+    std::array<std::deque<Job>, kPriorityCount> m_queues;  ///< Indexed by Priority
+    std::vector<WorkerState> m_workers;                    ///< Indexed like m_engines
+    bool m_stopping = false;
+
+    std::mutex m_statisticsMutex;
+    std::array<ClassStatistics, kPriorityCount> m_classes;  ///< Indexed by Priority
+    qint64 m_preemptions = 0;
+};
+
+#endif  // OCRSERVER_H
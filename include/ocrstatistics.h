@@ -0,0 +1,73 @@
+/*
+ * Module: OCR Statistics
+ *
+ * Objective:
+ * - Aggregate the per-stage metrics recorded in OCRProcessor::OCRResult across
+ *   a batch of pages.
+ * - Report percentiles (p50/p95/p99) without keeping every sample, using
+ *   fixed-precision log-linear histograms (latencyhistogram.h).
+ */
+
+#ifndef OCRSTATISTICS_H
+#define OCRSTATISTICS_H
+
+#include <QString>
+#include <QtGlobal>
+#include <array>
+
+#include "latencyhistogram.h"
+#include "ocrprocessor.h"
+
+/**
+ * @brief Batch-level aggregation of OCR stage metrics
+ */
+class OCRStageStatistics {
+   public:
+    /**
+     * @brief Add the stage metrics of one processed page
+     */
+    void add(const OCRProcessor::OCRResult& result);
+
+    /**
+     * @brief Fold statistics gathered elsewhere (e.g. another worker) into this one
+     */
+    void merge(const OCRStageStatistics& other);
+
+    /**
+     * @brief Duration histogram (nanoseconds) of a stage
+     *
+     * Holds one sample per page the stage ran on; its count() is that number
+     * of pages.
+     */
+    const LatencyHistogram& durations(OCRProcessor::Stage stage) const;
+
+    /**
+     * @brief Allocation histogram (bytes) of a stage, over the pages it ran on
+     */
+    const LatencyHistogram& allocations(OCRProcessor::Stage stage) const;
+
+    /**
+     * @brief Histogram of end-to-end processing time (nanoseconds)
+     *
+     * Recorded from OCRResult::processingTimeNs, the page's wall time, and
+     * only from the sum of the stages for results that lack it.
+     */
+    const LatencyHistogram& total() const { return m_total; }
+
+    /**
+     * @brief Number of pages aggregated
+     */
+    qint64 pageCount() const { return m_total.count(); }
+
+    /**
+     * @brief Render a fixed-width table with the page count and p50/p95/p99 per stage
+     */
+    QString formatTable() const;
+
+   private:
+    std::array<LatencyHistogram, OCRProcessor::kStageCount> m_durations;
+    std::array<LatencyHistogram, OCRProcessor::kStageCount> m_allocations;
+    LatencyHistogram m_total;
+};
+
+#endif  // OCRSTATISTICS_H
@@ -0,0 +1,89 @@
+/*
+ * Module: OCRTestPages
+ *
+ * Objective:
+ * - Render deterministic synthetic pages (prose paragraphs, equations, mixed)
+ *   with QPainter so benchmarks and accuracy checks need no external assets.
+ * - Provide the ground-truth text for every rendered page.
+ *
+ * Equations are written in a small markup where "^{...}" and "_{...}" are
+ * drawn as raised/lowered smaller glyphs, e.g. "x^{2} + 3x - 4 = 0". The
+ * ground truth keeps the glyphs but drops the markup ("x2 + 3x - 4 = 0"),
+ * which is what a linear OCR pass can be expected to read.
+ *
+ * Rendering requires a QGuiApplication (fonts); use the "offscreen" platform
+ * plugin for headless runs.
+ */
+
+#ifndef OCRTESTPAGES_H
+#define OCRTESTPAGES_H
+
+#include <QImage>
+#include <QSizeF>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+
+/**
+ * @brief Deterministic synthetic page renderer
+ */
+class OCRTestPages {
+   public:
+    /**
+     * @brief Content type of a rendered page
+     */
+    enum class PageKind {
+        Paragraphs,  ///< Prose paragraphs only
+        Equations,   ///< One equation per line
+        Mixed        ///< Alternating prose and equation lines
+    };
+
+    /**
+     * @brief Parameters of one synthetic page
+     */
+    struct PageSpec {
+        PageKind kind = PageKind::Paragraphs;  ///< Content type
+        int dpi = 300;                         ///< Rendering resolution
+        QSizeF sizeInches = QSizeF(8.5, 11);   ///< Physical page size
+        int fontPoints = 12;                   ///< Body font size
+        quint32 seed = 1;                      ///< Content selection seed
+    };
+
+    /**
+     * @brief A rendered page together with its expected text
+     */
+    struct Page {
+        QImage image;             ///< Grayscale8 rendering
+        QStringList groundTruth;  ///< Expected text, one entry per rendered line
+    };
+
+    /**
+     * @brief Render a page
+     */
+    static Page render(const PageSpec& spec);
+
+    /**
+     * @brief Render a single equation tightly cropped with a small margin
+     * @param markup Equation in ^{}/_{} markup
+     * @param dpi Rendering resolution
+     * @param fontPoints Font size
+     */
+    static QImage renderEquation(const QString& markup, int dpi, int fontPoints = 16);
+
+    /**
+     * @brief Fixed corpus of equations in ^{}/_{} markup
+     */
+    static const QStringList& equationCorpus();
+
+    /**
+     * @brief Strip ^{}/_{} markup, leaving the glyphs a linear reader sees
+     */
+    static QString plainText(const QString& markup);
+
+    /**
+     * @brief Short lowercase name of a page kind ("paragraphs", "equations", "mixed")
+     */
+    static QString kindName(PageKind kind);
+};
+
+#endif  // OCRTESTPAGES_H
@@ -0,0 +1,224 @@
+/*
+ * Module: OCR Threading
+ *
+ * Objective:
+ * - Decide once per process how many OCRProcessor engines recognize pages
+ *   side by side (workers) and how many threads each engine may start for
+ *   Tesseract's internal OpenMP loops, so that workers x engine threads does
+ *   not exceed the CPUs the process may actually use.
+ * - Count those CPUs from the scheduler affinity mask and the cgroup CPU
+ *   quota (containers, systemd slices) rather than the machine's core count.
+ *   The cgroup memory limit is read the same way (see OCRMemoryBudget).
+ * - Run a batch of pages on a pool of engines, one engine per worker thread.
+ * - Optionally pin every worker to its own set of cores, spreading workers
+ *   over the NUMA nodes, and create each engine on its pinned thread so the
+ *   kernel's first-touch policy places its models and page buffers on the
+ *   worker's node.
+ *
+ * OpenMP reads OMP_THREAD_LIMIT when its runtime is loaded, which for a
+ * program linked against an OpenMP-enabled Tesseract is before main().
+ * Changing the limit afterwards therefore restarts the program; see
+ * OCRThreading::applyEngineThreads().
+ */
+
+#ifndef OCRTHREADING_H
+#define OCRTHREADING_H
+
+#include <QLoggingCategory>
+#include <QString>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ocrprocessor.h"
+
+Q_DECLARE_LOGGING_CATEGORY(ocrThreading)
+
+/**
+ * @brief Process-wide split between inter-engine and intra-engine parallelism
+ */
+class OCRThreading {
+   public:
+    /**
+     * @brief CPUs available to this process
+     */
+    struct CpuInfo {
+        int onlineCpus = 1;      ///< Logical CPUs of the machine
+        int affinityCpus = 1;    ///< CPUs in the scheduler affinity mask
+        double quotaCpus = 0.0;  ///< cgroup CPU bandwidth limit in CPUs (0 = none)
+        int usableCpus = 1;      ///< Affinity CPUs capped by the quota, at least 1
+        int numaNodes = 1;       ///< NUMA nodes holding affinity CPUs
+    };
+
+    /**
+     * @brief How the usable CPUs are shared out
+     */
+    struct Plan {
+        int workers = 1;             ///< Engines recognizing pages in parallel
+        int engineThreads = 1;       ///< OpenMP threads per engine
+        bool overlapRegions = true;  ///< Mixed pages recognize prose and math concurrently
+        bool pinWorkers = false;     ///< Pin each worker to its own cores (Linux)
+    };
+
+    /**
+     * @brief Where one worker runs
+     */
+    struct Placement {
+        std::vector<int> cpus;  ///< CPUs the worker and its engine threads may use (empty = any)
+        int node = -1;          ///< NUMA node of those CPUs (-1 = unknown)
+    };
+
+    /**
+     * @brief Read the affinity mask and cgroup (v2, else v1) CPU quota
+     */
+    static CpuInfo detectCpus();
+
+    /**
+     * @brief cgroup (v2, else v1) memory limit in bytes, the smallest along the path; 0 = none
+     */
+    static qint64 detectMemoryLimit();
+
+    /**
+     * @brief Fill in the automatic parts of a plan
+     *
+     * A count of 0 means automatic. With both automatic the pool gets one
+     * single-threaded engine per usable CPU, which gives the best throughput
+     * for batches; with one fixed, the other gets the CPUs left over. An
+     * OMP_THREAD_LIMIT from the environment counts as a fixed engineThreads.
+     * Mixed-page region overlap is only kept while it has a CPU of its own.
+     */
+    static Plan makePlan(int workers, int engineThreads, const CpuInfo& cpus);
+
+    /**
+     * @brief Install the process-wide plan (read by OCRProcessor for every page)
+     */
+    static void setPlan(const Plan& plan);
+    static Plan plan();
+
+    /**
+     * @brief Make the OpenMP runtime use at most `threads` threads per engine
+     *
+     * Sets OMP_THREAD_LIMIT. If the runtime is already loaded with another
+     * limit, the program is executed again with the same arguments; call this
+     * early in main(), before any engine exists. A single engine with no
+     * explicit count can keep the runtime's default and skip the call.
+     *
+     * @return False if the limit could not be applied (a warning is logged)
+     */
+    static bool applyEngineThreads(int threads);
+
+    /**
+     * @brief Thread limit of the loaded OpenMP runtime; 0 if there is none
+     */
+    static int openMpThreadLimit();
+
+    /**
+     * @brief Give each of `workers` workers `engineThreads` CPUs of one NUMA node
+     *
+     * Workers are dealt to the nodes in turn, so a pool smaller than the
+     * machine still uses the memory bandwidth of every node. Within a node,
+     * hyperthread siblings are only used once every core has a worker. With
+     * more workers than CPU sets the sets are shared. Empty where the affinity
+     * mask cannot be read or holds a single CPU.
+     */
+    static std::vector<Placement> placeWorkers(int workers, int engineThreads);
+
+    /**
+     * @brief Restrict the calling thread to a placement until destroyed
+     *
+     * Threads the pinned thread starts (OpenMP, region overlap) inherit its
+     * CPUs. The previous mask is restored on destruction, which matters for
+     * the caller's own thread acting as a worker.
+     */
+    class ThreadPin {
+       public:
+        explicit ThreadPin(const Placement& placement);
+        ~ThreadPin();
+
+        ThreadPin(const ThreadPin&) = delete;
+        ThreadPin& operator=(const ThreadPin&) = delete;
+
+       private:
+        std::vector<int> m_previous;  ///< Mask to restore (empty = not pinned)
+    };
+
+    /**
+     * @brief One-line summary, e.g. "4 workers x 1 engine thread on 4 of 16 CPUs"
+     */
+    static QString describe(const Plan& plan, const CpuInfo& cpus);
+};
+
+/**
+ * @brief Fixed set of engines, each driven by its own thread
+ *
+ * Tesseract engines are not thread-safe, so every worker owns one
+ * OCRProcessor. run() hands out page indices until all are done, and
+ * serve() until its source runs dry; the calling thread acts as the first
+ * worker. With OCRThreading::Plan::pinWorkers set when the pool is created,
+ * every worker runs pinned to its OCRThreading::placeWorkers() CPUs, and its
+ * engine is created on a thread pinned the same way. A pool can also be
+ * made of threads alone, for tasks that send their pages to engines
+ * elsewhere (OCRProcessPool); those tasks take the worker number instead of
+ * an engine.
+ */
+class OCRWorkerPool {
+   public:
+    using Task = std::function<void(OCRProcessor& engine, int index)>;
+
+    /**
+     * @brief Create `workers` engines with the same configuration
+     * @throws std::runtime_error if an engine cannot be initialized
+     */
+    OCRWorkerPool(const OCRProcessor::OCRConfig& config, int workers);
+
+    /**
+     * @brief Create `workers` threads without engines; only WorkerTask overloads apply
+     */
+    explicit OCRWorkerPool(int workers);
+
+    using WorkerTask = std::function<void(int worker, int index)>;
+
+    /**
+     * @brief Run task(engine, i) for every i in [0, count) and wait for all
+     *
+     * Tasks run concurrently on different engines; a task must not throw.
+     */
+    void run(int count, const Task& task);
+
+    /**
+     * @brief Run task(engine, i) for every i in `order`, handing them out in that order
+     *
+     * Each free worker takes the next index, so putting the most expensive
+     * work first (OCRBatchPlan::longestFirst) keeps the tail of the run short.
+     */
+    void run(const std::vector<int>& order, const Task& task);
+    void run(const std::vector<int>& order, const WorkerTask& task);
+
+    using Source = std::function<bool(int& index)>;
+
+    /**
+     * @brief Run task(engine, i) for every i that `next` yields, until it returns false
+     *
+     * For work that arrives while the pool runs (a watched folder). Every
+     * worker calls `next` itself, concurrently, and may block inside it
+     * until there is work; returning false retires that worker.
+     */
+    void serve(const Source& next, const Task& task);
+    void serve(const Source& next, const WorkerTask& task);
+
+    int size() const { return m_workers; }
+    bool hasEngines() const { return !m_engines.empty(); }
+    OCRProcessor& engine(int worker) { return *m_engines[worker]; }
+
+    /**
+     * @brief CPUs of a worker; a thread driving engine(worker) itself pins with this
+     */
+    const OCRThreading::Placement& placement(int worker) const { return m_placements[worker]; }
+
+   private:
+    std::vector<std::unique_ptr<OCRProcessor>> m_engines;  ///< One per worker, or none
+    std::vector<OCRThreading::Placement> m_placements;     ///< One per worker (empty cpus = any)
+    int m_workers;
+};
+
+#endif  // OCRTHREADING_H
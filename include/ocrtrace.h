@@ -0,0 +1,166 @@
+/*
+ * Module: OCRTrace
+ *
+ * Objective:
+ * - Record spans of the OCR pipeline (stages, lock waits, queue waits, jobs)
+ *   per thread and export them as Chrome/Perfetto trace-event JSON.
+ * - Cost a single relaxed atomic load per instrumentation point while tracing
+ *   is disabled at runtime, and nothing at all when compiled out.
+ *
+ * Build with -DMATHSCAN_ENABLE_TRACING=OFF to remove the instrumentation.
+ * At runtime tracing is started with OCRTrace::start() or by setting the
+ * MATHSCAN_TRACE environment variable to an output path and calling
+ * OCRTrace::startFromEnvironment(). The resulting file can be opened in
+ * chrome://tracing or https://ui.perfetto.dev.
+ */
+
+#ifndef OCRTRACE_H
+#define OCRTRACE_H
+
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <string>
+
+/**
+ * @brief Process-wide trace-event recorder
+ *
+ * Event names and categories must be string literals (or otherwise outlive
+ * the trace); only the optional detail argument is copied.
+ */
+class OCRTrace {
+   public:
+    /**
+     * @brief Enable tracing; events are written to outputPath by stop()
+     * @return false if tracing is compiled out or already running
+     */
+    static bool start(const QString& outputPath);
+
+    /**
+     * @brief Start tracing if MATHSCAN_TRACE names an output file
+     * @return true if tracing was started
+     */
+    static bool startFromEnvironment();
+
+    /**
+     * @brief Disable tracing and write all buffered events
+     * @return true if the trace file was written
+     */
+    static bool stop();
+
+#ifdef MATHSCAN_ENABLE_TRACING
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+#else
+    static constexpr bool isEnabled() { return false; }
+#endif
+
+    /**
+     * @brief Monotonic timestamp in microseconds used for all events
+     */
+    static qint64 nowUs();
+
+    /**
+     * @brief Record a complete span ("X" event) on the calling thread
+     * @param name Span name (string literal)
+     * @param category Comma-separated category list (string literal)
+     * @param startUs Start timestamp from nowUs()
+     * @param durationUs Span duration in microseconds
+     * @param detail Optional free-form argument shown in the trace viewer
+     */
+    static void recordComplete(const char* name, const char* category, qint64 startUs,
+                               qint64 durationUs, const QString& detail = QString());
+
+    /**
+     * @brief Record a span that ends now and lasted durationNs nanoseconds
+     */
+    static void recordEndingNow(const char* name, const char* category, qint64 durationNs);
+
+    /**
+     * @brief Record a counter sample ("C" event), e.g. queue depth
+     */
+    static void recordCounter(const char* name, qint64 value);
+
+    /**
+     * @brief Name the calling thread in the trace viewer
+     */
+    static void setThreadName(const QString& name);
+
+   private:
+    static void appendEvent(char phase, const char* name, const char* category, qint64 timestampUs,
+                            qint64 durationUs, qint64 value, std::string detail);
+
+#ifdef MATHSCAN_ENABLE_TRACING
+    static std::atomic<bool> s_enabled;
+#endif
+};
+
+/**
+ * @brief RAII span covering the enclosing scope
+ */
+class OCRTraceScope {
+   public:
+    OCRTraceScope(const char* name, const char* category, const QString& detail = QString())
+        : m_name(name), m_category(category), m_active(OCRTrace::isEnabled()) {
+        if (m_active) {
+            m_detail = detail;
+            m_startUs = OCRTrace::nowUs();
+        }
+    }
+
+    ~OCRTraceScope() {
+        if (m_active) {
+            OCRTrace::recordComplete(m_name, m_category, m_startUs,
+                                     OCRTrace::nowUs() - m_startUs, m_detail);
+        }
+    }
+
+    OCRTraceScope(const OCRTraceScope&) = delete;
+    OCRTraceScope& operator=(const OCRTraceScope&) = delete;
+
+   private:
+    const char* m_name;
+    const char* m_category;
+    bool m_active;
+    qint64 m_startUs = 0;
+    QString m_detail;
+};
+
+/**
+ * @brief QMutexLocker replacement that records contended lock waits
+ *
+ * The uncontended path is a plain tryLock(); only when the mutex is already
+ * held and tracing is enabled is the wait recorded as a "lock" span.
+ */
+class OCRTraceMutexLocker {
+   public:
+    OCRTraceMutexLocker(QMutex* mutex, const char* waitName) : m_mutex(mutex) {
+        if (!OCRTrace::isEnabled()) {
+            m_mutex->lock();
+        } else if (!m_mutex->tryLock()) {
+            const qint64 startUs = OCRTrace::nowUs();
+            m_mutex->lock();
+            OCRTrace::recordComplete(waitName, "lock", startUs, OCRTrace::nowUs() - startUs);
+        }
+    }
+
+    ~OCRTraceMutexLocker() { m_mutex->unlock(); }
+
+    OCRTraceMutexLocker(const OCRTraceMutexLocker&) = delete;
+    OCRTraceMutexLocker& operator=(const OCRTraceMutexLocker&) = delete;
+
+   private:
+    QMutex* m_mutex;
+};
+
+#define OCR_TRACE_CONCAT_INNER(a, b) a##b
+#define OCR_TRACE_CONCAT(a, b) OCR_TRACE_CONCAT_INNER(a, b)
+
+#ifdef MATHSCAN_ENABLE_TRACING
+#define OCR_TRACE_SCOPE(name, category) \
+    OCRTraceScope OCR_TRACE_CONCAT(ocrTraceScope_, __LINE__)(name, category)
+#else
+#define OCR_TRACE_SCOPE(name, category) ((void)0)
+#endif
+
+#endif  // OCRTRACE_H
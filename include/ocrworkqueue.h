@@ -0,0 +1,179 @@
+/*
+ * Module: OCR Work Queue
+ *
+ * Objective:
+ * - Share one batch between several ocr_batch processes, on one machine or
+ *   on several machines that mount the same directory (NFS), without a
+ *   coordinator process.
+ * - Hand out the inputs in fixed-size chunks under time-limited leases, so
+ *   a node that dies only delays its chunks by the lease time, after which
+ *   another node takes them over.
+ * - Let every node write its results to its own shard file and merge the
+ *   shards into one result file, in input order, once every chunk is done.
+ *
+ * All coordination is done with files. Exclusive creation uses link(),
+ * which is atomic on NFS, where O_EXCL is not reliable on older servers.
+ * Replacement uses rename(). The queue directory looks like this:
+ *
+ *   manifest.json           inputs and chunk size, written by the first node
+ *   leases/chunk-NNNNNN     held chunks: owner, token and expiry time
+ *   done/chunk-NNNNNN       finished chunks, naming the node that finished them
+ *   shards/<node>.jsonl     one line per page recognized by that node
+ *   results.jsonl           merged results, one line per input
+ *
+ * Lease expiry compares wall-clock times from different machines, so the
+ * nodes' clocks must agree to well within the lease time (NTP).
+ *
+ * Linux only.
+ */
+
+#ifndef OCRWORKQUEUE_H
+#define OCRWORKQUEUE_H
+
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "ocrprocessor.h"
+
+Q_DECLARE_LOGGING_CATEGORY(ocrWorkQueue)
+
+/**
+ * @brief Lease-based batch queue in a shared directory
+ *
+ * claim(), record() and complete() are called from one thread at a time;
+ * a background thread renews the leases this node holds.
+ */
+class OCRWorkQueue {
+   public:
+    struct Options {
+        QString directory;       ///< Queue directory, shared by all nodes
+        int chunkSize = 16;      ///< Inputs per chunk (only used by the node that creates it)
+        int leaseSeconds = 120;  ///< Lease lifetime; renewed every third of it
+        QString node;            ///< Node name (empty = defaultNode())
+    };
+
+    enum class Claim {
+        Claimed,  ///< A chunk was leased to this node
+        Busy,     ///< Other nodes hold live leases on every chunk left
+        Finished  ///< Every chunk is done or already held by this node
+    };
+
+    /**
+     * @brief What the merge found
+     */
+    struct MergeSummary {
+        int pages = 0;        ///< Lines written to results.jsonl
+        int shards = 0;       ///< Shard files read
+        int duplicates = 0;   ///< Pages recognized by more than one node (one kept)
+        bool merged = false;  ///< False if results.jsonl already existed
+    };
+
+    /**
+     * @brief "<host>-<pid>", unique among processes on a shared mount
+     */
+    static QString defaultNode();
+
+    explicit OCRWorkQueue(const Options& options);
+
+    /**
+     * @brief Stops lease renewal and releases unfinished chunks to other nodes
+     */
+    ~OCRWorkQueue();
+
+    OCRWorkQueue(const OCRWorkQueue&) = delete;
+    OCRWorkQueue& operator=(const OCRWorkQueue&) = delete;
+
+    /**
+     * @brief Create the queue for `inputs`, or join the existing one
+     *
+     * The first node's manifest wins: a joining node works on the manifest's
+     * inputs whatever it was given (it may be given none).
+     */
+    bool open(const QStringList& inputs, QString* error = nullptr);
+
+    /**
+     * @brief Lease the first chunk that is neither done nor held by a live lease
+     *
+     * Expired leases are taken over.
+     * @param chunk Set to the leased chunk when the result is Claim::Claimed
+     */
+    Claim claim(int& chunk);
+
+    /**
+     * @brief Append a page's result to this node's shard
+     */
+    bool record(int page, const OCRProcessor::OCRResult& result);
+
+    /**
+     * @brief Mark a chunk done once all its pages are recorded, and drop its lease
+     */
+    bool complete(int chunk);
+
+    /**
+     * @brief Merge all shards into results.jsonl if every chunk is done
+     * @return false if chunks are still outstanding or the merge failed
+     */
+    bool merge(MergeSummary& summary, QString* error = nullptr);
+
+    const QStringList& inputs() const { return m_inputs; }
+    int chunkCount() const { return (m_inputs.size() + m_chunkSize - 1) / m_chunkSize; }
+    int chunkOf(int page) const { return page / m_chunkSize; }
+    int firstPage(int chunk) const { return chunk * m_chunkSize; }
+    int endPage(int chunk) const {
+        return std::min<int>(m_inputs.size(), (chunk + 1) * m_chunkSize);
+    }
+    QString node() const { return m_node; }
+    QString resultsPath() const { return m_directory.filePath("results.jsonl"); }
+
+    /**
+     * @brief How long a node with nothing to claim waits before trying again
+     */
+    std::chrono::milliseconds pollInterval() const;
+
+    int takenOver() const { return m_takenOver; }  ///< Expired leases taken from other nodes
+    int lost() const { return m_lost; }            ///< Own leases found taken by other nodes
+
+   private:
+    QString leasePath(int chunk) const;
+    QString donePath(int chunk) const;
+    QByteArray leaseContents() const;
+    bool ownsLease(int chunk) const;
+    bool takeOver(int chunk);
+
+    /**
+     * @brief Extends this node's lease on @p chunk; false when the chunk was lost
+     *
+     * Renames the lease away before re-creating it exclusively, the same way takeOver()
+     * does, so a renewal racing a takeover never leaves two nodes holding the chunk.
+     */
+    bool renewLease(int chunk);
+    void renewLeases();
+
+    QDir m_directory;
+    QString m_node;
+    QByteArray m_token;  ///< Identifies this process's leases
+    int m_leaseSeconds;
+    int m_chunkSize;
+    QStringList m_inputs;  ///< From the manifest, absolute paths
+    QFile m_shard;         ///< shards/<node>.jsonl
+    int m_takenOver = 0;
+    int m_lost = 0;
+
+    mutable std::mutex m_mutex;  ///< Guards m_held, m_done and m_stopping
+    std::condition_variable m_wake;
+    QSet<int> m_held;  ///< Chunks leased to this node and not yet complete
+    QSet<int> m_done;  ///< Chunks known to be done (never undone)
+    bool m_stopping = false;
+    std::thread m_renewer;
+};
+
+#endif  // OCRWORKQUEUE_H
@@ -0,0 +1,96 @@
+/*
+ * Module: Page Splitter
+ *
+ * Objective:
+ * - Divide the text lines found by page layout analysis into prose regions
+ *   and math regions before any recognition has run, so Mixed pages can send
+ *   each region to an engine configured for it.
+ * - Work on plain glyph boxes and baselines, independent of Qt and Tesseract.
+ *
+ * A line is classified from the vertical placement of its glyphs relative to
+ * the baseline. Operators (+, =, -, *) and superscripts float above it and
+ * subscripts hang below it without reaching the x-height, while in prose
+ * almost every glyph sits on the baseline. Dots, commas and quotes are too
+ * small to count either way. Consecutive lines of the same kind within one
+ * layout block form a region.
+ */
+
+#ifndef PAGESPLITTER_H
+#define PAGESPLITTER_H
+
+#include <vector>
+
+/**
+ * @brief Prose/math segmentation of text lines from layout analysis
+ */
+class PageSplitter {
+   public:
+    /**
+     * @brief Axis-aligned box, right and bottom exclusive
+     */
+    struct Box {
+        int left = 0;
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+
+        int width() const { return right - left; }
+        int height() const { return bottom - top; }
+    };
+
+    enum class RegionKind {
+        Prose,  ///< Running text
+        Math    ///< Equations and formulas
+    };
+
+    /**
+     * @brief One text line as found by layout analysis
+     */
+    struct Line {
+        int block = 0;            ///< Index of the enclosing layout block
+        Box box;                  ///< Line bounding box
+        int baselineLeft = 0;     ///< Baseline y at box.left
+        int baselineRight = 0;    ///< Baseline y at box.right
+        std::vector<Box> glyphs;  ///< Connected glyph boxes, left to right
+
+        /**
+         * @brief Baseline y at column x
+         */
+        double baselineAt(int x) const;
+    };
+
+    /**
+     * @brief Consecutive lines of one kind within one block
+     */
+    struct Region {
+        RegionKind kind = RegionKind::Prose;
+        Box box;            ///< Union of the line boxes
+        int firstLine = 0;  ///< Index of the first line in the input
+        int lineCount = 0;
+    };
+
+    /**
+     * @brief Share of a line's glyphs placed like operators or scripts
+     * @return Ratio in [0, 1], or a negative value when the line has too few
+     *         measurable glyphs to judge
+     */
+    static double scriptGlyphRatio(const Line& line);
+
+    /**
+     * @brief Group lines into prose and math regions
+     *
+     * Lines too short to judge take the kind of the preceding line of their
+     * block (or the following one at the start of a block).
+     *
+     * @param lines Text lines in reading order
+     * @param mathRatio scriptGlyphRatio() at or above which a line is math
+     * @return Regions in reading order
+     */
+    static std::vector<Region> split(const std::vector<Line>& lines,
+                                     double mathRatio = kDefaultMathRatio);
+
+    static constexpr double kDefaultMathRatio = 0.15;
+    static constexpr int kMinMeasurableGlyphs = 3;
+};
+
+#endif  // PAGESPLITTER_H
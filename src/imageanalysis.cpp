@@ -0,0 +1,301 @@
+/*
+ * Module: Image Analysis Implementation
+ *
+ * Histogram thresholding and projection-profile text size estimation.
+ */
+
+#include "imageanalysis.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGEANALYSIS_HAVE_SSE2
+#endif
+
+namespace {
+
+using Histogram = std::array<uint32_t, 256>;
+
+Histogram sampleHistogram(const GrayImageView& image, int columnStep, int rowStep) {
+    Histogram histogram{};
+    for (int y = 0; y < image.height; y += rowStep) {
+        const uint8_t* line = image.scanLine(y);
+        for (int x = 0; x < image.width; x += columnStep) {
+            ++histogram[line[x]];
+        }
+    }
+    return histogram;
+}
+
+int otsuFromHistogram(const Histogram& histogram) {
+    uint64_t total = 0;
+    double weightedSum = 0.0;
+    for (int level = 0; level < 256; ++level) {
+        total += histogram[level];
+        weightedSum += static_cast<double>(level) * histogram[level];
+    }
+    if (total == 0) {
+        return 127;
+    }
+
+    uint64_t darkCount = 0;
+    double darkSum = 0.0;
+    double bestVariance = -1.0;
+    int bestLevel = 127;
+    for (int level = 0; level < 255; ++level) {
+        darkCount += histogram[level];
+        darkSum += static_cast<double>(level) * histogram[level];
+        const uint64_t lightCount = total - darkCount;
+        if (darkCount == 0 || lightCount == 0) {
+            continue;
+        }
+        const double darkMean = darkSum / darkCount;
+        const double lightMean = (weightedSum - darkSum) / lightCount;
+        const double meanGap = darkMean - lightMean;
+        const double variance = static_cast<double>(darkCount) * lightCount * meanGap * meanGap;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            bestLevel = level;
+        }
+    }
+    return bestLevel;
+}
+
+/**
+ * @brief Running totals for measureInk()
+ */
+struct InkTotals {
+    uint64_t ink = 0;
+    uint64_t sum = 0;
+    uint64_t sumSquares = 0;
+};
+
+void accumulateRowScalar(const uint8_t* pixels, int count, uint8_t inkLevel, InkTotals& totals) {
+    for (int x = 0; x < count; ++x) {
+        const uint32_t value = pixels[x];
+        totals.ink += value < inkLevel;
+        totals.sum += value;
+        totals.sumSquares += value * value;
+    }
+}
+
+#ifdef IMAGEANALYSIS_HAVE_SSE2
+/**
+ * @brief SSE2 version of accumulateRowScalar, 16 pixels per step
+ *
+ * Ink flags are counted in 8-bit lanes and squares in 32-bit lanes; both are
+ * folded into the 64-bit totals before they can overflow.
+ */
+void accumulateRowSse2(const uint8_t* pixels, int count, uint8_t inkLevel, InkTotals& totals) {
+    // Largest block count whose per-lane ink counter and squared sums cannot overflow
+    constexpr int kBlocksPerFlush = 255;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i belowInk = _mm_set1_epi8(static_cast<char>(inkLevel - 1));
+
+    __m128i sum = zero;
+    int x = 0;
+    while (x + 16 <= count && inkLevel > 0) {
+        __m128i inkCount = zero;
+        __m128i squares = zero;
+        for (int block = 0; block < kBlocksPerFlush && x + 16 <= count; ++block, x += 16) {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + x));
+
+            // value <= inkLevel - 1 (unsigned) gives 0xFF; subtracting counts it
+            const __m128i isInk = _mm_cmpeq_epi8(_mm_min_epu8(value, belowInk), value);
+            inkCount = _mm_sub_epi8(inkCount, isInk);
+
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(value, zero));
+
+            const __m128i low = _mm_unpacklo_epi8(value, zero);
+            const __m128i high = _mm_unpackhi_epi8(value, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low),
+                                                           _mm_madd_epi16(high, high)));
+        }
+
+        const __m128i inkSums = _mm_sad_epu8(inkCount, zero);
+        totals.ink += static_cast<uint64_t>(_mm_cvtsi128_si32(inkSums)) +
+                      static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(inkSums, 8)));
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), squares);
+        totals.sumSquares += uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    alignas(16) uint64_t sums[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum);
+    totals.sum += sums[0] + sums[1];
+
+    accumulateRowScalar(pixels + x, count - x, inkLevel, totals);
+}
+#endif
+
+double median(std::vector<int>& values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    if (values.size() % 2) {
+        return values[middle];
+    }
+    const int upper = values[middle];
+    const int lower = *std::max_element(values.begin(), values.begin() + middle);
+    return (lower + upper) / 2.0;
+}
+
+}  // namespace
+
+/**
+ * @brief Otsu threshold of a sampled grayscale histogram
+ */
+int ImageAnalysis::otsuThreshold(const GrayImageView& image, int columnStep, int rowStep) {
+    if (!image.pixels || image.width <= 0 || image.height <= 0) {
+        return 127;
+    }
+    return otsuFromHistogram(
+        sampleHistogram(image, std::max(1, columnStep), std::max(1, rowStep)));
+}
+
+/**
+ * @brief Ink level for measureInk() that adapts to the page
+ */
+int ImageAnalysis::inkLevel(const GrayImageView& image, int minContrast) {
+    if (!image.pixels || image.width <= 0 || image.height <= 0) {
+        return 128;
+    }
+    const Histogram histogram = sampleHistogram(image, 2, 4);
+    const int threshold = otsuFromHistogram(histogram);
+    const int paper = static_cast<int>(std::max_element(histogram.begin(), histogram.end()) -
+                                       histogram.begin());
+    // With sparse ink Otsu splits the paper's own noise, so the paper's side
+    // comes from its gray level; measureInk() counts pixels darker than the level
+    return paper >= 128 ? std::clamp(std::min(threshold + 1, paper - minContrast), 0, 255)
+                        : std::clamp(std::max(threshold + 1, paper + minContrast + 1), 0, 255);
+}
+
+/**
+ * @brief Measure ink coverage and gray-level statistics
+ */
+ImageAnalysis::InkStatistics ImageAnalysis::measureInk(const GrayImageView& image, int inkLevel,
+                                                       int rowStep) {
+    InkStatistics statistics;
+    if (!image.pixels || image.width <= 0 || image.height <= 0) {
+        return statistics;
+    }
+    rowStep = std::max(1, rowStep);
+    const uint8_t level = static_cast<uint8_t>(std::clamp(inkLevel, 0, 255));
+
+    InkTotals totals;
+    for (int y = 0; y < image.height; y += rowStep) {
+#ifdef IMAGEANALYSIS_HAVE_SSE2
+        accumulateRowSse2(image.scanLine(y), image.width, level, totals);
+#else
+        accumulateRowScalar(image.scanLine(y), image.width, level, totals);
+#endif
+        statistics.samples += image.width;
+    }
+
+    const double samples = static_cast<double>(statistics.samples);
+    statistics.inkRatio = totals.ink / samples;
+    statistics.mean = totals.sum / samples;
+    const double variance = totals.sumSquares / samples - statistics.mean * statistics.mean;
+    statistics.standardDeviation = std::sqrt(std::max(0.0, variance));
+    return statistics;
+}
+
+/**
+ * @brief Estimate the x-height of the text on a page
+ */
+ImageAnalysis::TextMetrics ImageAnalysis::estimateTextMetrics(const GrayImageView& image,
+                                                              int columnStep) {
+    TextMetrics metrics;
+    if (!image.pixels || image.width <= 0 || image.height <= 0) {
+        return metrics;
+    }
+    columnStep = std::max(1, columnStep);
+
+    const Histogram histogram = sampleHistogram(image, columnStep, 2);
+    const int threshold = otsuFromHistogram(histogram);
+    metrics.inkThreshold = threshold;
+
+    // A flat histogram has no text to measure
+    const auto firstLevel = std::find_if(histogram.begin(), histogram.end(),
+                                         [](uint32_t count) { return count != 0; });
+    const auto lastLevel = std::find_if(histogram.rbegin(), histogram.rend(),
+                                        [](uint32_t count) { return count != 0; });
+    if (firstLevel == histogram.end() ||
+        (histogram.rend() - lastLevel - 1) - (firstLevel - histogram.begin()) < 32) {
+        return metrics;
+    }
+
+    // Ink is the minority class; this also handles light text on a dark page
+    uint64_t darkCount = 0;
+    uint64_t total = 0;
+    for (int level = 0; level < 256; ++level) {
+        total += histogram[level];
+        if (level <= threshold) {
+            darkCount += histogram[level];
+        }
+    }
+    const bool inverted = darkCount * 2 > total;
+
+    // Horizontal projection profile: ink samples per row
+    std::vector<int> rowInk(image.height);
+    for (int y = 0; y < image.height; ++y) {
+        const uint8_t* line = image.scanLine(y);
+        int ink = 0;
+        for (int x = 0; x < image.width; x += columnStep) {
+            ink += inverted ? line[x] > threshold : line[x] <= threshold;
+        }
+        rowInk[y] = ink;
+    }
+
+    // Rows below this are specks or scanner noise, not text
+    const int sampledWidth = (image.width + columnStep - 1) / columnStep;
+    const int minRowInk = std::max(2, sampledWidth / 500);
+    const int maxBandHeight = std::max(4, image.height / 3);
+
+    std::vector<int> bandHeights;
+    std::vector<int> coreHeights;
+    int y = 0;
+    while (y < image.height) {
+        if (rowInk[y] < minRowInk) {
+            ++y;
+            continue;
+        }
+        const int bandStart = y;
+        int peak = 0;
+        while (y < image.height && rowInk[y] >= minRowInk) {
+            peak = std::max(peak, rowInk[y]);
+            ++y;
+        }
+        const int bandHeight = y - bandStart;
+        if (bandHeight < 4 || bandHeight > maxBandHeight) {
+            continue;  // rules, underlines, figures
+        }
+
+        // The x-band is where ink density stays near the band's peak
+        int coreFirst = -1;
+        int coreLast = -1;
+        for (int row = bandStart; row < y; ++row) {
+            if (rowInk[row] * 2 >= peak) {
+                coreLast = row;
+                if (coreFirst < 0) {
+                    coreFirst = row;
+                }
+            }
+        }
+        bandHeights.push_back(bandHeight);
+        coreHeights.push_back(coreLast - coreFirst + 1);
+    }
+
+    metrics.lineCount = static_cast<int>(coreHeights.size());
+    metrics.xHeight = median(coreHeights);
+    metrics.lineHeight = median(bandHeights);
+    return metrics;
+}
@@ -0,0 +1,108 @@
+/*
+ * Module: Latency Histogram Implementation
+ *
+ * Log-linear bucketing, merging and percentile lookup.
+ */
+
+#include "latencyhistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// 2^5 = 32 exact buckets, then 16 sub-buckets per power of two
+constexpr int kSubBucketBits = 5;
+constexpr uint64_t kSubBucketCount = uint64_t(1) << kSubBucketBits;
+constexpr uint64_t kHalfSubBucketCount = kSubBucketCount / 2;
+
+int highestBit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+}  // namespace
+
+/**
+ * @brief Map a value to its bucket
+ *
+ * Values >= 32 are split into an exponent e (so that value >> e lies in
+ * [16, 32)) and that 4-bit mantissa.
+ */
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < kSubBucketCount) {
+        return static_cast<int>(value);
+    }
+    const int exponent = highestBit(value) - (kSubBucketBits - 1);
+    const uint64_t mantissa = value >> exponent;
+    return static_cast<int>(kSubBucketCount + (exponent - 1) * kHalfSubBucketCount +
+                            (mantissa - kHalfSubBucketCount));
+}
+
+/**
+ * @brief Midpoint of the value range covered by a bucket
+ */
+uint64_t LatencyHistogram::bucketValue(int index) {
+    if (static_cast<uint64_t>(index) < kSubBucketCount) {
+        return static_cast<uint64_t>(index);
+    }
+    const uint64_t offset = static_cast<uint64_t>(index) - kSubBucketCount;
+    const int exponent = static_cast<int>(offset / kHalfSubBucketCount) + 1;
+    const uint64_t mantissa = offset % kHalfSubBucketCount + kHalfSubBucketCount;
+    return (mantissa << exponent) + (uint64_t(1) << (exponent - 1));
+}
+
+void LatencyHistogram::record(qint64 value) {
+    const uint64_t clamped = value > 0 ? static_cast<uint64_t>(value) : 0;
+    const int index = bucketIndex(clamped);
+    if (static_cast<size_t>(index) >= m_buckets.size()) {
+        m_buckets.resize(index + 1, 0);
+    }
+    ++m_buckets[index];
+
+    const qint64 stored = static_cast<qint64>(clamped);
+    m_min = m_count ? std::min(m_min, stored) : stored;
+    m_max = std::max(m_max, stored);
+    m_sum += stored;
+    ++m_count;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.m_count == 0) {
+        return;
+    }
+    if (other.m_buckets.size() > m_buckets.size()) {
+        m_buckets.resize(other.m_buckets.size(), 0);
+    }
+    for (size_t i = 0; i < other.m_buckets.size(); ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_min = m_count ? std::min(m_min, other.m_min) : other.m_min;
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+    m_count += other.m_count;
+}
+
+qint64 LatencyHistogram::percentile(double percentile) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const double clampedPercentile = std::clamp(percentile, 0.0, 100.0);
+    const auto rank = std::max<qint64>(
+        1, static_cast<qint64>(std::ceil(clampedPercentile / 100.0 * m_count)));
+
+    qint64 seen = 0;
+    for (size_t i = 0; i < m_buckets.size(); ++i) {
+        seen += static_cast<qint64>(m_buckets[i]);
+        if (seen >= rank) {
+            // Never report beyond the observed extremes
+            return std::clamp(static_cast<qint64>(bucketValue(static_cast<int>(i))), m_min,
+                              m_max);
+        }
+    }
+    return m_max;
+}
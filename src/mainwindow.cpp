@@ -7,6 +7,14 @@
 
 #include "../include/mainwindow.h"
 
+#if defined(TESSERACT_AVAILABLE) && defined(Q_OS_LINUX)
+#include <poll.h>
+#include <unistd.h>
+
+#include "../include/ocrprotocol.h"
+#include "../include/ocrresultjson.h"
+#endif
+
 #include <QApplication>
 #include <QCheckBox>
 #include <QCloseEvent>
@@ -18,15 +26,21 @@
 #include <QFileInfo>
 #include <QFormLayout>
 #include <QGroupBox>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonObject>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QMouseEvent>
 #include <QPixmap>
+#include <QtMath>
 #include <QRadioButton>
 #include <QSettings>
 #include <QSpinBox>
 #include <QStandardPaths>
 #include <QTimer>
 #include <QUrl>
+#include <algorithm>
 
 // Note: Logging category is defined in ocr_main.cpp to avoid multiple definitions
 
@@ -34,6 +48,7 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       m_centralWidget(nullptr),
       m_mainSplitter(nullptr),
+      m_selectionBand(nullptr),
       m_settings(nullptr),
       m_operationInProgress(false)
 #ifdef TESSERACT_AVAILABLE
@@ -223,6 +238,9 @@ void MainWindow::setupCentralWidget() {
     m_imagePreviewLabel->setStyleSheet(
         "QLabel { border: 2px dashed #ccc; background-color: #f9f9f9; }");
     m_imagePreviewLabel->setScaledContents(true);
+    m_imagePreviewLabel->setToolTip("Drag to recognize only part of the image");
+    m_imagePreviewLabel->installEventFilter(this);
+    m_selectionBand = new QRubberBand(QRubberBand::Rectangle, m_imagePreviewLabel);
 
     m_inputLayout->addWidget(m_openFileButton);
     m_inputLayout->addWidget(m_configureButton);
@@ -317,6 +335,103 @@ void MainWindow::setupConnections() {
     qCInfo(gui) << "Signal-slot connections established";
 }
 
+bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
+    if (watched != m_imagePreviewLabel || !m_currentImageSize.isValid() ||
+        m_operationInProgress) {
+        return QMainWindow::eventFilter(watched, event);
+    }
+
+    switch (event->type()) {
+        case QEvent::MouseButtonPress: {
+            auto *mouseEvent = static_cast<QMouseEvent *>(event);
+            if (mouseEvent->button() != Qt::LeftButton) {
+                break;
+            }
+            m_selectionOrigin = mouseEvent->position().toPoint();
+            m_selectionBand->setGeometry(QRect(m_selectionOrigin, QSize()));
+            m_selectionBand->show();
+            return true;
+        }
+        case QEvent::MouseMove: {
+            auto *mouseEvent = static_cast<QMouseEvent *>(event);
+            if (!m_selectionBand->isVisible() || !(mouseEvent->buttons() & Qt::LeftButton)) {
+                break;
+            }
+            m_selectionBand->setGeometry(
+                QRect(m_selectionOrigin, mouseEvent->position().toPoint()).normalized());
+            return true;
+        }
+        case QEvent::MouseButtonRelease: {
+            auto *mouseEvent = static_cast<QMouseEvent *>(event);
+            if (mouseEvent->button() != Qt::LeftButton || !m_selectionBand->isVisible()) {
+                break;
+            }
+            const QRect previewRect = m_selectionBand->geometry();
+
+            // A click without a real drag goes back to whole-page recognition
+            if (previewRect.width() < MIN_SELECTION_SIZE ||
+                previewRect.height() < MIN_SELECTION_SIZE) {
+                clearRegionSelection();
+                m_statusLabel->setText("Selection cleared. Whole page will be processed.");
+                return true;
+            }
+
+            m_selectedRegion = previewToSourceRect(previewRect);
+            qCInfo(gui) << "Region selected:" << m_selectedRegion;
+#ifdef TESSERACT_AVAILABLE
+            if (m_ocrProcessor && !m_selectedRegion.isEmpty()) {
+                performOCROnCurrentImage();
+            }
+#endif
+            return true;
+        }
+        default:
+            break;
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::showImagePreview(const QString &filePath) {
+    clearRegionSelection();
+
+    // Apply EXIF orientation so preview pixels match what the OCR engine sees
+    QImageReader reader(filePath);
+    reader.setAutoTransform(true);
+    const QImage image = reader.read();
+    if (image.isNull()) {
+        m_currentImageSize = QSize();
+        return;
+    }
+
+    m_currentImageSize = image.size();
+    m_imagePreviewLabel->setPixmap(QPixmap::fromImage(image).scaled(
+        m_imagePreviewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+}
+
+QRect MainWindow::previewToSourceRect(const QRect &previewRect) const {
+    // setScaledContents() stretches the pixmap over the whole contents rectangle
+    const QRect contents = m_imagePreviewLabel->contentsRect();
+    if (contents.isEmpty() || !m_currentImageSize.isValid()) {
+        return QRect();
+    }
+
+    const QRect local =
+        previewRect.intersected(contents).translated(-contents.left(), -contents.top());
+    const double scaleX = static_cast<double>(m_currentImageSize.width()) / contents.width();
+    const double scaleY = static_cast<double>(m_currentImageSize.height()) / contents.height();
+
+    const QRect source(qFloor(local.x() * scaleX), qFloor(local.y() * scaleY),
+                       qCeil(local.width() * scaleX), qCeil(local.height() * scaleY));
+    return source.intersected(QRect(QPoint(0, 0), m_currentImageSize));
+}
+
+void MainWindow::clearRegionSelection() {
+    m_selectedRegion = QRect();
+    if (m_selectionBand) {
+        m_selectionBand->hide();
+    }
+}
+
 void MainWindow::loadSettings() {
     // Restore window geometry
     restoreGeometry(m_settings->value("geometry").toByteArray());
@@ -367,12 +482,7 @@ void MainWindow::dropEvent(QDropEvent *event) {
                     m_filePathLabel->setStyleSheet("QLabel { color: black; font-style: normal; }");
 
                     // Load and display image preview
-                    QPixmap pixmap(filePath);
-                    if (!pixmap.isNull()) {
-                        m_imagePreviewLabel->setPixmap(pixmap.scaled(m_imagePreviewLabel->size(),
-                                                                     Qt::KeepAspectRatio,
-                                                                     Qt::SmoothTransformation));
-                    }
+                    showImagePreview(filePath);
 
                     m_startOCRButton->setEnabled(true);
                     m_statusLabel->setText("Image loaded. Ready for OCR processing.");
@@ -415,11 +525,7 @@ void MainWindow::onOpenFile() {
         m_filePathLabel->setStyleSheet("QLabel { color: black; font-style: normal; }");
 
         // Load and display image preview
-        QPixmap pixmap(fileName);
-        if (!pixmap.isNull()) {
-            m_imagePreviewLabel->setPixmap(pixmap.scaled(
-                m_imagePreviewLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-        }
+        showImagePreview(fileName);
 
         m_startOCRButton->setEnabled(true);
         m_statusLabel->setText("Image loaded. Ready for OCR processing.");
@@ -589,6 +695,9 @@ void MainWindow::onOCRModeChanged() {
         auto config = m_ocrProcessor->getConfig();
         config.mode = m_currentOCRMode;
         m_ocrProcessor->setConfig(config);
+#ifdef Q_OS_LINUX
+        m_processPool.reset();  // Started again with the new configuration when next used
+#endif
 
         // Save setting
         m_settings->setValue("ocr/mode", static_cast<int>(m_currentOCRMode));
@@ -603,7 +712,13 @@ void MainWindow::performOCROnCurrentImage() {
         return;
     }
 
-    qCInfo(gui) << "Starting OCR processing on:" << m_currentFilePath;
+    qCInfo(gui) << "Starting OCR processing on:" << m_currentFilePath
+                << (m_selectedRegion.isNull() ? QString("(whole page)")
+                                              : QString("(region %1,%2 %3x%4)")
+                                                    .arg(m_selectedRegion.x())
+                                                    .arg(m_selectedRegion.y())
+                                                    .arg(m_selectedRegion.width())
+                                                    .arg(m_selectedRegion.height()));
 
     // Start operation
     m_operationInProgress = true;
@@ -615,8 +730,12 @@ void MainWindow::performOCROnCurrentImage() {
     try {
         updateProgress(30, "Loading and preprocessing image...");
 
-        // Perform OCR
-        auto result = m_ocrProcessor->performOCR(m_currentFilePath);
+        OCRProcessor::OCRResult result;
+        if (!recognizeWithDaemon(m_currentFilePath, m_selectedRegion, result) &&
+            !recognizeIsolated(m_currentFilePath, m_selectedRegion, result)) {
+            // Perform OCR; a selected region reuses the page prepared by earlier runs
+            result = m_ocrProcessor->performOCR(m_currentFilePath, m_selectedRegion);
+        }
 
         updateProgress(90, "Processing OCR results...");
 
@@ -626,13 +745,19 @@ void MainWindow::performOCROnCurrentImage() {
 
             displayOCRResults(result.text, result.confidence);
 
-            updateProgress(100, QString("OCR completed successfully - Confidence: %1%")
-                                    .arg(result.confidence, 0, 'f', 1));
+            if (result.isBlankPage) {
+                updateProgress(100, "Page appears blank - recognition skipped");
+            } else {
+                updateProgress(100, QString("OCR completed successfully%1 - Confidence: %2%")
+                                        .arg(result.region.isNull() ? "" : " (selection)")
+                                        .arg(result.confidence, 0, 'f', 1));
+            }
 
             qCInfo(gui) << "OCR processing successful:"
                         << "Text length:" << result.text.length()
                         << "Confidence:" << result.confidence << "Time:" << result.processingTimeMs
-                        << "ms";
+                        << "ms" << (result.reusedPreparedImage ? "(cached page)" : "")
+                        << (result.reusedLayout ? "(cached layout)" : "");
 
         } else {
             QString errorMsg = QString("OCR processing failed: %1").arg(result.errorMessage);
@@ -652,6 +777,117 @@ void MainWindow::performOCROnCurrentImage() {
     onOperationCompleted();
 }
 
+/**
+ * @brief Recognize through a running ocr_daemon as an interactive request
+ *
+ * The daemon serves interactive requests before batch work and cancels a
+ * batch page when every engine is busy, so a click does not wait behind a
+ * batch run on the same machine. The request carries the settings of the
+ * in-process engine so the daemon recognizes the page the same way.
+ *
+ * Returns false, and the caller recognizes in-process, when ocr/use_daemon
+ * is off (the default), no daemon is listening, the socket belongs to
+ * another user, or no reply arrives within ocr/daemon_timeout_ms.
+ */
+bool MainWindow::recognizeWithDaemon(const QString &filePath, const QRect &region,
+                                     OCRProcessor::OCRResult &result) const {
+#ifdef Q_OS_LINUX
+    if (!m_settings->value("ocr/use_daemon", false).toBool()) {
+        return false;
+    }
+    const int fd = OCRProtocol::connect(OCRProtocol::defaultSocketPath());
+    if (fd < 0) {
+        return false;
+    }
+    // The fallback socket lives in /tmp, where another user could listen first
+    if (!OCRProtocol::peerIsSameUser(fd)) {
+        qCWarning(gui) << "OCR daemon socket is owned by another user; recognizing in-process";
+        ::close(fd);
+        return false;
+    }
+
+    const OCRProcessor::OCRConfig config = m_ocrProcessor->getConfig();
+    OCRProtocol::Message request;
+    request.header = QJsonObject{{"id", 0},
+                                 {"op", "recognize"},
+                                 {"priority", "interactive"},
+                                 {"path", QFileInfo(filePath).absoluteFilePath()},
+                                 {"mode", OCRProcessor::modeName(m_currentOCRMode)},
+                                 {"language", config.language},
+                                 {"dpi", config.dpi},
+                                 {"minConfidence", config.minimumConfidence},
+                                 {"preprocess", config.preprocessImage}};
+    if (!region.isNull()) {
+        request.header.insert(
+            "region", QJsonArray{region.x(), region.y(), region.width(), region.height()});
+    }
+
+    // A stuck daemon must not hang the window: give up and recognize in-process
+    const int timeoutMs = m_settings->value("ocr/daemon_timeout_ms", 30000).toInt();
+    pollfd readable{fd, POLLIN, 0};
+    OCRProtocol::Message reply;
+    const bool answered = OCRProtocol::send(fd, request) &&
+                          ::poll(&readable, 1, timeoutMs) == 1 &&
+                          OCRProtocol::receive(fd, reply);
+    ::close(fd);
+    if (!answered) {
+        qCWarning(gui) << "No reply from the OCR daemon; recognizing in-process";
+        return false;
+    }
+
+    result = OCRResultJson::fromJson(reply.header);
+    result.region = region;
+    qCInfo(gui) << "Recognized by ocr_daemon after waiting"
+                << reply.header.value("queueUs").toInteger() << "us for an engine";
+    return true;
+#else
+    Q_UNUSED(filePath);
+    Q_UNUSED(region);
+    Q_UNUSED(result);
+    return false;
+#endif
+}
+
+/**
+ * @brief Recognize in an ocr_daemon worker process when ocr/isolate_engine is set
+ *
+ * A page that crashes the engine then fails with an error message instead
+ * of closing the window. The worker is started on first use with the
+ * in-process engine's configuration, capped at ocr/isolate_memory_mb, and
+ * restarted after a crash. Returns false when isolation is off or no worker
+ * can be started; the caller then recognizes in-process.
+ */
+bool MainWindow::recognizeIsolated(const QString &filePath, const QRect &region,
+                                   OCRProcessor::OCRResult &result) {
+#ifdef Q_OS_LINUX
+    if (!m_settings->value("ocr/isolate_engine", false).toBool()) {
+        return false;
+    }
+    if (!m_processPool) {
+        OCRProcessPool::Options options;
+        options.workerArguments = OCRProcessPool::engineArguments(m_ocrProcessor->getConfig(), 0);
+        options.memoryLimitBytes =
+            std::max<qint64>(0, m_settings->value("ocr/isolate_memory_mb", 0).toLongLong()) << 20;
+        try {
+            m_processPool = std::make_unique<OCRProcessPool>(options);
+        } catch (const std::exception &e) {
+            qCWarning(gui) << "Cannot start an OCR worker process; recognizing in-process:"
+                           << e.what();
+            return false;
+        }
+    }
+    result = m_processPool->recognize(filePath, region, m_currentOCRMode);
+    qCInfo(gui) << "Recognized in an isolated worker;" << m_processPool->restarts()
+                << "restart(s) so far";
+    return true;
+#else
+    Q_UNUSED(filePath);
+    Q_UNUSED(region);
+    Q_UNUSED(result);
+    return false;
+#endif
+}
+
 void MainWindow::updateOCRProgress(int percentage) {
     updateProgress(percentage, QString("OCR processing... %1%").arg(percentage));
 }
@@ -830,6 +1066,9 @@ void MainWindow::onConfigureOCR() {
         // Update processor configuration
         if (m_ocrProcessor->setConfig(newConfig)) {
             m_currentOCRMode = newConfig.mode;
+#ifdef Q_OS_LINUX
+            m_processPool.reset();  // Started again with the new configuration when next used
+#endif
 
             // Save settings
             m_settings->setValue("ocr/language", newConfig.language);
@@ -0,0 +1,646 @@
+/*
+ * Module: Math Expression Implementation
+ *
+ * Script detection from glyph placement, recursive-descent parsing and
+ * LaTeX/S-expression output.
+ */
+
+#include "mathexpression.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mathgrammar.h"
+
+namespace {
+
+// Glyphs whose bottom is this close to the baseline (in glyph heights) sit on it
+constexpr double kOnBaseline = 0.15;
+// A glyph is a superscript when its bottom is this far above the baseline...
+constexpr double kRaisedBy = 0.25;
+// ...and a subscript when its bottom is this far below it...
+constexpr double kLoweredBy = 0.2;
+// ...while its top stays below this height, unlike descenders of g, p and y
+constexpr double kLoweredTopBelow = 0.6;
+// Operators join a superscript when their centre is above this height;
+// baseline operators are centred near half the x-height
+constexpr double kRaisedOperatorAbove = 0.8;
+// Operators join a subscript when their centre is below this height
+constexpr double kLoweredOperatorBelow = 0.25;
+
+bool isDigit(char32_t c) { return c >= '0' && c <= '9'; }
+
+bool isLetter(char32_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= 0x391 && c <= 0x3C9);
+}
+
+bool isOperatorCharacter(char32_t c) {
+    switch (c) {
+        case '+':
+        case '-':
+        case '*':
+        case '/':
+        case '^':
+        case '_':
+        case '=':
+        case '<':
+        case '>':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief First code point of a symbol, in canonical form (0 for empty text)
+ */
+char32_t leadingCodePoint(const std::string& text) {
+    if (text.empty()) {
+        return 0;
+    }
+    const char* p = text.c_str();
+    return MathGrammar::canonical(MathGrammar::readCodePoint(p));
+}
+
+bool isOperand(const std::string& text) {
+    const char32_t c = leadingCodePoint(text);
+    return isDigit(c) || isLetter(c);
+}
+
+char closingFor(const std::string& open) {
+    switch (open.empty() ? 0 : open[0]) {
+        case '(':
+            return ')';
+        case '[':
+            return ']';
+        default:
+            return '}';
+    }
+}
+
+double median(std::vector<int>& values) {
+    const size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    return values[middle];
+}
+
+}  // namespace
+
+/**
+ * @brief Build the tree from the glyphs of one line
+ */
+bool MathExpression::parse(const std::vector<Symbol>& symbols) {
+    m_nodes.clear();
+    m_error.clear();
+    m_root = -1;
+
+    assignLevels(symbols);
+    return tokenize(symbols) && parseTokens();
+}
+
+/**
+ * @brief Build the tree from text alone
+ */
+bool MathExpression::parse(const std::string& utf8) {
+    m_scratch.clear();
+    bool wordStart = true;
+    const char* p = utf8.c_str();
+    while (*p) {
+        const char* begin = p;
+        const char32_t c = MathGrammar::readCodePoint(p);
+        if (c == ' ' || c == '\t' || c == '\n') {
+            wordStart = true;
+            continue;
+        }
+        Symbol symbol;
+        symbol.text.assign(begin, p);
+        symbol.startsWord = wordStart;
+        m_scratch.push_back(std::move(symbol));
+        wordStart = false;
+    }
+    return parse(m_scratch);
+}
+
+/**
+ * @brief Script level of every symbol from its placement against the baseline
+ */
+void MathExpression::assignLevels(const std::vector<Symbol>& symbols) {
+    m_levels.assign(symbols.size(), 0);
+
+    // Reference height: median of the letters and digits standing on the baseline
+    m_heights.clear();
+    for (const Symbol& symbol : symbols) {
+        if (isOperand(symbol.text) && symbol.bottom > symbol.top) {
+            m_heights.push_back(symbol.bottom - symbol.top);
+        }
+    }
+    if (m_heights.empty()) {
+        return;  // no geometry: scripts need explicit ^ or _
+    }
+    const double tolerance = std::max(1.0, kOnBaseline * median(m_heights));
+    m_heights.clear();
+    for (const Symbol& symbol : symbols) {
+        if (isOperand(symbol.text) && std::abs(symbol.bottom - symbol.baseline) <= tolerance) {
+            m_heights.push_back(symbol.bottom - symbol.top);
+        }
+    }
+    if (m_heights.empty()) {
+        return;
+    }
+    const double reference = std::max(1.0, median(m_heights));
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const Symbol& symbol = symbols[i];
+        if (!isOperand(symbol.text)) {
+            continue;
+        }
+        if (symbol.bottom < symbol.baseline - kRaisedBy * reference) {
+            m_levels[i] = 1;
+        } else if (symbol.bottom > symbol.baseline + kLoweredBy * reference &&
+                   symbol.top > symbol.baseline - kLoweredTopBelow * reference) {
+            m_levels[i] = -1;
+        }
+    }
+
+    // Operators between two script glyphs, placed like them, belong to the script
+    for (size_t i = 1; i + 1 < symbols.size(); ++i) {
+        const int level = m_levels[i - 1];
+        if (level == 0 || m_levels[i + 1] != level ||
+            !isOperatorCharacter(leadingCodePoint(symbols[i].text))) {
+            continue;
+        }
+        const Symbol& symbol = symbols[i];
+        const double centre = (symbol.top + symbol.bottom) / 2.0;
+        const bool placed = level > 0
+                                ? centre < symbol.baseline - kRaisedOperatorAbove * reference
+                                : centre > symbol.baseline - kLoweredOperatorBelow * reference;
+        if (placed) {
+            m_levels[i] = level;
+        }
+    }
+
+    // A script needs a base: an operand or closing bracket, or more of the script
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        if (m_levels[i] == 0) {
+            continue;
+        }
+        const char32_t previous = i > 0 ? leadingCodePoint(symbols[i - 1].text) : 0;
+        const bool hasBase =
+            i > 0 && (m_levels[i - 1] == m_levels[i] ||
+                      (m_levels[i - 1] == 0 && (isOperand(symbols[i - 1].text) ||
+                                                previous == ')' || previous == ']')));
+        if (!hasBase) {
+            m_levels[i] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Split the symbols into numbers, variables, operators and brackets
+ */
+bool MathExpression::tokenize(const std::vector<Symbol>& symbols) {
+    m_tokens.clear();
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const int level = m_levels[i];
+        const char* p = symbols[i].text.c_str();
+        bool wordStart = symbols[i].startsWord;
+        while (*p) {
+            const char* begin = p;
+            const char32_t c = MathGrammar::canonical(MathGrammar::readCodePoint(p));
+            if (c == ' ') {
+                wordStart = true;
+                continue;
+            }
+
+            // Digits and decimal points extend a number on the same level and word
+            if (isDigit(c) || c == '.') {
+                if (!m_tokens.empty() && !wordStart && m_tokens.back().type == TokenType::Number &&
+                    m_tokens.back().level == level) {
+                    m_tokens.back().text.append(begin, p);
+                    continue;
+                }
+            }
+            wordStart = false;
+
+            Token token;
+            token.level = level;
+            if (isDigit(c) || c == '.') {
+                token.type = TokenType::Number;
+                token.text.assign(begin, p);
+            } else if (isLetter(c)) {
+                token.type = TokenType::Variable;
+                token.text.assign(begin, p);
+            } else if (isOperatorCharacter(c)) {
+                token.type = TokenType::Operator;
+                token.text.assign(1, static_cast<char>(c));
+            } else if (c == '(' || c == '[' || c == '{') {
+                token.type = TokenType::Open;
+                token.text.assign(1, static_cast<char>(c));
+            } else if (c == ')' || c == ']' || c == '}') {
+                token.type = TokenType::Close;
+                token.text.assign(1, static_cast<char>(c));
+            } else if (c == ',') {
+                token.type = TokenType::Comma;
+                token.text = ",";
+            } else {
+                fail("unexpected character '" + std::string(begin, p) + "'");
+                return false;
+            }
+            m_tokens.push_back(std::move(token));
+        }
+    }
+    return true;
+}
+
+bool MathExpression::parseTokens() {
+    if (m_tokens.empty()) {
+        fail("empty expression");
+        return false;
+    }
+    m_pos = 0;
+    m_end = static_cast<int>(m_tokens.size());
+    m_level = 0;
+
+    const int root = parseRelation();
+    if (root >= 0 && m_pos != m_end) {
+        fail("unexpected '" + m_tokens[m_pos].text + "'");
+        return false;
+    }
+    if (root < 0) {
+        return false;
+    }
+    m_root = root;
+    return true;
+}
+
+/**
+ * @brief relation := sum (('=' | '<' | '>') sum)*
+ */
+int MathExpression::parseRelation() {
+    int left = parseSum();
+    while (left >= 0 && (isOperator("=") || isOperator("<") || isOperator(">"))) {
+        const std::string op = m_tokens[m_pos++].text;
+        const int right = parseSum();
+        if (right < 0) {
+            return -1;
+        }
+        const int node = addNode(NodeKind::Binary, op);
+        appendChild(node, left);
+        appendChild(node, right);
+        left = node;
+    }
+    return left;
+}
+
+/**
+ * @brief sum := term (('+' | '-') term)*
+ */
+int MathExpression::parseSum() {
+    int left = parseTerm();
+    while (left >= 0 && (isOperator("+") || isOperator("-"))) {
+        const std::string op = m_tokens[m_pos++].text;
+        const int right = parseTerm();
+        if (right < 0) {
+            return -1;
+        }
+        const int node = addNode(NodeKind::Binary, op);
+        appendChild(node, left);
+        appendChild(node, right);
+        left = node;
+    }
+    return left;
+}
+
+/**
+ * @brief term := unary (('*' | '/') unary)*
+ */
+int MathExpression::parseTerm() {
+    int left = parseUnary();
+    while (left >= 0 && (isOperator("*") || isOperator("/"))) {
+        const std::string op = m_tokens[m_pos++].text;
+        const int right = parseUnary();
+        if (right < 0) {
+            return -1;
+        }
+        const int node = addNode(NodeKind::Binary, op);
+        appendChild(node, left);
+        appendChild(node, right);
+        left = node;
+    }
+    return left;
+}
+
+/**
+ * @brief unary := ('-' | '+') unary | product
+ */
+int MathExpression::parseUnary() {
+    if (isOperator("+")) {
+        ++m_pos;
+        return parseUnary();
+    }
+    if (isOperator("-")) {
+        ++m_pos;
+        const int operand = parseUnary();
+        if (operand < 0) {
+            return -1;
+        }
+        const int node = addNode(NodeKind::Negate, "-");
+        appendChild(node, operand);
+        return node;
+    }
+    return parseProduct();
+}
+
+/**
+ * @brief product := postfix postfix*  (implicit multiplication)
+ */
+int MathExpression::parseProduct() {
+    const int first = parsePostfix();
+    if (first < 0 || !startsOperand()) {
+        return first;
+    }
+    const int node = addNode(NodeKind::Product, "");
+    appendChild(node, first);
+    while (startsOperand()) {
+        const int factor = parsePostfix();
+        if (factor < 0) {
+            return -1;
+        }
+        appendChild(node, factor);
+    }
+    return node;
+}
+
+/**
+ * @brief postfix := primary (script | '^' ['-'] primary | '_' primary)*
+ */
+int MathExpression::parsePostfix() {
+    int base = parsePrimary();
+    while (base >= 0) {
+        if (m_level == 0 && m_pos < m_end && m_tokens[m_pos].level != 0) {
+            base = parseScript(base);
+        } else if (isOperator("^") || isOperator("_")) {
+            const NodeKind kind =
+                m_tokens[m_pos++].text == "^" ? NodeKind::Superscript : NodeKind::Subscript;
+            int script;
+            if (kind == NodeKind::Superscript && isOperator("-")) {
+                ++m_pos;
+                const int operand = parsePrimary();
+                script = operand < 0 ? -1 : addNode(NodeKind::Negate, "-");
+                if (script >= 0) {
+                    appendChild(script, operand);
+                }
+            } else {
+                script = parsePrimary();
+            }
+            if (script < 0) {
+                return -1;
+            }
+            const int node = addNode(kind, kind == NodeKind::Superscript ? "^" : "_");
+            appendChild(node, base);
+            appendChild(node, script);
+            base = node;
+        } else {
+            break;
+        }
+    }
+    return base;
+}
+
+/**
+ * @brief Parse the run of raised or lowered tokens after a base as its script
+ */
+int MathExpression::parseScript(int base) {
+    const int level = m_tokens[m_pos].level;
+    int runEnd = m_pos;
+    while (runEnd < m_end && m_tokens[runEnd].level == level) {
+        ++runEnd;
+    }
+
+    const int outerEnd = m_end;
+    const int outerLevel = m_level;
+    m_end = runEnd;
+    m_level = level;
+    const int script = parseSum();
+    if (script >= 0 && m_pos != m_end) {
+        fail("unexpected '" + m_tokens[m_pos].text + "' in script");
+    }
+    const bool complete = script >= 0 && m_pos == m_end;
+    m_end = outerEnd;
+    m_level = outerLevel;
+    if (!complete) {
+        return -1;
+    }
+
+    const bool raised = level > 0;
+    const int node = addNode(raised ? NodeKind::Superscript : NodeKind::Subscript,
+                             raised ? "^" : "_");
+    appendChild(node, base);
+    appendChild(node, script);
+    return node;
+}
+
+/**
+ * @brief primary := number | variable | open list close
+ */
+int MathExpression::parsePrimary() {
+    if (!atLevel()) {
+        return fail("missing operand");
+    }
+    const Token& token = m_tokens[m_pos];
+    switch (token.type) {
+        case TokenType::Number:
+            ++m_pos;
+            return addNode(NodeKind::Number, token.text);
+        case TokenType::Variable:
+            ++m_pos;
+            return addNode(NodeKind::Variable, token.text);
+        case TokenType::Open:
+            break;
+        default:
+            return fail("unexpected '" + token.text + "'");
+    }
+
+    const std::string open = m_tokens[m_pos++].text;
+    const int group = addNode(NodeKind::Group, open);
+    while (true) {
+        const int element = parseSum();
+        if (element < 0) {
+            return -1;
+        }
+        appendChild(group, element);
+        if (!atLevel() || m_tokens[m_pos].type != TokenType::Comma) {
+            break;
+        }
+        ++m_pos;
+    }
+    if (!atLevel() || m_tokens[m_pos].type != TokenType::Close ||
+        m_tokens[m_pos].text[0] != closingFor(open)) {
+        return fail(std::string("missing '") + closingFor(open) + "'");
+    }
+    ++m_pos;
+    return group;
+}
+
+bool MathExpression::atLevel() const {
+    return m_pos < m_end && m_tokens[m_pos].level == m_level;
+}
+
+bool MathExpression::startsOperand() const {
+    if (!atLevel()) {
+        return false;
+    }
+    const TokenType type = m_tokens[m_pos].type;
+    return type == TokenType::Number || type == TokenType::Variable || type == TokenType::Open;
+}
+
+bool MathExpression::isOperator(const char* op) const {
+    return atLevel() && m_tokens[m_pos].type == TokenType::Operator && m_tokens[m_pos].text == op;
+}
+
+int MathExpression::fail(const std::string& message) {
+    if (m_error.empty()) {
+        m_error = message;
+    }
+    return -1;
+}
+
+int MathExpression::addNode(NodeKind kind, const std::string& text) {
+    Node node;
+    node.kind = kind;
+    node.text = text;
+    m_nodes.push_back(std::move(node));
+    return static_cast<int>(m_nodes.size()) - 1;
+}
+
+void MathExpression::appendChild(int parent, int child) {
+    int* link = &m_nodes[parent].firstChild;
+    while (*link >= 0) {
+        link = &m_nodes[*link].nextSibling;
+    }
+    *link = child;
+}
+
+/**
+ * @brief LaTeX for the parsed expression
+ */
+std::string MathExpression::toLatex() const {
+    std::string latex;
+    if (m_root >= 0) {
+        appendLatex(m_root, latex);
+    }
+    return latex;
+}
+
+void MathExpression::appendLatex(int index, std::string& out) const {
+    const Node& node = m_nodes[index];
+    const int first = node.firstChild;
+    const int second = first >= 0 ? m_nodes[first].nextSibling : -1;
+
+    switch (node.kind) {
+        case NodeKind::Number:
+        case NodeKind::Variable:
+            out += node.text;
+            break;
+
+        case NodeKind::Negate:
+            out += '-';
+            appendLatex(first, out);
+            break;
+
+        case NodeKind::Binary:
+            appendLatex(first, out);
+            if (node.text == "*") {
+                out += " \\cdot ";
+            } else {
+                out += ' ';
+                out += node.text;
+                out += ' ';
+            }
+            appendLatex(second, out);
+            break;
+
+        case NodeKind::Product:
+            for (int child = first, previous = -1; child >= 0;
+                 previous = child, child = m_nodes[child].nextSibling) {
+                // Adjacent numbers would read as one
+                if (previous >= 0 && m_nodes[previous].kind == NodeKind::Number &&
+                    m_nodes[child].kind == NodeKind::Number) {
+                    out += ' ';
+                }
+                appendLatex(child, out);
+            }
+            break;
+
+        case NodeKind::Group: {
+            const bool braces = node.text == "{";
+            out += braces ? "\\{" : node.text;
+            for (int child = first; child >= 0; child = m_nodes[child].nextSibling) {
+                if (child != first) {
+                    out += ", ";
+                }
+                appendLatex(child, out);
+            }
+            out += braces ? std::string("\\}") : std::string(1, closingFor(node.text));
+            break;
+        }
+
+        case NodeKind::Superscript:
+        case NodeKind::Subscript: {
+            const NodeKind baseKind = m_nodes[first].kind;
+            const bool wrap = baseKind != NodeKind::Number && baseKind != NodeKind::Variable &&
+                              baseKind != NodeKind::Group;
+            if (wrap) {
+                out += '{';
+            }
+            appendLatex(first, out);
+            if (wrap) {
+                out += '}';
+            }
+            out += node.kind == NodeKind::Superscript ? "^{" : "_{";
+            appendLatex(second, out);
+            out += '}';
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Prefix S-expression of the parsed expression
+ */
+std::string MathExpression::toTree() const {
+    std::string tree;
+    if (m_root >= 0) {
+        appendTree(m_root, tree);
+    }
+    return tree;
+}
+
+void MathExpression::appendTree(int index, std::string& out) const {
+    const Node& node = m_nodes[index];
+    if (node.kind == NodeKind::Number || node.kind == NodeKind::Variable) {
+        out += node.text;
+        return;
+    }
+
+    out += '(';
+    switch (node.kind) {
+        case NodeKind::Negate:
+            out += "neg";
+            break;
+        case NodeKind::Product:
+            out += '*';
+            break;
+        case NodeKind::Group:
+            out += node.text == "(" ? "paren" : node.text == "[" ? "bracket" : "brace";
+            break;
+        default:
+            out += node.text;
+            break;
+    }
+    for (int child = node.firstChild; child >= 0; child = m_nodes[child].nextSibling) {
+        out += ' ';
+        appendTree(child, out);
+    }
+    out += ')';
+}
@@ -0,0 +1,442 @@
+/*
+ * Module: Math Grammar Implementation
+ *
+ * Character-level equation recognizer and grammar-pruned beam search.
+ */
+
+#include "mathgrammar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Parser phases; operand-complete phases are Integer onwards
+ */
+enum Phase : uint8_t {
+    ExpectOperand,  ///< Start, or after an operator, relation, comma or '('
+    AfterSign,      ///< After a unary '+' or '-'
+    AfterDot,       ///< Decimal point read, a digit must follow
+    Integer,        ///< Inside the integer digits of a number
+    Fraction,       ///< Inside the fraction digits of a number
+    NumberEnd,      ///< Number followed by a space
+    Variable,       ///< After a variable letter
+    Closed          ///< After a closing bracket
+};
+
+// Alternatives less likely than this count as this likely
+constexpr double kMinProbability = 0.005;
+// Hypotheses this far (in log-probability) behind the best are dropped
+constexpr double kScoreWindow = 12.0;
+
+bool isComplete(uint8_t phase) { return phase >= Integer; }
+
+char openingFor(char32_t c) {
+    switch (c) {
+        case ')':
+            return '(';
+        case ']':
+            return '[';
+        case '}':
+            return '{';
+        default:
+            return 0;
+    }
+}
+
+void appendUtf8(std::string& out, char32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+}  // namespace
+
+bool MathGrammar::State::operator==(const State& other) const {
+    return phase == other.phase && depth == other.depth && relations == other.relations &&
+           std::memcmp(stack, other.stack, sizeof(stack)) == 0;
+}
+
+char32_t MathGrammar::canonical(char32_t c) {
+    switch (c) {
+        case 0x2212:  // minus sign
+        case 0x2013:  // en dash
+            return '-';
+        case 0x00D7:  // multiplication sign
+        case 0x22C5:  // dot operator
+            return '*';
+        case 0x00F7:  // division sign
+            return '/';
+        default:
+            return c;
+    }
+}
+
+char32_t MathGrammar::readCodePoint(const char*& utf8) {
+    const auto* p = reinterpret_cast<const unsigned char*>(utf8);
+    char32_t c = *p++;
+    int extra = 0;
+    if (c >= 0xF0) {
+        c &= 0x07;
+        extra = 3;
+    } else if (c >= 0xE0) {
+        c &= 0x0F;
+        extra = 2;
+    } else if (c >= 0xC0) {
+        c &= 0x1F;
+        extra = 1;
+    } else if (c >= 0x80) {
+        extra = -1;
+    }
+    for (; extra > 0 && (*p & 0xC0) == 0x80; --extra, ++p) {
+        c = (c << 6) | (*p & 0x3F);
+    }
+    utf8 = reinterpret_cast<const char*>(p);
+    return extra ? 0xFFFD : c;
+}
+
+bool MathGrammar::isVariable(char32_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool MathGrammar::isDigitLike(char32_t c) {
+    return c == 'l' || c == 'I' || c == 'O';
+}
+
+/**
+ * @brief Advance the state by one code point
+ */
+bool MathGrammar::feed(State& state, char32_t c) {
+    c = canonical(c);
+    const uint8_t phase = state.phase;
+
+    if (c == ' ') {
+        if (phase == AfterDot) {
+            return false;
+        }
+        if (phase == Integer || phase == Fraction) {
+            state.phase = NumberEnd;
+        }
+        return true;
+    }
+
+    if (c >= '0' && c <= '9') {
+        switch (phase) {
+            case ExpectOperand:
+            case AfterSign:
+            case Integer:
+            case Variable:
+            case Closed:
+                state.phase = Integer;
+                return true;
+            case AfterDot:
+            case Fraction:
+                state.phase = Fraction;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    if (c == '.') {
+        if (phase != Integer) {
+            return false;
+        }
+        state.phase = AfterDot;
+        return true;
+    }
+
+    if (isVariable(c)) {
+        if (phase == AfterDot) {
+            return false;
+        }
+        state.phase = Variable;
+        return true;
+    }
+
+    switch (c) {
+        case '+':
+        case '-':
+            if (phase == ExpectOperand) {
+                state.phase = AfterSign;
+                return true;
+            }
+            if (!isComplete(phase)) {
+                return false;
+            }
+            state.phase = ExpectOperand;
+            return true;
+
+        case '*':
+        case '/':
+        case '^':
+            if (!isComplete(phase)) {
+                return false;
+            }
+            state.phase = ExpectOperand;
+            return true;
+
+        case '=':
+        case '<':
+        case '>':
+            if (!isComplete(phase) || state.depth > 0) {
+                return false;
+            }
+            state.relations = static_cast<uint8_t>(std::min(255, state.relations + 1));
+            state.phase = ExpectOperand;
+            return true;
+
+        case '(':
+        case '[':
+        case '{':
+            if (phase == AfterDot || state.depth >= kMaxDepth) {
+                return false;
+            }
+            state.stack[state.depth++] = static_cast<char>(c);
+            state.phase = ExpectOperand;
+            return true;
+
+        case ')':
+        case ']':
+        case '}':
+            if (!isComplete(phase) || state.depth == 0 ||
+                state.stack[state.depth - 1] != openingFor(c)) {
+                return false;
+            }
+            state.stack[--state.depth] = 0;
+            state.phase = Closed;
+            return true;
+
+        case ',':
+            if (!isComplete(phase) || state.depth == 0) {
+                return false;
+            }
+            state.phase = ExpectOperand;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool MathGrammar::accepts(const State& state) {
+    return isComplete(state.phase) && state.depth == 0;
+}
+
+bool MathGrammar::parses(const std::string& utf8) {
+    State state;
+    const char* p = utf8.c_str();
+    while (*p) {
+        if (!feed(state, readCodePoint(p))) {
+            return false;
+        }
+    }
+    return accepts(state);
+}
+
+MathBeamSearch::MathBeamSearch() : MathBeamSearch(Options()) {}
+
+MathBeamSearch::MathBeamSearch(const Options& options) : m_options(options) {
+    m_options.beamWidth = std::max(1, m_options.beamWidth);
+    m_options.maxChoices = std::max(1, m_options.maxChoices);
+    m_beam.reserve(m_options.beamWidth);
+    m_candidates.reserve(static_cast<size_t>(m_options.beamWidth) * m_options.maxChoices);
+    clear();
+}
+
+void MathBeamSearch::clear() {
+    m_choices.clear();
+    m_offsets.clear();
+    m_selected.clear();
+    m_offsets.push_back(0);
+}
+
+int MathBeamSearch::addSymbol(const char* const* utf8, const float* confidences, int count) {
+    count = std::min(count, m_options.maxChoices);
+    for (int i = 0; i < count; ++i) {
+        Choice choice;
+        const char* p = utf8[i];
+        while (p && *p && choice.length < kMaxCodePoints) {
+            choice.codePoints[choice.length++] = MathGrammar::readCodePoint(p);
+        }
+        choice.confidence = confidences[i];
+        if (choice.length > 0) {
+            m_choices.push_back(choice);
+        }
+    }
+    m_offsets.push_back(static_cast<int>(m_choices.size()));
+    return symbolCount() - 1;
+}
+
+void MathBeamSearch::addSpace() {
+    Choice space;
+    space.codePoints[0] = ' ';
+    space.length = 1;
+    space.confidence = 100.0f;
+    m_choices.push_back(space);
+    m_offsets.push_back(static_cast<int>(m_choices.size()));
+}
+
+/**
+ * @brief Whether the recognizer's pick for a neighbouring symbol is a letter
+ *
+ * "ln" and "lim" are read as letters; an l, I or O standing between digits,
+ * spaces and operators is more likely a misread 1 or 0.
+ */
+bool MathBeamSearch::touchesLetter(int symbol) const {
+    for (int neighbour : {symbol - 1, symbol + 1}) {
+        if (neighbour >= 0 && neighbour < symbolCount() &&
+            m_offsets[neighbour] < m_offsets[neighbour + 1] &&
+            MathGrammar::isVariable(m_choices[m_offsets[neighbour]].codePoints[0])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Search for the best grammatical sequence
+ */
+MathBeamSearch::Outcome MathBeamSearch::run(std::string& utf8) {
+    Outcome outcome;
+    const auto deadline = std::chrono::steady_clock::now() + m_options.budget;
+
+    m_history.clear();
+    m_beam.clear();
+    m_beam.push_back(Hypothesis());
+    m_selected.resize(symbolCount());
+    for (int symbol = 0; symbol < symbolCount(); ++symbol) {
+        const bool empty = m_offsets[symbol] == m_offsets[symbol + 1];
+        m_selected[symbol] = empty ? -1 : m_offsets[symbol];
+    }
+
+    for (int symbol = 0; symbol < symbolCount(); ++symbol) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            outcome.overBudget = true;
+            return outcome;
+        }
+
+        const int first = m_offsets[symbol];
+        const int last = m_offsets[symbol + 1];
+        if (first == last) {
+            continue;  // symbol without usable alternatives
+        }
+
+        const bool lone = !touchesLetter(symbol);
+        m_candidates.clear();
+        for (const Hypothesis& hypothesis : m_beam) {
+            for (int c = first; c < last; ++c) {
+                const Choice& choice = m_choices[c];
+                Hypothesis next;
+                next.state = hypothesis.state;
+                bool valid = true;
+                for (int i = 0; i < choice.length && valid; ++i) {
+                    valid = MathGrammar::feed(next.state, choice.codePoints[i]);
+                }
+                if (!valid) {
+                    continue;
+                }
+                double probability =
+                    std::max(kMinProbability, std::min(1.0, choice.confidence / 100.0));
+                if (lone && choice.length == 1 && MathGrammar::isDigitLike(choice.codePoints[0])) {
+                    probability *= kLoneDigitLikePenalty;
+                }
+                next.score = hypothesis.score + std::log(probability);
+
+                // Equal parser states have equal futures: keep only the better one
+                auto same = std::find_if(m_candidates.begin(), m_candidates.end(),
+                                         [&next](const Hypothesis& other) {
+                                             return other.state == next.state;
+                                         });
+                if (same != m_candidates.end()) {
+                    if (same->score >= next.score) {
+                        continue;
+                    }
+                    m_candidates.erase(same);
+                }
+
+                next.back = static_cast<int>(m_history.size());
+                m_history.push_back({hypothesis.back, c});
+                m_candidates.push_back(next);
+            }
+        }
+        if (m_candidates.empty()) {
+            return outcome;
+        }
+
+        // Keep the best beamWidth candidates within the score window
+        std::sort(m_candidates.begin(), m_candidates.end(),
+                  [](const Hypothesis& a, const Hypothesis& b) { return a.score > b.score; });
+        const double cutoff = m_candidates.front().score - kScoreWindow;
+        m_beam.clear();
+        for (const Hypothesis& candidate : m_candidates) {
+            if (static_cast<int>(m_beam.size()) == m_options.beamWidth ||
+                candidate.score < cutoff) {
+                break;
+            }
+            m_beam.push_back(candidate);
+        }
+    }
+
+    const Hypothesis* best = nullptr;
+    for (const Hypothesis& hypothesis : m_beam) {
+        if (MathGrammar::accepts(hypothesis.state) && (!best || hypothesis.score > best->score)) {
+            best = &hypothesis;
+        }
+    }
+    if (!best) {
+        return outcome;
+    }
+
+    // Walk the back pointers, then emit the choices in reading order
+    m_path.clear();
+    for (int step = best->back; step >= 0; step = m_history[step].previous) {
+        m_path.push_back(m_history[step].choice);
+    }
+
+    utf8.clear();
+    for (auto it = m_path.rbegin(); it != m_path.rend(); ++it) {
+        const Choice& choice = m_choices[*it];
+        for (int i = 0; i < choice.length; ++i) {
+            appendUtf8(utf8, choice.codePoints[i]);
+        }
+        // The first alternative of every symbol is the recognizer's own pick
+        const auto symbolStart = std::upper_bound(m_offsets.begin(), m_offsets.end(), *it) - 1;
+        outcome.changed = outcome.changed || *it != *symbolStart;
+        m_selected[symbolStart - m_offsets.begin()] = *it;
+    }
+
+    outcome.parsed = true;
+    outcome.score = best->score;
+    return outcome;
+}
+
+void MathBeamSearch::appendSelectedText(int symbol, std::string& utf8) const {
+    int index = -1;
+    if (symbol >= 0 && symbol < static_cast<int>(m_selected.size())) {
+        index = m_selected[symbol];
+    } else if (symbol >= 0 && symbol < symbolCount() && m_offsets[symbol] < m_offsets[symbol + 1]) {
+        index = m_offsets[symbol];  // run() has not seen this symbol yet
+    }
+    if (index < 0) {
+        return;
+    }
+    const Choice& choice = m_choices[index];
+    for (int i = 0; i < choice.length; ++i) {
+        appendUtf8(utf8, choice.codePoints[i]);
+    }
+}
@@ -0,0 +1,509 @@
+/*
+ * Project: OCR & PPT Automation Tool - Equation Accuracy/Speed Harness
+ *
+ * Objective:
+ * - Render the fixed equation corpus from OCRTestPages and recognize every
+ *   equation with each OCRProcessor::ProcessingMode at several DPIs.
+ * - Report character error rate (CER) next to ms/page for every configuration
+ *   and mark the configurations on the accuracy/speed Pareto front.
+ * - Compare against a stored baseline and fail when a configuration becomes
+ *   slower or less accurate than the allowed thresholds.
+ *
+ * Usage:
+ *   ocr_accuracy [--write-baseline base.json]
+ *   ocr_accuracy --baseline base.json [--max-slowdown 15] [--max-cer-increase 0.01]
+ *   ocr_accuracy --cascade      (adds fast-tier vs final CER per DPI)
+ *
+ * Equations-mode rows also report how many equations convert to exactly the
+ * LaTeX the corpus markup describes.
+ *
+ * Before recognizing anything, the harness checks that the grammar search
+ * keeps known-good equations (the corpus plus equations using l, I and O as
+ * letters) unchanged when 1/0 lookalikes are offered as alternatives, and
+ * that it still corrects a lone misread l. A failed check exits with 4.
+ */
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QTextStream>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "mathgrammar.h"
+#include "ocrprocessor.h"
+#include "ocrstatistics.h"
+#include "ocrtestpages.h"
+
+Q_LOGGING_CATEGORY(accuracy, "app.accuracy")
+
+namespace {
+
+/**
+ * @brief Aggregated outcome of one mode/DPI configuration
+ */
+struct ConfigResult {
+    QString name;
+    OCRProcessor::ProcessingMode mode;
+    int dpi = 0;
+    double cer = 0.0;             ///< Corpus-level character error rate (0 = perfect)
+    double exactMatch = 0.0;      ///< Fraction of equations recognized exactly
+    double msPerPage = 0.0;       ///< Median recognition latency
+    bool pareto = false;          ///< Not dominated in (cer, msPerPage)
+    bool cascade = false;         ///< Two-tier recognition (fast pass, escalated weak lines)
+    double fastCer = 0.0;         ///< Cascade only: CER of the fast tier before escalation
+    double escalationRate = 0.0;  ///< Cascade only: fraction of words escalated
+    bool latex = false;           ///< Equation lines were converted to LaTeX
+    double latexMatch = 0.0;      ///< Fraction of equations whose LaTeX matches the markup
+    double postprocessMs = 0.0;   ///< Median correction and conversion time per page
+};
+
+/**
+ * @brief Drop all whitespace: spacing around operators is not part of the expression
+ */
+QString normalize(const QString& text) {
+    QString normalized;
+    normalized.reserve(text.size());
+    for (const QChar c : text) {
+        if (!c.isSpace()) {
+            normalized.append(c);
+        }
+    }
+    return normalized;
+}
+
+/**
+ * @brief LaTeX a perfect conversion of corpus markup produces, without whitespace
+ *
+ * Script braces ("x^{2}") are LaTeX already; literal braces and "*" are not.
+ */
+QString expectedLatex(const QString& markup) {
+    QString latex;
+    std::vector<bool> scriptBraces;
+    QChar previous;
+    for (const QChar c : markup) {
+        if (c.isSpace()) {
+            continue;
+        }
+        if (c == '{') {
+            const bool script = previous == '^' || previous == '_';
+            scriptBraces.push_back(script);
+            latex += script ? "{" : "\\{";
+        } else if (c == '}') {
+            const bool script = !scriptBraces.empty() && scriptBraces.back();
+            if (!scriptBraces.empty()) {
+                scriptBraces.pop_back();
+            }
+            latex += script ? "}" : "\\}";
+        } else if (c == '*') {
+            latex += "\\cdot";
+        } else {
+            latex += c;
+        }
+        previous = c;
+    }
+    return latex;
+}
+
+/**
+ * @brief Levenshtein distance with a single rolling row
+ */
+int editDistance(const QString& a, const QString& b) {
+    std::vector<int> row(b.size() + 1);
+    for (int j = 0; j <= b.size(); ++j) {
+        row[j] = j;
+    }
+    for (int i = 1; i <= a.size(); ++i) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (int j = 1; j <= b.size(); ++j) {
+            const int above = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                               diagonal + (a.at(i - 1) == b.at(j - 1) ? 0 : 1)});
+            diagonal = above;
+        }
+    }
+    return row[b.size()];
+}
+
+/**
+ * @brief Run the corpus once with one mode and DPI
+ * @param cascade Recognize with the two-tier cascade instead of a single engine
+ */
+ConfigResult runConfig(OCRProcessor& processor, OCRProcessor::ProcessingMode mode, int dpi,
+                       const QList<QImage>& images, const QStringList& truths,
+                       const QStringList& latexTruths, bool verbose, bool cascade = false) {
+    OCRProcessor::OCRConfig config = processor.getConfig();
+    config.mode = mode;
+    config.cascade = cascade;
+    processor.setConfig(config);
+
+    ConfigResult result;
+    result.mode = mode;
+    result.dpi = dpi;
+    result.cascade = cascade;
+    result.name = QString("%1/%2dpi")
+                      .arg(cascade ? "cascade" : OCRProcessor::modeName(mode))
+                      .arg(dpi);
+
+    LatencyHistogram latencyNs;
+    qint64 errors = 0;
+    qint64 characters = 0;
+    qint64 fastErrors = 0;
+    qint64 words = 0;
+    qint64 escalatedWords = 0;
+    int exact = 0;
+    int latexExact = 0;
+    LatencyHistogram postprocessNs;
+    QElapsedTimer timer;
+    QTextStream err(stderr);
+
+    for (int i = 0; i < images.size(); ++i) {
+        timer.start();
+        const OCRProcessor::OCRResult ocr = processor.performOCR(images.at(i));
+        latencyNs.record(timer.nsecsElapsed());
+
+        const QString expected = normalize(truths.at(i));
+        const QString actual = normalize(ocr.text);
+        const int distance = editDistance(actual, expected);
+        errors += distance;
+        characters += expected.size();
+        exact += distance == 0 ? 1 : 0;
+
+        if (!ocr.equations.empty()) {
+            result.latex = true;
+            QString latex;
+            for (const OCRProcessor::Equation& equation : ocr.equations) {
+                latex += equation.latex;
+            }
+            latexExact += normalize(latex) == latexTruths.at(i) ? 1 : 0;
+            postprocessNs.record(ocr.stage(OCRProcessor::Stage::Postprocess).durationNs);
+        }
+
+        if (ocr.cascade.used) {
+            fastErrors += editDistance(normalize(ocr.cascade.fastText), expected);
+            words += ocr.cascade.words;
+            escalatedWords += ocr.cascade.escalatedWords;
+        }
+
+        if (verbose && distance > 0) {
+            err << "  " << result.name << "  expected \"" << truths.at(i) << "\"  got \""
+                << ocr.text.trimmed() << "\"\n";
+        }
+    }
+
+    result.cer = characters ? static_cast<double>(errors) / characters : 0.0;
+    result.exactMatch = images.isEmpty() ? 0.0 : static_cast<double>(exact) / images.size();
+    result.msPerPage = latencyNs.percentile(50) / 1e6;
+    result.fastCer = characters ? static_cast<double>(fastErrors) / characters : 0.0;
+    result.escalationRate = words ? static_cast<double>(escalatedWords) / words : 0.0;
+    result.latexMatch = images.isEmpty() ? 0.0 : static_cast<double>(latexExact) / images.size();
+    result.postprocessMs = result.latex ? postprocessNs.percentile(50) / 1e6 : 0.0;
+    return result;
+}
+
+/**
+ * @brief Mark configurations that no other configuration beats on both axes
+ */
+void markParetoFront(std::vector<ConfigResult>& results) {
+    for (ConfigResult& candidate : results) {
+        candidate.pareto = std::none_of(
+            results.begin(), results.end(), [&candidate](const ConfigResult& other) {
+                const bool noWorse =
+                    other.cer <= candidate.cer && other.msPerPage <= candidate.msPerPage;
+                const bool better =
+                    other.cer < candidate.cer || other.msPerPage < candidate.msPerPage;
+                return noWorse && better;
+            });
+    }
+}
+
+QJsonObject toJson(const std::vector<ConfigResult>& results) {
+    QJsonArray entries;
+    for (const ConfigResult& r : results) {
+        QJsonObject entry{{"name", r.name},
+                          {"mode", OCRProcessor::modeName(r.mode)},
+                          {"dpi", r.dpi},
+                          {"cer", r.cer},
+                          {"exactMatch", r.exactMatch},
+                          {"msPerPage", r.msPerPage},
+                          {"pareto", r.pareto}};
+        if (r.cascade) {
+            entry.insert("fastCer", r.fastCer);
+            entry.insert("escalationRate", r.escalationRate);
+        }
+        if (r.latex) {
+            entry.insert("latexMatch", r.latexMatch);
+            entry.insert("postprocessMs", r.postprocessMs);
+        }
+        entries.append(entry);
+    }
+    return QJsonObject{{"tool", "ocr_accuracy"},
+                       {"corpusSize", OCRTestPages::equationCorpus().size()},
+                       {"results", entries}};
+}
+
+/**
+ * @brief Compare with a baseline report
+ * @return Number of configurations that regressed
+ */
+int compareWithBaseline(const std::vector<ConfigResult>& results, const QJsonObject& baseline,
+                        double maxSlowdownPercent, double maxCerIncrease, QTextStream& out) {
+    QHash<QString, QJsonObject> previous;
+    for (const QJsonValue& value : baseline.value("results").toArray()) {
+        const QJsonObject entry = value.toObject();
+        previous.insert(entry.value("name").toString(), entry);
+    }
+
+    int regressions = 0;
+    for (const ConfigResult& r : results) {
+        if (!previous.contains(r.name)) {
+            out << "  NEW        " << r.name << "\n";
+            continue;
+        }
+        const QJsonObject base = previous.value(r.name);
+        const double baseMs = base.value("msPerPage").toDouble();
+        const double baseCer = base.value("cer").toDouble();
+        const double slowdown = baseMs > 0 ? (r.msPerPage - baseMs) / baseMs * 100.0 : 0.0;
+        const double cerDelta = r.cer - baseCer;
+
+        QStringList problems;
+        if (slowdown > maxSlowdownPercent) {
+            problems << QString("%1% slower").arg(slowdown, 0, 'f', 1);
+        }
+        if (cerDelta > maxCerIncrease) {
+            problems << QString("CER +%1").arg(cerDelta, 0, 'f', 4);
+        }
+
+        if (problems.isEmpty()) {
+            out << "  ok         " << r.name << "\n";
+        } else {
+            out << "  REGRESSION " << r.name << ": " << problems.join(", ") << "\n";
+            ++regressions;
+        }
+    }
+    return regressions;
+}
+
+}  // namespace
+
+/**
+ * @brief Grammar search over `text` with a lookalike offered for every l, I, O, 1 and 0
+ * @param confidence Recognizer confidence of each symbol of `text`; lookalikes get 40
+ */
+QString searchWithLookalikes(const QString& text, float confidence, MathBeamSearch& search) {
+    search.clear();
+    const std::string utf8 = text.toStdString();
+    for (const char c : utf8) {
+        if (c == ' ') {
+            search.addSpace();
+            continue;
+        }
+        const char own[2] = {c, 0};
+        const char* lookalike = c == 'l' || c == 'I' ? "1"
+                                : c == 'O'           ? "0"
+                                : c == '1'           ? "l"
+                                : c == '0'           ? "O"
+                                                     : nullptr;
+        const char* const choices[2] = {own, lookalike};
+        const float confidences[2] = {confidence, 40.0f};
+        search.addSymbol(choices, confidences, lookalike ? 2 : 1);
+    }
+    std::string chosen;
+    return search.run(chosen).parsed ? QString::fromStdString(chosen) : QString();
+}
+
+/**
+ * @brief Check that the grammar search leaves correct equations alone
+ * @return Number of failed checks, each printed to `err`
+ */
+int grammarSelfCheck(const QStringList& truths, QTextStream& err) {
+    QStringList unchanged = {"ln x = 2",  "O(n) = n log n", "I = V / R", "l = 2a + b",
+                             "lim = 0",   "10 = 2 * 5",     "x2 + 1 = 5"};
+    for (const QString& truth : truths) {
+        if (MathGrammar::parses(truth.toStdString())) {
+            unchanged << truth;
+        }
+    }
+
+    int failures = 0;
+    MathBeamSearch search;
+    for (const QString& text : unchanged) {
+        const QString chosen = searchWithLookalikes(text, 90.0f, search);
+        if (chosen != text) {
+            err << "Grammar check: \"" << text << "\" became \"" << chosen << "\"\n";
+            ++failures;
+        }
+    }
+    // A lone l read only a little more confidently than the 1 it stands for is still corrected
+    const QString corrected = searchWithLookalikes("x2 + l = 5", 60.0f, search);
+    if (corrected != "x2 + 1 = 5") {
+        err << "Grammar check: \"x2 + l = 5\" became \"" << corrected << "\"\n";
+        ++failures;
+    }
+    return failures;
+}
+
+/**
+ * @brief Harness entry point
+ */
+int main(int argc, char* argv[]) {
+    // Text rendering needs a GUI application, but no display
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName("ocr_accuracy");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Equation OCR accuracy versus speed per processing mode");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption dpiOption("dpi", "Comma-separated rendering DPIs", "list", "150,300");
+    QCommandLineOption languageOption({"l", "language"}, "Tesseract language code", "lang", "eng");
+    QCommandLineOption baselineOption("baseline", "Compare against a previous report", "file");
+    QCommandLineOption writeBaselineOption("write-baseline", "Write this run's report", "file");
+    QCommandLineOption maxSlowdownOption("max-slowdown", "Allowed ms/page increase in percent",
+                                         "percent", "15");
+    QCommandLineOption maxCerOption("max-cer-increase", "Allowed absolute CER increase", "delta",
+                                    "0.01");
+    QCommandLineOption cascadeOption(
+        "cascade", "Also run the two-tier cascade and report fast-tier versus final CER");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Print every misrecognized equation");
+
+    parser.addOptions({dpiOption, languageOption, baselineOption, writeBaselineOption,
+                       maxSlowdownOption, maxCerOption, cascadeOption, verboseOption});
+    parser.process(app);
+
+    QLoggingCategory::setFilterRules(
+        "ocr.processor.info=false\nocr.processor.debug=false\nocr.processor.warning=false");
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList& corpus = OCRTestPages::equationCorpus();
+    QStringList truths;
+    QStringList latexTruths;
+    for (const QString& markup : corpus) {
+        truths << OCRTestPages::plainText(markup);
+        latexTruths << expectedLatex(markup);
+    }
+    if (grammarSelfCheck(truths, err) > 0) {
+        return 4;
+    }
+
+    OCRProcessor::OCRConfig config;
+    config.language = parser.value(languageOption);
+    config.minimumConfidence = 0;
+    config.extractLayout = false;
+
+    std::unique_ptr<OCRProcessor> processor;
+    try {
+        processor = std::make_unique<OCRProcessor>(config);
+    } catch (const std::exception& e) {
+        err << "Failed to initialize OCR: " << e.what() << "\n";
+        return 2;
+    }
+
+    const QList<OCRProcessor::ProcessingMode> modes = {
+        OCRProcessor::ProcessingMode::Auto, OCRProcessor::ProcessingMode::Text,
+        OCRProcessor::ProcessingMode::Equations, OCRProcessor::ProcessingMode::Mixed};
+
+    std::vector<ConfigResult> results;
+    for (const QString& dpiText : parser.value(dpiOption).split(',', Qt::SkipEmptyParts)) {
+        const int dpi = dpiText.trimmed().toInt();
+        if (dpi <= 0) {
+            err << "Invalid DPI: " << dpiText << "\n";
+            return 1;
+        }
+
+        QList<QImage> images;
+        for (const QString& markup : corpus) {
+            images << OCRTestPages::renderEquation(markup, dpi);
+        }
+
+        for (OCRProcessor::ProcessingMode mode : modes) {
+            results.push_back(runConfig(*processor, mode, dpi, images, truths, latexTruths,
+                                        parser.isSet(verboseOption)));
+        }
+        if (parser.isSet(cascadeOption)) {
+            // Equations mode never cascades: its grammar correction needs the single engine
+            results.push_back(runConfig(*processor, OCRProcessor::ProcessingMode::Text, dpi,
+                                        images, truths, latexTruths, parser.isSet(verboseOption),
+                                        true));
+        }
+    }
+    markParetoFront(results);
+
+    out << QString("%1%2%3%4  %5\n")
+               .arg("configuration", -20)
+               .arg("CER", 10)
+               .arg("exact", 10)
+               .arg("ms/page", 10)
+               .arg("pareto");
+    for (const ConfigResult& r : results) {
+        out << QString("%1%2%3%4  %5\n")
+                   .arg(r.name, -20)
+                   .arg(r.cer, 10, 'f', 4)
+                   .arg(r.exactMatch, 10, 'f', 3)
+                   .arg(r.msPerPage, 10, 'f', 2)
+                   .arg(r.pareto ? "*" : "");
+    }
+    for (const ConfigResult& r : results) {
+        if (r.cascade) {
+            out << QString("%1 fast-tier CER %2 -> final %3, %4% of words escalated\n")
+                       .arg(r.name)
+                       .arg(r.fastCer, 0, 'f', 4)
+                       .arg(r.cer, 0, 'f', 4)
+                       .arg(r.escalationRate * 100.0, 0, 'f', 1);
+        }
+    }
+    for (const ConfigResult& r : results) {
+        if (r.latex) {
+            out << QString("%1 LaTeX exact %2, correction and conversion %3 of %4 ms/page\n")
+                       .arg(r.name)
+                       .arg(r.latexMatch, 0, 'f', 3)
+                       .arg(r.postprocessMs, 0, 'f', 3)
+                       .arg(r.msPerPage, 0, 'f', 2);
+        }
+    }
+
+    const QJsonObject report = toJson(results);
+    if (parser.isSet(writeBaselineOption)) {
+        QFile file(parser.value(writeBaselineOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write " << file.fileName() << "\n";
+            return 1;
+        }
+        file.write(QJsonDocument(report).toJson(QJsonDocument::Indented));
+    }
+
+    if (parser.isSet(baselineOption)) {
+        QFile file(parser.value(baselineOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "Cannot read baseline " << file.fileName() << "\n";
+            return 1;
+        }
+        const QJsonObject baseline = QJsonDocument::fromJson(file.readAll()).object();
+
+        out << "\nComparison with " << file.fileName() << ":\n";
+        const int regressions =
+            compareWithBaseline(results, baseline, parser.value(maxSlowdownOption).toDouble(),
+                                parser.value(maxCerOption).toDouble(), out);
+        if (regressions > 0) {
+            out << regressions << " configuration(s) regressed\n";
+            return 3;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,924 @@
+/*
+ * Project: OCR & PPT Automation Tool - Headless Batch Driver
+ *
+ * Objective:
+ * - Run OCRProcessor over a list of image files and/or directories without a GUI.
+ * - Print one status line per page and, at the end, a per-stage timing table
+ *   (decode, preprocess, convert, layout, recognition) with p50/p95/p99.
+ * - Optionally write the recognized text into an output folder, plus one
+ *   LaTeX line per equation for pages with equation lines.
+ * - Optionally recognize several pages at once on a pool of engines, with
+ *   the CPUs split between workers and Tesseract's own threads. Pages are
+ *   dispatched longest-first by a cost estimated from their headers, huge
+ *   pages can be cut into bands, and the run's makespan is compared with
+ *   FIFO dispatch of the same page times. Workers can be pinned to their own
+ *   cores on a NUMA node (--pin-workers, Linux).
+ * - Optionally keep a journal of finished pages, so a run that was killed
+ *   or crashed can be restarted and skip the pages it already did.
+ * - Optionally keep running after the existing files and recognize new ones
+ *   as they land in the input directories (--watch, Linux), until SIGINT or
+ *   SIGTERM.
+ * - Optionally share one batch between several processes or machines
+ *   through a lease-based queue in a shared directory (--queue, Linux).
+ * - Optionally run the engines in separate, memory-capped worker processes,
+ *   so a page that crashes an engine fails alone (--isolate, Linux).
+ * - Keep in-process engines within a memory budget (by default a share of
+ *   the cgroup limit) and report per-pool peaks, waits and downscaled pages.
+ *
+ * Usage:
+ *   ocr_batch [options] <image|directory>...
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QWaitCondition>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+#ifdef Q_OS_LINUX
+#include <signal.h>
+
+#include "ocrfolderwatcher.h"
+#include "ocrprocesspool.h"
+#include "ocrworkqueue.h"
+#endif
+
+#include "ocrbatchplan.h"
+#include "ocrjournal.h"
+#include "ocrlayout.h"
+#include "ocrmemorybudget.h"
+#include "ocrprocessor.h"
+#include "ocrstatistics.h"
+#include "ocrthreading.h"
+#include "ocrtrace.h"
+
+Q_LOGGING_CATEGORY(batch, "app.batch")
+
+namespace {
+
+#ifdef Q_OS_LINUX
+OCRFolderWatcher* s_watcher = nullptr;
+
+void handleTermination(int) {
+    if (s_watcher) {
+        s_watcher->stop();
+    }
+}
+#endif
+
+/**
+ * @brief Expand files and directories into a sorted list of supported images
+ */
+QStringList collectInputs(const QStringList& arguments, bool recursive) {
+    QStringList files;
+    const QStringList formats = OCRProcessor::getSupportedFormats();
+
+    for (const QString& argument : arguments) {
+        QFileInfo info(argument);
+        if (info.isDir()) {
+            QStringList nameFilters;
+            for (const QString& format : formats) {
+                nameFilters << QString("*.%1").arg(format);
+            }
+            QDirIterator it(
+                argument, nameFilters, QDir::Files,
+                recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+            QStringList directoryFiles;
+            while (it.hasNext()) {
+                directoryFiles << it.next();
+            }
+            directoryFiles.sort();
+            files << directoryFiles;
+        } else {
+            files << argument;
+        }
+    }
+    return files;
+}
+
+/**
+ * @brief Combine the band results of a tiled page into one page result
+ *
+ * Text, equations and layouts (already in page coordinates) are joined top to
+ * bottom, and stage costs, cascade and decode counters add up. Confidence is
+ * weighted by the amount of text each band produced and the scales by band
+ * height; the page counts as budget-scaled by its most reduced band.
+ */
+OCRProcessor::OCRResult mergeTiles(std::vector<OCRProcessor::OCRResult>& tiles) {
+    OCRProcessor::OCRResult page = std::move(tiles.front());
+    double weightedConfidence = page.confidence * page.text.size();
+    qint64 characters = page.text.size();
+    double fastConfidenceSum = page.cascade.fastConfidence * page.cascade.words;
+    const double firstHeight = std::max(1, page.region.height());
+    double scaleSum = page.appliedScale * firstHeight;
+    double heights = firstHeight;
+    double xHeightSum = page.estimatedXHeight * firstHeight;
+    double xHeightHeights = page.estimatedXHeight > 0.0 ? firstHeight : 0.0;
+    std::shared_ptr<OCRLayout> layout;
+    auto appendLayout = [&](const OCRProcessor::OCRResult& tile) {
+        if (tile.layout) {
+            if (!layout) {
+                layout = std::make_shared<OCRLayout>();
+            }
+            layout->appendLayout(*tile.layout);
+        }
+    };
+    appendLayout(page);
+    for (size_t i = 1; i < tiles.size(); ++i) {
+        OCRProcessor::OCRResult& tile = tiles[i];
+        if (!tile.text.isEmpty() && !page.text.isEmpty() && !page.text.endsWith('\n')) {
+            page.text += '\n';
+        }
+        page.text += tile.text;
+        weightedConfidence += tile.confidence * tile.text.size();
+        characters += tile.text.size();
+        if (page.success && !tile.success) {
+            page.errorMessage = tile.errorMessage;
+        }
+        page.success = page.success && tile.success;
+        page.cancelled = page.cancelled || tile.cancelled;
+        page.processingTimeMs += tile.processingTimeMs;
+        page.processingTimeNs += tile.processingTimeNs;
+        for (int s = 0; s < OCRProcessor::kStageCount; ++s) {
+            page.stages[s].durationNs += tile.stages[s].durationNs;
+            page.stages[s].bytesAllocated += tile.stages[s].bytesAllocated;
+        }
+        page.decodedSize = QSize(std::max(page.decodedSize.width(), tile.decodedSize.width()),
+                                 page.decodedSize.height() + tile.decodedSize.height());
+        page.decodeBytesSaved += tile.decodeBytesSaved;
+        page.budgetScale = std::min(page.budgetScale, tile.budgetScale);
+        const double height = std::max(1, tile.region.height());
+        scaleSum += tile.appliedScale * height;
+        heights += height;
+        if (tile.estimatedXHeight > 0.0) {
+            xHeightSum += tile.estimatedXHeight * height;
+            xHeightHeights += height;
+        }
+        page.reusedPreparedImage = page.reusedPreparedImage && tile.reusedPreparedImage;
+        page.reusedLayout = page.reusedLayout && tile.reusedLayout;
+
+        OCRProcessor::CascadeMetrics& cascade = page.cascade;
+        if (tile.cascade.used) {
+            if (cascade.used && !cascade.fastText.isEmpty() && !tile.cascade.fastText.isEmpty()) {
+                cascade.fastText += '\n';
+            }
+            cascade.used = true;
+            cascade.words += tile.cascade.words;
+            cascade.escalatedWords += tile.cascade.escalatedWords;
+            cascade.escalatedLines += tile.cascade.escalatedLines;
+            cascade.fastNs += tile.cascade.fastNs;
+            cascade.escalationNs += tile.cascade.escalationNs;
+            cascade.fastText += tile.cascade.fastText;
+            fastConfidenceSum += tile.cascade.fastConfidence * tile.cascade.words;
+        }
+        page.grammar.lines += tile.grammar.lines;
+        page.grammar.parsedLines += tile.grammar.parsedLines;
+        page.grammar.correctedLines += tile.grammar.correctedLines;
+        page.grammar.overBudgetLines += tile.grammar.overBudgetLines;
+        page.split.proseRegions += tile.split.proseRegions;
+        page.split.mathRegions += tile.split.mathRegions;
+        page.split.proseNs += tile.split.proseNs;
+        page.split.mathNs += tile.split.mathNs;
+        page.split.used = page.split.used || tile.split.used;
+        std::move(tile.equations.begin(), tile.equations.end(),
+                  std::back_inserter(page.equations));
+        appendLayout(tile);
+    }
+    page.region = QRect();
+    page.layout = std::move(layout);
+    page.confidence = characters > 0 ? static_cast<float>(weightedConfidence / characters)
+                                     : page.confidence;
+    if (page.cascade.words > 0) {
+        page.cascade.fastConfidence =
+            static_cast<float>(fastConfidenceSum / page.cascade.words);
+    }
+    page.appliedScale = scaleSum / heights;
+    page.estimatedXHeight = xHeightHeights > 0.0 ? xHeightSum / xHeightHeights : 0.0;
+    page.isBlankPage =
+        page.isBlankPage && std::all_of(tiles.begin() + 1, tiles.end(),
+                                        [](const OCRProcessor::OCRResult& tile) {
+                                            return tile.isBlankPage;
+                                        });
+    return page;
+}
+
+}  // namespace
+
+/**
+ * @brief Headless batch entry point
+ */
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ocr_batch");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Run OCR over images without the GUI");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("inputs", "Image files or directories to process", "<input>...");
+
+    QCommandLineOption modeOption({"m", "mode"}, "Processing mode: auto, text, equations, mixed",
+                                  "mode", "auto");
+    QCommandLineOption languageOption({"l", "language"}, "Tesseract language code", "lang", "eng");
+    QCommandLineOption dpiOption("dpi", "Processing DPI", "dpi", "300");
+    QCommandLineOption minConfidenceOption("min-confidence", "Minimum confidence (0-100)",
+                                           "percent", "60");
+    QCommandLineOption noPreprocessOption("no-preprocess", "Disable image preprocessing");
+    QCommandLineOption noLayoutOption("no-layout", "Skip collecting word/symbol geometry");
+    QCommandLineOption xHeightOption("x-height",
+                                     "Target text x-height in pixels (0 = scale by --dpi only)",
+                                     "pixels", "24");
+    QCommandLineOption blankInkOption("blank-ink",
+                                      "Skip pages with less ink coverage than this (0 = off)",
+                                      "ratio", "0.00002");
+    QCommandLineOption maxEdgeOption("max-edge",
+                                     "Longest image edge to decode, in pixels (0 = unlimited)",
+                                     "pixels", "3508");
+    QCommandLineOption cascadeOption(
+        "cascade", "Fast first pass; re-recognize only low-confidence lines at full quality");
+    QCommandLineOption fastDataOption("fast-data",
+                                      "tessdata_fast directory for the cascade's first pass",
+                                      "dir");
+    QCommandLineOption noGrammarOption("no-grammar",
+                                       "Keep equation lines as recognized (no grammar search)");
+    QCommandLineOption noLatexOption("no-latex", "Skip converting equation lines to LaTeX");
+    QCommandLineOption workersOption(
+        {"j", "workers"}, "Pages recognized in parallel, one engine each (0 = one per CPU)",
+        "count", "1");
+    QCommandLineOption engineThreadsOption(
+        "engine-threads", "OpenMP threads per engine (0 = share the CPUs left by --workers)",
+        "count", "0");
+    QCommandLineOption orderOption(
+        "order", "Dispatch order: longest (estimated cost, largest first) or fifo", "order",
+        "longest");
+    QCommandLineOption tileOption(
+        "tile-megapixels", "Cut pages larger than this into bands for several workers (0 = off)",
+        "megapixels", "0");
+    QCommandLineOption recursiveOption({"r", "recursive"}, "Descend into subdirectories");
+    QCommandLineOption outputDirOption({"o", "output-dir"},
+                                       "Write recognized text as <name>.txt into this directory",
+                                       "dir");
+    QCommandLineOption journalOption(
+        "journal", "Record finished pages in this file and skip them when the run is restarted",
+        "file");
+    QCommandLineOption watchOption(
+        "watch", "Then keep recognizing new files as they land in the input directories");
+    QCommandLineOption debounceOption(
+        "debounce-ms", "With --watch: quiet time after a file's last write before OCR starts",
+        "ms", "50");
+    QCommandLineOption queueOption(
+        "queue", "Share the batch with other ocr_batch processes through this (NFS) directory",
+        "dir");
+    QCommandLineOption chunkOption("chunk-size", "With --queue: inputs per claimed chunk",
+                                   "count", "16");
+    QCommandLineOption leaseOption(
+        "lease-seconds", "With --queue: time after which a silent node's chunks are taken over",
+        "seconds", "120");
+    QCommandLineOption nodeOption("node", "With --queue: node name (default <host>-<pid>)",
+                                  "name");
+    QCommandLineOption isolateOption(
+        "isolate", "Run the engines in worker processes, so a crashing page fails alone");
+    QCommandLineOption workerMemoryOption(
+        "worker-memory-mb", "With --isolate: address-space limit per worker (0 = none)", "MiB",
+        "0");
+    QCommandLineOption pageTimeoutOption(
+        "page-timeout-ms", "With --isolate: kill and restart a worker stuck on a page (0 = off)",
+        "ms", "0");
+    QCommandLineOption pinOption(
+        "pin-workers", "Pin each worker to its own cores, spread over the NUMA nodes (Linux)");
+    QCommandLineOption memoryBudgetOption(
+        "memory-budget-mb", "Memory budget for all engines (0 = from cgroup limit, -1 = none)",
+        "MiB", "0");
+    QCommandLineOption traceOption("trace", "Write a Chrome trace-event JSON file", "file");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Enable OCR processor logging");
+
+    parser.addOptions({modeOption, languageOption, dpiOption, minConfidenceOption,
+                       noPreprocessOption, noLayoutOption, xHeightOption, maxEdgeOption,
+                       blankInkOption, cascadeOption, fastDataOption, noGrammarOption,
+                       noLatexOption, workersOption, engineThreadsOption, orderOption,
+                       tileOption, recursiveOption, outputDirOption, journalOption,
+                       watchOption, debounceOption, queueOption, chunkOption, leaseOption,
+                       nodeOption, isolateOption, workerMemoryOption, pageTimeoutOption,
+                       pinOption, memoryBudgetOption, traceOption, verboseOption});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (!parser.isSet(verboseOption)) {
+        QLoggingCategory::setFilterRules("ocr.processor.info=false\nocr.processor.debug=false");
+    }
+
+    OCRProcessor::OCRConfig config;
+    if (!OCRProcessor::modeFromName(parser.value(modeOption), config.mode)) {
+        err << "Unknown processing mode: " << parser.value(modeOption) << "\n";
+        return 1;
+    }
+    config.language = parser.value(languageOption);
+    config.dpi = parser.value(dpiOption).toInt();
+    config.minimumConfidence = parser.value(minConfidenceOption).toInt();
+    config.preprocessImage = !parser.isSet(noPreprocessOption);
+    config.extractLayout = !parser.isSet(noLayoutOption);
+    config.blankPageInkRatio = std::max(0.0, parser.value(blankInkOption).toDouble());
+    config.targetXHeight = std::max(0, parser.value(xHeightOption).toInt());
+    config.maxDecodeLongEdge = std::max(0, parser.value(maxEdgeOption).toInt());
+    config.cascade = parser.isSet(cascadeOption) || parser.isSet(fastDataOption);
+    config.fastDataPath = parser.value(fastDataOption);
+    config.grammarSearch = !parser.isSet(noGrammarOption);
+    config.equationLatex = !parser.isSet(noLatexOption);
+    const qint64 budgetMb = parser.value(memoryBudgetOption).toLongLong();
+    config.memoryBudgetBytes = budgetMb > 0 ? budgetMb << 20 : budgetMb;
+
+    // Decide the thread split before any engine exists; this may restart the program
+    const OCRThreading::CpuInfo cpus = OCRThreading::detectCpus();
+    OCRThreading::Plan plan =
+        OCRThreading::makePlan(parser.value(workersOption).toInt(),
+                               parser.value(engineThreadsOption).toInt(), cpus);
+    if (plan.workers > 1 || parser.value(engineThreadsOption).toInt() > 0) {
+        OCRThreading::applyEngineThreads(plan.engineThreads);
+    }
+    // Isolated engines run in worker processes, which are not pinned
+    plan.pinWorkers = parser.isSet(pinOption) && !parser.isSet(isolateOption);
+    OCRThreading::setPlan(plan);
+
+    const bool watch = parser.isSet(watchOption);
+    const bool queueing = parser.isSet(queueOption);
+    const bool isolate = parser.isSet(isolateOption);
+#ifndef Q_OS_LINUX
+    if (watch || queueing || isolate) {
+        err << "--watch, --queue and --isolate are only available on Linux\n";
+        return 1;
+    }
+#endif
+    if (queueing && (watch || parser.isSet(journalOption))) {
+        err << "--queue cannot be combined with --watch or --journal\n";
+        return 1;
+    }
+#ifdef Q_OS_LINUX
+    // Watch before the existing files are listed, so nothing landing meanwhile is missed;
+    // a file both listed and reported is skipped by its fingerprint
+    std::unique_ptr<OCRFolderWatcher> watcher;
+    if (watch) {
+        QString error;
+        try {
+            watcher = std::make_unique<OCRFolderWatcher>(OCRProcessor::getSupportedFormats(),
+                                                         parser.value(debounceOption).toInt());
+            for (const QString& argument : parser.positionalArguments()) {
+                if (QFileInfo(argument).isDir() &&
+                    !watcher->addDirectory(argument, parser.isSet(recursiveOption), &error)) {
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        if (!error.isEmpty()) {
+            err << error << "\n";
+            return 1;
+        }
+        s_watcher = watcher.get();
+        struct sigaction action = {};
+        action.sa_handler = handleTermination;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+#endif
+    const QStringList arguments =
+        collectInputs(parser.positionalArguments(), parser.isSet(recursiveOption));
+    // A node joining an existing queue needs no inputs of its own
+    if (arguments.isEmpty() && !watch && !queueing) {
+        parser.showHelp(1);
+    }
+    const QString order = parser.value(orderOption);
+    if (order != "longest" && order != "fifo") {
+        err << "Unknown dispatch order: " << order << "\n";
+        return 1;
+    }
+
+    QDir outputDir;
+    const bool writeText = parser.isSet(outputDirOption);
+    if (writeText) {
+        outputDir.setPath(parser.value(outputDirOption));
+        if (!outputDir.mkpath(".")) {
+            err << "Cannot create output directory: " << outputDir.path() << "\n";
+            return 1;
+        }
+    }
+    auto textPath = [&](const QString& input) {
+        return outputDir.filePath(QFileInfo(input).completeBaseName() + ".txt");
+    };
+
+#ifdef Q_OS_LINUX
+    std::unique_ptr<OCRWorkQueue> workQueue;
+    if (queueing) {
+        OCRWorkQueue::Options queueOptions;
+        queueOptions.directory = parser.value(queueOption);
+        queueOptions.chunkSize = parser.value(chunkOption).toInt();
+        queueOptions.leaseSeconds = parser.value(leaseOption).toInt();
+        queueOptions.node = parser.value(nodeOption);
+        workQueue = std::make_unique<OCRWorkQueue>(queueOptions);
+        QString error;
+        if (!workQueue->open(arguments, &error)) {
+            err << error << "\n";
+            return 1;
+        }
+        out << "Queue " << queueOptions.directory << ": node " << workQueue->node() << ", "
+            << workQueue->inputs().size() << " input(s) in " << workQueue->chunkCount()
+            << " chunk(s)\n";
+    }
+#endif
+
+    // Skip what a previous run finished; one stat() and a hash lookup per input
+    std::unique_ptr<OCRJournal> journal;
+    QStringList inputs = queueing ? QStringList() : arguments;  // Queued pages come from chunks
+    std::vector<OCRJournal::Fingerprint> fingerprints;
+    if (parser.isSet(journalOption)) {
+        journal = std::make_unique<OCRJournal>(parser.value(journalOption));
+        QString error;
+        if (!journal->open(&error)) {
+            err << error << "\n";
+            return 1;
+        }
+        inputs.clear();
+        int resumed = 0;
+        for (const QString& input : arguments) {
+            const OCRJournal::Fingerprint fingerprint = OCRJournal::fingerprint(input);
+            const OCRJournal::Entry* done = journal->find(fingerprint);
+            if (!done) {
+                inputs.append(input);
+                fingerprints.push_back(fingerprint);
+                continue;
+            }
+            ++resumed;
+            // Output lost since the last run comes back from the journal, not from OCR
+            if (writeText && done->textBytes > 0 && !QFileInfo::exists(textPath(input))) {
+                QFile textFile(textPath(input));
+                if (textFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                    textFile.write(journal->text(*done).toUtf8());
+                }
+            }
+        }
+        out << "Journal " << journal->path() << ": " << resumed << " of " << arguments.size()
+            << " input(s) already finished\n";
+        if (inputs.isEmpty() && !watch) {
+            return 0;
+        }
+    }
+
+    // Only headers are read here; bands are only worth it with workers to share them
+    const std::vector<OCRBatchPlan::WorkUnit> units = OCRBatchPlan::plan(
+        inputs, config.maxDecodeLongEdge,
+        plan.workers > 1 ? std::max(0.0, parser.value(tileOption).toDouble()) : 0.0,
+        plan.workers);
+    std::vector<int> dispatchOrder(units.size());
+    std::iota(dispatchOrder.begin(), dispatchOrder.end(), 0);
+    const std::vector<int> longestFirst = OCRBatchPlan::longestFirst(units);
+    if (order == "longest") {
+        dispatchOrder = longestFirst;
+    }
+
+    // Start tracing before engine initialization so Init() shows up in the trace
+    const bool tracing = parser.isSet(traceOption) ? OCRTrace::start(parser.value(traceOption))
+                                                   : OCRTrace::startFromEnvironment();
+    OCRTrace::setThreadName("batch main");
+
+    const int workers =
+        watch || queueing ? plan.workers : std::min<int>(plan.workers, units.size());
+    std::unique_ptr<OCRWorkerPool> pool;
+#ifdef Q_OS_LINUX
+    std::unique_ptr<OCRProcessPool> processPool;
+#endif
+    try {
+        OCR_TRACE_SCOPE("engine init", "ocr,init");
+#ifdef Q_OS_LINUX
+        if (isolate) {
+            // The pool's threads only dispatch; each waits on its worker process
+            OCRProcessPool::Options poolOptions;
+            poolOptions.workerArguments =
+                OCRProcessPool::engineArguments(config, plan.engineThreads);
+            poolOptions.workers = std::max(1, workers);
+            poolOptions.memoryLimitBytes =
+                std::max<qint64>(0, parser.value(workerMemoryOption).toLongLong()) << 20;
+            poolOptions.timeoutMs = std::max(0, parser.value(pageTimeoutOption).toInt());
+            processPool = std::make_unique<OCRProcessPool>(poolOptions);
+            pool = std::make_unique<OCRWorkerPool>(workers);
+        }
+#endif
+        if (!pool) {
+            pool = std::make_unique<OCRWorkerPool>(config, workers);
+        }
+    } catch (const std::exception& e) {
+        err << "Failed to initialize OCR: " << e.what() << "\n";
+        OCRTrace::stop();
+        return 2;
+    }
+
+    qCInfo(batch) << "Processing" << inputs.size() << "input(s) with"
+                  << OCRThreading::describe(plan, cpus);
+
+    // A region is a band of a tiled page; each worker decodes only its band
+    auto recognize = [&](int worker, const QString& input, const QRect& region) {
+#ifdef Q_OS_LINUX
+        if (processPool) {
+            return processPool->recognize(input, region, config.mode, true);
+        }
+#endif
+        OCRProcessor& processor = pool->engine(worker);
+        return region.isNull() ? processor.performOCR(input)
+                               : processor.performOCRBand(input, region);
+    };
+
+    OCRStageStatistics statistics;
+    int failures = 0;
+    int blankPages = 0;
+    qint64 decodeBytesSaved = 0;
+    OCRProcessor::CascadeMetrics cascadeTotals;
+    OCRProcessor::GrammarMetrics grammarTotals;
+    double fastConfidenceSum = 0.0;
+    double finalConfidenceSum = 0.0;
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    auto report = [&](const QString& input, const OCRProcessor::OCRResult& result) {
+        statistics.add(result);
+        decodeBytesSaved += result.decodeBytesSaved;
+        if (result.cascade.used) {
+            const OCRProcessor::CascadeMetrics& cascade = result.cascade;
+            cascadeTotals.words += cascade.words;
+            cascadeTotals.escalatedWords += cascade.escalatedWords;
+            cascadeTotals.escalatedLines += cascade.escalatedLines;
+            cascadeTotals.fastNs += cascade.fastNs;
+            cascadeTotals.escalationNs += cascade.escalationNs;
+            fastConfidenceSum += cascade.fastConfidence * cascade.words;
+            finalConfidenceSum += result.confidence * cascade.words;
+        }
+        grammarTotals.lines += result.grammar.lines;
+        grammarTotals.parsedLines += result.grammar.parsedLines;
+        grammarTotals.correctedLines += result.grammar.correctedLines;
+        grammarTotals.overBudgetLines += result.grammar.overBudgetLines;
+
+        if (result.isBlankPage) {
+            out << "BLANK " << input << "  " << result.processingTimeMs << " ms\n";
+            out.flush();
+            ++blankPages;
+            return;
+        }
+
+        out << (result.success ? "OK  " : "FAIL") << "  " << input << "  "
+            << QString::number(result.confidence, 'f', 1) << "%  " << result.processingTimeMs
+            << " ms  scale " << QString::number(result.appliedScale, 'f', 2);
+        if (result.estimatedXHeight > 0) {
+            out << " (x-height " << QString::number(result.estimatedXHeight, 'f', 1) << " px)";
+        }
+        if (result.budgetScale < 1.0) {
+            out << "  budget " << QString::number(result.budgetScale, 'f', 2);
+        }
+        if (result.split.used) {
+            out << "  regions " << result.split.proseRegions << " prose / "
+                << result.split.mathRegions << " math";
+        }
+        if (!result.success) {
+            out << "  (" << result.errorMessage << ")";
+            ++failures;
+        }
+        out << "\n";
+        out.flush();
+
+        if (writeText && !result.text.isEmpty()) {
+            QFile textFile(textPath(input));
+            if (textFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                textFile.write(result.text.toUtf8());
+            } else {
+                err << "Cannot write " << textFile.fileName() << "\n";
+            }
+        }
+        if (writeText && !result.equations.empty()) {
+            QFile latexFile(outputDir.filePath(QFileInfo(input).completeBaseName() + ".tex"));
+            if (latexFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                for (const OCRProcessor::Equation& equation : result.equations) {
+                    // Lines that did not parse keep their text as a comment
+                    const QString line = equation.latex.isEmpty() ? "% " + equation.text
+                                                                  : equation.latex;
+                    latexFile.write((line + "\n").toUtf8());
+                }
+            } else {
+                err << "Cannot write " << latexFile.fileName() << "\n";
+            }
+        }
+    };
+
+    // Pages are reported in input order, whichever worker finishes first
+    std::vector<std::unique_ptr<OCRProcessor::OCRResult>> finished(inputs.size());
+    std::vector<std::vector<OCRProcessor::OCRResult>> tileResults(inputs.size());
+    std::vector<int> tilesLeft(inputs.size(), 0);
+    for (const OCRBatchPlan::WorkUnit& unit : units) {
+        tileResults[unit.page].resize(static_cast<size_t>(unit.tileCount));
+        tilesLeft[unit.page] = unit.tileCount;
+    }
+    std::vector<qint64> unitUs(units.size(), 0);
+    std::vector<qint64> pageStartNs(inputs.size(), -1);  ///< runClock time of a page's first band
+    int nextToReport = 0;
+    QMutex reportMutex;
+    // Files already dispatched, by absolute path, as they were; guarded by reportMutex
+    QHash<QString, OCRJournal::Fingerprint> dispatched;
+    QElapsedTimer runClock;
+    runClock.start();
+    pool->run(dispatchOrder, [&](int worker, int index) {
+        const OCRBatchPlan::WorkUnit& unit = units[index];
+        const QString& input = inputs.at(unit.page);
+        OCRTraceScope pageScope("page", "batch", input);
+        if (watch) {
+            // The rescan after an inotify overflow reports this file again
+            const QString path = QFileInfo(input).absoluteFilePath();
+            const OCRJournal::Fingerprint fingerprint = OCRJournal::fingerprint(input);
+            QMutexLocker locker(&reportMutex);
+            dispatched.insert(path, fingerprint);
+        }
+        const qint64 startNs = runClock.nsecsElapsed();
+        OCRProcessor::OCRResult result = recognize(worker, input, unit.region);
+        const qint64 endNs = runClock.nsecsElapsed();
+
+        QMutexLocker locker(&reportMutex);
+        unitUs[index] = (endNs - startNs) / 1000;
+        qint64& pageStart = pageStartNs[unit.page];
+        pageStart = pageStart < 0 ? startNs : std::min(pageStart, startNs);
+        tileResults[unit.page][unit.tile] = std::move(result);
+        if (--tilesLeft[unit.page] == 0) {
+            auto page =
+                std::make_unique<OCRProcessor::OCRResult>(mergeTiles(tileResults[unit.page]));
+            if (unit.tileCount > 1) {
+                // Bands run in parallel: the page took from its first band's start to now
+                page->processingTimeNs = endNs - pageStart;
+                page->processingTimeMs = static_cast<int>(page->processingTimeNs / 1000000);
+            }
+            finished[unit.page] = std::move(page);
+            tileResults[unit.page].clear();
+        }
+        while (nextToReport < inputs.size() && finished[nextToReport]) {
+            const OCRProcessor::OCRResult& page = *finished[nextToReport];
+            report(inputs.at(nextToReport), page);
+            // Recorded after its output files, so a recorded page never lacks them
+            if (journal && (page.success || page.isBlankPage)) {
+                journal->record(inputs.at(nextToReport), fingerprints[nextToReport], page);
+            }
+            finished[nextToReport].reset();
+            ++nextToReport;
+        }
+    });
+    const qint64 makespanUs = runClock.nsecsElapsed() / 1000;
+
+    int watchedPages = 0;
+    int queuedPages = 0;
+    qint64 startLatencySumMs = 0;
+    qint64 startLatencyMaxMs = 0;
+#ifdef Q_OS_LINUX
+    if (watcher) {
+        out << "Watching for new files; SIGINT or SIGTERM stops after the queued ones\n";
+        out.flush();
+        // A reader thread feeds landed files to the first free engine, in landing order
+        std::deque<OCRFolderWatcher::Ready> arrivals;
+        QHash<int, OCRFolderWatcher::Ready> taken;
+        int nextArrival = 0;
+        bool watching = true;
+        QMutex queueMutex;
+        QWaitCondition queueChanged;
+        std::thread reader([&] {
+            OCRTrace::setThreadName("watch");
+            for (;;) {
+                std::vector<OCRFolderWatcher::Ready> ready = watcher->wait();
+                QMutexLocker locker(&queueMutex);
+                watching = !ready.empty();
+                std::move(ready.begin(), ready.end(), std::back_inserter(arrivals));
+                queueChanged.wakeAll();
+                if (!watching) {
+                    return;
+                }
+            }
+        });
+
+        pool->serve(
+            [&](int& index) {
+                QMutexLocker locker(&queueMutex);
+                while (arrivals.empty() && watching) {
+                    queueChanged.wait(&queueMutex);
+                }
+                if (arrivals.empty()) {
+                    return false;
+                }
+                index = nextArrival++;
+                taken.insert(index, std::move(arrivals.front()));
+                arrivals.pop_front();
+                return true;
+            },
+            [&](int worker, int index) {
+                OCRFolderWatcher::Ready file;
+                {
+                    QMutexLocker locker(&queueMutex);
+                    file = taken.take(index);
+                }
+                const qint64 startLatencyMs = file.landed.elapsed();
+                const OCRJournal::Fingerprint fingerprint = OCRJournal::fingerprint(file.path);
+                {
+                    // Already taken, e.g. found again by the rescan after a queue overflow;
+                    // a rewritten file has a new fingerprint and is recognized again
+                    QMutexLocker locker(&reportMutex);
+                    const auto seen = dispatched.constFind(file.path);
+                    if ((seen != dispatched.constEnd() && *seen == fingerprint) ||
+                        (journal && journal->find(fingerprint))) {
+                        return;
+                    }
+                    dispatched.insert(file.path, fingerprint);
+                }
+                OCRTraceScope pageScope("page", "watch", file.path);
+                const OCRProcessor::OCRResult result = recognize(worker, file.path, QRect());
+
+                QMutexLocker locker(&reportMutex);
+                report(file.path, result);
+                if (journal && (result.success || result.isBlankPage)) {
+                    journal->record(file.path, fingerprint, result);
+                }
+                ++watchedPages;
+                startLatencySumMs += startLatencyMs;
+                startLatencyMaxMs = std::max(startLatencyMaxMs, startLatencyMs);
+            });
+        reader.join();
+        s_watcher = nullptr;
+    }
+
+    if (workQueue) {
+        // Workers claim a chunk when they run dry and report pages as they finish
+        std::deque<int> claimedPages;
+        QHash<int, int> chunkPagesLeft;
+        QMutex claimMutex;
+        pool->serve(
+            [&](int& page) {
+                QMutexLocker locker(&claimMutex);
+                for (;;) {
+                    if (!claimedPages.empty()) {
+                        page = claimedPages.front();
+                        claimedPages.pop_front();
+                        return true;
+                    }
+                    int chunk = -1;
+                    const OCRWorkQueue::Claim claim = workQueue->claim(chunk);
+                    if (claim == OCRWorkQueue::Claim::Finished) {
+                        return false;
+                    }
+                    if (claim == OCRWorkQueue::Claim::Claimed) {
+                        for (int p = workQueue->firstPage(chunk); p < workQueue->endPage(chunk);
+                             ++p) {
+                            claimedPages.push_back(p);
+                        }
+                        QMutexLocker reportLocker(&reportMutex);
+                        chunkPagesLeft.insert(chunk, workQueue->endPage(chunk) -
+                                                         workQueue->firstPage(chunk));
+                        continue;
+                    }
+                    // Other nodes hold the rest; keep checking in case one of them dies
+                    locker.unlock();
+                    std::this_thread::sleep_for(workQueue->pollInterval());
+                    locker.relock();
+                }
+            },
+            [&](int worker, int page) {
+                const QString& input = workQueue->inputs().at(page);
+                OCRTraceScope pageScope("page", "queue", input);
+                const OCRProcessor::OCRResult result = recognize(worker, input, QRect());
+
+                QMutexLocker locker(&reportMutex);
+                report(input, result);
+                workQueue->record(page, result);
+                ++queuedPages;
+                const int chunk = workQueue->chunkOf(page);
+                if (--chunkPagesLeft[chunk] == 0) {
+                    chunkPagesLeft.remove(chunk);
+                    workQueue->complete(chunk);
+                }
+            });
+    }
+#endif
+    if (journal && !journal->sync()) {
+        err << "Cannot sync journal " << journal->path() << "\n";
+    }
+
+    const qint64 elapsedMs = wallClock.elapsed();
+    out << "\n" << statistics.formatTable();
+    const int pages = static_cast<int>(inputs.size()) + watchedPages + queuedPages;
+    if (blankPages > 0) {
+        err << blankPages << " page(s) skipped as blank without recognition; "
+            << "--blank-ink 0 recognizes every page\n";
+    }
+    out << "Pages: " << pages << "  failed: " << failures << "  blank: " << blankPages
+        << "  wall time: " << elapsedMs << " ms";
+    if (elapsedMs > 0) {
+        out << "  (" << QString::number(pages * 1000.0 / elapsedMs, 'f', 2) << " pages/s)";
+    }
+    out << "\n";
+    out << "Threads: " << OCRThreading::describe(plan, cpus) << "\n";
+    if (watch) {
+        out << "Watched: " << watchedPages << " new page(s)";
+        if (watchedPages > 0) {
+            out << ", OCR started " << startLatencySumMs / watchedPages << " ms (max "
+                << startLatencyMaxMs << " ms) after a file's first event";
+        }
+#ifdef Q_OS_LINUX
+        out << ", " << watcher->overflows() << " event queue overflow(s)";
+#endif
+        out << "\n";
+    }
+#ifdef Q_OS_LINUX
+    if (workQueue) {
+        out << "Queue: " << queuedPages << " page(s) on node " << workQueue->node() << ", "
+            << workQueue->takenOver() << " chunk(s) taken over, " << workQueue->lost()
+            << " lost\n";
+        // Every node tries; the last one to finish finds all chunks done
+        OCRWorkQueue::MergeSummary merge;
+        QString error;
+        if (workQueue->merge(merge, &error)) {
+            if (merge.merged) {
+                out << "Merged " << merge.pages << " page(s) from " << merge.shards
+                    << " shard(s) into " << workQueue->resultsPath() << " ("
+                    << merge.duplicates << " duplicate(s) dropped)\n";
+            }
+        } else {
+            out << "Not merged: " << error << "\n";
+        }
+    }
+#endif
+#ifdef Q_OS_LINUX
+    if (processPool) {
+        out << "Isolation: " << processPool->size() << " worker process(es), "
+            << processPool->restarts() << " restart(s) after crashes or timeouts\n";
+    }
+#endif
+    if (pool->size() > 1 && !units.empty()) {
+        // Replaying the measured unit times isolates the effect of the dispatch order
+        std::vector<int> fifo(units.size());
+        std::iota(fifo.begin(), fifo.end(), 0);
+        const qint64 totalUs = std::accumulate(unitUs.begin(), unitUs.end(), qint64(0));
+        const qint64 lowerBoundUs =
+            std::max(totalUs / pool->size(), *std::max_element(unitUs.begin(), unitUs.end()));
+        const int tiledPages = static_cast<int>(std::count_if(
+            units.begin(), units.end(),
+            [](const OCRBatchPlan::WorkUnit& unit) { return unit.tile == 1; }));
+        out << "Makespan: " << makespanUs / 1000 << " ms, " << order << " dispatch of "
+            << units.size() << " units (" << tiledPages << " pages in bands); same unit times: "
+            << "FIFO "
+            << OCRBatchPlan::simulateMakespan(unitUs, fifo, pool->size()) / 1000
+            << " ms, longest-first "
+            << OCRBatchPlan::simulateMakespan(unitUs, longestFirst, pool->size()) / 1000
+            << " ms, lower bound " << lowerBoundUs / 1000 << " ms\n";
+    }
+    const OCRMemoryBudget::Usage memory = OCRMemoryBudget::usage();
+    if (memory.admissions > 0) {
+        const auto mib = [](qint64 bytes) { return QString::number(bytes / 1048576.0, 'f', 1); };
+        out << "Memory: budget "
+            << (memory.limitBytes > 0 ? mib(memory.limitBytes) + " MiB" : QString("none"))
+            << ", peak " << mib(memory.peakTotalBytes) << " MiB (working "
+            << mib(memory.peakBytes[0]) << ", prepared " << mib(memory.peakBytes[1])
+            << ", engines " << mib(memory.peakBytes[2]) << "); " << memory.waits << " of "
+            << memory.admissions << " page(s) waited " << memory.waitNs / 1000000 << " ms, "
+            << memory.downscales << " downscaled, " << memory.overcommits << " over budget\n";
+    }
+    out << "Decode-time downscaling saved "
+        << QString::number(decodeBytesSaved / 1048576.0, 'f', 1) << " MiB of pixel buffers\n";
+    if (cascadeTotals.words > 0) {
+        const double words = cascadeTotals.words;
+        out << "Cascade: " << cascadeTotals.escalatedWords << " of " << cascadeTotals.words
+            << " words escalated ("
+            << QString::number(100.0 * cascadeTotals.escalatedWords / words, 'f', 1) << "%, "
+            << cascadeTotals.escalatedLines << " lines)  fast tier "
+            << cascadeTotals.fastNs / 1000000 << " ms, escalation "
+            << cascadeTotals.escalationNs / 1000000 << " ms  confidence "
+            << QString::number(fastConfidenceSum / words, 'f', 1) << "% -> "
+            << QString::number(finalConfidenceSum / words, 'f', 1) << "%\n";
+    }
+    if (grammarTotals.lines > 0) {
+        out << "Grammar: " << grammarTotals.parsedLines << " of " << grammarTotals.lines
+            << " equation lines parse, " << grammarTotals.correctedLines << " corrected, "
+            << grammarTotals.overBudgetLines << " over budget\n";
+    }
+
+    if (tracing) {
+        OCRTrace::stop();
+    }
+
+    return failures == 0 ? 0 : 3;
+}
@@ -0,0 +1,501 @@
+/*
+ * Project: OCR & PPT Automation Tool - OCR Microbenchmark
+ *
+ * Objective:
+ * - Render deterministic test pages (paragraphs, equations, mixed) at several
+ *   DPIs and page sizes with QPainter; no image files or network access needed.
+ * - Measure OCRProcessor::performOCR latency percentiles, throughput per core
+ *   and peak resident memory for every configuration.
+ * - Emit JSON so two builds can be compared by diffing their reports.
+ * - For equation pages, report equation correction and LaTeX conversion
+ *   (the postprocess stage) as a share of recognition time.
+ * - With --compare-threading, run the same pages once as a pool of
+ *   single-threaded engines and once as one engine with all CPUs, each in a
+ *   child process (the OpenMP thread limit is fixed per process).
+ * - With --compare-placement, run the same pool once with free-floating
+ *   workers and once with every worker pinned to its own cores, spread over
+ *   the NUMA nodes (--pin-workers).
+ *
+ * Usage:
+ *   ocr_bench [--iterations N] [--threads T] [--engine-threads E] [--pin-workers]
+ *             [--quick] [--output report.json]
+ *   ocr_bench --compare-threading [--quick]
+ *   ocr_bench --compare-placement [--quick]
+ */
+
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QSysInfo>
+#include <QTextStream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ocrprocessor.h"
+#include "ocrstatistics.h"
+#include "ocrtestpages.h"
+#include "ocrthreading.h"
+#include "ocrtrace.h"
+
+Q_LOGGING_CATEGORY(bench, "app.bench")
+
+namespace {
+
+/**
+ * @brief One benchmark configuration
+ */
+struct BenchConfig {
+    OCRTestPages::PageKind kind;
+    int dpi;
+    QString sizeName;
+    QSizeF sizeInches;
+    OCRProcessor::ProcessingMode mode;
+};
+
+/**
+ * @brief Matching processing mode for a synthetic page kind
+ */
+OCRProcessor::ProcessingMode modeFor(OCRTestPages::PageKind kind) {
+    switch (kind) {
+        case OCRTestPages::PageKind::Paragraphs:
+            return OCRProcessor::ProcessingMode::Text;
+        case OCRTestPages::PageKind::Equations:
+            return OCRProcessor::ProcessingMode::Equations;
+        case OCRTestPages::PageKind::Mixed:
+            return OCRProcessor::ProcessingMode::Mixed;
+    }
+    return OCRProcessor::ProcessingMode::Auto;
+}
+
+/**
+ * @brief Build the configuration matrix
+ */
+std::vector<BenchConfig> benchMatrix(bool quick) {
+    const QList<int> dpis = quick ? QList<int>{300} : QList<int>{150, 300};
+    const QList<QPair<QString, QSizeF>> sizes =
+        quick ? QList<QPair<QString, QSizeF>>{{"crop", QSizeF(4.0, 3.0)}}
+              : QList<QPair<QString, QSizeF>>{{"crop", QSizeF(4.0, 3.0)},
+                                              {"letter", QSizeF(8.5, 11.0)}};
+    const QList<OCRTestPages::PageKind> kinds = {OCRTestPages::PageKind::Paragraphs,
+                                                 OCRTestPages::PageKind::Equations,
+                                                 OCRTestPages::PageKind::Mixed};
+
+    std::vector<BenchConfig> matrix;
+    for (OCRTestPages::PageKind kind : kinds) {
+        for (int dpi : dpis) {
+            for (const auto& size : sizes) {
+                matrix.push_back({kind, dpi, size.first, size.second, modeFor(kind)});
+            }
+        }
+    }
+    return matrix;
+}
+
+/**
+ * @brief Read a "VmXXX:" field (KiB) from /proc/self/status; -1 where unavailable
+ */
+qint64 readProcStatusKiB(const char* field) {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return -1;
+    }
+    const QByteArray prefix(field);
+    for (const QByteArray& line : status.readAll().split('\n')) {
+        if (line.startsWith(prefix)) {
+            return line.mid(prefix.size()).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Reset the kernel's peak RSS watermark so each configuration is measured alone
+ */
+void resetPeakRss() {
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly)) {
+        clearRefs.write("5");
+    }
+}
+
+QString configName(const BenchConfig& config) {
+    return QString("%1/%2dpi/%3/%4")
+        .arg(OCRTestPages::kindName(config.kind))
+        .arg(config.dpi)
+        .arg(config.sizeName)
+        .arg(OCRProcessor::modeName(config.mode));
+}
+
+QJsonObject histogramToJson(const LatencyHistogram& histogram, double scale) {
+    return QJsonObject{{"count", histogram.count()},
+                       {"p50", histogram.percentile(50) * scale},
+                       {"p95", histogram.percentile(95) * scale},
+                       {"p99", histogram.percentile(99) * scale},
+                       {"mean", histogram.mean() * scale},
+                       {"min", histogram.min() * scale},
+                       {"max", histogram.max() * scale}};
+}
+
+/**
+ * @brief Run one configuration on `threads` workers, each with its own engine
+ */
+QJsonObject runConfig(const BenchConfig& config, int iterations, int warmup,
+                      const OCRThreading::Plan& plan, const QString& language) {
+    OCRTestPages::PageSpec spec;
+    spec.kind = config.kind;
+    spec.dpi = config.dpi;
+    spec.sizeInches = config.sizeInches;
+    const OCRTestPages::Page page = OCRTestPages::render(spec);
+
+    OCRProcessor::OCRConfig ocrConfig;
+    ocrConfig.mode = config.mode;
+    ocrConfig.language = language;
+    ocrConfig.dpi = 300;
+    ocrConfig.minimumConfidence = 0;
+
+    // Engines are created up front: Init() cost is not part of the measurement
+    OCRWorkerPool pool(ocrConfig, plan.workers);
+    for (int t = 0; t < pool.size(); ++t) {
+        // Buffers an engine allocates on first use belong on its node too
+        const OCRThreading::ThreadPin pin(pool.placement(t));
+        for (int w = 0; w < warmup; ++w) {
+            pool.engine(t).performOCR(page.image);
+        }
+    }
+
+    resetPeakRss();
+
+    QMutex statsMutex;
+    OCRStageStatistics statistics;
+    LatencyHistogram latencyNs;
+    double confidenceSum = 0.0;
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+    pool.run(iterations, [&](OCRProcessor& engine, int) {
+        QElapsedTimer timer;
+        timer.start();
+        const OCRProcessor::OCRResult result = engine.performOCR(page.image);
+        const qint64 elapsedNs = timer.nsecsElapsed();
+
+        QMutexLocker locker(&statsMutex);
+        latencyNs.record(elapsedNs);
+        statistics.add(result);
+        confidenceSum += result.confidence;
+    });
+    const double wallSeconds = wallClock.nsecsElapsed() / 1e9;
+
+    const double pagesPerSecond = wallSeconds > 0 ? iterations / wallSeconds : 0.0;
+
+    QJsonObject stages;
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        const auto stage = static_cast<OCRProcessor::Stage>(i);
+        stages.insert(OCRProcessor::stageName(stage),
+                      histogramToJson(statistics.durations(stage), 1e-6));
+    }
+
+    // Equation correction and conversion must stay small next to recognition; stages only
+    // hold the pages they ran on, so compare totals rather than means
+    const LatencyHistogram& recognition = statistics.durations(OCRProcessor::Stage::Recognition);
+    const LatencyHistogram& postprocess = statistics.durations(OCRProcessor::Stage::Postprocess);
+    const double recognitionNs = recognition.mean() * recognition.count();
+    const double postprocessShare =
+        recognitionNs > 0 ? postprocess.mean() * postprocess.count() / recognitionNs : 0.0;
+
+    return QJsonObject{{"name", configName(config)},
+                       {"kind", OCRTestPages::kindName(config.kind)},
+                       {"dpi", config.dpi},
+                       {"size", config.sizeName},
+                       {"width", page.image.width()},
+                       {"height", page.image.height()},
+                       {"mode", OCRProcessor::modeName(config.mode)},
+                       {"threads", plan.workers},
+                       {"engineThreads", plan.engineThreads},
+                       {"pinned", plan.pinWorkers},
+                       {"iterations", iterations},
+                       {"latencyMs", histogramToJson(latencyNs, 1e-6)},
+                       {"stagesMs", stages},
+                       {"pagesPerSecond", pagesPerSecond},
+                       {"pagesPerSecondPerCore",
+                        pagesPerSecond / (plan.workers * plan.engineThreads)},
+                       {"peakRssKiB", readProcStatusKiB("VmHWM:")},
+                       {"postprocessShare", postprocessShare},
+                       {"meanConfidence", iterations ? confidenceSum / iterations : 0.0}};
+}
+
+/**
+ * @brief Write the report to `path`, or to stdout when it is empty
+ * @return Process exit code
+ */
+int writeReport(const QJsonObject& report, const QString& path, QTextStream& err) {
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (path.isEmpty()) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        err << "Cannot write " << file.fileName() << "\n";
+        return 1;
+    }
+    file.write(json);
+    return 0;
+}
+
+QJsonObject cpusToJson(const OCRThreading::CpuInfo& cpus) {
+    return QJsonObject{{"online", cpus.onlineCpus},
+                       {"affinity", cpus.affinityCpus},
+                       {"quota", cpus.quotaCpus},
+                       {"usable", cpus.usableCpus},
+                       {"numaNodes", cpus.numaNodes}};
+}
+
+/**
+ * @brief Run this benchmark in a child process with a fixed thread split
+ * @return The child's report; empty if it failed
+ */
+QJsonObject runChild(QStringList arguments, const OCRThreading::Plan& plan) {
+    if (plan.pinWorkers) {
+        arguments << "--pin-workers";
+    }
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("OMP_THREAD_LIMIT", QString::number(plan.engineThreads));
+
+    QProcess child;
+    child.setProcessEnvironment(environment);
+    child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    child.start(QCoreApplication::applicationFilePath(),
+                arguments + QStringList{"--threads", QString::number(plan.workers),
+                                        "--engine-threads", QString::number(plan.engineThreads)});
+    if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit ||
+        child.exitCode() != 0) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(child.readAllStandardOutput()).object();
+}
+
+/**
+ * @brief Run two strategies on the same pages, each in a child process, and print pages/s
+ *
+ * Both strategies run at least two pages per usable CPU so a pool has work
+ * for every worker.
+ * @return Report with the children's results under `key`; empty if one failed
+ */
+QJsonObject compareStrategies(const QString& key,
+                              const QList<QPair<QString, OCRThreading::Plan>>& strategies,
+                              QStringList arguments, int iterations,
+                              const OCRThreading::CpuInfo& cpus, QTextStream& err) {
+    arguments << "--iterations" << QString::number(std::max(iterations, 2 * cpus.usableCpus));
+
+    QJsonArray reports;
+    QList<QJsonArray> results;
+    for (const auto& strategy : strategies) {
+        err << "== " << strategy.first << ": "
+            << OCRThreading::describe(strategy.second, cpus) << "\n";
+        err.flush();
+        const QJsonObject report = runChild(arguments, strategy.second);
+        if (report.isEmpty()) {
+            err << "Strategy " << strategy.first << " failed\n";
+            return QJsonObject();
+        }
+        results << report.value("results").toArray();
+        reports.append(QJsonObject{{"strategy", strategy.first},
+                                   {"workers", strategy.second.workers},
+                                   {"engineThreads", strategy.second.engineThreads},
+                                   {"pinned", strategy.second.pinWorkers},
+                                   {"results", results.back()}});
+    }
+
+    const QString first = strategies.at(0).first;
+    const QString second = strategies.at(1).first;
+    err << "\n"
+        << QString("%1%2%3%4\n")
+               .arg("configuration", -36)
+               .arg(first + " p/s", 12)
+               .arg(second + " p/s", 12)
+               .arg(first + "/" + second, 12);
+    const QJsonArray& firstResults = results.at(0);
+    const QJsonArray& secondResults = results.at(1);
+    for (int i = 0; i < firstResults.size() && i < secondResults.size(); ++i) {
+        const double firstRate = firstResults.at(i).toObject().value("pagesPerSecond").toDouble();
+        const double secondRate =
+            secondResults.at(i).toObject().value("pagesPerSecond").toDouble();
+        err << QString("%1%2%3%4\n")
+                   .arg(firstResults.at(i).toObject().value("name").toString(), -36)
+                   .arg(firstRate, 12, 'f', 2)
+                   .arg(secondRate, 12, 'f', 2)
+                   .arg(secondRate > 0 ? firstRate / secondRate : 0.0, 12, 'f', 2);
+    }
+
+    return QJsonObject{{"tool", "ocr_bench"},
+                       {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+                       {"cpus", cpusToJson(cpus)},
+                       {key, reports}};
+}
+
+/**
+ * @brief Pool of single-threaded engines versus one engine with every CPU
+ */
+QJsonObject compareThreading(const QStringList& arguments, int iterations,
+                             const OCRThreading::CpuInfo& cpus, QTextStream& err) {
+    return compareStrategies("threadingComparison",
+                             {{"pool", OCRThreading::makePlan(cpus.usableCpus, 1, cpus)},
+                              {"engine", OCRThreading::makePlan(1, cpus.usableCpus, cpus)}},
+                             arguments, iterations, cpus, err);
+}
+
+/**
+ * @brief The same pool with workers pinned to their own cores versus free-floating
+ *
+ * On one NUMA node the difference is mostly migration and cache effects; on
+ * several it also shows engines reading models from a remote node.
+ */
+QJsonObject comparePlacement(const QStringList& arguments, int iterations,
+                             const OCRThreading::CpuInfo& cpus, QTextStream& err) {
+    OCRThreading::Plan pinned = OCRThreading::makePlan(cpus.usableCpus, 1, cpus);
+    pinned.pinWorkers = true;
+    return compareStrategies(
+        "placementComparison",
+        {{"pinned", pinned}, {"floating", OCRThreading::makePlan(cpus.usableCpus, 1, cpus)}},
+        arguments, iterations, cpus, err);
+}
+
+}  // namespace
+
+/**
+ * @brief Benchmark entry point
+ */
+int main(int argc, char* argv[]) {
+    // Text rendering needs a GUI application, but no display
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setApplicationName("ocr_bench");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("OCR latency/throughput benchmark on synthetic pages");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption iterationsOption({"n", "iterations"}, "Measured pages per configuration",
+                                        "count", "5");
+    QCommandLineOption warmupOption("warmup", "Unmeasured pages per engine", "count", "1");
+    QCommandLineOption threadsOption({"t", "threads"}, "Worker threads (one engine each)",
+                                     "count", "1");
+    QCommandLineOption engineThreadsOption(
+        "engine-threads", "OpenMP threads per engine (0 = share the CPUs left by --threads)",
+        "count", "0");
+    QCommandLineOption compareOption(
+        "compare-threading",
+        "Compare a pool of single-threaded engines with one engine using every CPU");
+    QCommandLineOption pinOption("pin-workers",
+                                 "Pin each worker to its own cores, spread over the NUMA nodes");
+    QCommandLineOption comparePlacementOption(
+        "compare-placement", "Compare a pool of pinned workers with the same pool unpinned");
+    QCommandLineOption languageOption({"l", "language"}, "Tesseract language code", "lang", "eng");
+    QCommandLineOption quickOption("quick", "Only 300 dpi crops (fast smoke run)");
+    QCommandLineOption filterOption("filter", "Only run configurations whose name contains text",
+                                    "text");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report to a file", "file");
+    QCommandLineOption traceOption("trace", "Write a Chrome trace-event JSON file", "file");
+
+    parser.addOptions({iterationsOption, warmupOption, threadsOption, engineThreadsOption,
+                       pinOption, compareOption, comparePlacementOption, languageOption,
+                       quickOption, filterOption, outputOption, traceOption});
+    parser.process(app);
+
+    QLoggingCategory::setFilterRules("ocr.processor.info=false\nocr.processor.debug=false");
+
+    const int iterations = std::max(1, parser.value(iterationsOption).toInt());
+    const int warmup = std::max(0, parser.value(warmupOption).toInt());
+    const int threads = std::max(1, parser.value(threadsOption).toInt());
+    const int engineThreads = std::max(0, parser.value(engineThreadsOption).toInt());
+    const QString filter = parser.value(filterOption);
+
+    QTextStream err(stderr);
+    const OCRThreading::CpuInfo cpus = OCRThreading::detectCpus();
+    if (parser.isSet(compareOption) || parser.isSet(comparePlacementOption)) {
+        QStringList arguments{"--warmup", QString::number(warmup), "--language",
+                              parser.value(languageOption)};
+        if (parser.isSet(quickOption)) {
+            arguments << "--quick";
+        }
+        if (!filter.isEmpty()) {
+            arguments << "--filter" << filter;
+        }
+        const QJsonObject report =
+            parser.isSet(compareOption) ? compareThreading(arguments, iterations, cpus, err)
+                                        : comparePlacement(arguments, iterations, cpus, err);
+        if (report.isEmpty()) {
+            return 2;
+        }
+        return writeReport(report, parser.value(outputOption), err);
+    }
+
+    // The thread split is fixed before any engine exists; this may restart the program
+    OCRThreading::Plan plan = OCRThreading::makePlan(threads, engineThreads, cpus);
+    if (plan.workers > 1 || engineThreads > 0) {
+        OCRThreading::applyEngineThreads(plan.engineThreads);
+    }
+    plan.pinWorkers = parser.isSet(pinOption);
+    OCRThreading::setPlan(plan);
+    err << "Threads: " << OCRThreading::describe(plan, cpus) << "\n";
+
+    const bool tracing = parser.isSet(traceOption) && OCRTrace::start(parser.value(traceOption));
+
+    QJsonArray results;
+    QString tesseractVersion;
+
+    try {
+        for (const BenchConfig& config : benchMatrix(parser.isSet(quickOption))) {
+            if (!filter.isEmpty() && !configName(config).contains(filter)) {
+                continue;
+            }
+            const QJsonObject entry =
+                runConfig(config, iterations, warmup, plan, parser.value(languageOption));
+            err << entry.value("name").toString() << ": p50 "
+                << entry.value("latencyMs").toObject().value("p50").toDouble() << " ms, "
+                << entry.value("pagesPerSecond").toDouble() << " pages/s";
+            const double postprocessShare = entry.value("postprocessShare").toDouble();
+            if (postprocessShare > 0) {
+                err << ", postprocess " << QString::number(postprocessShare * 100.0, 'f', 2)
+                    << "% of recognition";
+            }
+            err << "\n";
+            err.flush();
+            results.append(entry);
+        }
+        tesseractVersion = OCRProcessor().getTesseractVersion();
+    } catch (const std::exception& e) {
+        err << "Benchmark failed: " << e.what() << "\n";
+        return 2;
+    }
+
+    if (tracing) {
+        OCRTrace::stop();
+    }
+
+    const QJsonObject report{
+        {"tool", "ocr_bench"},
+        {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {"qtVersion", QT_VERSION_STR},
+        {"tesseractVersion", tesseractVersion},
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"hardwareThreads", static_cast<int>(std::thread::hardware_concurrency())},
+        {"cpus", cpusToJson(cpus)},
+        {"openMpThreadLimit", OCRThreading::openMpThreadLimit()},
+        {"results", results}};
+    return writeReport(report, parser.value(outputOption), err);
+}
@@ -0,0 +1,583 @@
+/*
+ * Project: OCR & PPT Automation Tool - OCR Daemon Client
+ *
+ * Objective:
+ * - Send images to a running ocr_daemon and print the recognized text, so
+ *   scripts get warm-engine latency without linking Tesseract.
+ * - Submit pages by path, as encoded file contents, or as decoded pixels in
+ *   a shared-memory ring (--shared) that the daemon reads in place.
+ * - With --bench, act as a load generator: keep a fixed number of
+ *   connections busy, then report requests/s, latency percentiles and the
+ *   part of each request spent outside the daemon (socket and framing).
+ *   Mixing in interactive requests reports the queue wait of each class.
+ *
+ * Usage:
+ *   ocr_client [--socket path] [--mode mode] [--send-image | --shared] <image>...
+ *   ocr_client --bench [--requests N] [--concurrency C] [--ping] [<image>...]
+ *   ocr_client --bench --interactive-every N <image>...
+ *   ocr_client --compare-submission [--requests N] <image>...
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ocrprotocol.h"
+
+namespace {
+
+/**
+ * @brief How a page reaches the daemon
+ */
+enum class Submission {
+    Path,    ///< The daemon opens and decodes the file
+    Image,   ///< Encoded file contents in the request body
+    Shared,  ///< Decoded grayscale pixels in an OCRSharedRing
+};
+
+const char* submissionName(Submission submission) {
+    switch (submission) {
+        case Submission::Image:
+            return "image";
+        case Submission::Shared:
+            return "shared";
+        case Submission::Path:
+            break;
+    }
+    return "path";
+}
+
+/**
+ * @brief What every request of a run looks like
+ */
+struct RequestTemplate {
+    QString op = "recognize";
+    QString mode;              ///< Empty = daemon default
+    QJsonArray region;         ///< Empty = whole page
+    QString priority;          ///< "interactive" or "batch"; empty = daemon default (batch)
+    int interactiveEvery = 0;  ///< Every Nth request is interactive (0 = none)
+    Submission submission = Submission::Path;
+};
+
+/**
+ * @brief Whether request `id` of a run goes to the interactive class
+ */
+bool isInteractive(const RequestTemplate& request, int id) {
+    if (request.interactiveEvery > 0) {
+        return id % request.interactiveEvery == 0;
+    }
+    return request.priority == "interactive";
+}
+
+/**
+ * @brief One page, loaded in the forms its submissions need
+ */
+struct Input {
+    QString argument;    ///< As given on the command line
+    QString path;        ///< Absolute; the daemon resolves paths from its own directory
+    QByteArray encoded;  ///< File contents, for Submission::Image
+    QImage pixels;       ///< Decoded grayscale page, for Submission::Shared
+};
+
+/**
+ * @brief Read and decode what the chosen submissions need
+ */
+bool loadInputs(const QStringList& arguments, bool encoded, bool decoded, QList<Input>& inputs,
+                QString& error) {
+    for (const QString& argument : arguments) {
+        Input input;
+        input.argument = argument;
+        input.path = QFileInfo(argument).absoluteFilePath();
+        if (encoded) {
+            QFile file(argument);
+            if (!file.open(QIODevice::ReadOnly)) {
+                error = QString("Cannot read %1").arg(argument);
+                return false;
+            }
+            input.encoded = file.readAll();
+        }
+        if (decoded) {
+            // The engine recognizes grayscale; converting here shrinks the ring slot 4x
+            QImageReader reader(argument);
+            reader.setAutoTransform(true);
+            input.pixels = reader.read().convertToFormat(QImage::Format_Grayscale8);
+            if (input.pixels.isNull()) {
+                error = QString("Cannot decode %1: %2").arg(argument, reader.errorString());
+                return false;
+            }
+        }
+        inputs << input;
+    }
+    return true;
+}
+
+/**
+ * @brief Ring size for one page in flight per connection: the largest page
+ */
+size_t ringBytesFor(const QList<Input>& inputs) {
+    qsizetype largest = 1;
+    for (const Input& input : inputs) {
+        largest = std::max(largest, input.pixels.sizeInBytes());
+    }
+    return static_cast<size_t>(largest);
+}
+
+/**
+ * @brief Build the request for one input; shared pages are copied into the ring
+ */
+OCRProtocol::Message makeRequest(const RequestTemplate& request, int id, const Input& input,
+                                 OCRSharedRing* ring) {
+    OCRProtocol::Message message;
+    message.header = QJsonObject{{"id", id}, {"op", request.op}};
+    if (!request.mode.isEmpty()) {
+        message.header.insert("mode", request.mode);
+    }
+    if (!request.region.isEmpty()) {
+        message.header.insert("region", request.region);
+    }
+    if (request.op != "recognize") {
+        return message;
+    }
+    if (request.interactiveEvery > 0 || !request.priority.isEmpty()) {
+        message.header.insert("priority", isInteractive(request, id) ? "interactive" : "batch");
+    }
+    switch (request.submission) {
+        case Submission::Path:
+            message.header.insert("path", input.path);
+            break;
+        case Submission::Image:
+            message.body = input.encoded;
+            break;
+        case Submission::Shared: {
+            const qint64 offset = ring->reserve(static_cast<size_t>(input.pixels.sizeInBytes()));
+            std::memcpy(ring->data() + offset, input.pixels.constBits(),
+                        static_cast<size_t>(input.pixels.sizeInBytes()));
+            message.header.insert("shared", QJsonObject{{"offset", offset},
+                                                        {"width", input.pixels.width()},
+                                                        {"height", input.pixels.height()},
+                                                        {"bytesPerLine",
+                                                         input.pixels.bytesPerLine()},
+                                                        {"format", "gray8"}});
+            break;
+        }
+    }
+    return message;
+}
+
+/**
+ * @brief Send one request and wait for its reply
+ */
+bool roundTrip(int fd, const OCRProtocol::Message& request, OCRProtocol::Message& reply) {
+    return OCRProtocol::send(fd, request) && OCRProtocol::receive(fd, reply);
+}
+
+/**
+ * @brief Connect, creating and attaching a ring for shared submissions
+ * @return Connected descriptor, or -1 with `error` set
+ */
+int openConnection(const QString& socketPath, const RequestTemplate& request, size_t ringBytes,
+                   std::shared_ptr<OCRSharedRing>& ring, QString& error) {
+    const int fd = OCRProtocol::connect(socketPath, &error);
+    if (fd < 0 || request.submission != Submission::Shared || request.op != "recognize") {
+        return fd;
+    }
+    ring = OCRSharedRing::create(ringBytes, &error);
+    OCRProtocol::Message attach;
+    attach.header = QJsonObject{{"id", -1}, {"op", "attach"}};
+    OCRProtocol::Message reply;
+    if (ring) {
+        attach.descriptor = ring->descriptor();
+        if (!roundTrip(fd, attach, reply) || !reply.header.value("ok").toBool()) {
+            error = QString("The daemon did not attach the shared ring: %1")
+                        .arg(reply.header.value("error").toString("connection closed"));
+            ring.reset();
+        }
+    }
+    if (!ring) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+double percentile(const std::vector<qint64>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return static_cast<double>(sorted[std::min(rank, sorted.size() - 1)]);
+}
+
+QJsonObject summarize(std::vector<qint64>& samplesUs) {
+    std::sort(samplesUs.begin(), samplesUs.end());
+    return QJsonObject{{"p50", percentile(samplesUs, 50)},
+                       {"p95", percentile(samplesUs, 95)},
+                       {"p99", percentile(samplesUs, 99)},
+                       {"max", samplesUs.empty() ? 0.0 : static_cast<double>(samplesUs.back())}};
+}
+
+/**
+ * @brief Closed-loop load: `concurrency` connections, each waiting for its reply
+ * @param report Filled with the run's summary for --output
+ */
+int runBenchmark(const QString& socketPath, const RequestTemplate& request,
+                 const QList<Input>& inputs, int requests, int concurrency, QJsonObject& report) {
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const size_t ringBytes = ringBytesFor(inputs);
+    std::vector<int> sockets;
+    std::vector<std::shared_ptr<OCRSharedRing>> rings(concurrency);
+    for (int c = 0; c < concurrency; ++c) {
+        QString error;
+        const int fd = openConnection(socketPath, request, ringBytes, rings[c], error);
+        if (fd < 0) {
+            err << error << "\n";
+            for (int open : sockets) {
+                ::close(open);
+            }
+            return 2;
+        }
+        sockets.push_back(fd);
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<int> failures(0);
+    std::atomic<int> lostConnections(0);
+    std::atomic<int> preemptions(0);
+    std::vector<std::vector<qint64>> latencyUs(concurrency);
+    std::vector<std::vector<qint64>> overheadUs(concurrency);
+    // Daemon-side wait for an engine, [interactive, batch] per connection
+    std::vector<std::array<std::vector<qint64>, 2>> queueUs(concurrency);
+    const Input noInput;
+
+    auto client = [&](int c) {
+        OCRProtocol::Message reply;
+        QElapsedTimer timer;
+        for (int id = next.fetch_add(1); id < requests; id = next.fetch_add(1)) {
+            const Input& input = inputs.isEmpty() ? noInput : inputs.at(id % inputs.size());
+            // Writing the pixels into the ring is part of the shared submission's cost
+            timer.start();
+            const OCRProtocol::Message message = makeRequest(request, id, input, rings[c].get());
+            if (!roundTrip(sockets[c], message, reply)) {
+                lostConnections.fetch_add(1);
+                return;
+            }
+            const qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+            latencyUs[c].push_back(elapsedUs);
+            overheadUs[c].push_back(elapsedUs - reply.header.value("serviceUs").toInteger());
+            if (reply.header.contains("queueUs")) {
+                queueUs[c][isInteractive(request, id) ? 0 : 1].push_back(
+                    reply.header.value("queueUs").toInteger());
+            }
+            preemptions.fetch_add(reply.header.value("preemptions").toInt());
+            if (!reply.header.value("ok").toBool()) {
+                failures.fetch_add(1);
+            }
+        }
+    };
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+    std::vector<std::thread> threads;
+    for (int c = 1; c < concurrency; ++c) {
+        threads.emplace_back(client, c);
+    }
+    client(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double wallSeconds = wallClock.nsecsElapsed() / 1e9;
+    for (int fd : sockets) {
+        ::close(fd);
+    }
+
+    std::vector<qint64> latency;
+    std::vector<qint64> overhead;
+    std::array<std::vector<qint64>, 2> waits;
+    for (int c = 0; c < concurrency; ++c) {
+        latency.insert(latency.end(), latencyUs[c].begin(), latencyUs[c].end());
+        overhead.insert(overhead.end(), overheadUs[c].begin(), overheadUs[c].end());
+        for (size_t k = 0; k < waits.size(); ++k) {
+            waits[k].insert(waits[k].end(), queueUs[c][k].begin(), queueUs[c][k].end());
+        }
+    }
+    const double requestsPerSecond = wallSeconds > 0 ? latency.size() / wallSeconds : 0.0;
+    const QJsonObject latencySummary = summarize(latency);
+    const QJsonObject overheadSummary = summarize(overhead);
+
+    out << latency.size() << " " << request.op << " requests";
+    if (request.op == "recognize") {
+        out << " by " << submissionName(request.submission);
+    }
+    out << ", concurrency " << concurrency << ": "
+        << QString::number(requestsPerSecond, 'f', 1) << " req/s, " << failures.load()
+        << " failed, " << lostConnections.load() << " connection(s) lost\n";
+    out << "latency ms  ";
+    for (const char* key : {"p50", "p95", "p99", "max"}) {
+        out << "  " << key << " "
+            << QString::number(latencySummary.value(key).toDouble() / 1e3, 'f', 3);
+    }
+    out << "\n";
+    out << "outside the daemon us   p50 " << overheadSummary.value("p50").toDouble() << "  p99 "
+        << overheadSummary.value("p99").toDouble() << "\n";
+
+    QJsonObject queueSummary;
+    const char* classNames[] = {"interactive", "batch"};
+    for (size_t k = 0; k < waits.size(); ++k) {
+        if (waits[k].empty()) {
+            continue;
+        }
+        const QJsonObject summary = summarize(waits[k]);
+        queueSummary.insert(classNames[k], summary);
+        out << "queue wait ms " << classNames[k] << "  "
+            << QString::number(waits[k].size()) << " requests  p50 "
+            << QString::number(summary.value("p50").toDouble() / 1e3, 'f', 3) << "  p99 "
+            << QString::number(summary.value("p99").toDouble() / 1e3, 'f', 3) << "\n";
+    }
+    if (preemptions.load() > 0) {
+        out << preemptions.load() << " batch page(s) cancelled and requeued\n";
+    }
+
+    report = QJsonObject{{"op", request.op},
+                         {"submission", submissionName(request.submission)},
+                         {"requests", static_cast<int>(latency.size())},
+                         {"concurrency", concurrency},
+                         {"failures", failures.load()},
+                         {"lostConnections", lostConnections.load()},
+                         {"requestsPerSecond", requestsPerSecond},
+                         {"latencyUs", latencySummary},
+                         {"overheadUs", overheadSummary},
+                         {"queueUs", queueSummary},
+                         {"preemptions", preemptions.load()}};
+    return failures.load() == 0 && lostConnections.load() == 0 ? 0 : 3;
+}
+
+bool writeReport(const QString& outputPath, const QJsonObject& report) {
+    QFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QTextStream(stderr) << "Cannot write " << file.fileName() << "\n";
+        return false;
+    }
+    file.write(QJsonDocument(report).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+/**
+ * @brief Run the same load once per submission and compare throughput with paths
+ */
+int compareSubmissions(const QString& socketPath, RequestTemplate request,
+                       const QList<Input>& inputs, int requests, int concurrency,
+                       const QString& outputPath) {
+    QTextStream out(stdout);
+    QJsonArray runs;
+    double pathRate = 0.0;
+    int status = 0;
+    for (Submission submission : {Submission::Path, Submission::Image, Submission::Shared}) {
+        request.submission = submission;
+        QJsonObject report;
+        const int runStatus = runBenchmark(socketPath, request, inputs, requests, concurrency,
+                                           report);
+        if (runStatus == 2) {
+            return runStatus;
+        }
+        status = std::max(status, runStatus);
+        const double rate = report.value("requestsPerSecond").toDouble();
+        if (submission == Submission::Path) {
+            pathRate = rate;
+        } else if (pathRate > 0.0) {
+            out << submissionName(submission) << " vs path: "
+                << QString::number(rate / pathRate, 'f', 2) << "x throughput\n";
+        }
+        runs.append(report);
+    }
+    if (!outputPath.isEmpty() &&
+        !writeReport(outputPath, QJsonObject{{"tool", "ocr_client"}, {"runs", runs}})) {
+        return 1;
+    }
+    return status;
+}
+
+}  // namespace
+
+/**
+ * @brief Client entry point
+ */
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ocr_client");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Recognize images with a running ocr_daemon");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("images", "Image files to recognize", "<image>...");
+
+    QCommandLineOption socketOption({"s", "socket"}, "Daemon socket path", "path",
+                                    OCRProtocol::defaultSocketPath());
+    QCommandLineOption modeOption({"m", "mode"}, "Processing mode: auto, text, equations, mixed",
+                                  "mode");
+    QCommandLineOption regionOption("region", "Only recognize x,y,width,height", "rect");
+    QCommandLineOption priorityOption(
+        {"p", "priority"}, "Scheduling class: interactive or batch (default: batch)", "class");
+    QCommandLineOption interactiveEveryOption(
+        "interactive-every", "In a --bench run, send every Nth request as interactive", "n");
+    QCommandLineOption sendImageOption("send-image",
+                                       "Send the file contents instead of the path");
+    QCommandLineOption sharedOption("shared",
+                                    "Decode locally and pass pixels through shared memory");
+    QCommandLineOption jsonOption("json", "Print the daemon's full replies as JSON");
+    QCommandLineOption statsOption("stats", "Print the daemon's request statistics");
+    QCommandLineOption benchOption("bench", "Measure requests/s and latency under load");
+    QCommandLineOption compareOption(
+        "compare-submission", "Benchmark paths, file contents and shared memory in turn");
+    QCommandLineOption requestsOption({"n", "requests"}, "Requests in a --bench run", "count",
+                                      "200");
+    QCommandLineOption concurrencyOption({"c", "concurrency"},
+                                         "Connections kept busy in a --bench run", "count", "4");
+    QCommandLineOption pingOption("ping", "Benchmark pings (dispatch cost only, no OCR)");
+    QCommandLineOption outputOption({"o", "output"}, "Write the --bench report as JSON",
+                                    "file");
+
+    parser.addOptions({socketOption, modeOption, regionOption, priorityOption,
+                       interactiveEveryOption, sendImageOption, sharedOption, jsonOption,
+                       statsOption, benchOption, compareOption, requestsOption,
+                       concurrencyOption, pingOption, outputOption});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    const QString socketPath = parser.value(socketOption);
+
+    RequestTemplate request;
+    request.mode = parser.value(modeOption);
+    request.priority = parser.value(priorityOption);
+    if (!request.priority.isEmpty() && request.priority != "interactive" &&
+        request.priority != "batch") {
+        err << "--priority expects interactive or batch\n";
+        return 1;
+    }
+    if (parser.isSet(benchOption)) {
+        request.interactiveEvery = std::max(0, parser.value(interactiveEveryOption).toInt());
+    }
+    if (parser.isSet(sendImageOption) && parser.isSet(sharedOption)) {
+        err << "--send-image and --shared are exclusive\n";
+        return 1;
+    }
+    if (parser.isSet(sendImageOption)) {
+        request.submission = Submission::Image;
+    } else if (parser.isSet(sharedOption)) {
+        request.submission = Submission::Shared;
+    }
+    if (parser.isSet(regionOption)) {
+        const QStringList parts = parser.value(regionOption).split(',');
+        if (parts.size() != 4) {
+            err << "--region expects x,y,width,height\n";
+            return 1;
+        }
+        for (const QString& part : parts) {
+            request.region.append(part.trimmed().toInt());
+        }
+    }
+
+    const bool comparing = parser.isSet(compareOption);
+    QList<Input> inputs;
+    QString error;
+    if (!loadInputs(parser.positionalArguments(),
+                    comparing || request.submission == Submission::Image,
+                    comparing || request.submission == Submission::Shared, inputs, error)) {
+        err << error << "\n";
+        return 1;
+    }
+
+    const int requests = std::max(1, parser.value(requestsOption).toInt());
+    const int concurrency = std::max(1, parser.value(concurrencyOption).toInt());
+    if (comparing) {
+        if (inputs.isEmpty()) {
+            parser.showHelp(1);
+        }
+        return compareSubmissions(socketPath, request, inputs, requests, concurrency,
+                                  parser.value(outputOption));
+    }
+    if (parser.isSet(benchOption)) {
+        if (parser.isSet(pingOption)) {
+            request.op = "ping";
+        } else if (inputs.isEmpty()) {
+            parser.showHelp(1);
+        }
+        QJsonObject report;
+        const int status =
+            runBenchmark(socketPath, request, inputs, requests, concurrency, report);
+        if (status != 2 && parser.isSet(outputOption)) {
+            report.insert("tool", "ocr_client");
+            if (!writeReport(parser.value(outputOption), report)) {
+                return 1;
+            }
+        }
+        return status;
+    }
+
+    if (inputs.isEmpty() && !parser.isSet(statsOption)) {
+        parser.showHelp(1);
+    }
+
+    std::shared_ptr<OCRSharedRing> ring;
+    const int fd = openConnection(socketPath, request, ringBytesFor(inputs), ring, error);
+    if (fd < 0) {
+        err << error << "\n";
+        return 2;
+    }
+
+    int failures = 0;
+    OCRProtocol::Message reply;
+    if (parser.isSet(statsOption)) {
+        RequestTemplate stats;
+        stats.op = "stats";
+        if (!roundTrip(fd, makeRequest(stats, 0, Input(), nullptr), reply)) {
+            err << "The daemon closed the connection\n";
+            ::close(fd);
+            return 2;
+        }
+        out << QJsonDocument(reply.header).toJson(QJsonDocument::Indented);
+    }
+
+    for (int i = 0; i < inputs.size(); ++i) {
+        const Input& input = inputs.at(i);
+        if (!roundTrip(fd, makeRequest(request, i, input, ring.get()), reply)) {
+            err << "The daemon closed the connection\n";
+            ::close(fd);
+            return 2;
+        }
+        if (parser.isSet(jsonOption)) {
+            out << QJsonDocument(reply.header).toJson(QJsonDocument::Compact) << "\n";
+        } else if (reply.header.value("ok").toBool()) {
+            if (inputs.size() > 1) {
+                out << "==> " << input.argument << " <==\n";
+            }
+            out << reply.header.value("text").toString();
+        } else {
+            err << input.argument << ": " << reply.header.value("error").toString() << "\n";
+        }
+        failures += reply.header.value("ok").toBool() ? 0 : 1;
+        out.flush();
+    }
+    ::close(fd);
+    return failures == 0 ? 0 : 3;
+}
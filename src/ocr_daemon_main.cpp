@@ -0,0 +1,204 @@
+/*
+ * Project: OCR & PPT Automation Tool - OCR Daemon
+ *
+ * Objective:
+ * - Keep OCR engines initialized in one long-running process and serve
+ *   recognition requests from ocr_client and scripts over a Unix domain
+ *   socket (see ocrprotocol.h for the wire format).
+ * - Serve interactive requests (the GUI) ahead of batch work, cancelling a
+ *   batch page when no engine is free.
+ * - Shut down cleanly on SIGINT/SIGTERM, finishing queued requests and
+ *   removing the socket file.
+ * - Run as an isolated engine process of an OCRProcessPool (--worker-fd),
+ *   serving the supervisor's end of a socket pair until it closes.
+ *
+ * Usage:
+ *   ocr_daemon [--socket path] [--workers N] [--mode mode] [--language lang]
+ *              [engine options as for ocr_batch]
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QLoggingCategory>
+#include <QTextStream>
+#include <algorithm>
+#include <exception>
+#include <memory>
+
+#include <fcntl.h>
+#include <signal.h>
+
+#include "ocrprocessor.h"
+#include "ocrserver.h"
+#include "ocrthreading.h"
+#include "ocrtrace.h"
+
+Q_LOGGING_CATEGORY(daemonLog, "app.daemon")
+
+namespace {
+
+OCRServer* s_server = nullptr;
+
+void handleTermination(int) {
+    if (s_server) {
+        s_server->stop();
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Daemon entry point
+ */
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("ocr_daemon");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Serve OCR requests from warm engines on a Unix socket");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption socketOption({"s", "socket"}, "Socket path", "path",
+                                    OCRProtocol::defaultSocketPath());
+    QCommandLineOption workersOption(
+        {"j", "workers"}, "Engines serving requests in parallel (0 = one per CPU)", "count", "0");
+    QCommandLineOption engineThreadsOption(
+        "engine-threads", "OpenMP threads per engine (0 = share the CPUs left by --workers)",
+        "count", "0");
+    QCommandLineOption modeOption({"m", "mode"},
+                                  "Default processing mode: auto, text, equations, mixed", "mode",
+                                  "auto");
+    QCommandLineOption languageOption({"l", "language"}, "Tesseract language code", "lang", "eng");
+    QCommandLineOption dpiOption("dpi", "Processing DPI", "dpi", "300");
+    QCommandLineOption minConfidenceOption("min-confidence", "Minimum confidence (0-100)",
+                                           "percent", "60");
+    QCommandLineOption noPreprocessOption("no-preprocess", "Disable image preprocessing");
+    QCommandLineOption noLayoutOption("no-layout", "Skip collecting word/symbol geometry");
+    QCommandLineOption xHeightOption("x-height",
+                                     "Target text x-height in pixels (0 = scale by --dpi only)",
+                                     "pixels", "24");
+    QCommandLineOption blankInkOption("blank-ink",
+                                      "Skip pages with less ink coverage than this (0 = off)",
+                                      "ratio", "0.00002");
+    QCommandLineOption maxEdgeOption("max-edge",
+                                     "Longest image edge to decode, in pixels (0 = unlimited)",
+                                     "pixels", "3508");
+    QCommandLineOption cascadeOption(
+        "cascade", "Fast first pass; re-recognize only low-confidence lines at full quality");
+    QCommandLineOption fastDataOption("fast-data",
+                                      "tessdata_fast directory for the cascade's first pass",
+                                      "dir");
+    QCommandLineOption noGrammarOption("no-grammar",
+                                       "Keep equation lines as recognized (no grammar search)");
+    QCommandLineOption noLatexOption("no-latex", "Skip converting equation lines to LaTeX");
+    QCommandLineOption pinOption(
+        "pin-workers", "Pin each engine to its own cores, spread over the NUMA nodes (Linux)");
+    QCommandLineOption memoryBudgetOption(
+        "memory-budget-mb", "Memory budget for all engines (0 = from cgroup limit, -1 = none)",
+        "MiB", "0");
+    QCommandLineOption traceOption("trace", "Write a Chrome trace-event JSON file on exit",
+                                   "file");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Enable OCR processor logging");
+    QCommandLineOption workerFdOption("worker-fd", "Serve this inherited socket (OCRProcessPool)",
+                                      "fd");
+    workerFdOption.setFlags(QCommandLineOption::HiddenFromHelp);
+
+    parser.addOptions({socketOption, workersOption, engineThreadsOption, modeOption,
+                       languageOption, dpiOption, minConfidenceOption, noPreprocessOption,
+                       noLayoutOption, xHeightOption, blankInkOption, maxEdgeOption,
+                       cascadeOption, fastDataOption, noGrammarOption, noLatexOption,
+                       pinOption, memoryBudgetOption, traceOption, verboseOption,
+                       workerFdOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (!parser.isSet(verboseOption)) {
+        QLoggingCategory::setFilterRules("ocr.processor.info=false\nocr.processor.debug=false");
+    }
+
+    OCRServer::Options options;
+    options.socketPath = parser.value(socketOption);
+    if (!OCRProcessor::modeFromName(parser.value(modeOption), options.config.mode)) {
+        err << "Unknown processing mode: " << parser.value(modeOption) << "\n";
+        return 1;
+    }
+    options.config.language = parser.value(languageOption);
+    options.config.dpi = parser.value(dpiOption).toInt();
+    options.config.minimumConfidence = parser.value(minConfidenceOption).toInt();
+    options.config.preprocessImage = !parser.isSet(noPreprocessOption);
+    options.config.extractLayout = !parser.isSet(noLayoutOption);
+    options.config.blankPageInkRatio = std::max(0.0, parser.value(blankInkOption).toDouble());
+    options.config.targetXHeight = std::max(0, parser.value(xHeightOption).toInt());
+    options.config.maxDecodeLongEdge = std::max(0, parser.value(maxEdgeOption).toInt());
+    options.config.cascade = parser.isSet(cascadeOption) || parser.isSet(fastDataOption);
+    options.config.fastDataPath = parser.value(fastDataOption);
+    options.config.grammarSearch = !parser.isSet(noGrammarOption);
+    options.config.equationLatex = !parser.isSet(noLatexOption);
+    const qint64 budgetMb = parser.value(memoryBudgetOption).toLongLong();
+    options.config.memoryBudgetBytes = budgetMb > 0 ? budgetMb << 20 : budgetMb;
+    if (parser.isSet(workerFdOption) && !parser.isSet(memoryBudgetOption)) {
+        // A supervised worker shares its supervisor's cgroup and has its own limit
+        options.config.memoryBudgetBytes = -1;
+    }
+
+    // The thread split is fixed before any engine exists; this may restart the program
+    const OCRThreading::CpuInfo cpus = OCRThreading::detectCpus();
+    OCRThreading::Plan plan =
+        OCRThreading::makePlan(parser.value(workersOption).toInt(),
+                               parser.value(engineThreadsOption).toInt(), cpus);
+    if (plan.workers > 1 || parser.value(engineThreadsOption).toInt() > 0) {
+        OCRThreading::applyEngineThreads(plan.engineThreads);
+    }
+    plan.pinWorkers = parser.isSet(pinOption);
+    OCRThreading::setPlan(plan);
+    options.workers = plan.workers;
+    if (parser.isSet(workerFdOption)) {
+        options.connectedFd = parser.value(workerFdOption).toInt();
+        ::fcntl(options.connectedFd, F_SETFD, FD_CLOEXEC);
+    }
+
+    const bool tracing = parser.isSet(traceOption) ? OCRTrace::start(parser.value(traceOption))
+                                                   : OCRTrace::startFromEnvironment();
+    OCRTrace::setThreadName("daemon io");
+
+    std::unique_ptr<OCRServer> server;
+    try {
+        OCR_TRACE_SCOPE("engine init", "ocr,init");
+        server = std::make_unique<OCRServer>(options);
+    } catch (const std::exception& e) {
+        err << "Failed to initialize OCR: " << e.what() << "\n";
+        OCRTrace::stop();
+        return 2;
+    }
+
+    QString error;
+    if (options.connectedFd < 0 && !server->listen(&error)) {
+        err << error << "\n";
+        OCRTrace::stop();
+        return 1;
+    }
+
+    s_server = server.get();
+    struct sigaction action = {};
+    action.sa_handler = handleTermination;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    if (options.connectedFd < 0) {
+        qCInfo(daemonLog) << "Listening on" << server->socketPath() << "with"
+                          << OCRThreading::describe(plan, cpus);
+    } else {
+        qCInfo(daemonLog) << "Serving descriptor" << options.connectedFd << "for a supervisor";
+    }
+    server->serve();
+
+    s_server = nullptr;
+    server.reset();
+    if (tracing) {
+        OCRTrace::stop();
+    }
+    return 0;
+}
@@ -27,6 +27,10 @@
 
 #include "../include/mainwindow.h"
 
+#ifdef TESSERACT_AVAILABLE
+#include "../include/ocrtrace.h"
+#endif
+
 // Logging categories for structured debugging
 Q_LOGGING_CATEGORY(startup, "app.startup")
 Q_LOGGING_CATEGORY(gui, "app.gui")
@@ -115,6 +119,14 @@ int main(int argc, char *argv[]) {
         // Configure application settings
         configureApplication(app);
 
+#ifdef TESSERACT_AVAILABLE
+        // Optional pipeline tracing (MATHSCAN_TRACE=/path/trace.json)
+        if (OCRTrace::startFromEnvironment()) {
+            OCRTrace::setThreadName("GUI thread");
+            QObject::connect(&app, &QApplication::aboutToQuit, []() { OCRTrace::stop(); });
+        }
+#endif
+
         // Verify environment and permissions
         if (!verifyApplicationEnvironment()) {
             qCCritical(error) << "Environment verification failed";
@@ -0,0 +1,186 @@
+/*
+ * Module: OCR Batch Plan Implementation
+ *
+ * Header-based page cost estimates, band tiling and makespan simulation.
+ */
+
+#include "ocrbatchplan.h"
+
+#include <QFileInfo>
+#include <QImage>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <queue>
+
+#include "imageanalysis.h"
+
+namespace {
+
+/// Compressed bits per pixel at which a page counts as fully dense
+constexpr double kDenseBitsPerPixel = 4.0;
+
+}  // namespace
+
+OCRBatchPlan::PageEstimate OCRBatchPlan::estimate(const QString& path, int maxDecodeLongEdge) {
+    PageEstimate page;
+    page.fileBytes = QFileInfo(path).size();
+
+    QImageReader reader(path);
+    page.size = reader.size();
+    if (page.size.isEmpty()) {
+        // No usable header: let the file size stand in for the pixel count
+        page.cost = page.fileBytes / 1e6;
+        return page;
+    }
+    page.transformed = reader.transformation() != QImageIOHandler::TransformationNone;
+    if (reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+        page.size.transpose();
+    }
+
+    const double pixels = static_cast<double>(page.size.width()) * page.size.height();
+    double decodedPixels = pixels;
+    const int longEdge = std::max(page.size.width(), page.size.height());
+    if (maxDecodeLongEdge > 0 && longEdge > maxDecodeLongEdge) {
+        const double scale = static_cast<double>(maxDecodeLongEdge) / longEdge;
+        decodedPixels *= scale * scale;
+    }
+    page.megapixels = decodedPixels / 1e6;
+
+    const double bitsPerPixel = page.fileBytes * 8.0 / pixels;
+    page.cost = page.megapixels * (1.0 + std::min(bitsPerPixel, kDenseBitsPerPixel) /
+                                             kDenseBitsPerPixel);
+    return page;
+}
+
+std::vector<QRect> OCRBatchPlan::tileRows(const QString& path, const QSize& size, int tiles) {
+    if (tiles < 2 || size.isEmpty()) {
+        return {QRect(QPoint(0, 0), size)};
+    }
+    tiles = std::min(tiles, size.height());
+
+    // Ink per thumbnail row, only where the thumbnail is a cheap scaled decode;
+    // other formats and rotated files are not decoded twice
+    QImageReader reader(path);
+    if (!reader.supportsOption(QImageIOHandler::ScaledSize) ||
+        reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+        return {QRect(QPoint(0, 0), size)};
+    }
+    const int height = std::min(size.height(), kThumbnailHeight);
+    reader.setScaledSize(
+        QSize(std::max(1, static_cast<int>(qint64(size.width()) * height / size.height())),
+              height));
+    const QImage thumbnail = reader.read().convertToFormat(QImage::Format_Grayscale8);
+    if (thumbnail.isNull()) {
+        return {QRect(QPoint(0, 0), size)};
+    }
+
+    const GrayImageView view{thumbnail.constBits(), thumbnail.width(), thumbnail.height(),
+                             static_cast<int>(thumbnail.bytesPerLine())};
+    const int inkLevel = ImageAnalysis::otsuThreshold(view);
+    std::vector<int> rowInk(static_cast<size_t>(view.height));
+    for (int y = 0; y < view.height; ++y) {
+        const uint8_t* row = view.scanLine(y);
+        rowInk[y] = static_cast<int>(std::count_if(
+            row, row + view.width, [&](uint8_t value) { return value <= inkLevel; }));
+    }
+    return cutBands(rowInk, static_cast<int>(view.width * kBlankRowInk), size, tiles);
+}
+
+std::vector<QRect> OCRBatchPlan::cutBands(const std::vector<int>& rowInk, int maxInk,
+                                          const QSize& size, int tiles) {
+    const int rows = static_cast<int>(rowInk.size());
+    if (tiles < 2 || rows == 0 || size.isEmpty()) {
+        return {QRect(QPoint(0, 0), size)};
+    }
+
+    const int window = rows / (4 * tiles);
+    std::vector<int> cuts{0};
+    int previous = 0;  // Last cut in thumbnail rows
+    for (int t = 1; t < tiles; ++t) {
+        const int ideal = static_cast<int>(static_cast<qint64>(rows) * t / tiles);
+        int best = -1;
+        for (int y = std::max(previous + 1, ideal - window);
+             y <= std::min(rows - 1, ideal + window); ++y) {
+            // Prefer the emptiest blank row, then the one closest to the even split
+            if (rowInk[y] <= maxInk &&
+                (best < 0 || rowInk[y] < rowInk[best] ||
+                 (rowInk[y] == rowInk[best] && std::abs(y - ideal) < std::abs(best - ideal)))) {
+                best = y;
+            }
+        }
+        if (best < 0) {
+            continue;  // text runs through the whole window
+        }
+        previous = best;
+        cuts.push_back(static_cast<int>(static_cast<qint64>(best) * size.height() / rows));
+    }
+    cuts.push_back(size.height());
+
+    std::vector<QRect> bands;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        if (cuts[i + 1] > cuts[i]) {
+            bands.emplace_back(0, cuts[i], size.width(), cuts[i + 1] - cuts[i]);
+        }
+    }
+    return bands;
+}
+
+std::vector<OCRBatchPlan::WorkUnit> OCRBatchPlan::plan(const QStringList& paths,
+                                                       int maxDecodeLongEdge,
+                                                       double tileMegapixels, int maxTiles) {
+    std::vector<WorkUnit> units;
+    units.reserve(static_cast<size_t>(paths.size()));
+    for (int page = 0; page < paths.size(); ++page) {
+        const PageEstimate estimated = estimate(paths.at(page), maxDecodeLongEdge);
+        int tiles = 1;
+        // Bands are decoded by clip rectangle, which EXIF orientation defeats
+        if (tileMegapixels > 0.0 && !estimated.transformed &&
+            estimated.megapixels > tileMegapixels) {
+            tiles = std::min(std::max(1, maxTiles),
+                             static_cast<int>(std::ceil(estimated.megapixels / tileMegapixels)));
+        }
+        const std::vector<QRect> bands =
+            tiles < 2 ? std::vector<QRect>() : tileRows(paths.at(page), estimated.size, tiles);
+        if (bands.size() < 2) {
+            units.push_back({page, 0, 1, QRect(), estimated.cost});
+            continue;
+        }
+
+        for (size_t tile = 0; tile < bands.size(); ++tile) {
+            const double share =
+                static_cast<double>(bands[tile].height()) / estimated.size.height();
+            units.push_back({page, static_cast<int>(tile), static_cast<int>(bands.size()),
+                             bands[tile], estimated.cost * share});
+        }
+    }
+    return units;
+}
+
+std::vector<int> OCRBatchPlan::longestFirst(const std::vector<WorkUnit>& units) {
+    std::vector<int> order(units.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return units[a].cost > units[b].cost; });
+    return order;
+}
+
+qint64 OCRBatchPlan::simulateMakespan(const std::vector<qint64>& durations,
+                                      const std::vector<int>& order, int workers) {
+    // Min-heap of the times at which each worker becomes free
+    std::priority_queue<qint64, std::vector<qint64>, std::greater<qint64>> freeAt;
+    for (int w = 0; w < std::max(1, workers); ++w) {
+        freeAt.push(0);
+    }
+    qint64 makespan = 0;
+    for (int unit : order) {
+        const qint64 finish = freeAt.top() + durations[unit];
+        freeAt.pop();
+        freeAt.push(finish);
+        makespan = std::max(makespan, finish);
+    }
+    return makespan;
+}
@@ -0,0 +1,211 @@
+/*
+ * Module: OCR Folder Watcher Implementation
+ *
+ * inotify watches, event decoding and per-file debouncing.
+ */
+
+#include "ocrfolderwatcher.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(ocrFolderWatcher, "ocr.watcher")
+
+OCRFolderWatcher::OCRFolderWatcher(const QStringList& suffixes, int debounceMs)
+    : m_debounceMs(std::max(0, debounceMs)) {
+    for (const QString& suffix : suffixes) {
+        m_suffixes << suffix.toLower();
+    }
+    m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0 || ::pipe2(m_wakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        const std::string reason = std::strerror(errno);
+        if (m_inotifyFd >= 0) {
+            ::close(m_inotifyFd);
+        }
+        throw std::runtime_error("Cannot set up inotify: " + reason);
+    }
+}
+
+OCRFolderWatcher::~OCRFolderWatcher() {
+    ::close(m_inotifyFd);
+    ::close(m_wakePipe[0]);
+    ::close(m_wakePipe[1]);
+}
+
+bool OCRFolderWatcher::addDirectory(const QString& directory, bool recursive, QString* error) {
+    const QFileInfo info(directory);
+    if (!info.isDir()) {
+        if (error) {
+            *error = QString("Not a directory: %1").arg(directory);
+        }
+        return false;
+    }
+    const QString root = info.absoluteFilePath();
+    if (!watch(root, recursive, error)) {
+        return false;
+    }
+    if (recursive) {
+        const QFileInfoList children =
+            QDir(root).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        for (const QFileInfo& child : children) {
+            if (!addDirectory(child.absoluteFilePath(), true, error)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool OCRFolderWatcher::watch(const QString& directory, bool recursive, QString* error) {
+    // IN_CREATE is only needed to follow new subdirectories, but costs little otherwise
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_EXCL_UNLINK;
+    const int descriptor =
+        ::inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(), mask);
+    if (descriptor < 0) {
+        if (error) {
+            *error = QString("Cannot watch %1: %2")
+                         .arg(directory, QString::fromLocal8Bit(std::strerror(errno)));
+        }
+        return false;
+    }
+    m_directories.insert(descriptor, directory);
+    m_recursive.insert(descriptor, recursive);
+    return true;
+}
+
+std::vector<OCRFolderWatcher::Ready> OCRFolderWatcher::wait() {
+    while (!m_stopped) {
+        std::vector<Ready> ready;
+        int timeoutMs = -1;  // Until the next event, if nothing is pending
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            const qint64 quietMs = it->lastEvent.elapsed();
+            if (quietMs >= m_debounceMs) {
+                ready.push_back({it.key(), it->landed});
+                it = m_pending.erase(it);
+            } else {
+                const int dueMs = static_cast<int>(m_debounceMs - quietMs);
+                timeoutMs = timeoutMs < 0 ? dueMs : std::min(timeoutMs, dueMs);
+                ++it;
+            }
+        }
+        if (!ready.empty()) {
+            std::sort(ready.begin(), ready.end(),
+                      [](const Ready& a, const Ready& b) { return a.landed < b.landed; });
+            return ready;
+        }
+
+        pollfd descriptors[2] = {{m_inotifyFd, POLLIN, 0}, {m_wakePipe[0], POLLIN, 0}};
+        const int count = ::poll(descriptors, 2, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            qCWarning(ocrFolderWatcher) << "poll failed:" << std::strerror(errno);
+            m_stopped = true;
+        } else if (count > 0 && descriptors[1].revents) {
+            m_stopped = true;
+        } else if (count > 0 && descriptors[0].revents & POLLIN) {
+            readEvents();
+        }
+    }
+    return {};
+}
+
+void OCRFolderWatcher::stop() {
+    const char byte = 0;
+    // Only async-signal-safe calls here; a full pipe already means "stop"
+    [[maybe_unused]] const ssize_t written = ::write(m_wakePipe[1], &byte, 1);
+}
+
+void OCRFolderWatcher::readEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return;  // EAGAIN: the queue is drained
+        }
+
+        for (const char* cursor = buffer; cursor < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+            cursor += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped, so the folders are the only record of what landed
+                ++m_overflows;
+                qCWarning(ocrFolderWatcher) << "inotify queue overflowed; rescanning"
+                                            << m_directories.size() << "directories";
+                // Subdirectories created meanwhile are lost events too; scan() watches
+                // them, so iterate over a copy
+                const QHash<int, QString> directories = m_directories;
+                for (auto it = directories.cbegin(); it != directories.cend(); ++it) {
+                    scan(it.value(), m_recursive.value(it.key()));
+                }
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                m_directories.remove(event->wd);
+                m_recursive.remove(event->wd);
+                continue;
+            }
+            const auto directory = m_directories.constFind(event->wd);
+            if (directory == m_directories.constEnd() || event->len == 0) {
+                continue;
+            }
+
+            const QString path = *directory + '/' + QFile::decodeName(event->name);
+            if (event->mask & IN_ISDIR) {
+                if (m_recursive.value(event->wd) && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                    watch(path, true, nullptr)) {
+                    // Files may have landed before the watch existed
+                    scan(path, true);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                notice(path);
+            }
+        }
+    }
+}
+
+void OCRFolderWatcher::scan(const QString& directory, bool recursive) {
+    const QFileInfoList entries = QDir(directory).entryInfoList(
+        QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    for (const QFileInfo& entry : entries) {
+        const QString path = entry.absoluteFilePath();
+        if (!entry.isDir()) {
+            notice(path);
+        } else if (recursive && watch(path, true, nullptr)) {
+            scan(path, true);
+        }
+    }
+}
+
+void OCRFolderWatcher::notice(const QString& path) {
+    if (!accepts(QFileInfo(path).fileName())) {
+        return;
+    }
+    const auto it = m_pending.find(path);
+    if (it != m_pending.end()) {
+        it->lastEvent.restart();  // Still being written: wait for quiet again
+        return;
+    }
+    Pending pending;
+    pending.landed.start();
+    pending.lastEvent.start();
+    m_pending.insert(path, pending);
+}
+
+bool OCRFolderWatcher::accepts(const QString& fileName) const {
+    // Dot files are the usual in-progress names of copy tools and uploaders
+    return !fileName.startsWith('.') &&
+           m_suffixes.contains(QFileInfo(fileName).suffix().toLower());
+}
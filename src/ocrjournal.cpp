@@ -0,0 +1,235 @@
+/*
+ * Module: OCR Batch Journal Implementation
+ *
+ * Fingerprinting, journal replay and batched fsync of finished pages.
+ */
+
+#include "ocrjournal.h"
+
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <QDateTime>
+#include <io.h>
+#endif
+
+Q_LOGGING_CATEGORY(ocrJournal, "ocr.journal")
+
+namespace {
+
+/**
+ * @brief Flush a file's data to stable storage
+ */
+bool syncFile(QFile& file) {
+    if (!file.flush()) {
+        return false;
+    }
+#if defined(Q_OS_LINUX)
+    return ::fdatasync(file.handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#else
+    return ::_commit(file.handle()) == 0;
+#endif
+}
+
+}  // namespace
+
+OCRJournal::Fingerprint OCRJournal::fingerprint(const QString& path) {
+    Fingerprint fingerprint;
+#ifdef Q_OS_UNIX
+    struct stat status;
+    if (::stat(QFile::encodeName(path).constData(), &status) != 0) {
+        return fingerprint;
+    }
+    fingerprint.identity = QByteArray::number(static_cast<quint64>(status.st_dev)) + ':' +
+                           QByteArray::number(static_cast<quint64>(status.st_ino));
+    fingerprint.size = static_cast<qint64>(status.st_size);
+#ifdef Q_OS_DARWIN
+    const timespec& modified = status.st_mtimespec;
+#else
+    const timespec& modified = status.st_mtim;
+#endif
+    fingerprint.mtimeNs = static_cast<qint64>(modified.tv_sec) * 1000000000 + modified.tv_nsec;
+#else
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        return fingerprint;
+    }
+    fingerprint.identity = info.absoluteFilePath().toUtf8();
+    fingerprint.size = info.size();
+    fingerprint.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+#endif
+    return fingerprint;
+}
+
+OCRJournal::OCRJournal(const QString& path) : m_journal(path), m_text(path + ".text") {}
+
+OCRJournal::~OCRJournal() {
+    if (m_journal.isOpen()) {
+        sync();
+    }
+}
+
+bool OCRJournal::open(QString* error) {
+    if (!load(error)) {
+        return false;
+    }
+    // Unbuffered: every record reaches the kernel before record() returns
+    const QIODevice::OpenMode mode =
+        QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered;
+    if (!m_journal.open(mode) || !m_text.open(mode)) {
+        if (error) {
+            *error = QString("Cannot open journal %1: %2")
+                         .arg(m_journal.fileName(),
+                              m_journal.isOpen() ? m_text.errorString() : m_journal.errorString());
+        }
+        m_journal.close();
+        return false;
+    }
+    m_textSize = m_text.size();
+    m_sinceSync.start();
+    qCInfo(ocrJournal) << "Journal" << m_journal.fileName() << "holds" << m_entries.size()
+                       << "finished pages";
+    return true;
+}
+
+bool OCRJournal::load(QString* error) {
+    if (!m_journal.exists()) {
+        return true;
+    }
+    if (!m_journal.open(QIODevice::ReadWrite)) {
+        if (error) {
+            *error = QString("Cannot read journal %1: %2")
+                         .arg(m_journal.fileName(), m_journal.errorString());
+        }
+        return false;
+    }
+    const QByteArray contents = m_journal.readAll();
+    const qint64 textSize = QFileInfo(m_text.fileName()).size();
+
+    qint64 complete = 0;  // End of the last whole line
+    while (complete < contents.size()) {
+        const qint64 end = contents.indexOf('\n', complete);
+        if (end < 0) {
+            break;
+        }
+        const QJsonObject line =
+            QJsonDocument::fromJson(contents.mid(complete, end - complete)).object();
+        complete = end + 1;
+
+        Entry entry;
+        entry.fingerprint.identity = line.value("id").toString().toUtf8();
+        entry.fingerprint.size = line.value("size").toString().toLongLong();
+        entry.fingerprint.mtimeNs = line.value("mtime").toString().toLongLong();
+        entry.path = line.value("path").toString();
+        entry.blank = line.value("blank").toBool();
+        entry.confidence = static_cast<float>(line.value("confidence").toDouble());
+        entry.textOffset = line.value("offset").toString().toLongLong();
+        entry.textBytes = line.value("bytes").toString().toLongLong();
+        if (entry.fingerprint.identity.isEmpty() || entry.textOffset < 0 ||
+            entry.textBytes < 0 || entry.textOffset + entry.textBytes > textSize) {
+            ++m_discarded;
+            continue;
+        }
+        m_entries.insert(entry.fingerprint.identity, entry);
+    }
+
+    if (complete < contents.size()) {
+        // The process died in the middle of a line; the page is simply done again
+        ++m_discarded;
+        m_journal.resize(complete);
+    }
+    m_journal.close();
+    if (m_discarded > 0) {
+        qCWarning(ocrJournal) << "Discarded" << m_discarded << "incomplete journal record(s)";
+    }
+    return true;
+}
+
+const OCRJournal::Entry* OCRJournal::find(const Fingerprint& fingerprint) const {
+    const auto it = m_entries.constFind(fingerprint.identity);
+    if (it == m_entries.constEnd() || !(it->fingerprint == fingerprint)) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+bool OCRJournal::record(const QString& path, const Fingerprint& fingerprint,
+                        const OCRProcessor::OCRResult& result) {
+    if (!m_journal.isOpen() || !fingerprint.isValid()) {
+        return false;
+    }
+
+    Entry entry;
+    entry.fingerprint = fingerprint;
+    entry.path = path;
+    entry.blank = result.isBlankPage;
+    entry.confidence = result.confidence;
+    entry.textOffset = m_textSize;
+
+    // Text first, so a line never points at text that was not written
+    const QByteArray text = result.text.toUtf8();
+    if (m_text.write(text) != text.size()) {
+        qCWarning(ocrJournal) << "Cannot append to" << m_text.fileName() << m_text.errorString();
+        m_textSize = m_text.size();
+        return false;
+    }
+    entry.textBytes = text.size();
+    m_textSize += text.size();
+
+    // 64-bit values are strings: JSON numbers are doubles
+    QJsonObject line;
+    line["id"] = QString::fromUtf8(fingerprint.identity);
+    line["size"] = QString::number(fingerprint.size);
+    line["mtime"] = QString::number(fingerprint.mtimeNs);
+    line["path"] = path;
+    line["blank"] = entry.blank;
+    line["confidence"] = entry.confidence;
+    line["offset"] = QString::number(entry.textOffset);
+    line["bytes"] = QString::number(entry.textBytes);
+    const QByteArray encoded = QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n';
+    if (m_journal.write(encoded) != encoded.size()) {
+        qCWarning(ocrJournal) << "Cannot append to" << m_journal.fileName()
+                              << m_journal.errorString();
+        return false;
+    }
+    m_entries.insert(fingerprint.identity, entry);
+
+    if (m_unsynced++ == 0) {
+        m_sinceSync.restart();
+    }
+    if (m_unsynced >= kSyncRecords || m_sinceSync.elapsed() >= kSyncIntervalMs) {
+        return sync();
+    }
+    return true;
+}
+
+QString OCRJournal::text(const Entry& entry) {
+    if (entry.textBytes == 0 || !m_text.isOpen()) {
+        return QString();
+    }
+    // Appends always go to the end, so moving the read position is harmless
+    if (!m_text.seek(entry.textOffset)) {
+        return QString();
+    }
+    return QString::fromUtf8(m_text.read(entry.textBytes));
+}
+
+bool OCRJournal::sync() {
+    if (m_unsynced == 0) {
+        return true;
+    }
+    // Text before journal, as for the writes
+    const bool synced = syncFile(m_text) && syncFile(m_journal);
+    if (!synced) {
+        qCWarning(ocrJournal) << "fsync failed for" << m_journal.fileName();
+    }
+    m_unsynced = 0;
+    return synced;
+}
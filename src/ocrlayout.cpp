@@ -0,0 +1,159 @@
+/*
+ * Module: OCRLayout Implementation
+ *
+ * Arena-backed, struct-of-arrays storage for Tesseract page layout results.
+ */
+
+#include "ocrlayout.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+OCRLayout::Columns::Columns(std::pmr::memory_resource* resource)
+    : left(resource),
+      top(resource),
+      right(resource),
+      bottom(resource),
+      confidence(resource),
+      parent(resource),
+      textOffset(resource),
+      textLength(resource) {}
+
+void OCRLayout::Columns::reserve(size_t count) {
+    left.reserve(count);
+    top.reserve(count);
+    right.reserve(count);
+    bottom.reserve(count);
+    confidence.reserve(count);
+    parent.reserve(count);
+    textOffset.reserve(count);
+    textLength.reserve(count);
+}
+
+void* OCRLayout::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    m_allocated += bytes;
+    return ::operator new(bytes, std::align_val_t(alignment));
+}
+
+void OCRLayout::CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    ::operator delete(p, bytes, std::align_val_t(alignment));
+}
+
+bool OCRLayout::CountingResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+/**
+ * @brief Create an empty layout backed by a fresh arena
+ */
+OCRLayout::OCRLayout(size_t initialArenaBytes)
+    : m_arena(initialArenaBytes, &m_upstream),
+      m_lines(&m_arena),
+      m_words(&m_arena),
+      m_symbols(&m_arena),
+      m_text(&m_arena) {}
+
+/**
+ * @brief Reserve column capacity up front
+ *
+ * A monotonic arena never reuses freed blocks, so growing a vector repeatedly
+ * wastes the abandoned buffers. Callers that know the element counts should
+ * reserve before appending.
+ */
+void OCRLayout::reserve(size_t lines, size_t words, size_t symbols) {
+    m_lines.reserve(lines);
+    m_words.reserve(words);
+    m_symbols.reserve(symbols);
+    // Most symbols are a single UTF-8 byte; words and lines repeat their symbols' text
+    m_text.reserve(symbols * 3 + words + lines);
+}
+
+/**
+ * @brief Append an element to the given level
+ */
+int OCRLayout::append(Level level, const QRect& box, float confidence, int parent,
+                      const char* utf8) {
+    Columns& cols = columnsFor(level);
+
+    const size_t length = utf8 ? std::strlen(utf8) : 0;
+    const size_t offset = m_text.size();
+    m_text.insert(m_text.end(), utf8, utf8 + length);
+
+    cols.left.push_back(box.left());
+    cols.top.push_back(box.top());
+    cols.right.push_back(box.left() + box.width());
+    cols.bottom.push_back(box.top() + box.height());
+    cols.confidence.push_back(confidence);
+    cols.parent.push_back(level == Level::Line ? -1 : parent);
+    cols.textOffset.push_back(static_cast<uint32_t>(offset));
+    cols.textLength.push_back(static_cast<uint32_t>(length));
+
+    return static_cast<int>(cols.size()) - 1;
+}
+
+/**
+ * @brief Append every element of another layout after this one's
+ */
+void OCRLayout::appendLayout(const OCRLayout& other, const QPoint& offset) {
+    // Each level's parents live one level up; remember where those were appended
+    const int parentBase[] = {-1, count(Level::Line), count(Level::Word)};
+    const Level levels[] = {Level::Line, Level::Word, Level::Symbol};
+
+    for (int l = 0; l < 3; ++l) {
+        const Columns& source = other.columns(levels[l]);
+        Columns& target = columnsFor(levels[l]);
+        for (size_t i = 0; i < source.size(); ++i) {
+            const size_t textOffset = m_text.size();
+            const char* text = other.m_text.data() + source.textOffset[i];
+            m_text.insert(m_text.end(), text, text + source.textLength[i]);
+
+            target.left.push_back(source.left[i] + offset.x());
+            target.top.push_back(source.top[i] + offset.y());
+            target.right.push_back(source.right[i] + offset.x());
+            target.bottom.push_back(source.bottom[i] + offset.y());
+            target.confidence.push_back(source.confidence[i]);
+            target.parent.push_back(source.parent[i] < 0 ? -1
+                                                         : source.parent[i] + parentBase[l]);
+            target.textOffset.push_back(static_cast<uint32_t>(textOffset));
+            target.textLength.push_back(source.textLength[i]);
+        }
+    }
+}
+
+int OCRLayout::count(Level level) const { return static_cast<int>(columns(level).size()); }
+
+QRect OCRLayout::boundingBox(Level level, int index) const {
+    const Columns& cols = columns(level);
+    return QRect(cols.left[index], cols.top[index], cols.right[index] - cols.left[index],
+                 cols.bottom[index] - cols.top[index]);
+}
+
+float OCRLayout::confidence(Level level, int index) const {
+    return columns(level).confidence[index];
+}
+
+int OCRLayout::parent(Level level, int index) const { return columns(level).parent[index]; }
+
+QString OCRLayout::text(Level level, int index) const {
+    const Columns& cols = columns(level);
+    return QString::fromUtf8(m_text.data() + cols.textOffset[index],
+                             static_cast<int>(cols.textLength[index]));
+}
+
+const OCRLayout::Columns& OCRLayout::columns(Level level) const {
+    switch (level) {
+        case Level::Line:
+            return m_lines;
+        case Level::Word:
+            return m_words;
+        case Level::Symbol:
+            return m_symbols;
+    }
+    throw std::invalid_argument("Unknown layout level");
+}
+
+OCRLayout::Columns& OCRLayout::columnsFor(Level level) {
+    return const_cast<Columns&>(static_cast<const OCRLayout*>(this)->columns(level));
+}
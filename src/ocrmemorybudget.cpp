@@ -0,0 +1,159 @@
+/*
+ * Module: OCR Memory Budget Implementation
+ *
+ * Pool accounting, page admission and the resident-set probe.
+ */
+
+#include "ocrmemorybudget.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+#include "ocrthreading.h"
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+Q_LOGGING_CATEGORY(ocrMemory, "ocr.memory")
+
+namespace {
+
+std::mutex s_mutex;
+std::condition_variable s_released;  ///< Signalled when a charge shrinks or the budget changes
+OCRMemoryBudget::Usage s_usage;      ///< Guarded by s_mutex
+
+/**
+ * @brief Add `delta` to a pool and track the peaks; s_mutex must be held
+ */
+void apply(OCRMemoryBudget::Pool pool, qint64 delta) {
+    const int index = static_cast<int>(pool);
+    s_usage.bytes[index] += delta;
+    s_usage.peakBytes[index] = std::max(s_usage.peakBytes[index], s_usage.bytes[index]);
+    s_usage.peakTotalBytes = std::max(s_usage.peakTotalBytes, s_usage.totalBytes());
+}
+
+}  // namespace
+
+OCRMemoryBudget::Charge::Charge(Pool pool, qint64 bytes) : m_pool(pool) {
+    resize(bytes);
+}
+
+OCRMemoryBudget::Charge::Charge(Charge&& other) noexcept
+    : m_pool(other.m_pool), m_bytes(std::exchange(other.m_bytes, 0)) {}
+
+OCRMemoryBudget::Charge& OCRMemoryBudget::Charge::operator=(Charge&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_pool = other.m_pool;
+        m_bytes = std::exchange(other.m_bytes, 0);
+    }
+    return *this;
+}
+
+void OCRMemoryBudget::Charge::resize(qint64 bytes) {
+    bytes = std::max<qint64>(0, bytes);
+    if (bytes == m_bytes) {
+        return;
+    }
+    const bool shrinking = bytes < m_bytes;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        apply(m_pool, bytes - m_bytes);
+    }
+    m_bytes = bytes;
+    if (shrinking) {
+        s_released.notify_all();
+    }
+}
+
+void OCRMemoryBudget::configure(qint64 requestedBytes) {
+    qint64 limit = 0;
+    if (requestedBytes > 0) {
+        limit = requestedBytes;
+    } else if (requestedBytes == 0) {
+        limit = static_cast<qint64>(OCRThreading::detectMemoryLimit() * kCgroupShare);
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (limit == s_usage.limitBytes) {
+            return;
+        }
+        s_usage.limitBytes = limit;
+    }
+    s_released.notify_all();
+    qCInfo(ocrMemory) << "Memory budget:"
+                      << (limit > 0 ? QString("%1 MiB").arg(limit >> 20) : QString("none"));
+}
+
+qint64 OCRMemoryBudget::limit() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_usage.limitBytes;
+}
+
+OCRMemoryBudget::Charge OCRMemoryBudget::admit(qint64 bytes, qint64 minimumBytes) {
+    bytes = std::max<qint64>(0, bytes);
+    minimumBytes = std::clamp<qint64>(minimumBytes, 0, bytes);
+    const int working = static_cast<int>(Pool::Working);
+
+    Charge charge;
+    charge.m_pool = Pool::Working;
+    std::unique_lock<std::mutex> lock(s_mutex);
+    ++s_usage.admissions;
+    QElapsedTimer waitTimer;
+    for (;;) {
+        const qint64 limit = s_usage.limitBytes;
+        const qint64 others = s_usage.totalBytes() - s_usage.bytes[working];
+        const qint64 headroom = limit - s_usage.totalBytes();
+        // What the page gets once every page in flight has finished
+        const qint64 granted = limit > 0 ? std::clamp(limit - others, minimumBytes, bytes) : bytes;
+        if (limit <= 0 || granted <= headroom || s_usage.bytes[working] == 0) {
+            if (limit > 0 && granted > headroom) {
+                ++s_usage.overcommits;
+            }
+            if (granted < bytes) {
+                ++s_usage.downscales;
+            }
+            if (waitTimer.isValid()) {
+                s_usage.waitNs += waitTimer.nsecsElapsed();
+            }
+            apply(Pool::Working, granted);
+            charge.m_bytes = granted;
+            return charge;
+        }
+        if (!waitTimer.isValid()) {
+            ++s_usage.waits;
+            waitTimer.start();
+        }
+        s_released.wait(lock);
+    }
+}
+
+bool OCRMemoryBudget::overLimit() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_usage.limitBytes > 0 && s_usage.totalBytes() > s_usage.limitBytes;
+}
+
+OCRMemoryBudget::Usage OCRMemoryBudget::usage() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_usage;
+}
+
+qint64 OCRMemoryBudget::residentBytes() {
+#ifdef Q_OS_LINUX
+    // statm: size resident shared text lib data dt, in pages
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toLongLong() * ::sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
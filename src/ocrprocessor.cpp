@@ -8,10 +8,15 @@
 
 #include "ocrprocessor.h"
 
+#include "imageanalysis.h"
+#include "ocrthreading.h"
+#include "ocrtrace.h"
+
 // Tesseract includes
 #include <leptonica/allheaders.h>
 #include <tesseract/baseapi.h>
 #include <tesseract/ocrclass.h>
+#include <tesseract/resultiterator.h>
 
 // Qt includes
 #include <QCoreApplication>
@@ -26,12 +31,171 @@
 
 // Standard library includes
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <iterator>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 // Logging category definition
 Q_LOGGING_CATEGORY(ocrProcessor, "ocr.processor")
 
+namespace {
+
+// Limits on automatic text scaling; beyond these the estimate is more
+// likely wrong than the page
+constexpr double kMinTextScale = 0.25;
+constexpr double kMaxTextScale = 3.0;
+// Rescale only when the x-height is off target by more than this fraction
+constexpr double kTextScaleTolerance = 0.1;
+// Smallest reduced-resolution first pass the cascade will run
+constexpr double kMinFastScale = 0.1;
+// First arena block of a per-region layout; a region holds a few lines at most
+constexpr size_t kRegionLayoutArenaBytes = 8 * 1024;
+// Working set of a page being prepared: RGB32 decode plus its grayscale copy
+constexpr qint64 kWorkingBytesPerPixel = 5;
+// Smallest extra scale the memory budget may impose before overcommitting
+constexpr double kMinBudgetScale = 0.5;
+
+/**
+ * @brief One text line of the cascade's fast tier
+ */
+struct CascadeLine {
+    QRect box;                   ///< Line box in fast-tier pixels
+    QString text;                ///< Space-joined words (replaced when escalated)
+    double confidenceSum = 0.0;  ///< Sum of word confidences
+    int words = 0;
+    int weakWords = 0;  ///< Words below minimumConfidence
+    bool paragraphStart = false;
+    std::unique_ptr<OCRLayout> layout;  ///< Main-engine geometry when the text was replaced
+};
+
+/**
+ * @brief Lines joined the way GetUTF8Text() lays out a page
+ */
+QString joinCascadeLines(const std::vector<CascadeLine>& lines) {
+    QString text;
+    for (const CascadeLine& line : lines) {
+        if (line.paragraphStart) {
+            text += '\n';
+        }
+        text += line.text;
+        text += '\n';
+    }
+    return text;
+}
+
+/**
+ * @brief Scale a pixel rectangle outward so no covered pixel is lost
+ */
+QRect scaledRect(const QRect& rect, double factor) {
+    return QRect(QPoint(static_cast<int>(std::floor(rect.left() * factor)),
+                        static_cast<int>(std::floor(rect.top() * factor))),
+                 QPoint(static_cast<int>(std::ceil((rect.right() + 1) * factor)) - 1,
+                        static_cast<int>(std::ceil((rect.bottom() + 1) * factor)) - 1));
+}
+
+/**
+ * @brief Recognized characters in a text, whitespace excluded
+ */
+qint64 inkCharacters(const QString& text) {
+    qint64 characters = 0;
+    for (const QChar c : text) {
+        characters += c.isSpace() ? 0 : 1;
+    }
+    return characters;
+}
+
+/**
+ * @brief Text lines and glyph boxes of a layout analysis, in reading order
+ */
+std::vector<PageSplitter::Line> layoutLines(tesseract::PageIterator* iterator) {
+    std::vector<PageSplitter::Line> lines;
+    if (!iterator || iterator->Empty(tesseract::RIL_SYMBOL)) {
+        return lines;
+    }
+
+    int block = 0;
+    int left = 0, top = 0, right = 0, bottom = 0;
+    do {
+        if (!lines.empty() && iterator->IsAtBeginningOf(tesseract::RIL_BLOCK)) {
+            ++block;
+        }
+        if (lines.empty() || iterator->IsAtBeginningOf(tesseract::RIL_TEXTLINE)) {
+            PageSplitter::Line line;
+            line.block = block;
+            iterator->BoundingBox(tesseract::RIL_TEXTLINE, &left, &top, &right, &bottom);
+            line.box = {left, top, right, bottom};
+            line.baselineLeft = line.baselineRight = bottom;
+
+            // Tesseract fits the baseline through the line's blobs; extend it to the box edges
+            int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+            if (iterator->Baseline(tesseract::RIL_TEXTLINE, &x1, &y1, &x2, &y2)) {
+                const double slope = x2 != x1 ? static_cast<double>(y2 - y1) / (x2 - x1) : 0.0;
+                line.baselineLeft = qRound(y1 + (left - x1) * slope);
+                line.baselineRight = qRound(y1 + (right - x1) * slope);
+            }
+            lines.push_back(std::move(line));
+        }
+        iterator->BoundingBox(tesseract::RIL_SYMBOL, &left, &top, &right, &bottom);
+        lines.back().glyphs.push_back({left, top, right, bottom});
+    } while (iterator->Next(tesseract::RIL_SYMBOL));
+    return lines;
+}
+
+/**
+ * @brief Text block boxes of a layout analysis, in reading order
+ */
+std::vector<QRect> layoutTextBlocks(tesseract::PageIterator* iterator) {
+    std::vector<QRect> blocks;
+    if (!iterator || iterator->Empty(tesseract::RIL_BLOCK)) {
+        return blocks;
+    }
+    do {
+        if (!PTIsTextType(iterator->BlockType())) {
+            continue;
+        }
+        int left = 0, top = 0, right = 0, bottom = 0;
+        iterator->BoundingBox(tesseract::RIL_BLOCK, &left, &top, &right, &bottom);
+        blocks.emplace_back(left, top, right - left, bottom - top);
+    } while (iterator->Next(tesseract::RIL_BLOCK));
+    return blocks;
+}
+
+/**
+ * @brief True when both configurations prepare identical pixels from a source
+ */
+bool samePreparation(const OCRProcessor::OCRConfig& a, const OCRProcessor::OCRConfig& b) {
+    return a.preprocessImage == b.preprocessImage && a.dpi == b.dpi &&
+           a.targetXHeight == b.targetXHeight && a.maxDecodeLongEdge == b.maxDecodeLongEdge &&
+           a.blankPageInkRatio == b.blankPageInkRatio;
+}
+
+/**
+ * @brief Emit a trace span for a stage that has just finished
+ */
+inline void traceStage(OCRProcessor::Stage stage, const OCRProcessor::OCRResult& result) {
+    if (OCRTrace::isEnabled()) {
+        OCRTrace::recordEndingNow(OCRProcessor::stageName(stage), "ocr,stage",
+                                  result.stage(stage).durationNs);
+    }
+}
+
+/**
+ * @brief Non-owning ImageAnalysis view of a Grayscale8 QImage
+ */
+GrayImageView grayView(const QImage& gray) {
+    GrayImageView view;
+    view.pixels = gray.constBits();
+    view.width = gray.width();
+    view.height = gray.height();
+    view.bytesPerLine = static_cast<int>(gray.bytesPerLine());
+    return view;
+}
+
+}  // namespace
+
 // Static member initialization
 QStringList OCRProcessor::s_supportedFormats;
 bool OCRProcessor::s_supportedFormatsInitialized = false;
@@ -48,9 +212,12 @@ OCRProcessor::OCRProcessor(const OCRConfig& config)
     : m_tesseractAPI(std::make_unique<TessBaseAPI>()), m_config(config), m_initialized(false) {
     qCDebug(ocrProcessor) << "Initializing OCRProcessor with language:" << m_config.language;
 
+    OCRMemoryBudget::configure(m_config.memoryBudgetBytes);
+    const qint64 residentBefore = OCRMemoryBudget::residentBytes();
     if (!initializeTesseract()) {
         throw std::runtime_error("Failed to initialize Tesseract OCR engine");
     }
+    chargeEngine(residentBefore);
 
     if (!applyConfiguration()) {
         throw std::runtime_error("Failed to apply OCR configuration");
@@ -73,9 +240,23 @@ OCRProcessor::~OCRProcessor() {
  */
 OCRProcessor::OCRProcessor(OCRProcessor&& other) noexcept
     : m_tesseractAPI(std::move(other.m_tesseractAPI)),
+      m_fastAPI(std::move(other.m_fastAPI)),
+      m_fastEngineKey(std::move(other.m_fastEngineKey)),
       m_config(std::move(other.m_config)),
       m_initialized(other.m_initialized),
-      m_tesseractDataPath(std::move(other.m_tesseractDataPath)) {
+      m_tesseractDataPath(std::move(other.m_tesseractDataPath)),
+      m_pageCache(std::move(other.m_pageCache)),
+      m_nextPageId(other.m_nextPageId),
+      m_enginePageId(other.m_enginePageId),
+      m_fastEnginePageId(other.m_fastEnginePageId),
+      m_equationAPI(std::move(other.m_equationAPI)),
+      m_equationEngineKey(std::move(other.m_equationEngineKey)),
+      m_equationEnginePageId(other.m_equationEnginePageId),
+      m_mathSearch(std::move(other.m_mathSearch)),
+      m_mathExpression(std::move(other.m_mathExpression)),
+      m_engineCharge(std::move(other.m_engineCharge)),
+      m_pageCacheCharge(std::move(other.m_pageCacheCharge)),
+      m_cancelFlag(other.m_cancelFlag) {
     other.m_initialized = false;
 }
 
@@ -90,6 +271,20 @@ OCRProcessor& OCRProcessor::operator=(OCRProcessor&& other) noexcept {
         m_config = std::move(other.m_config);
         m_initialized = other.m_initialized;
         m_tesseractDataPath = std::move(other.m_tesseractDataPath);
+        m_fastAPI = std::move(other.m_fastAPI);
+        m_fastEngineKey = std::move(other.m_fastEngineKey);
+        m_pageCache = std::move(other.m_pageCache);
+        m_nextPageId = other.m_nextPageId;
+        m_enginePageId = other.m_enginePageId;
+        m_fastEnginePageId = other.m_fastEnginePageId;
+        m_equationAPI = std::move(other.m_equationAPI);
+        m_equationEngineKey = std::move(other.m_equationEngineKey);
+        m_equationEnginePageId = other.m_equationEnginePageId;
+        m_mathSearch = std::move(other.m_mathSearch);
+        m_mathExpression = std::move(other.m_mathExpression);
+        m_engineCharge = std::move(other.m_engineCharge);
+        m_pageCacheCharge = std::move(other.m_pageCacheCharge);
+        m_cancelFlag = other.m_cancelFlag;
 
         other.m_initialized = false;
     }
@@ -100,13 +295,21 @@ OCRProcessor& OCRProcessor::operator=(OCRProcessor&& other) noexcept {
  * @brief Perform OCR on image file
  */
 OCRProcessor::OCRResult OCRProcessor::performOCR(const QString& imagePath) {
-    QMutexLocker locker(&m_mutex);
+    return performOCR(imagePath, QRect());
+}
+
+/**
+ * @brief Perform OCR on a region of an image file
+ */
+OCRProcessor::OCRResult OCRProcessor::performOCR(const QString& imagePath, const QRect& region) {
+    OCRTraceScope traceScope("performOCR(file)", "ocr", imagePath);
+    OCRTraceMutexLocker locker(&m_mutex, "m_mutex wait");
 
     OCRResult result;
     QElapsedTimer timer;
     timer.start();
 
-    qCDebug(ocrProcessor) << "Starting OCR processing for:" << imagePath;
+    qCDebug(ocrProcessor) << "Starting OCR processing for:" << imagePath << region;
 
     // Validate input
     if (!m_initialized) {
@@ -121,20 +324,139 @@ OCRProcessor::OCRResult OCRProcessor::performOCR(const QString& imagePath) {
         return result;
     }
 
-    // Load image
-    QImage image(imagePath);
-    if (image.isNull()) {
-        result.errorMessage = QString("Failed to load image: %1").arg(imagePath);
+    const QFileInfo fileInfo(imagePath);
+    if (usePreparedPage(fileInfo)) {
+        // Unchanged file seen before: only recognition remains to be done
+        const PreparedPage& page = currentPage();
+        result.imageSize = page.sourceSize;
+        result.appliedScale = page.appliedScale;
+        result.estimatedXHeight = page.estimatedXHeight;
+        result.reusedPreparedImage = true;
+        qCDebug(ocrProcessor) << "Reusing prepared page for:" << imagePath;
+    } else {
+        // Load image, already reduced to the resolution recognition will use; the
+        // working-set charge is held until the page is prepared
+        OCRMemoryBudget::Charge working;
+        QImage image = loadImage(imagePath, result, working);
+        if (image.isNull()) {
+            result.errorMessage = QString("Failed to load image: %1").arg(imagePath);
+            qCWarning(ocrProcessor) << result.errorMessage;
+            return result;
+        }
+
+        qCDebug(ocrProcessor) << "Loaded image size:" << result.imageSize
+                              << "decoded as:" << result.decodedSize;
+
+        if (!prepareImage(image, result.imageSize, result)) {
+            result.processingTimeNs = timer.nsecsElapsed();
+            result.processingTimeMs = static_cast<int>(result.processingTimeNs / 1000000);
+            logOCROperation(QString("File: %1").arg(imagePath), result);
+            return result;
+        }
+        PreparedPage& page = currentPage();
+        page.path = fileInfo.absoluteFilePath();
+        page.lastModified = fileInfo.lastModified();
+        page.fileSize = fileInfo.size();
+    }
+
+    // Map the requested region into prepared-image pixels
+    QRect target;
+    if (!region.isNull()) {
+        result.region = region.intersected(QRect(QPoint(0, 0), result.imageSize));
+        if (result.region.isEmpty()) {
+            result.errorMessage = "Selected region lies outside the image";
+            qCWarning(ocrProcessor) << result.errorMessage << region;
+            return result;
+        }
+
+        const ImageData& imageData = currentPage().imageData;
+        target = scaledRect(result.region, 1.0 / imageData.sourceScale)
+                     .intersected(QRect(0, 0, imageData.width, imageData.height));
+        if (target.isEmpty()) {
+            result.errorMessage = "Selected region is too small to recognize";
+            qCWarning(ocrProcessor) << result.errorMessage << region;
+            return result;
+        }
+    }
+
+    extractText(target, result);
+    result.processingTimeNs = timer.nsecsElapsed();
+    result.processingTimeMs = static_cast<int>(result.processingTimeNs / 1000000);
+
+    logOCROperation(QString("File: %1").arg(imagePath), result);
+    return result;
+}
+
+/**
+ * @brief Perform OCR on one band of a large page, decoding only the band
+ */
+OCRProcessor::OCRResult OCRProcessor::performOCRBand(const QString& imagePath,
+                                                     const QRect& band) {
+    // Clip rectangles are in stored pixels, which EXIF orientation reorders
+    QSize pageSize;
+    {
+        QImageReader probe(imagePath);
+        if (probe.transformation() != QImageIOHandler::TransformationNone) {
+            return performOCR(imagePath, band);
+        }
+        pageSize = probe.size();
+    }
+
+    OCRTraceScope traceScope("performOCRBand", "ocr", imagePath);
+    OCRTraceMutexLocker locker(&m_mutex, "m_mutex wait");
+
+    OCRResult result;
+    QElapsedTimer timer;
+    timer.start();
+
+    qCDebug(ocrProcessor) << "Starting band OCR processing for:" << imagePath << band;
+
+    if (!m_initialized) {
+        result.errorMessage = "OCR processor not initialized";
+        qCWarning(ocrProcessor) << result.errorMessage;
+        return result;
+    }
+
+    if (!validateImage(imagePath)) {
+        result.errorMessage = QString("Invalid or unsupported image file: %1").arg(imagePath);
         qCWarning(ocrProcessor) << result.errorMessage;
         return result;
     }
 
-    result.imageSize = image.size();
-    qCDebug(ocrProcessor) << "Loaded image size:" << result.imageSize;
+    result.region = band.intersected(QRect(QPoint(0, 0), pageSize));
+    if (result.region.isEmpty()) {
+        result.errorMessage = "Selected region lies outside the image";
+        qCWarning(ocrProcessor) << result.errorMessage << band;
+        return result;
+    }
 
-    // Process the image
-    result = performOCR(image);
-    result.processingTimeMs = timer.elapsed();
+    // The band is prepared like a page of its own and, like an in-memory
+    // image, is not kept for later lookups
+    bool prepared = false;
+    {
+        OCRMemoryBudget::Charge working;
+        const QImage image = loadImage(imagePath, result, working, result.region);
+        if (image.isNull()) {
+            result.errorMessage = QString("Failed to load image: %1").arg(imagePath);
+            qCWarning(ocrProcessor) << result.errorMessage;
+            return result;
+        }
+        prepared = prepareImage(image, result.region.size(), result, pageSize);
+    }
+    if (prepared) {
+        extractText(QRect(), result);
+        for (Equation& equation : result.equations) {
+            equation.box.translate(result.region.topLeft());
+        }
+        if (result.layout) {
+            auto layout = std::make_shared<OCRLayout>();
+            layout->appendLayout(*result.layout, result.region.topLeft());
+            result.layout = std::move(layout);
+        }
+    }
+    result.imageSize = pageSize;
+    result.processingTimeNs = timer.nsecsElapsed();
+    result.processingTimeMs = static_cast<int>(result.processingTimeNs / 1000000);
 
     logOCROperation(QString("File: %1").arg(imagePath), result);
     return result;
@@ -144,7 +466,8 @@ OCRProcessor::OCRResult OCRProcessor::performOCR(const QString& imagePath) {
  * @brief Perform OCR on QImage
  */
 OCRProcessor::OCRResult OCRProcessor::performOCR(const QImage& image) {
-    QMutexLocker locker(&m_mutex);
+    OCR_TRACE_SCOPE("performOCR(image)", "ocr");
+    OCRTraceMutexLocker locker(&m_mutex, "m_mutex wait");
 
     OCRResult result;
     QElapsedTimer timer;
@@ -164,26 +487,394 @@ OCRProcessor::OCRResult OCRProcessor::performOCR(const QImage& image) {
         return result;
     }
 
-    result.imageSize = image.size();
+    result.decodedSize = image.size();
+    processImage(image, image.size(), result);
+    result.processingTimeNs = timer.nsecsElapsed();
+    result.processingTimeMs = static_cast<int>(result.processingTimeNs / 1000000);
+
+    logOCROperation("QImage processing", result);
+    return result;
+}
+
+/**
+ * @brief Decode an image file at the resolution OCR will actually use
+ *
+ * The header is read first so the target size is known before any pixels are
+ * decoded. Handlers that support QImageIOHandler::ScaledSize (JPEG does the
+ * reduction in the DCT domain) then never materialise the full-resolution
+ * bitmap; other formats decode at full size and are reduced in preprocessing.
+ * With a clip rectangle the band is the source: handlers that support
+ * QImageIOHandler::ClipRect decode only its rows.
+ */
+QImage OCRProcessor::loadImage(const QString& imagePath, OCRResult& result,
+                               OCRMemoryBudget::Charge& working, const QRect& clip) const {
+    QElapsedTimer stageTimer;
+    stageTimer.start();
+
+    QImageReader reader(imagePath);
+    reader.setAutoTransform(true);
+
+    // Header size is before EXIF orientation is applied
+    QSize pageSize = reader.size();
+    if (pageSize.isValid() &&
+        reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+        pageSize.transpose();
+    }
+    const QSize sourceSize = clip.isValid() ? clip.size() : pageSize;
+
+    // Glyph size is unknown before decoding, so with automatic text scaling
+    // only the size cap can be applied here. A band gets its page's cap, so
+    // all bands and the untiled page share one scale.
+    const double textScale = m_config.targetXHeight > 0 ? 1.0 : 0.0;
+    double scale = pageSize.isValid() ? targetScale(pageSize, textScale) : 1.0;
+    const bool scaledDecode = reader.supportsOption(QImageIOHandler::ScaledSize);
+
+    // Wait for room in the memory budget before any pixels exist. A handler
+    // without scaled decoding materialises the full bitmap whatever the scale,
+    // and one without clipping the full page whatever the clip, so that page
+    // waits for room for all of it instead of being shrunk.
+    if (sourceSize.isValid()) {
+        if (clip.isValid() && !reader.supportsOption(QImageIOHandler::ClipRect)) {
+            working = admitPage(reader.size(), false, result);
+        } else if (scaledDecode) {
+            working = admitPage(scale < 1.0 ? sourceSize * scale : sourceSize, true, result);
+        } else {
+            working = admitPage(sourceSize, false, result);
+        }
+        scale *= result.budgetScale;
+    }
+    if (scale < 1.0 && scaledDecode) {
+        // Scaled size and clip refer to the stored (untransformed) image
+        reader.setScaledSize((reader.size() * scale).expandedTo(QSize(1, 1)));
+        if (clip.isValid()) {
+            reader.setScaledClipRect(scaledRect(clip, scale).intersected(
+                QRect(QPoint(0, 0), reader.scaledSize())));
+        }
+    } else if (clip.isValid()) {
+        reader.setClipRect(clip);
+    }
+
+    QImage image = reader.read();
+    if (!image.isNull() && image.format() != QImage::Format_Grayscale8 &&
+        m_config.preprocessImage) {
+        // Qt has no gray decode option; dropping colour right away halves or
+        // quarters what the remaining stages touch
+        image.convertTo(QImage::Format_Grayscale8);
+    }
+
+    result.stage(Stage::Decode).durationNs = stageTimer.nsecsElapsed();
+    result.stage(Stage::Decode).bytesAllocated = image.sizeInBytes();
+    traceStage(Stage::Decode, result);
+
+    if (image.isNull()) {
+        qCWarning(ocrProcessor) << "Image decode failed:" << reader.errorString();
+        return image;
+    }
+
+    result.imageSize = sourceSize.isValid() ? sourceSize : image.size();
+    result.decodedSize = image.size();
+
+    const qint64 fullDecodeBytes = static_cast<qint64>(result.imageSize.width()) *
+                                   result.imageSize.height() * 4;
+    result.decodeBytesSaved = std::max<qint64>(0, fullDecodeBytes - image.sizeInBytes());
+    return image;
+}
+
+/**
+ * @brief Admit a page to the memory budget by its decoded size
+ *
+ * The estimate covers the RGB32 decode plus its grayscale copy. Without
+ * preprocessing nothing rescales the page, so, like a page the caller cannot
+ * shrink, it must be admitted whole.
+ */
+OCRMemoryBudget::Charge OCRProcessor::admitPage(const QSize& decodedSize, bool shrinkable,
+                                                OCRResult& result) const {
+    const qint64 estimate =
+        static_cast<qint64>(decodedSize.width()) * decodedSize.height() * kWorkingBytesPerPixel;
+    const qint64 minimum = shrinkable && m_config.preprocessImage
+                               ? static_cast<qint64>(estimate * kMinBudgetScale * kMinBudgetScale)
+                               : estimate;
+
+    OCRMemoryBudget::Charge charge = OCRMemoryBudget::admit(estimate, minimum);
+    if (charge.bytes() < estimate) {
+        result.budgetScale = std::sqrt(static_cast<double>(charge.bytes()) / estimate);
+        qCInfo(ocrProcessor) << "Memory budget: decoding page at" << result.budgetScale
+                             << "of its target size";
+    }
+    return charge;
+}
+
+/**
+ * @brief Scale from source pixels to the pixels handed to Tesseract
+ *
+ * Combines the text-size or DPI normalisation done by preprocessing with the
+ * maxDecodeLongEdge cap. Only applies when preprocessing is enabled.
+ */
+double OCRProcessor::targetScale(const QSize& sourceSize, double textScale) const {
+    if (!m_config.preprocessImage) {
+        return 1.0;
+    }
+
+    // Without a text measurement assume 300 DPI is optimal
+    double scale = textScale;
+    if (scale <= 0.0) {
+        scale = (m_config.dpi > 0 && m_config.dpi != 300) ? m_config.dpi / 300.0 : 1.0;
+    }
+
+    const int longEdge = std::max(sourceSize.width(), sourceSize.height());
+    if (m_config.maxDecodeLongEdge > 0 && longEdge * scale > m_config.maxDecodeLongEdge) {
+        scale = static_cast<double>(m_config.maxDecodeLongEdge) / longEdge;
+    }
+    return scale;
+}
+
+/**
+ * @brief Check whether a page carries too little ink to be worth recognizing
+ */
+bool OCRProcessor::isBlankPage(const QImage& gray) const {
+    // A fixed mid-gray level misses pencil and light print on white paper
+    const GrayImageView view = grayView(gray);
+    const int inkLevel = ImageAnalysis::inkLevel(view);
+    const ImageAnalysis::InkStatistics ink = ImageAnalysis::measureInk(view, inkLevel);
+    const bool blank = ink.isBlank(m_config.blankPageInkRatio);
+    qCDebug(ocrProcessor) << "Ink coverage:" << ink.inkRatio << "below level" << inkLevel
+                          << "mean:" << ink.mean << "stddev:" << ink.standardDeviation
+                          << (blank ? "(blank)" : "");
+    return blank;
+}
+
+/**
+ * @brief Derive the scale that brings the page's x-height to the target
+ *
+ * A projection-profile pass over the decoded page costs a few milliseconds;
+ * pages without enough text lines (figures, near-blank scans) fall back to
+ * the DPI-based scale.
+ */
+double OCRProcessor::estimateTextScale(const QImage& gray, const QSize& sourceSize,
+                                       OCRResult& result) const {
+    const ImageAnalysis::TextMetrics metrics = ImageAnalysis::estimateTextMetrics(grayView(gray));
+    if (!metrics.isReliable()) {
+        qCDebug(ocrProcessor) << "Text scale estimate unreliable (" << metrics.lineCount
+                              << "lines ), using DPI scaling";
+        return 0.0;
+    }
+
+    result.estimatedXHeight = metrics.xHeight * sourceSize.width() / gray.width();
+    const double scale = std::clamp(m_config.targetXHeight / result.estimatedXHeight,
+                                    kMinTextScale, kMaxTextScale);
+    qCDebug(ocrProcessor) << "Estimated x-height:" << result.estimatedXHeight << "px over"
+                          << metrics.lineCount << "lines, text scale:" << scale;
+    return scale;
+}
+
+/**
+ * @brief Whole-page pipeline for an already decoded image
+ *
+ * The caller decoded the image, so it can only be admitted to the memory
+ * budget after the fact: the charge stands for the image and preparation's
+ * copies while they coexist. A budget scale below 1 still shrinks what
+ * preprocessing produces, but not the image the caller already holds.
+ */
+void OCRProcessor::processImage(const QImage& image, const QSize& sourceSize,
+                                OCRResult& result) {
+    bool prepared = false;
+    {
+        // Only preparation needs the working set; recognition reads the cached page
+        const OCRMemoryBudget::Charge working = admitPage(image.size(), true, result);
+        prepared = prepareImage(image, sourceSize, result);
+    }
+    if (prepared) {
+        extractText(QRect(), result);
+    }
+}
+
+/**
+ * @brief Look up an unchanged file in m_pageCache and make it the current page
+ */
+bool OCRProcessor::usePreparedPage(const QFileInfo& fileInfo) {
+    const QString path = fileInfo.absoluteFilePath();
+    for (auto it = m_pageCache.begin(); it != m_pageCache.end(); ++it) {
+        if (it->path != path) {
+            continue;
+        }
+        if (it->lastModified != fileInfo.lastModified() || it->fileSize != fileInfo.size()) {
+            // Release its charge now; a failed reload would otherwise leave it charged
+            m_pageCache.erase(it);
+            trimPageCache();
+            return false;
+        }
+        m_pageCache.splice(m_pageCache.begin(), m_pageCache, it);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Pixel bytes charged against OCRConfig::pageCacheBytes
+ */
+qint64 OCRProcessor::PreparedPage::bytes() const {
+    qint64 total = static_cast<qint64>(imageData.height) * imageData.bytesPerLine;
+    if (fastImageData.pixels && fastImageData.pixels != imageData.pixels) {
+        total += static_cast<qint64>(fastImageData.height) * fastImageData.bytesPerLine;
+    }
+    return total;
+}
+
+/**
+ * @brief Evict least recently used pages beyond OCRConfig::pageCacheBytes
+ *
+ * Pages are also evicted while the process is over its memory budget, so
+ * cached pages give way to pages waiting for admission.
+ */
+void OCRProcessor::trimPageCache() {
+    qint64 total = 0;
+    for (const PreparedPage& page : m_pageCache) {
+        total += page.bytes();
+    }
+    m_pageCacheCharge.resize(total);
+    while (m_pageCache.size() > 1 &&
+           (total > m_config.pageCacheBytes || OCRMemoryBudget::overLimit())) {
+        total -= m_pageCache.back().bytes();
+        qCDebug(ocrProcessor) << "Evicting prepared page:" << m_pageCache.back().path;
+        m_pageCache.pop_back();
+        m_pageCacheCharge.resize(total);
+    }
+}
+
+/**
+ * @brief Charge the resident-set growth since `residentBefore` to m_engineCharge
+ *
+ * Growth from other threads in the meantime is charged too; engines are
+ * rarely created while pages are in flight, so the error stays small.
+ */
+void OCRProcessor::chargeEngine(qint64 residentBefore) {
+    const qint64 growth = OCRMemoryBudget::residentBytes() - residentBefore;
+    m_engineCharge.resize(m_engineCharge.bytes() + std::max<qint64>(0, growth));
+}
+
+/**
+ * @brief SetImage() unless the engine already holds this page
+ */
+void OCRProcessor::loadIntoEngine(TessBaseAPI& api, const ImageData& imageData, quint64 pageId,
+                                  quint64& heldPageId) const {
+    if (heldPageId != pageId) {
+        api.SetImage(imageData.pixels, imageData.width, imageData.height,
+                     imageData.bytesPerPixel, imageData.bytesPerLine);
+        heldPageId = pageId;
+    }
+}
+
+/**
+ * @brief Recognize with a monitor whose cancel callback reads m_cancelFlag
+ *
+ * Tesseract polls the callback between words, so a set flag stops a page
+ * within a few milliseconds instead of after the whole page.
+ */
+bool OCRProcessor::recognize(TessBaseAPI& api) const {
+    if (!m_cancelFlag) {
+        return api.Recognize(nullptr) == 0;
+    }
+    if (cancelRequested()) {
+        return false;
+    }
+    ETEXT_DESC monitor;
+    monitor.cancel = [](void* flag, int) {
+        return static_cast<const std::atomic<bool>*>(flag)->load(std::memory_order_relaxed);
+    };
+    monitor.cancel_this = const_cast<std::atomic<bool>*>(m_cancelFlag);
+    return api.Recognize(&monitor) == 0 && !cancelRequested();
+}
+
+bool OCRProcessor::cancelRequested() const {
+    return m_cancelFlag && m_cancelFlag->load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Preprocess and convert a decoded image into a new m_pageCache entry
+ */
+bool OCRProcessor::prepareImage(const QImage& image, const QSize& sourceSize,
+                                OCRResult& result, const QSize& pageSize) {
+    result.imageSize = sourceSize;
 
     try {
-        // Preprocess image if enabled
-        QImage processedImage = m_config.preprocessImage ? preprocessImage(image) : image;
+        QElapsedTimer stageTimer;
+
+        // Preprocess image if enabled, applying whatever scaling decode did not
+        stageTimer.start();
+        QImage processedImage = image;
+        if (m_config.preprocessImage && image.width() > 0) {
+            const QImage gray = image.format() == QImage::Format_Grayscale8
+                                    ? image
+                                    : image.convertToFormat(QImage::Format_Grayscale8);
+
+            // Blank pages end here with an empty, flagged result
+            if (m_config.blankPageInkRatio > 0.0 && isBlankPage(gray)) {
+                result.isBlankPage = true;
+                result.success = true;
+                result.stage(Stage::Preprocess).durationNs = stageTimer.nsecsElapsed();
+                traceStage(Stage::Preprocess, result);
+                return false;
+            }
+
+            const double textScale =
+                m_config.targetXHeight > 0 ? estimateTextScale(gray, sourceSize, result) : 0.0;
+
+            const double decodedScale = static_cast<double>(image.width()) / sourceSize.width();
+            double remainingScale =
+                targetScale(pageSize.isValid() ? pageSize : sourceSize, textScale) *
+                result.budgetScale / decodedScale;
+
+            // Resampling costs more than a small mismatch in glyph size
+            if (textScale > 0.0 && std::abs(remainingScale - 1.0) < kTextScaleTolerance) {
+                remainingScale = 1.0;
+            }
+            result.appliedScale = decodedScale * remainingScale;
+            processedImage = preprocessImage(gray, remainingScale);
+        } else if (sourceSize.width() > 0) {
+            result.appliedScale = static_cast<double>(image.width()) / sourceSize.width();
+        }
+        result.stage(Stage::Preprocess).durationNs = stageTimer.nsecsElapsed();
+        if (processedImage.constBits() != image.constBits()) {
+            result.stage(Stage::Preprocess).bytesAllocated = processedImage.sizeInBytes();
+        }
+        traceStage(Stage::Preprocess, result);
 
         // Convert image for Tesseract
+        stageTimer.restart();
         ImageData imageData = convertImageForTesseract(processedImage);
+        if (processedImage.width() > 0) {
+            imageData.sourceScale =
+                static_cast<double>(sourceSize.width()) / processedImage.width();
+        }
+        result.stage(Stage::Convert).durationNs = stageTimer.nsecsElapsed();
+        if (imageData.pixels != processedImage.constBits()) {
+            result.stage(Stage::Convert).bytesAllocated =
+                static_cast<qint64>(imageData.height) * imageData.bytesPerLine;
+        }
+        traceStage(Stage::Convert, result);
+
+        if (!imageData.pixels) {
+            return false;
+        }
+
+        // In-memory images are never looked up again; only files stay cached
+        m_pageCache.remove_if([](const PreparedPage& page) { return page.path.isEmpty(); });
 
-        // Extract text
-        result = extractText(imageData);
-        result.processingTimeMs = timer.elapsed();
+        PreparedPage page;
+        page.id = m_nextPageId++;
+        page.sourceSize = sourceSize;
+        page.imageData = std::move(imageData);
+        page.appliedScale = result.appliedScale;
+        page.estimatedXHeight = result.estimatedXHeight;
+        m_pageCache.push_front(std::move(page));
+        trimPageCache();
+        return true;
 
     } catch (const std::exception& e) {
         result.errorMessage = QString("OCR processing failed: %1").arg(e.what());
         qCWarning(ocrProcessor) << result.errorMessage;
+        return false;
     }
-
-    logOCROperation("QImage processing", result);
-    return result;
 }
 
 /**
@@ -207,6 +898,14 @@ OCRProcessor::OCRResult OCRProcessor::performOCR(const QString& imagePath, Proce
     return result;
 }
 
+/**
+ * @brief Attach or detach the flag recognize() watches
+ */
+void OCRProcessor::setCancelFlag(const std::atomic<bool>* flag) {
+    QMutexLocker locker(&m_mutex);
+    m_cancelFlag = flag;
+}
+
 /**
  * @brief Get current configuration
  */
@@ -222,7 +921,20 @@ bool OCRProcessor::setConfig(const OCRConfig& config) {
     QMutexLocker locker(&m_mutex);
 
     qCDebug(ocrProcessor) << "Updating OCR configuration";
+
+    // Mode, language and whitelist only affect recognition; cached pages stay valid
+    if (!samePreparation(m_config, config)) {
+        m_pageCache.clear();
+    } else if (config.fastScale != m_config.fastScale ||
+               config.fastDataPath != m_config.fastDataPath) {
+        for (PreparedPage& page : m_pageCache) {
+            page.fastImageData = ImageData{};
+        }
+        m_fastEnginePageId = 0;
+    }
     m_config = config;
+    OCRMemoryBudget::configure(m_config.memoryBudgetBytes);
+    trimPageCache();
 
     return applyConfiguration();
 }
@@ -311,6 +1023,54 @@ QStringList OCRProcessor::getSupportedFormats() {
     return s_supportedFormats;
 }
 
+/**
+ * @brief Get stage name
+ */
+const char* OCRProcessor::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Decode:
+            return "decode";
+        case Stage::Preprocess:
+            return "preprocess";
+        case Stage::Convert:
+            return "convert";
+        case Stage::Layout:
+            return "layout";
+        case Stage::Recognition:
+            return "recognition";
+        case Stage::Postprocess:
+            return "postprocess";
+        case Stage::Count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* OCRProcessor::modeName(ProcessingMode mode) {
+    switch (mode) {
+        case ProcessingMode::Auto:
+            return "auto";
+        case ProcessingMode::Text:
+            return "text";
+        case ProcessingMode::Equations:
+            return "equations";
+        case ProcessingMode::Mixed:
+            return "mixed";
+    }
+    return "unknown";
+}
+
+bool OCRProcessor::modeFromName(const QString& name, ProcessingMode& mode) {
+    for (const ProcessingMode candidate : {ProcessingMode::Auto, ProcessingMode::Text,
+                                           ProcessingMode::Equations, ProcessingMode::Mixed}) {
+        if (name.compare(QLatin1String(modeName(candidate)), Qt::CaseInsensitive) == 0) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Initialize Tesseract
  */
@@ -367,6 +1127,17 @@ void OCRProcessor::cleanupTesseract() {
         m_tesseractAPI->End();
         qCDebug(ocrProcessor) << "Tesseract resources cleaned up";
     }
+    if (m_fastAPI) {
+        m_fastAPI->End();
+        m_fastAPI.reset();
+    }
+    m_fastEngineKey.clear();
+    if (m_equationAPI) {
+        m_equationAPI->End();
+        m_equationAPI.reset();
+    }
+    m_equationEngineKey.clear();
+    m_engineCharge.reset();
     m_initialized = false;
 }
 
@@ -380,9 +1151,25 @@ bool OCRProcessor::applyConfiguration() {
 
     qCDebug(ocrProcessor) << "Applying OCR configuration";
 
+    configureEngine(*m_tesseractAPI, m_config.mode);
+    if (m_fastAPI) {
+        configureEngine(*m_fastAPI, m_config.mode);
+    }
+    if (m_equationAPI) {
+        configureEngine(*m_equationAPI, ProcessingMode::Equations);
+    }
+
+    qCDebug(ocrProcessor) << "Configuration applied successfully";
+    return true;
+}
+
+/**
+ * @brief Apply page segmentation, engine mode, DPI and whitelist to one engine
+ */
+void OCRProcessor::configureEngine(TessBaseAPI& api, ProcessingMode mode) const {
     // Set page segmentation mode based on processing mode
     tesseract::PageSegMode psm;
-    switch (m_config.mode) {
+    switch (mode) {
         case ProcessingMode::Text:
             psm = tesseract::PSM_AUTO;
             break;
@@ -397,32 +1184,107 @@ bool OCRProcessor::applyConfiguration() {
             break;
     }
 
-    m_tesseractAPI->SetPageSegMode(psm);
+    api.SetPageSegMode(psm);
 
     // Set OCR Engine Mode
-    m_tesseractAPI->SetVariable("tessedit_ocr_engine_mode", "1");  // Use LSTM OCR engine
+    api.SetVariable("tessedit_ocr_engine_mode", "1");  // Use LSTM OCR engine
 
     // Set DPI if specified
     if (m_config.dpi > 0) {
-        m_tesseractAPI->SetVariable("user_defined_dpi",
-                                    QString::number(m_config.dpi).toLocal8Bit().constData());
+        api.SetVariable("user_defined_dpi",
+                        QString::number(m_config.dpi).toLocal8Bit().constData());
     }
 
-    // Configure equation recognition if needed
-    if (m_config.mode == ProcessingMode::Equations || m_config.mode == ProcessingMode::Mixed) {
-        m_tesseractAPI->SetVariable(
+    // Configure equation recognition if needed; Mixed pages route math to m_equationAPI
+    if (mode == ProcessingMode::Equations) {
+        api.SetVariable(
             "tessedit_char_whitelist",
             "0123456789+-*/=()[]{}^_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ .,");
+    } else {
+        // The engine outlives mode switches; drop a whitelist left by a previous mode
+        api.SetVariable("tessedit_char_whitelist", "");
     }
 
-    qCDebug(ocrProcessor) << "Configuration applied successfully";
+    // Per-symbol alternatives for the grammar search over equation lines
+    const bool symbolChoices = mode == ProcessingMode::Equations && m_config.grammarSearch;
+    api.SetVariable("lstm_choice_mode", symbolChoices ? "2" : "0");
+}
+
+/**
+ * @brief Initialize and configure an additional engine
+ */
+std::unique_ptr<TessBaseAPI> OCRProcessor::createEngine(const QString& dataPath,
+                                                        ProcessingMode mode) const {
+    const QByteArray dataPathBytes = dataPath.toLocal8Bit();
+    const QByteArray languageBytes = m_config.language.toLocal8Bit();
+    auto api = std::make_unique<TessBaseAPI>();
+    if (api->Init(dataPath.isEmpty() ? nullptr : dataPathBytes.constData(),
+                  languageBytes.constData()) != 0) {
+        return nullptr;
+    }
+    configureEngine(*api, mode);
+    return api;
+}
+
+/**
+ * @brief Create (or re-create) the cascade's first-pass engine on demand
+ */
+bool OCRProcessor::ensureFastEngine() {
+    const QString dataPath =
+        m_config.fastDataPath.isEmpty() ? m_tesseractDataPath : m_config.fastDataPath;
+    const QString key = dataPath + '|' + m_config.language;
+    if (key == m_fastEngineKey) {
+        return m_fastAPI != nullptr;
+    }
+
+    if (m_fastAPI) {
+        m_fastAPI->End();
+    }
+    const qint64 residentBefore = OCRMemoryBudget::residentBytes();
+    m_fastAPI = createEngine(dataPath, m_config.mode);
+    chargeEngine(residentBefore);
+    m_fastEngineKey = key;
+    m_fastEnginePageId = 0;
+
+    if (!m_fastAPI) {
+        qCWarning(ocrProcessor) << "Cascade disabled: cannot initialize fast engine from"
+                                << dataPath;
+        return false;
+    }
+    qCInfo(ocrProcessor) << "Cascade fast engine initialized from" << dataPath;
+    return true;
+}
+
+/**
+ * @brief Create (or re-create) the Mixed-mode equation engine on demand
+ */
+bool OCRProcessor::ensureEquationEngine() {
+    const QString key = m_tesseractDataPath + '|' + m_config.language;
+    if (key == m_equationEngineKey) {
+        return m_equationAPI != nullptr;
+    }
+
+    if (m_equationAPI) {
+        m_equationAPI->End();
+    }
+    const qint64 residentBefore = OCRMemoryBudget::residentBytes();
+    m_equationAPI = createEngine(m_tesseractDataPath, ProcessingMode::Equations);
+    chargeEngine(residentBefore);
+    m_equationEngineKey = key;
+    m_equationEnginePageId = 0;
+
+    if (!m_equationAPI) {
+        qCWarning(ocrProcessor) << "Mixed pages fall back to a single engine: cannot initialize"
+                                << "the equation engine";
+        return false;
+    }
     return true;
 }
 
 /**
  * @brief Preprocess image for better OCR
  */
-QImage OCRProcessor::preprocessImage(const QImage& image) const {
+QImage OCRProcessor::preprocessImage(const QImage& image, double scaleFactor) const {
     qCDebug(ocrProcessor) << "Preprocessing image for OCR";
 
     QImage processed = image;
@@ -432,9 +1294,8 @@ QImage OCRProcessor::preprocessImage(const QImage& image) const {
         processed = processed.convertToFormat(QImage::Format_Grayscale8);
     }
 
-    // Scale image if needed (optimal DPI for OCR is usually 300)
-    if (m_config.dpi > 0 && m_config.dpi != 300) {
-        double scaleFactor = m_config.dpi / 300.0;
+    // Scale image if needed; sub-percent factors are left to Tesseract
+    if (std::abs(scaleFactor - 1.0) > 0.01) {
         QSize newSize = processed.size() * scaleFactor;
         processed = processed.scaled(newSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
@@ -451,20 +1312,16 @@ OCRProcessor::ImageData OCRProcessor::convertImageForTesseract(const QImage& ima
 
     ImageData imageData;
 
-    // Convert to RGB32 format for consistent processing
-    QImage rgbImage = image.convertToFormat(QImage::Format_RGB32);
+    // Tesseract thresholds to gray anyway; 8-bit input is shared, not copied
+    imageData.buffer = image.format() == QImage::Format_Grayscale8
+                           ? image
+                           : image.convertToFormat(QImage::Format_Grayscale8);
 
-    imageData.width = rgbImage.width();
-    imageData.height = rgbImage.height();
-    imageData.bytesPerPixel = 4;  // RGB32 format
-    imageData.bytesPerLine = rgbImage.bytesPerLine();
-
-    // Allocate memory for image data
-    size_t dataSize = imageData.height * imageData.bytesPerLine;
-    imageData.data = std::make_unique<unsigned char[]>(dataSize);
-
-    // Copy image data
-    std::memcpy(imageData.data.get(), rgbImage.constBits(), dataSize);
+    imageData.pixels = imageData.buffer.constBits();
+    imageData.width = imageData.buffer.width();
+    imageData.height = imageData.buffer.height();
+    imageData.bytesPerPixel = 1;  // Grayscale8 format
+    imageData.bytesPerLine = imageData.buffer.bytesPerLine();
 
     qCDebug(ocrProcessor) << "Image converted:" << imageData.width << "x" << imageData.height;
     return imageData;
@@ -472,27 +1329,45 @@ OCRProcessor::ImageData OCRProcessor::convertImageForTesseract(const QImage& ima
 
 /**
  * @brief Extract text using Tesseract
+ *
+ * Layout analysis and recognition are run as separate calls so each can be
+ * timed: Recognize() reuses the block list built by AnalyseLayout(). The page
+ * is only handed to Tesseract once; later regions just move the rectangle,
+ * which restricts thresholding, layout and recognition to that area.
  */
-OCRProcessor::OCRResult OCRProcessor::extractText(const ImageData& imageData) {
+void OCRProcessor::extractText(const QRect& region, OCRResult& result) {
     qCDebug(ocrProcessor) << "Extracting text with Tesseract";
 
-    OCRResult result;
+    const ImageData& imageData = currentPage().imageData;
+    const QRect area = region.isNull() ? QRect(0, 0, imageData.width, imageData.height) : region;
 
     try {
-        // Set image data in Tesseract
-        m_tesseractAPI->SetImage(imageData.data.get(), imageData.width, imageData.height,
-                                 imageData.bytesPerPixel, imageData.bytesPerLine);
-
-        // Perform OCR
-        char* ocrResult = m_tesseractAPI->GetUTF8Text();
+        // The cascade's merged lines have no symbol alternatives to correct equations
+        // from, so Equations mode always runs the single engine
+        float confidence;
+        if (m_config.mode == ProcessingMode::Mixed && ensureEquationEngine()) {
+            confidence = recognizeMixed(area, result);
+        } else if (m_config.cascade && m_config.mode != ProcessingMode::Equations &&
+                   ensureFastEngine()) {
+            confidence = recognizeCascade(area, result);
+        } else {
+            confidence = recognizeSingle(area, result);
+        }
 
-        if (ocrResult) {
-            result.text = QString::fromUtf8(ocrResult);
-            delete[] ocrResult;
+        if (cancelRequested()) {
+            // Partial text is dropped; the caller is expected to run the page again
+            result.cancelled = true;
+            result.text.clear();
+            result.layout.reset();
+            result.equations.clear();
+            result.errorMessage = "OCR cancelled";
+            qCInfo(ocrProcessor) << result.errorMessage;
+        } else if (confidence >= 0.0f) {
+            result.stage(Stage::Recognition).bytesAllocated += result.text.size() * sizeof(QChar);
 
             // Get confidence score if enabled
             if (m_config.enableConfidenceScoring) {
-                result.confidence = m_tesseractAPI->MeanTextConf();
+                result.confidence = confidence;
 
                 // Check if confidence meets minimum threshold
                 if (result.confidence >= m_config.minimumConfidence) {
@@ -518,15 +1393,712 @@ OCRProcessor::OCRResult OCRProcessor::extractText(const ImageData& imageData) {
         result.errorMessage = QString("Exception during text extraction: %1").arg(e.what());
         qCCritical(ocrProcessor) << result.errorMessage;
     }
+}
 
-    return result;
+/**
+ * @brief Single-engine recognition of a rectangle of the prepared page
+ */
+float OCRProcessor::recognizeSingle(const QRect& area, OCRResult& result) {
+    PreparedPage& page = currentPage();
+    const ImageData& imageData = page.imageData;
+    QElapsedTimer stageTimer;
+
+    // Segmentation does not depend on mode or whitelist: reuse the blocks found last time
+    const bool segmenting = m_tesseractAPI->GetPageSegMode() == tesseract::PSM_AUTO;
+    if (segmenting && page.hasLayout && page.layoutArea == area) {
+        result.reusedLayout = true;
+        return recognizeCachedBlocks(result);
+    }
+
+    // Set image data in Tesseract and run thresholding plus page layout analysis
+    stageTimer.start();
+    loadIntoEngine(*m_tesseractAPI, imageData, page.id, m_enginePageId);
+    m_tesseractAPI->SetRectangle(area.x(), area.y(), area.width(), area.height());
+    std::unique_ptr<tesseract::PageIterator> layoutIterator(m_tesseractAPI->AnalyseLayout());
+    if (segmenting) {
+        page.textBlocks = layoutTextBlocks(layoutIterator.get());
+        page.layoutArea = area;
+        page.hasLayout = true;
+
+        // The same segmentation serves a later Mixed run of this page
+        if (layoutIterator) {
+            layoutIterator->Begin();
+        }
+        page.splitRegions = PageSplitter::split(layoutLines(layoutIterator.get()));
+        page.splitArea = area;
+        page.hasSplit = true;
+    }
+    layoutIterator.reset();
+    result.stage(Stage::Layout).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Layout, result);
+
+    // Perform OCR
+    stageTimer.restart();
+    float confidence = -1.0f;
+    char* ocrResult = recognize(*m_tesseractAPI) ? m_tesseractAPI->GetUTF8Text() : nullptr;
+
+    if (ocrResult) {
+        result.text = QString::fromUtf8(ocrResult);
+        delete[] ocrResult;
+
+        confidence = m_config.enableConfidenceScoring ? m_tesseractAPI->MeanTextConf() : 0.0f;
+
+        if (m_config.extractLayout) {
+            result.layout = buildLayout(*m_tesseractAPI, imageData.sourceScale, result.text);
+            if (result.layout) {
+                result.stage(Stage::Recognition).bytesAllocated +=
+                    static_cast<qint64>(result.layout->arenaBytes());
+            }
+        }
+    }
+    result.stage(Stage::Recognition).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Recognition, result);
+
+    if (confidence >= 0.0f && m_config.mode == ProcessingMode::Equations &&
+        (m_config.grammarSearch || m_config.equationLatex)) {
+        stageTimer.restart();
+        postprocessEquations(*m_tesseractAPI, imageData.sourceScale, result.text,
+                             result.equations, result.grammar);
+        result.stage(Stage::Postprocess).durationNs = stageTimer.nsecsElapsed();
+        traceStage(Stage::Postprocess, result);
+    }
+    return confidence;
+}
+
+/**
+ * @brief Recognize the current page's cached text blocks one by one
+ *
+ * Each block is recognized with PSM_SINGLE_BLOCK, so Tesseract only finds the
+ * lines inside it instead of segmenting the whole page again. The block texts
+ * concatenate to what GetUTF8Text() returns for the full page.
+ */
+float OCRProcessor::recognizeCachedBlocks(OCRResult& result) {
+    const PreparedPage& page = currentPage();
+    const ImageData& imageData = page.imageData;
+    QElapsedTimer stageTimer;
+    stageTimer.start();
+
+    loadIntoEngine(*m_tesseractAPI, imageData, page.id, m_enginePageId);
+    std::shared_ptr<OCRLayout> layout;
+    if (m_config.extractLayout) {
+        layout = std::make_shared<OCRLayout>();
+    }
+
+    const tesseract::PageSegMode pageMode = m_tesseractAPI->GetPageSegMode();
+    m_tesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
+
+    double confidenceSum = 0.0;
+    qint64 characters = 0;
+    for (const QRect& block : page.textBlocks) {
+        m_tesseractAPI->SetRectangle(block.x(), block.y(), block.width(), block.height());
+        if (!recognize(*m_tesseractAPI)) {
+            if (cancelRequested()) {
+                break;
+            }
+            continue;
+        }
+
+        std::unique_ptr<char[]> text(m_tesseractAPI->GetUTF8Text());
+        const QString blockText = QString::fromUtf8(text.get());
+        result.text += blockText;
+
+        if (m_config.enableConfidenceScoring) {
+            const qint64 blockCharacters = inkCharacters(blockText);
+            confidenceSum += m_tesseractAPI->MeanTextConf() * static_cast<double>(blockCharacters);
+            characters += blockCharacters;
+        }
+        if (layout) {
+            appendLayout(*m_tesseractAPI, imageData.sourceScale, *layout);
+        }
+    }
+    m_tesseractAPI->SetPageSegMode(pageMode);
+
+    if (layout && layout->count(OCRLayout::Level::Line) > 0) {
+        result.stage(Stage::Recognition).bytesAllocated +=
+            static_cast<qint64>(layout->arenaBytes());
+        result.layout = std::move(layout);
+    }
+    result.stage(Stage::Recognition).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Recognition, result);
+
+    qCDebug(ocrProcessor) << "Recognized" << page.textBlocks.size()
+                          << "cached blocks without layout analysis";
+    return characters ? static_cast<float>(confidenceSum / characters) : 0.0f;
+}
+
+/**
+ * @brief Mixed-mode recognition: prose and math regions on separate engines
+ */
+float OCRProcessor::recognizeMixed(const QRect& area, OCRResult& result) {
+    PreparedPage& page = currentPage();
+    const ImageData& imageData = page.imageData;
+    SplitMetrics& split = result.split;
+    split.used = true;
+    QElapsedTimer stageTimer;
+
+    // Layout analysis with automatic segmentation, then prose/math classification
+    stageTimer.start();
+    if (page.hasSplit && page.splitArea == area) {
+        result.reusedLayout = true;
+    } else {
+        loadIntoEngine(*m_tesseractAPI, imageData, page.id, m_enginePageId);
+        m_tesseractAPI->SetRectangle(area.x(), area.y(), area.width(), area.height());
+        std::unique_ptr<tesseract::PageIterator> iterator(m_tesseractAPI->AnalyseLayout());
+        page.splitRegions = PageSplitter::split(layoutLines(iterator.get()));
+        page.splitArea = area;
+        page.hasSplit = true;
+
+        // The same segmentation serves a later Auto or Text run of this page
+        if (iterator) {
+            iterator->Begin();
+        }
+        page.textBlocks = layoutTextBlocks(iterator.get());
+        page.layoutArea = area;
+        page.hasLayout = true;
+        result.stage(Stage::Layout).durationNs = stageTimer.nsecsElapsed();
+        traceStage(Stage::Layout, result);
+    }
+
+    const std::vector<PageSplitter::Region>& regions = page.splitRegions;
+    for (const PageSplitter::Region& region : regions) {
+        if (region.kind == PageSplitter::RegionKind::Math) {
+            ++split.mathRegions;
+        } else {
+            ++split.proseRegions;
+        }
+    }
+
+    // Per-region output, merged in reading order once both engines are done
+    struct RegionOutput {
+        QString text;
+        double confidenceSum = 0.0;
+        qint64 characters = 0;
+        std::unique_ptr<OCRLayout> layout;
+        std::vector<Equation> equations;
+    };
+    std::vector<RegionOutput> outputs(regions.size());
+    const bool postprocess = m_config.grammarSearch || m_config.equationLatex;
+    if (m_config.grammarSearch) {
+        mathSearch();  // create it here rather than on the math thread
+    }
+
+    auto recognizeRegions = [&](TessBaseAPI& api, quint64& heldPageId,
+                                PageSplitter::RegionKind kind, qint64& elapsedNs) {
+        QElapsedTimer timer;
+        timer.start();
+        loadIntoEngine(api, imageData, page.id, heldPageId);
+        for (size_t i = 0; i < regions.size(); ++i) {
+            const PageSplitter::Region& region = regions[i];
+            if (region.kind != kind) {
+                continue;
+            }
+
+            // Keep glyph parts that stick out of the line boxes
+            const int margin = std::max(2, region.box.height() / (4 * region.lineCount));
+            const QRect box = QRect(QPoint(region.box.left, region.box.top),
+                                    QPoint(region.box.right - 1, region.box.bottom - 1))
+                                  .adjusted(-margin, -margin, margin, margin)
+                                  .intersected(area);
+            if (box.isEmpty()) {
+                continue;
+            }
+            api.SetRectangle(box.x(), box.y(), box.width(), box.height());
+            if (!recognize(api)) {
+                if (cancelRequested()) {
+                    break;
+                }
+                continue;
+            }
+
+            RegionOutput& output = outputs[i];
+            std::unique_ptr<char[]> text(api.GetUTF8Text());
+            output.text = QString::fromUtf8(text.get());
+            if (m_config.enableConfidenceScoring) {
+                output.characters = inkCharacters(output.text);
+                output.confidenceSum = api.MeanTextConf() * static_cast<double>(output.characters);
+            }
+            if (m_config.extractLayout) {
+                output.layout = std::make_unique<OCRLayout>(kRegionLayoutArenaBytes);
+                appendLayout(api, imageData.sourceScale, *output.layout);
+            }
+            if (kind == PageSplitter::RegionKind::Math && postprocess) {
+                // Only the math side writes these, so the threads do not share them
+                QElapsedTimer postprocessTimer;
+                postprocessTimer.start();
+                postprocessEquations(api, imageData.sourceScale, output.text, output.equations,
+                                     result.grammar);
+                result.stage(Stage::Postprocess).durationNs += postprocessTimer.nsecsElapsed();
+            }
+        }
+        elapsedNs = timer.nsecsElapsed();
+    };
+
+    // Prose regions are recognized block by block; the equation engine already is
+    stageTimer.restart();
+    const tesseract::PageSegMode pageMode = m_tesseractAPI->GetPageSegMode();
+    m_tesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_BLOCK);
+    // A pool that already keeps every CPU busy gains nothing from a second thread
+    const bool overlap = OCRThreading::plan().overlapRegions;
+    if (split.mathRegions > 0 && split.proseRegions > 0 && overlap) {
+        std::thread mathThread([&] {
+            recognizeRegions(*m_equationAPI, m_equationEnginePageId,
+                             PageSplitter::RegionKind::Math, split.mathNs);
+        });
+        recognizeRegions(*m_tesseractAPI, m_enginePageId, PageSplitter::RegionKind::Prose,
+                         split.proseNs);
+        mathThread.join();
+    } else {
+        if (split.mathRegions > 0) {
+            recognizeRegions(*m_equationAPI, m_equationEnginePageId,
+                             PageSplitter::RegionKind::Math, split.mathNs);
+        }
+        if (split.proseRegions > 0 || split.mathRegions == 0) {
+            recognizeRegions(*m_tesseractAPI, m_enginePageId, PageSplitter::RegionKind::Prose,
+                             split.proseNs);
+        }
+    }
+    m_tesseractAPI->SetPageSegMode(pageMode);
+
+    std::shared_ptr<OCRLayout> layout;
+    if (m_config.extractLayout) {
+        layout = std::make_shared<OCRLayout>();
+    }
+    double confidenceSum = 0.0;
+    qint64 characters = 0;
+    for (RegionOutput& output : outputs) {
+        result.text += output.text;
+        std::move(output.equations.begin(), output.equations.end(),
+                  std::back_inserter(result.equations));
+        confidenceSum += output.confidenceSum;
+        characters += output.characters;
+        if (layout && output.layout) {
+            layout->appendLayout(*output.layout);
+        }
+    }
+    if (layout && layout->count(OCRLayout::Level::Line) > 0) {
+        result.stage(Stage::Recognition).bytesAllocated +=
+            static_cast<qint64>(layout->arenaBytes());
+        result.layout = std::move(layout);
+    }
+    result.stage(Stage::Recognition).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Recognition, result);
+    if (result.stage(Stage::Postprocess).durationNs > 0) {
+        traceStage(Stage::Postprocess, result);
+    }
+
+    qCDebug(ocrProcessor) << "Mixed page:" << split.proseRegions << "prose regions in"
+                          << split.proseNs / 1000000 << "ms," << split.mathRegions
+                          << "math regions in" << split.mathNs / 1000000 << "ms";
+    return characters ? static_cast<float>(confidenceSum / characters) : 0.0f;
+}
+
+/**
+ * @brief Two-tier recognition: fast pass over the area, main engine on weak lines
+ *
+ * The fast engine (tessdata_fast models, or the main models on a reduced copy
+ * of the page) recognizes the whole area. Every text line holding a word below
+ * minimumConfidence is then recognized again by the main engine at full
+ * resolution with PSM_SINGLE_LINE, and its text is replaced when the main
+ * engine is more confident. Layout geometry comes from the tier whose text
+ * was kept for each line.
+ */
+float OCRProcessor::recognizeCascade(const QRect& area, OCRResult& result) {
+    PreparedPage& page = currentPage();
+    const ImageData& imageData = page.imageData;
+    CascadeMetrics& cascade = result.cascade;
+    cascade.used = true;
+
+    QElapsedTimer stageTimer;
+    QElapsedTimer tierTimer;
+    stageTimer.start();
+    tierTimer.start();
+
+    // Fast models read the same pixels; without them the first pass runs on a reduced copy
+    ImageData& fast = page.fastImageData;
+    if (!fast.pixels) {
+        if (!m_config.fastDataPath.isEmpty() || m_config.fastScale >= 1.0) {
+            fast = imageData;
+        } else {
+            const double scale = std::max(kMinFastScale, m_config.fastScale);
+            fast = convertImageForTesseract(
+                imageData.buffer.scaled(imageData.buffer.size() * scale, Qt::IgnoreAspectRatio,
+                                        Qt::SmoothTransformation));
+            fast.sourceScale = imageData.sourceScale * imageData.width / fast.width;
+            result.stage(Stage::Preprocess).bytesAllocated +=
+                static_cast<qint64>(fast.height) * fast.bytesPerLine;
+            trimPageCache();
+        }
+    }
+    const double fastFactor = static_cast<double>(fast.width) / imageData.width;
+
+    loadIntoEngine(*m_fastAPI, fast, page.id, m_fastEnginePageId);
+    const QRect fastArea =
+        scaledRect(area, fastFactor).intersected(QRect(0, 0, fast.width, fast.height));
+    m_fastAPI->SetRectangle(fastArea.x(), fastArea.y(), fastArea.width(), fastArea.height());
+    std::unique_ptr<tesseract::PageIterator> layoutIterator(m_fastAPI->AnalyseLayout());
+    layoutIterator.reset();
+    result.stage(Stage::Layout).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Layout, result);
+
+    stageTimer.restart();
+    if (!recognize(*m_fastAPI)) {
+        cascade.fastNs = tierTimer.nsecsElapsed();
+        result.stage(Stage::Recognition).durationNs = stageTimer.nsecsElapsed();
+        traceStage(Stage::Recognition, result);
+        return -1.0f;
+    }
+
+    // Group the fast tier's words into lines, counting the weak ones
+    std::vector<CascadeLine> lines;
+    std::unique_ptr<tesseract::ResultIterator> iterator(m_fastAPI->GetIterator());
+    if (iterator && !iterator->Empty(tesseract::RIL_WORD)) {
+        do {
+            if (lines.empty() || iterator->IsAtBeginningOf(tesseract::RIL_TEXTLINE)) {
+                CascadeLine line;
+                int left = 0, top = 0, right = 0, bottom = 0;
+                iterator->BoundingBox(tesseract::RIL_TEXTLINE, &left, &top, &right, &bottom);
+                line.box = QRect(left, top, right - left, bottom - top);
+                line.paragraphStart =
+                    !lines.empty() && iterator->IsAtBeginningOf(tesseract::RIL_PARA);
+                lines.push_back(std::move(line));
+            }
+
+            CascadeLine& line = lines.back();
+            std::unique_ptr<char[]> word(iterator->GetUTF8Text(tesseract::RIL_WORD));
+            const float wordConfidence = iterator->Confidence(tesseract::RIL_WORD);
+            if (!line.text.isEmpty()) {
+                line.text += ' ';
+            }
+            line.text += QString::fromUtf8(word.get());
+            line.confidenceSum += wordConfidence;
+            ++line.words;
+            if (wordConfidence < m_config.minimumConfidence) {
+                ++line.weakWords;
+            }
+        } while (iterator->Next(tesseract::RIL_WORD));
+    }
+    iterator.reset();
+
+    double fastConfidenceSum = 0.0;
+    for (const CascadeLine& line : lines) {
+        cascade.words += line.words;
+        fastConfidenceSum += line.confidenceSum;
+    }
+    cascade.fastConfidence = cascade.words ? fastConfidenceSum / cascade.words : 0.0f;
+    cascade.fastText = joinCascadeLines(lines);
+    cascade.fastNs = tierTimer.nsecsElapsed();
+
+    // Escalate weak lines to the main engine at full resolution
+    tierTimer.restart();
+    const tesseract::PageSegMode pageMode = m_tesseractAPI->GetPageSegMode();
+    bool lineModeSet = false;
+    for (CascadeLine& line : lines) {
+        if (line.weakWords == 0) {
+            continue;
+        }
+
+        // Pad so ascenders and descenders cut off by the fast line box are kept
+        QRect box = scaledRect(line.box, 1.0 / fastFactor);
+        const int margin = std::max(2, box.height() / 8);
+        box = box.adjusted(-margin, -margin, margin, margin).intersected(area);
+        if (box.isEmpty()) {
+            continue;
+        }
+
+        loadIntoEngine(*m_tesseractAPI, imageData, page.id, m_enginePageId);
+        if (!lineModeSet) {
+            m_tesseractAPI->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+            lineModeSet = true;
+        }
+        m_tesseractAPI->SetRectangle(box.x(), box.y(), box.width(), box.height());
+        if (!recognize(*m_tesseractAPI)) {
+            if (cancelRequested()) {
+                break;
+            }
+            continue;
+        }
+
+        std::unique_ptr<char[]> text(m_tesseractAPI->GetUTF8Text());
+        const float lineConfidence = m_tesseractAPI->MeanTextConf();
+        ++cascade.escalatedLines;
+        cascade.escalatedWords += line.weakWords;
+
+        if (lineConfidence * line.words > line.confidenceSum) {
+            line.text = QString::fromUtf8(text.get()).trimmed();
+            line.confidenceSum = lineConfidence * line.words;
+            if (m_config.extractLayout) {
+                line.layout = std::make_unique<OCRLayout>(kRegionLayoutArenaBytes);
+                appendLayout(*m_tesseractAPI, imageData.sourceScale, *line.layout);
+            }
+        }
+    }
+    if (lineModeSet) {
+        m_tesseractAPI->SetPageSegMode(pageMode);
+    }
+    cascade.escalationNs = tierTimer.nsecsElapsed();
+
+    result.text = joinCascadeLines(lines);
+    double confidenceSum = 0.0;
+    for (const CascadeLine& line : lines) {
+        confidenceSum += line.confidenceSum;
+    }
+
+    if (m_config.extractLayout) {
+        std::vector<const OCRLayout*> replacements;
+        replacements.reserve(lines.size());
+        for (const CascadeLine& line : lines) {
+            replacements.push_back(line.layout.get());
+        }
+        result.layout = buildLayout(*m_fastAPI, fast.sourceScale, result.text, replacements);
+        if (result.layout) {
+            result.stage(Stage::Recognition).bytesAllocated +=
+                static_cast<qint64>(result.layout->arenaBytes());
+        }
+    }
+    result.stage(Stage::Recognition).durationNs = stageTimer.nsecsElapsed();
+    traceStage(Stage::Recognition, result);
+
+    qCDebug(ocrProcessor) << "Cascade:" << cascade.words << "words," << cascade.escalatedWords
+                          << "escalated in" << cascade.escalatedLines << "lines | fast"
+                          << cascade.fastNs / 1000000 << "ms, escalation"
+                          << cascade.escalationNs / 1000000 << "ms";
+    return cascade.words ? static_cast<float>(confidenceSum / cascade.words) : 0.0f;
+}
+
+/**
+ * @brief Equation-line search set up for the current grammar options
+ */
+MathBeamSearch& OCRProcessor::mathSearch() {
+    MathBeamSearch::Options options;
+    options.beamWidth = std::max(1, m_config.grammarBeamWidth);
+    options.budget = std::chrono::microseconds(std::max(0, m_config.grammarBudgetUs));
+    if (!m_mathSearch || m_mathSearch->options().beamWidth != options.beamWidth ||
+        m_mathSearch->options().budget != options.budget) {
+        m_mathSearch = std::make_unique<MathBeamSearch>(options);
+    }
+    return *m_mathSearch;
+}
+
+/**
+ * @brief Correct and convert the equation lines an engine just recognized
+ *
+ * Each text line is one equation. Its symbols are fed to the search with the
+ * recognized symbol first and the LSTM alternatives after it, and a word break
+ * becomes a space. The search's choice for every symbol then goes, with the
+ * symbol's box and the line baseline, to the expression parser. Unchanged
+ * lines are left alone in `text`, so it keeps the paragraph breaks
+ * GetUTF8Text() produced.
+ */
+void OCRProcessor::postprocessEquations(TessBaseAPI& api, double sourceScale, QString& text,
+                                        std::vector<Equation>& equations,
+                                        GrammarMetrics& metrics) {
+    std::unique_ptr<tesseract::ResultIterator> iterator(api.GetIterator());
+    if (!iterator || iterator->Empty(tesseract::RIL_SYMBOL)) {
+        return;
+    }
+    MathBeamSearch* search = m_config.grammarSearch ? &mathSearch() : nullptr;
+
+    constexpr int kMaxChoices = 8;
+    const char* choiceTexts[kMaxChoices];
+    float choiceConfidences[kMaxChoices];
+    std::vector<MathExpression::Symbol> symbols;
+    std::vector<int> searchSymbols;
+    std::string corrected;
+    int cursor = 0;
+
+    bool more = true;
+    while (more) {
+        std::unique_ptr<char[]> lineText(iterator->GetUTF8Text(tesseract::RIL_TEXTLINE));
+        int lineLeft = 0, lineTop = 0, lineRight = 0, lineBottom = 0;
+        iterator->BoundingBox(tesseract::RIL_TEXTLINE, &lineLeft, &lineTop, &lineRight,
+                              &lineBottom);
+        int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+        if (!iterator->Baseline(tesseract::RIL_TEXTLINE, &x1, &y1, &x2, &y2)) {
+            x1 = lineLeft;
+            x2 = lineRight;
+            y1 = y2 = lineBottom;
+        }
+
+        symbols.clear();
+        searchSymbols.clear();
+        if (search) {
+            search->clear();
+        }
+        do {
+            std::unique_ptr<char[]> symbolText(iterator->GetUTF8Text(tesseract::RIL_SYMBOL));
+            if (symbolText) {
+                MathExpression::Symbol symbol;
+                symbol.text = symbolText.get();
+                symbol.startsWord = iterator->IsAtBeginningOf(tesseract::RIL_WORD);
+                iterator->BoundingBox(tesseract::RIL_SYMBOL, &symbol.left, &symbol.top,
+                                      &symbol.right, &symbol.bottom);
+                const double centre = (symbol.left + symbol.right) / 2.0;
+                symbol.baseline = x2 > x1 ? y1 + (centre - x1) * (y2 - y1) / (x2 - x1) : y1;
+
+                if (search) {
+                    if (symbol.startsWord && !symbols.empty()) {
+                        search->addSpace();
+                    }
+                    int count = 0;
+                    choiceTexts[count] = symbolText.get();
+                    choiceConfidences[count++] = iterator->Confidence(tesseract::RIL_SYMBOL);
+                    tesseract::ChoiceIterator choices(*iterator);
+                    do {
+                        const char* alternative = choices.GetUTF8Text();
+                        if (alternative && std::strcmp(alternative, symbolText.get()) != 0) {
+                            choiceTexts[count] = alternative;
+                            choiceConfidences[count++] = choices.Confidence();
+                        }
+                    } while (count < kMaxChoices && choices.Next());
+                    searchSymbols.push_back(
+                        search->addSymbol(choiceTexts, choiceConfidences, count));
+                }
+                symbols.push_back(std::move(symbol));
+            }
+            more = iterator->Next(tesseract::RIL_SYMBOL);
+        } while (more && !iterator->IsAtBeginningOf(tesseract::RIL_TEXTLINE));
+
+        if (symbols.empty() || !lineText) {
+            continue;
+        }
+        const QString original = QString::fromUtf8(lineText.get()).trimmed();
+        QString lineResult = original;
+
+        if (search) {
+            ++metrics.lines;
+            const MathBeamSearch::Outcome outcome = search->run(corrected);
+            if (outcome.overBudget) {
+                ++metrics.overBudgetLines;
+            }
+            if (outcome.parsed) {
+                ++metrics.parsedLines;
+                for (size_t i = 0; i < symbols.size(); ++i) {
+                    symbols[i].text.clear();
+                    search->appendSelectedText(searchSymbols[i], symbols[i].text);
+                }
+            }
+
+            const int position = text.indexOf(original, cursor);
+            if (position >= 0) {
+                cursor = position + static_cast<int>(original.size());
+                if (outcome.parsed && outcome.changed) {
+                    lineResult = QString::fromStdString(corrected);
+                    text.replace(position, original.size(), lineResult);
+                    cursor = position + static_cast<int>(lineResult.size());
+                    ++metrics.correctedLines;
+                    qCDebug(ocrProcessor) << "Grammar search:" << original << "->" << lineResult;
+                }
+            }
+        }
+
+        if (m_config.equationLatex) {
+            Equation equation;
+            equation.text = lineResult;
+            equation.box = scaledRect(
+                QRect(lineLeft, lineTop, lineRight - lineLeft, lineBottom - lineTop), sourceScale);
+            if (m_mathExpression.parse(symbols)) {
+                equation.latex = QString::fromStdString(m_mathExpression.toLatex());
+                equation.tree = QString::fromStdString(m_mathExpression.toTree());
+            } else {
+                qCDebug(ocrProcessor) << "No expression in" << lineResult << "-"
+                                      << m_mathExpression.error().c_str();
+            }
+            equations.push_back(std::move(equation));
+        }
+    }
+}
+
+/**
+ * @brief Collect line/word/symbol geometry from the last recognition
+ */
+std::shared_ptr<const OCRLayout> OCRProcessor::buildLayout(
+    TessBaseAPI& api, double sourceScale, const QString& text,
+    const std::vector<const OCRLayout*>& lineReplacements) const {
+    auto layout = std::make_shared<OCRLayout>();
+
+    // The recognized text gives a close upper bound for the element counts
+    const int lineEstimate = text.count('\n') + 1;
+    const int wordEstimate = text.count(' ') + lineEstimate;
+    layout->reserve(lineEstimate, wordEstimate, text.length());
+
+    if (!appendLayout(api, sourceScale, *layout, lineReplacements)) {
+        return nullptr;
+    }
+
+    qCDebug(ocrProcessor) << "Layout collected:" << layout->count(OCRLayout::Level::Line)
+                          << "lines," << layout->count(OCRLayout::Level::Word) << "words,"
+                          << layout->count(OCRLayout::Level::Symbol) << "symbols,"
+                          << layout->arenaBytes() << "arena bytes";
+    return layout;
+}
+
+/**
+ * @brief Append an engine's recognized lines, words and symbols to a layout
+ *
+ * Walks the result iterator once at symbol granularity and emits a line or word
+ * entry whenever the iterator crosses into a new one, so every level is filled
+ * in a single pass in reading order. A line with a replacement is copied from
+ * it instead and its symbols are skipped.
+ */
+bool OCRProcessor::appendLayout(TessBaseAPI& api, double sourceScale, OCRLayout& layout,
+                                const std::vector<const OCRLayout*>& lineReplacements) const {
+    std::unique_ptr<tesseract::ResultIterator> iterator(api.GetIterator());
+    if (!iterator || iterator->Empty(tesseract::RIL_SYMBOL)) {
+        return false;
+    }
+
+    auto scaledBox = [sourceScale](int left, int top, int right, int bottom) {
+        return QRect(qRound(left * sourceScale), qRound(top * sourceScale),
+                     qRound((right - left) * sourceScale), qRound((bottom - top) * sourceScale));
+    };
+
+    auto appendElement = [&](tesseract::PageIteratorLevel tessLevel, OCRLayout::Level level,
+                             int parent) {
+        int left = 0, top = 0, right = 0, bottom = 0;
+        iterator->BoundingBox(tessLevel, &left, &top, &right, &bottom);
+        std::unique_ptr<char[]> utf8(iterator->GetUTF8Text(tessLevel));
+        return layout.append(level, scaledBox(left, top, right, bottom),
+                             iterator->Confidence(tessLevel), parent, utf8.get());
+    };
+
+    int lineIndex = -1;
+    int currentLine = -1;
+    int currentWord = -1;
+    bool replaced = false;
+    do {
+        if (lineIndex < 0 || iterator->IsAtBeginningOf(tesseract::RIL_TEXTLINE)) {
+            ++lineIndex;
+            const OCRLayout* replacement = lineIndex < static_cast<int>(lineReplacements.size())
+                                               ? lineReplacements[lineIndex]
+                                               : nullptr;
+            replaced = replacement != nullptr;
+            if (replaced) {
+                layout.appendLayout(*replacement);
+            } else {
+                currentLine = appendElement(tesseract::RIL_TEXTLINE, OCRLayout::Level::Line, -1);
+                currentWord = -1;
+            }
+        }
+        if (replaced) {
+            continue;
+        }
+        if (currentWord < 0 || iterator->IsAtBeginningOf(tesseract::RIL_WORD)) {
+            currentWord = appendElement(tesseract::RIL_WORD, OCRLayout::Level::Word, currentLine);
+        }
+        appendElement(tesseract::RIL_SYMBOL, OCRLayout::Level::Symbol, currentWord);
+    } while (iterator->Next(tesseract::RIL_SYMBOL));
+    return true;
 }
 
 /**
  * @brief Log OCR operation
  */
 void OCRProcessor::logOCROperation(const QString& operation, const OCRResult& result) const {
-    if (result.success) {
+    if (result.isBlankPage) {
+        // A warning, so a page wrongly taken for blank is not lost silently
+        qCWarning(ocrProcessor) << "OCR SKIPPED -" << operation << "| Blank page, no text"
+                                << "| Time:" << result.processingTimeMs << "ms";
+    } else if (result.success) {
         qCInfo(ocrProcessor) << "OCR SUCCESS -" << operation
                              << "| Text length:" << result.text.length()
                              << "| Confidence:" << result.confidence
@@ -0,0 +1,376 @@
+/*
+ * Module: OCR Process Pool Implementation
+ *
+ * Worker start-up (fork, limits, exec), request submission, crash detection
+ * and restarts.
+ */
+
+#include "ocrprocesspool.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ocrresultjson.h"
+
+Q_LOGGING_CATEGORY(ocrProcessPool, "ocr.processpool")
+
+namespace {
+
+constexpr int kWorkerFd = 3;        ///< Where a worker finds its end of the socket pair
+constexpr int kExitGraceMs = 2000;  ///< Time a worker gets to exit before it is killed
+
+QString systemError() {
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+OCRProcessor::OCRResult failedResult(const QString& error) {
+    OCRProcessor::OCRResult result;
+    result.errorMessage = error;
+    return result;
+}
+
+}  // namespace
+
+QStringList OCRProcessPool::engineArguments(const OCRProcessor::OCRConfig& config,
+                                            int engineThreads) {
+    QStringList arguments{"--language",       config.language,
+                          "--dpi",            QString::number(config.dpi),
+                          "--min-confidence", QString::number(config.minimumConfidence),
+                          "--x-height",       QString::number(config.targetXHeight),
+                          "--blank-ink",      QString::number(config.blankPageInkRatio, 'g', 17),
+                          "--max-edge",       QString::number(config.maxDecodeLongEdge),
+                          "--engine-threads", QString::number(engineThreads)};
+    if (!config.preprocessImage) {
+        arguments << "--no-preprocess";
+    }
+    if (!config.extractLayout) {
+        arguments << "--no-layout";
+    }
+    if (config.cascade) {
+        arguments << "--cascade";
+    }
+    if (!config.fastDataPath.isEmpty()) {
+        arguments << "--fast-data" << config.fastDataPath;
+    }
+    if (!config.grammarSearch) {
+        arguments << "--no-grammar";
+    }
+    if (!config.equationLatex) {
+        arguments << "--no-latex";
+    }
+    return arguments;
+}
+
+OCRProcessPool::OCRProcessPool(const Options& options)
+    : m_options(options), m_workers(static_cast<size_t>(std::max(1, options.workers))) {
+    if (m_options.workerProgram.isEmpty()) {
+        m_options.workerProgram =
+            QDir(QCoreApplication::applicationDirPath()).filePath("ocr_daemon");
+    }
+
+    // Start every worker before waiting for any, so their engines initialize side by side
+    QString error;
+    for (Worker& worker : m_workers) {
+        if (!spawn(worker, &error)) {
+            break;
+        }
+    }
+    for (Worker& worker : m_workers) {
+        OCRProtocol::Message ping;
+        ping.header = QJsonObject{{"id", 0}, {"op", "ping"}};
+        OCRProtocol::Message reply;
+        if (error.isEmpty() && (!OCRProtocol::send(worker.fd, ping) ||
+                                !OCRProtocol::receive(worker.fd, reply))) {
+            error = QString("OCR worker %1 %2").arg(m_options.workerProgram, reap(worker, false));
+        }
+    }
+    if (!error.isEmpty()) {
+        // The destructor does not run for a constructor that throws
+        for (Worker& worker : m_workers) {
+            if (worker.fd >= 0) {
+                reap(worker, true);
+            }
+        }
+        throw std::runtime_error(error.toStdString());
+    }
+    qCInfo(ocrProcessPool) << "Started" << m_workers.size() << "worker process(es)"
+                           << (m_options.memoryLimitBytes > 0
+                                   ? QString("limited to %1 MiB each")
+                                         .arg(m_options.memoryLimitBytes >> 20)
+                                   : QString("without a memory limit"));
+}
+
+OCRProcessPool::~OCRProcessPool() {
+    // A worker's server returns once its socket closes, then the process exits
+    for (Worker& worker : m_workers) {
+        if (worker.fd >= 0) {
+            reap(worker, false);
+        }
+    }
+}
+
+bool OCRProcessPool::spawn(Worker& worker, QString* error) {
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        *error = QString("Cannot create a worker socket: %1").arg(systemError());
+        return false;
+    }
+
+    // Everything the child needs is prepared here: after fork() it may only
+    // make async-signal-safe calls, because other threads may hold locks
+    QList<QByteArray> arguments{QFile::encodeName(m_options.workerProgram), "--worker-fd",
+                                QByteArray::number(kWorkerFd), "--workers", "1"};
+    for (const QString& argument : m_options.workerArguments) {
+        arguments << argument.toLocal8Bit();
+    }
+    std::vector<char*> argv;
+    for (QByteArray& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    const rlimit memoryLimit{static_cast<rlim_t>(m_options.memoryLimitBytes),
+                             static_cast<rlim_t>(m_options.memoryLimitBytes)};
+    const pid_t parent = ::getpid();
+
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        // Die with the supervisor, even if it is killed without a chance to clean up
+        ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (::getppid() != parent) {
+            ::_exit(127);
+        }
+        if (m_options.memoryLimitBytes > 0) {
+            ::setrlimit(RLIMIT_AS, &memoryLimit);
+        }
+        // dup2() clears FD_CLOEXEC on the copy; a descriptor already in place keeps it
+        if (pair[1] == kWorkerFd) {
+            ::fcntl(kWorkerFd, F_SETFD, 0);
+        } else if (::dup2(pair[1], kWorkerFd) < 0) {
+            ::_exit(127);
+        }
+        ::execv(argv[0], argv.data());
+        ::_exit(127);
+    }
+    ::close(pair[1]);
+    if (pid < 0) {
+        ::close(pair[0]);
+        *error = QString("Cannot start an OCR worker: %1").arg(systemError());
+        return false;
+    }
+    worker.pid = pid;
+    worker.fd = pair[0];
+    worker.ring.reset();
+    return true;
+}
+
+/**
+ * @brief Close a worker's socket and collect its exit status
+ *
+ * Without `kill` the worker gets kExitGraceMs to exit on its own (it does once
+ * its socket closes) so a crash is reported as such; a worker still running
+ * after that, e.g. one that sent a malformed frame, is killed.
+ */
+QString OCRProcessPool::reap(Worker& worker, bool kill) {
+    if (kill) {
+        ::kill(worker.pid, SIGKILL);
+    }
+    ::close(worker.fd);
+    worker.fd = -1;
+    worker.ring.reset();
+
+    int status = 0;
+    pid_t reaped = 0;
+    if (!kill) {
+        QElapsedTimer grace;
+        grace.start();
+        for (;;) {
+            reaped = ::waitpid(worker.pid, &status, WNOHANG);
+            if (reaped < 0 && errno == EINTR) {
+                continue;
+            }
+            if (reaped != 0 || grace.elapsed() >= kExitGraceMs) {
+                break;
+            }
+            ::usleep(10000);
+        }
+        if (reaped == 0) {
+            qCWarning(ocrProcessPool) << "OCR worker" << worker.pid << "did not exit; killing it";
+            ::kill(worker.pid, SIGKILL);
+        }
+    }
+    while (reaped <= 0) {
+        reaped = ::waitpid(worker.pid, &status, 0);
+        if (reaped < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    worker.pid = -1;
+    if (reaped < 0) {
+        return "vanished";
+    }
+    if (WIFSIGNALED(status)) {
+        const int signal = WTERMSIG(status);
+        return QString("crashed (signal %1, %2)").arg(signal).arg(::strsignal(signal));
+    }
+    const int code = WEXITSTATUS(status);
+    return code == 127 ? QString("could not be executed")
+                       : QString("exited with status %1").arg(code);
+}
+
+bool OCRProcessPool::attachRing(Worker& worker, size_t bytes, QString* error) {
+    auto ring = OCRSharedRing::create(std::max(bytes, m_options.ringBytes), error);
+    if (!ring) {
+        return false;
+    }
+    OCRProtocol::Message attach;
+    attach.header = QJsonObject{{"id", 0}, {"op", "attach"}};
+    attach.descriptor = ring->descriptor();
+    OCRProtocol::Message reply;
+    if (!OCRProtocol::send(worker.fd, attach) || !OCRProtocol::receive(worker.fd, reply) ||
+        !reply.header.value("ok").toBool()) {
+        *error = QString("The OCR worker did not attach its shared ring: %1")
+                     .arg(reply.header.value("error").toString("connection closed"));
+        return false;
+    }
+    worker.ring = std::move(ring);
+    return true;
+}
+
+OCRProcessPool::Worker& OCRProcessPool::acquire() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        for (Worker& worker : m_workers) {
+            if (!worker.busy) {
+                worker.busy = true;
+                return worker;
+            }
+        }
+        m_idle.wait(lock);
+    }
+}
+
+void OCRProcessPool::release(Worker& worker) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        worker.busy = false;
+    }
+    m_idle.notify_one();
+}
+
+OCRProcessor::OCRResult OCRProcessPool::recognize(const QString& imagePath, const QRect& region,
+                                                  OCRProcessor::ProcessingMode mode, bool band) {
+    OCRProtocol::Message request;
+    request.header = QJsonObject{{"id", 0},
+                                 {"op", "recognize"},
+                                 {"path", QFileInfo(imagePath).absoluteFilePath()},
+                                 {"mode", OCRProcessor::modeName(mode)}};
+    if (!region.isNull()) {
+        request.header.insert(
+            "region", QJsonArray{region.x(), region.y(), region.width(), region.height()});
+        if (band) {
+            request.header.insert("band", true);
+        }
+    }
+    OCRProcessor::OCRResult result = submit(request, nullptr);
+    result.region = region;
+    return result;
+}
+
+OCRProcessor::OCRResult OCRProcessPool::recognize(const QImage& image,
+                                                  OCRProcessor::ProcessingMode mode) {
+    if (image.isNull()) {
+        return failedResult("Image is null");
+    }
+    // The engine recognizes grayscale; converting here shrinks the ring slot 4x
+    const QImage pixels = image.convertToFormat(QImage::Format_Grayscale8);
+    OCRProtocol::Message request;
+    request.header =
+        QJsonObject{{"id", 0}, {"op", "recognize"}, {"mode", OCRProcessor::modeName(mode)}};
+    OCRProcessor::OCRResult result = submit(request, &pixels);
+    result.imageSize = image.size();
+    return result;
+}
+
+OCRProcessor::OCRResult OCRProcessPool::submit(OCRProtocol::Message& request,
+                                               const QImage* image) {
+    Worker& worker = acquire();
+    QString error;
+    if (worker.fd < 0 && !spawn(worker, &error)) {
+        release(worker);
+        return failedResult(error);
+    }
+
+    if (image) {
+        const size_t bytes = static_cast<size_t>(image->sizeInBytes());
+        if ((!worker.ring || worker.ring->size() < bytes) &&
+            !attachRing(worker, bytes, &error)) {
+            // The worker may be gone or half-way through a frame; start over with a new one
+            reap(worker, true);
+            ++m_restarts;
+            QString spawnError;
+            spawn(worker, &spawnError);
+            release(worker);
+            return failedResult(error);
+        }
+        // One page per worker at a time, so the slot is free again by the next reserve()
+        const qint64 offset = worker.ring->reserve(bytes);
+        std::memcpy(worker.ring->data() + offset, image->constBits(), bytes);
+        request.header.insert("shared", QJsonObject{{"offset", offset},
+                                                    {"width", image->width()},
+                                                    {"height", image->height()},
+                                                    {"bytesPerLine", image->bytesPerLine()},
+                                                    {"format", "gray8"}});
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    OCRProtocol::Message reply;
+    bool answered = OCRProtocol::send(worker.fd, request);
+    bool timedOut = false;
+    if (answered && m_options.timeoutMs > 0) {
+        pollfd descriptor{worker.fd, POLLIN, 0};
+        int ready;
+        do {
+            const int leftMs = m_options.timeoutMs - static_cast<int>(clock.elapsed());
+            ready = ::poll(&descriptor, 1, std::max(0, leftMs));
+        } while (ready < 0 && errno == EINTR);
+        timedOut = ready == 0;
+    }
+    answered = answered && !timedOut && OCRProtocol::receive(worker.fd, reply);
+
+    if (!answered) {
+        // Whatever killed the worker, only this page fails; the next one gets a fresh process
+        const QString reason = timedOut ? QString("timed out after %1 ms").arg(m_options.timeoutMs)
+                                        : reap(worker, false);
+        if (timedOut) {
+            reap(worker, true);
+        }
+        ++m_restarts;
+        qCWarning(ocrProcessPool) << "OCR worker" << reason << "; restarting it";
+        if (!spawn(worker, &error)) {
+            qCWarning(ocrProcessPool) << error;  // Retried when the worker is next taken
+        }
+        release(worker);
+        return failedResult(QString("OCR worker %1").arg(reason));
+    }
+    release(worker);
+
+    return OCRResultJson::fromJson(reply.header);
+}
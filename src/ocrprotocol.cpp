@@ -0,0 +1,336 @@
+/*
+ * Module: OCR Protocol Implementation
+ *
+ * Unix domain socket setup, frame I/O and the shared-memory image ring for
+ * the OCR daemon.
+ */
+
+#include "ocrprotocol.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct FrameHeader {
+    uint32_t magic;
+    uint32_t headerBytes;
+    uint32_t bodyBytes;
+};
+
+/**
+ * @brief Fill a sockaddr_un; false if the path does not fit
+ */
+bool socketAddress(const QString& path, sockaddr_un& address, QString* error) {
+    const QByteArray encoded = QFile::encodeName(path);
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (encoded.isEmpty() || encoded.size() >= static_cast<int>(sizeof(address.sun_path))) {
+        if (error) {
+            *error = QString("Socket path is empty or too long: %1").arg(path);
+        }
+        return false;
+    }
+    std::memcpy(address.sun_path, encoded.constData(), encoded.size());
+    return true;
+}
+
+void setError(QString* error, const QString& what) {
+    if (error) {
+        *error = QString("%1: %2").arg(what, QString::fromLocal8Bit(std::strerror(errno)));
+    }
+}
+
+/**
+ * @brief Keep the first descriptor of an SCM_RIGHTS message, close any others
+ */
+void takeDescriptors(msghdr& envelope, int& descriptor) {
+    for (cmsghdr* control = CMSG_FIRSTHDR(&envelope); control;
+         control = CMSG_NXTHDR(&envelope, control)) {
+        if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const size_t count = (control->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(control) + i * sizeof(int), sizeof(int));
+            if (descriptor < 0) {
+                descriptor = fd;
+            } else {
+                ::close(fd);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Read exactly `size` bytes; false on end of stream or error
+ *
+ * A descriptor sent with the frame arrives with its first byte, so only the
+ * frame header is read with `descriptor` set.
+ */
+bool readFully(int fd, char* data, size_t size, int* descriptor = nullptr) {
+    alignas(cmsghdr) char controlBuffer[CMSG_SPACE(sizeof(int))];
+    while (size > 0) {
+        iovec part{data, size};
+        msghdr envelope{};
+        envelope.msg_iov = &part;
+        envelope.msg_iovlen = 1;
+        if (descriptor) {
+            envelope.msg_control = controlBuffer;
+            envelope.msg_controllen = sizeof(controlBuffer);
+        }
+        const ssize_t n = ::recvmsg(fd, &envelope, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (descriptor && n > 0) {
+            takeDescriptors(envelope, *descriptor);
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Read and validate one frame; the caller closes a passed descriptor on failure
+ */
+bool readFrame(int fd, OCRProtocol::Message& message) {
+    FrameHeader frame;
+    if (!readFully(fd, reinterpret_cast<char*>(&frame), sizeof(frame), &message.descriptor) ||
+        frame.magic != OCRProtocol::kMagic || frame.headerBytes > OCRProtocol::kMaxHeaderBytes ||
+        frame.bodyBytes > OCRProtocol::kMaxBodyBytes) {
+        return false;
+    }
+
+    QByteArray header(static_cast<int>(frame.headerBytes), Qt::Uninitialized);
+    if (!readFully(fd, header.data(), frame.headerBytes)) {
+        return false;
+    }
+    message.body.resize(static_cast<int>(frame.bodyBytes));
+    if (frame.bodyBytes > 0 && !readFully(fd, message.body.data(), frame.bodyBytes)) {
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(header, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        return false;
+    }
+    message.header = document.object();
+    return true;
+}
+
+}  // namespace
+
+QString OCRProtocol::defaultSocketPath() {
+    const QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    if (!runtimeDir.isEmpty()) {
+        return QFile::decodeName(runtimeDir) + "/mathscan-ocr.sock";
+    }
+    return QString("/tmp/mathscan-ocr-%1.sock").arg(::getuid());
+}
+
+int OCRProtocol::listen(const QString& path, QString* error) {
+    sockaddr_un address;
+    if (!socketAddress(path, address, error)) {
+        return -1;
+    }
+
+    // A socket file nobody answers on is left over from a daemon that died
+    const int probe = connect(path);
+    if (probe >= 0) {
+        ::close(probe);
+        if (error) {
+            *error = QString("Another daemon is listening on %1").arg(path);
+        }
+        return -1;
+    }
+    ::unlink(address.sun_path);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        setError(error, "socket");
+        return -1;
+    }
+    // Only the owner may submit work; the daemon reads any file it is sent
+    const mode_t previousMask = ::umask(0077);
+    const int bound = ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previousMask);
+    if (bound != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        setError(error, QString("Cannot listen on %1").arg(path));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int OCRProtocol::connect(const QString& path, QString* error) {
+    sockaddr_un address;
+    if (!socketAddress(path, address, error)) {
+        return -1;
+    }
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        setError(error, "socket");
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        setError(error, QString("Cannot connect to %1").arg(path));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool OCRProtocol::peerIsSameUser(int fd) {
+    ucred credentials{};
+    socklen_t length = sizeof(credentials);
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 &&
+           credentials.uid == ::getuid();
+}
+
+bool OCRProtocol::send(int fd, const Message& message) {
+    const QByteArray header = QJsonDocument(message.header).toJson(QJsonDocument::Compact);
+    if (static_cast<uint32_t>(header.size()) > kMaxHeaderBytes ||
+        static_cast<uint32_t>(message.body.size()) > kMaxBodyBytes) {
+        return false;
+    }
+    FrameHeader frame{kMagic, static_cast<uint32_t>(header.size()),
+                      static_cast<uint32_t>(message.body.size())};
+
+    iovec parts[3] = {{&frame, sizeof(frame)},
+                      {const_cast<char*>(header.constData()), static_cast<size_t>(header.size())},
+                      {const_cast<char*>(message.body.constData()),
+                       static_cast<size_t>(message.body.size())}};
+    int first = 0;
+    const int count = message.body.isEmpty() ? 2 : 3;
+    alignas(cmsghdr) char controlBuffer[CMSG_SPACE(sizeof(int))] = {};
+    bool descriptorSent = message.descriptor < 0;
+    while (first < count) {
+        msghdr envelope{};
+        envelope.msg_iov = parts + first;
+        envelope.msg_iovlen = count - first;
+        if (!descriptorSent) {
+            envelope.msg_control = controlBuffer;
+            envelope.msg_controllen = sizeof(controlBuffer);
+            cmsghdr* control = CMSG_FIRSTHDR(&envelope);
+            control->cmsg_level = SOL_SOCKET;
+            control->cmsg_type = SCM_RIGHTS;
+            control->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(control), &message.descriptor, sizeof(int));
+        }
+        ssize_t sent = ::sendmsg(fd, &envelope, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0) {
+            return false;
+        }
+        descriptorSent = true;
+        // Partial write: skip what went out and resend the rest
+        while (first < count && static_cast<size_t>(sent) >= parts[first].iov_len) {
+            sent -= static_cast<ssize_t>(parts[first].iov_len);
+            ++first;
+        }
+        if (first < count) {
+            parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + sent;
+            parts[first].iov_len -= static_cast<size_t>(sent);
+        }
+    }
+    return true;
+}
+
+bool OCRProtocol::receive(int fd, Message& message) {
+    message.descriptor = -1;
+    if (readFrame(fd, message)) {
+        return true;
+    }
+    if (message.descriptor >= 0) {
+        ::close(message.descriptor);
+        message.descriptor = -1;
+    }
+    return false;
+}
+
+std::shared_ptr<OCRSharedRing> OCRSharedRing::create(size_t bytes, QString* error) {
+    bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    const int fd = ::memfd_create("mathscan-ocr-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        setError(error, "memfd_create");
+        return nullptr;
+    }
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0 ||
+        ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        setError(error, "Cannot size and seal the shared ring");
+        ::close(fd);
+        return nullptr;
+    }
+    void* data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        setError(error, "mmap");
+        ::close(fd);
+        return nullptr;
+    }
+    return std::shared_ptr<OCRSharedRing>(
+        new OCRSharedRing(fd, static_cast<uchar*>(data), bytes));
+}
+
+std::shared_ptr<OCRSharedRing> OCRSharedRing::attach(int fd, QString* error) {
+    struct stat status;
+    const int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || ::fstat(fd, &status) != 0 ||
+        status.st_size <= 0) {
+        if (error) {
+            *error = "The shared ring must be a non-empty memfd sealed against shrinking";
+        }
+        ::close(fd);
+        return nullptr;
+    }
+    const size_t bytes = static_cast<size_t>(status.st_size);
+    void* data = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        setError(error, "mmap");
+        ::close(fd);
+        return nullptr;
+    }
+    return std::shared_ptr<OCRSharedRing>(
+        new OCRSharedRing(fd, static_cast<uchar*>(data), bytes));
+}
+
+OCRSharedRing::~OCRSharedRing() {
+    ::munmap(m_data, m_size);
+    ::close(m_fd);
+}
+
+qint64 OCRSharedRing::reserve(size_t bytes) {
+    bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    if (bytes > m_size) {
+        return -1;
+    }
+    if (m_next + bytes > m_size) {
+        m_next = 0;
+    }
+    const size_t offset = m_next;
+    m_next += bytes;
+    return static_cast<qint64>(offset);
+}
+
+bool OCRSharedRing::contains(qint64 offset, qint64 bytes) const {
+    return offset >= 0 && bytes >= 0 && static_cast<quint64>(offset) <= m_size &&
+           static_cast<quint64>(bytes) <= m_size - static_cast<quint64>(offset);
+}
@@ -0,0 +1,180 @@
+/*
+ * Module: OCR Result JSON Implementation
+ *
+ * Field-by-field encoding of OCRResult for daemon replies.
+ */
+
+#include "ocrresultjson.h"
+
+#include <QJsonArray>
+
+namespace {
+
+QJsonArray rectToJson(const QRect& rect) {
+    return QJsonArray{rect.x(), rect.y(), rect.width(), rect.height()};
+}
+
+QJsonArray sizeToJson(const QSize& size) {
+    return QJsonArray{size.width(), size.height()};
+}
+
+QSize sizeFromJson(const QJsonValue& value) {
+    const QJsonArray size = value.toArray();
+    return size.size() == 2 ? QSize(size.at(0).toInt(), size.at(1).toInt()) : QSize();
+}
+
+QRect rectFromJson(const QJsonValue& value) {
+    const QJsonArray box = value.toArray();
+    return box.size() == 4 ? QRect(box.at(0).toInt(), box.at(1).toInt(), box.at(2).toInt(),
+                                   box.at(3).toInt())
+                           : QRect();
+}
+
+}  // namespace
+
+QJsonObject OCRResultJson::toJson(const OCRProcessor::OCRResult& result) {
+    QJsonObject stages;
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        const auto stage = static_cast<OCRProcessor::Stage>(i);
+        const OCRProcessor::StageMetrics& metrics = result.stage(stage);
+        stages.insert(OCRProcessor::stageName(stage),
+                      QJsonObject{{"ns", metrics.durationNs}, {"bytes", metrics.bytesAllocated}});
+    }
+
+    // "equations" keeps its original form, LaTeX only, for ocr_client scripts
+    QJsonArray equations;
+    QJsonArray equationLines;
+    for (const OCRProcessor::Equation& equation : result.equations) {
+        equations.append(equation.latex);
+        equationLines.append(QJsonObject{{"text", equation.text},
+                                         {"latex", equation.latex},
+                                         {"tree", equation.tree},
+                                         {"box", rectToJson(equation.box)}});
+    }
+
+    QJsonObject reply{{"ok", result.success},
+                      {"text", result.text},
+                      {"confidence", result.confidence},
+                      {"processingMs", result.processingTimeMs},
+                      {"processingNs", result.processingTimeNs},
+                      {"equations", equations},
+                      {"equationLines", equationLines},
+                      {"imageSize", sizeToJson(result.imageSize)},
+                      {"decodedSize", sizeToJson(result.decodedSize)},
+                      {"decodeBytesSaved", result.decodeBytesSaved},
+                      {"appliedScale", result.appliedScale},
+                      {"budgetScale", result.budgetScale},
+                      {"xHeight", result.estimatedXHeight},
+                      {"stages", stages}};
+    if (!result.success) {
+        reply.insert("error", result.errorMessage);
+    }
+    if (result.isBlankPage) {
+        reply.insert("blank", true);
+    }
+    if (result.cancelled) {
+        reply.insert("cancelled", true);
+    }
+    if (!result.region.isNull()) {
+        reply.insert("region", rectToJson(result.region));
+    }
+    if (result.cascade.used) {
+        const OCRProcessor::CascadeMetrics& cascade = result.cascade;
+        reply.insert("cascade", QJsonObject{{"words", cascade.words},
+                                            {"escalatedWords", cascade.escalatedWords},
+                                            {"escalatedLines", cascade.escalatedLines},
+                                            {"fastNs", cascade.fastNs},
+                                            {"escalationNs", cascade.escalationNs},
+                                            {"fastConfidence", cascade.fastConfidence}});
+    }
+    if (result.split.used) {
+        const OCRProcessor::SplitMetrics& split = result.split;
+        reply.insert("split", QJsonObject{{"proseRegions", split.proseRegions},
+                                          {"mathRegions", split.mathRegions},
+                                          {"proseNs", split.proseNs},
+                                          {"mathNs", split.mathNs}});
+    }
+    if (result.grammar.lines > 0) {
+        const OCRProcessor::GrammarMetrics& grammar = result.grammar;
+        reply.insert("grammar", QJsonObject{{"lines", grammar.lines},
+                                            {"parsedLines", grammar.parsedLines},
+                                            {"correctedLines", grammar.correctedLines},
+                                            {"overBudgetLines", grammar.overBudgetLines}});
+    }
+    return reply;
+}
+
+OCRProcessor::OCRResult OCRResultJson::fromJson(const QJsonObject& reply) {
+    OCRProcessor::OCRResult result;
+    result.success = reply.value("ok").toBool();
+    result.text = reply.value("text").toString();
+    result.confidence = static_cast<float>(reply.value("confidence").toDouble());
+    result.errorMessage = reply.value("error").toString();
+    result.processingTimeMs = reply.value("processingMs").toInt();
+    result.processingTimeNs = reply.value("processingNs").toInteger();
+    result.isBlankPage = reply.value("blank").toBool();
+    result.cancelled = reply.value("cancelled").toBool();
+    result.region = rectFromJson(reply.value("region"));
+    result.imageSize = sizeFromJson(reply.value("imageSize"));
+    result.decodedSize = sizeFromJson(reply.value("decodedSize"));
+    result.decodeBytesSaved = reply.value("decodeBytesSaved").toInteger();
+    result.appliedScale = reply.value("appliedScale").toDouble(1.0);
+    result.budgetScale = reply.value("budgetScale").toDouble(1.0);
+    result.estimatedXHeight = reply.value("xHeight").toDouble();
+
+    const QJsonObject stages = reply.value("stages").toObject();
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        const auto stage = static_cast<OCRProcessor::Stage>(i);
+        const QJsonObject metrics = stages.value(OCRProcessor::stageName(stage)).toObject();
+        result.stage(stage).durationNs = metrics.value("ns").toInteger();
+        result.stage(stage).bytesAllocated = metrics.value("bytes").toInteger();
+    }
+
+    // Older daemons send only the LaTeX strings
+    const QJsonArray equationLines = reply.value("equationLines").toArray();
+    if (!equationLines.isEmpty()) {
+        for (const QJsonValue& value : equationLines) {
+            const QJsonObject line = value.toObject();
+            OCRProcessor::Equation equation;
+            equation.text = line.value("text").toString();
+            equation.latex = line.value("latex").toString();
+            equation.tree = line.value("tree").toString();
+            equation.box = rectFromJson(line.value("box"));
+            result.equations.push_back(equation);
+        }
+    } else {
+        for (const QJsonValue& latex : reply.value("equations").toArray()) {
+            OCRProcessor::Equation equation;
+            equation.latex = latex.toString();
+            result.equations.push_back(equation);
+        }
+    }
+
+    if (reply.contains("cascade")) {
+        const QJsonObject cascade = reply.value("cascade").toObject();
+        result.cascade.used = true;
+        result.cascade.words = cascade.value("words").toInt();
+        result.cascade.escalatedWords = cascade.value("escalatedWords").toInt();
+        result.cascade.escalatedLines = cascade.value("escalatedLines").toInt();
+        result.cascade.fastNs = cascade.value("fastNs").toInteger();
+        result.cascade.escalationNs = cascade.value("escalationNs").toInteger();
+        result.cascade.fastConfidence =
+            static_cast<float>(cascade.value("fastConfidence").toDouble());
+    }
+    if (reply.contains("split")) {
+        const QJsonObject split = reply.value("split").toObject();
+        result.split.used = true;
+        result.split.proseRegions = split.value("proseRegions").toInt();
+        result.split.mathRegions = split.value("mathRegions").toInt();
+        result.split.proseNs = split.value("proseNs").toInteger();
+        result.split.mathNs = split.value("mathNs").toInteger();
+    }
+    if (reply.contains("grammar")) {
+        const QJsonObject grammar = reply.value("grammar").toObject();
+        result.grammar.lines = grammar.value("lines").toInt();
+        result.grammar.parsedLines = grammar.value("parsedLines").toInt();
+        result.grammar.correctedLines = grammar.value("correctedLines").toInt();
+        result.grammar.overBudgetLines = grammar.value("overBudgetLines").toInt();
+    }
+    return result;
+}
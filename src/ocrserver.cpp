@@ -0,0 +1,486 @@
+/*
+ * Module: OCR Server Implementation
+ *
+ * Accept loop, request queue and engine workers of the OCR daemon.
+ */
+
+#include "ocrserver.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ocrmemorybudget.h"
+#include "ocrresultjson.h"
+#include "ocrtrace.h"
+
+Q_LOGGING_CATEGORY(ocrServer, "ocr.server")
+
+namespace {
+
+bool priorityFromName(const QString& name, OCRServer::Priority& priority) {
+    if (name == "interactive") {
+        priority = OCRServer::Priority::Interactive;
+    } else if (name == "batch") {
+        priority = OCRServer::Priority::Batch;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+qint64 microsecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+QJsonObject failure(const QString& error) {
+    return QJsonObject{{"ok", false}, {"error", error}};
+}
+
+/**
+ * @brief Wrap pixels in an attached ring as a QImage without copying them
+ *
+ * The image keeps a reference to the ring, so the mapping stays valid for as
+ * long as the engine holds the page, even after the client disconnects.
+ * @return Null image with `error` set if the geometry does not fit the ring
+ */
+QImage sharedImage(const std::shared_ptr<OCRSharedRing>& ring, const QJsonObject& shared,
+                   QString& error) {
+    if (!ring) {
+        error = "Request refers to a shared ring, but none is attached";
+        return QImage();
+    }
+    const QString formatName = shared.value("format").toString("gray8");
+    const QImage::Format format =
+        formatName == "rgb32" ? QImage::Format_RGB32 : QImage::Format_Grayscale8;
+    const qint64 bytesPerPixel = format == QImage::Format_RGB32 ? 4 : 1;
+    const qint64 offset = shared.value("offset").toInteger(-1);
+    const qint64 width = shared.value("width").toInteger();
+    const qint64 height = shared.value("height").toInteger();
+    const qint64 bytesPerLine = shared.value("bytesPerLine").toInteger();
+
+    // QImage needs 32-bit aligned scanlines
+    const qint64 ringBytes = static_cast<qint64>(ring->size());
+    if ((formatName != "gray8" && formatName != "rgb32") || width <= 0 || height <= 0 ||
+        width > INT_MAX / bytesPerPixel || height > INT_MAX || bytesPerLine > ringBytes ||
+        bytesPerLine < width * bytesPerPixel || bytesPerLine % 4 != 0 || offset % 4 != 0 ||
+        !ring->contains(offset, bytesPerLine * height)) {
+        error = "Shared image geometry does not fit the attached ring";
+        return QImage();
+    }
+
+    auto* reference = new std::shared_ptr<OCRSharedRing>(ring);
+    return QImage(
+        ring->constData() + offset, static_cast<int>(width), static_cast<int>(height),
+        static_cast<qsizetype>(bytesPerLine), format,
+        [](void* info) { delete static_cast<std::shared_ptr<OCRSharedRing>*>(info); }, reference);
+}
+
+}  // namespace
+
+const char* OCRServer::priorityName(Priority priority) {
+    return priority == Priority::Interactive ? "interactive" : "batch";
+}
+
+OCRServer::Connection::~Connection() {
+    ::close(fd);
+}
+
+bool OCRServer::Connection::send(const OCRProtocol::Message& message) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    return OCRProtocol::send(fd, message);
+}
+
+OCRServer::OCRServer(const Options& options)
+    : m_engines(options.config, options.workers),
+      m_defaultConfig(options.config),
+      m_socketPath(options.socketPath.isEmpty() ? OCRProtocol::defaultSocketPath()
+                                                : options.socketPath),
+      m_connectedFd(options.connectedFd),
+      m_workers(static_cast<size_t>(m_engines.size())) {
+    if (::pipe2(m_wakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        throw std::runtime_error("Cannot create the server wake-up pipe");
+    }
+}
+
+OCRServer::~OCRServer() {
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        QFile::remove(m_socketPath);
+    }
+    if (m_connectedFd >= 0) {
+        ::close(m_connectedFd);
+    }
+    ::close(m_wakePipe[0]);
+    ::close(m_wakePipe[1]);
+}
+
+bool OCRServer::listen(QString* error) {
+    m_listenFd = OCRProtocol::listen(m_socketPath, error);
+    return m_listenFd >= 0;
+}
+
+void OCRServer::stop() {
+    const char byte = 0;
+    // Only async-signal-safe calls here; a full pipe already means "stop"
+    [[maybe_unused]] const ssize_t written = ::write(m_wakePipe[1], &byte, 1);
+}
+
+void OCRServer::serve() {
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < m_engines.size(); ++worker) {
+        workers.emplace_back(&OCRServer::work, this, worker);
+    }
+    qCInfo(ocrServer) << "Serving" << m_socketPath << "with" << m_engines.size() << "engine(s)";
+
+    std::vector<std::shared_ptr<Connection>> connections;
+    if (m_connectedFd >= 0) {
+        connections.push_back(std::make_shared<Connection>(std::exchange(m_connectedFd, -1)));
+    }
+    std::vector<pollfd> descriptors;
+    bool running = m_listenFd >= 0 || !connections.empty();
+    while (running) {
+        descriptors.clear();
+        descriptors.push_back({m_wakePipe[0], POLLIN, 0});
+        descriptors.push_back({m_listenFd, POLLIN, 0});  // Ignored by poll() when -1
+        for (const auto& connection : connections) {
+            descriptors.push_back({connection->fd, POLLIN, 0});
+        }
+        if (::poll(descriptors.data(), descriptors.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(ocrServer) << "poll failed:" << strerror(errno);
+            break;
+        }
+
+        if (descriptors[0].revents) {
+            running = false;
+        }
+        if (descriptors[1].revents & POLLIN) {
+            const int client = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                connections.push_back(std::make_shared<Connection>(client));
+            }
+        }
+        // Connections are closed from the back so earlier indices stay valid
+        for (size_t i = descriptors.size() - 1; i >= 2; --i) {
+            if (descriptors[i].revents == 0) {
+                continue;
+            }
+            const std::shared_ptr<Connection>& connection = connections[i - 2];
+            if ((descriptors[i].revents & POLLIN) && handleRequest(connection)) {
+                continue;
+            }
+            // Workers may still reply on it; the descriptor closes with the last reference
+            ::shutdown(connection->fd, SHUT_RDWR);
+            connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i - 2));
+        }
+        if (m_listenFd < 0 && connections.empty()) {
+            running = false;  // The supervisor that handed us the socket is gone
+        }
+    }
+
+    qCInfo(ocrServer) << "Stopping; queued requests are finished first";
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopping = true;
+    }
+    m_queueReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const auto& connection : connections) {
+        ::shutdown(connection->fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * @brief Read one request; answer it here or queue it for an engine
+ * @return False when the connection should be closed
+ */
+bool OCRServer::handleRequest(const std::shared_ptr<Connection>& connection) {
+    Job job;
+    job.connection = connection;
+    if (!OCRProtocol::receive(connection->fd, job.request)) {
+        return false;
+    }
+    job.received = Clock::now();
+
+    const QString op = job.request.header.value("op").toString("recognize");
+    const int descriptor = std::exchange(job.request.descriptor, -1);
+    if (descriptor >= 0 && op != "attach") {
+        ::close(descriptor);
+    }
+    OCRProtocol::Message reply;
+    if (op == "recognize") {
+        const QString priority = job.request.header.value("priority").toString("batch");
+        if (priorityFromName(priority, job.priority)) {
+            job.ring = connection->ring;
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            const Priority queued = job.priority;
+            m_queues[static_cast<int>(queued)].push_back(std::move(job));
+            if (queued == Priority::Interactive) {
+                preemptBatchWork();
+            }
+            m_queueReady.notify_one();
+            return true;
+        }
+        reply.header = failure(QString("Unknown priority: %1").arg(priority));
+    } else if (op == "ping") {
+        reply.header = QJsonObject{{"ok", true}};
+    } else if (op == "attach") {
+        // Jobs already queued keep the ring they were submitted with
+        QString error = "attach carries no descriptor";
+        connection->ring = descriptor >= 0 ? OCRSharedRing::attach(descriptor, &error) : nullptr;
+        if (connection->ring) {
+            const qint64 ringBytes = static_cast<qint64>(connection->ring->size());
+            reply.header = QJsonObject{{"ok", true}, {"ringBytes", ringBytes}};
+        } else {
+            reply.header = failure(error);
+        }
+    } else if (op == "stats") {
+        reply.header = statistics();
+    } else {
+        reply.header = failure(QString("Unknown op: %1").arg(op));
+    }
+    reply.header.insert("id", job.request.header.value("id"));
+    reply.header.insert("serviceUs", microsecondsSince(job.received));
+    return connection->send(reply);
+}
+
+/**
+ * @brief Cancel batch pages until every waiting interactive request has an engine
+ *
+ * Called with m_queueMutex held. Engines that are idle or already being
+ * cancelled count as available, so one arrival cancels at most one page.
+ */
+void OCRServer::preemptBatchWork() {
+    size_t available = 0;
+    for (const WorkerState& state : m_workers) {
+        if (!state.busy || state.cancel.load(std::memory_order_relaxed)) {
+            ++available;
+        }
+    }
+    const size_t waiting = m_queues[static_cast<int>(Priority::Interactive)].size();
+    for (WorkerState& state : m_workers) {
+        if (available >= waiting) {
+            return;
+        }
+        if (state.busy && state.priority == Priority::Batch &&
+            !state.cancel.load(std::memory_order_relaxed)) {
+            state.cancel.store(true, std::memory_order_relaxed);
+            ++available;
+        }
+    }
+}
+
+void OCRServer::work(int worker) {
+    OCRTrace::setThreadName(QString("server engine %1").arg(worker));
+    const OCRThreading::ThreadPin pin(m_engines.placement(worker));
+    OCRProcessor& engine = m_engines.engine(worker);
+    WorkerState& state = m_workers[static_cast<size_t>(worker)];
+    engine.setCancelFlag(&state.cancel);
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            auto pending = [this] {
+                return std::any_of(m_queues.begin(), m_queues.end(),
+                                   [](const std::deque<Job>& queue) { return !queue.empty(); });
+            };
+            m_queueReady.wait(lock, [&] { return m_stopping || pending(); });
+            if (!pending()) {
+                break;  // stopping, and nothing left to do
+            }
+            // Lower Priority values are more urgent
+            std::deque<Job>& queue =
+                *std::find_if(m_queues.begin(), m_queues.end(),
+                              [](const std::deque<Job>& candidate) { return !candidate.empty(); });
+            job = std::move(queue.front());
+            queue.pop_front();
+            state.busy = true;
+            state.priority = job.priority;
+            state.cancel.store(false, std::memory_order_relaxed);
+        }
+        const qint64 queueUs = microsecondsSince(job.received);
+
+        OCRProtocol::Message reply;
+        {
+            OCR_TRACE_SCOPE("request", "server");
+            reply.header = recognize(engine, job);
+        }
+
+        if (reply.header.value("cancelled").toBool()) {
+            // Back to the head of its class; interactive requests are never cancelled
+            ++job.preemptions;
+            {
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                state.busy = false;
+                m_queues[static_cast<int>(job.priority)].push_front(std::move(job));
+            }
+            m_queueReady.notify_one();
+            std::lock_guard<std::mutex> lock(m_statisticsMutex);
+            ++m_preemptions;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            state.busy = false;
+        }
+
+        const qint64 serviceUs = microsecondsSince(job.received);
+        reply.header.insert("id", job.request.header.value("id"));
+        reply.header.insert("priority", priorityName(job.priority));
+        reply.header.insert("queueUs", queueUs);
+        reply.header.insert("serviceUs", serviceUs);
+        if (job.preemptions > 0) {
+            reply.header.insert("preemptions", job.preemptions);
+        }
+        job.connection->send(reply);
+
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        ClassStatistics& statistics = m_classes[static_cast<int>(job.priority)];
+        ++statistics.requests;
+        statistics.failures += reply.header.value("ok").toBool() ? 0 : 1;
+        statistics.queueUs.record(queueUs);
+        statistics.serviceUs.record(serviceUs);
+    }
+    engine.setCancelFlag(nullptr);
+}
+
+/**
+ * @brief Run one recognize request on an engine owned by the calling worker
+ */
+QJsonObject OCRServer::recognize(OCRProcessor& engine, const Job& job) {
+    const OCRProtocol::Message& request = job.request;
+    const QJsonObject& header = request.header;
+
+    // Settings a request does not name are the daemon's, not the ones the engine
+    // last ran with for another client
+    OCRProcessor::ProcessingMode mode = m_defaultConfig.mode;
+    if (header.contains("mode") &&
+        !OCRProcessor::modeFromName(header.value("mode").toString(), mode)) {
+        return failure(QString("Unknown mode: %1").arg(header.value("mode").toString()));
+    }
+    OCRProcessor::OCRConfig config = engine.getConfig();
+    const OCRProcessor::OCRConfig current = config;
+    config.mode = mode;
+    config.language = header.value("language").toString(m_defaultConfig.language);
+    config.dpi = header.value("dpi").toInt(m_defaultConfig.dpi);
+    config.minimumConfidence =
+        header.value("minConfidence").toInt(m_defaultConfig.minimumConfidence);
+    config.preprocessImage = header.value("preprocess").toBool(m_defaultConfig.preprocessImage);
+    if (config.mode != current.mode || config.language != current.language ||
+        config.dpi != current.dpi || config.minimumConfidence != current.minimumConfidence ||
+        config.preprocessImage != current.preprocessImage) {
+        if (!engine.setConfig(config)) {
+            engine.setConfig(current);
+            return failure(QString("Cannot apply language %1").arg(config.language));
+        }
+    }
+
+    QRect region;
+    const QJsonArray box = header.value("region").toArray();
+    if (box.size() == 4) {
+        region = QRect(box.at(0).toInt(), box.at(1).toInt(), box.at(2).toInt(),
+                       box.at(3).toInt());
+    }
+
+    OCRProcessor::OCRResult result;
+    const QString path = header.value("path").toString();
+    if (!path.isEmpty()) {
+        if (region.isNull()) {
+            result = engine.performOCR(path);
+        } else if (header.value("band").toBool()) {
+            result = engine.performOCRBand(path, region);
+        } else {
+            result = engine.performOCR(path, region);
+        }
+    } else if (header.contains("shared")) {
+        QString error;
+        QImage image = sharedImage(job.ring, header.value("shared").toObject(), error);
+        if (image.isNull()) {
+            return failure(error);
+        }
+        if (!region.isNull()) {
+            image = image.copy(region);
+        }
+        result = engine.performOCR(image);
+    } else if (!request.body.isEmpty()) {
+        QImage image = QImage::fromData(request.body);
+        if (image.isNull()) {
+            return failure("Cannot decode the image in the request body");
+        }
+        if (!region.isNull()) {
+            image = image.copy(region);
+        }
+        result = engine.performOCR(image);
+    } else {
+        return failure("Request has neither a path nor an image");
+    }
+
+    return OCRResultJson::toJson(result);
+}
+
+QJsonObject OCRServer::statistics() {
+    std::array<qint64, kPriorityCount> queueDepth{};
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        for (int i = 0; i < kPriorityCount; ++i) {
+            queueDepth[i] = static_cast<qint64>(m_queues[i].size());
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_statisticsMutex);
+    QJsonObject reply{{"ok", true},
+                      {"engines", m_engines.size()},
+                      {"preemptions", m_preemptions}};
+    qint64 requests = 0;
+    qint64 failures = 0;
+    for (const Priority priority : {Priority::Interactive, Priority::Batch}) {
+        const ClassStatistics& statistics = m_classes[static_cast<int>(priority)];
+        requests += statistics.requests;
+        failures += statistics.failures;
+        reply.insert(priorityName(priority),
+                     QJsonObject{{"requests", statistics.requests},
+                                 {"failures", statistics.failures},
+                                 {"queueDepth", queueDepth[static_cast<int>(priority)]},
+                                 {"queueUsP50", statistics.queueUs.percentile(50)},
+                                 {"queueUsP99", statistics.queueUs.percentile(99)},
+                                 {"serviceUsP50", statistics.serviceUs.percentile(50)},
+                                 {"serviceUsP99", statistics.serviceUs.percentile(99)}});
+    }
+    reply.insert("requests", requests);
+    reply.insert("failures", failures);
+
+    const OCRMemoryBudget::Usage memory = OCRMemoryBudget::usage();
+    QJsonObject pools;
+    const char* const poolNames[] = {"working", "prepared", "engines"};
+    for (int i = 0; i < OCRMemoryBudget::kPoolCount; ++i) {
+        pools.insert(poolNames[i],
+                     QJsonObject{{"bytes", memory.bytes[i]}, {"peakBytes", memory.peakBytes[i]}});
+    }
+    reply.insert("memory", QJsonObject{{"limitBytes", memory.limitBytes},
+                                       {"peakTotalBytes", memory.peakTotalBytes},
+                                       {"pools", pools},
+                                       {"admissions", memory.admissions},
+                                       {"waits", memory.waits},
+                                       {"waitMs", memory.waitNs / 1000000},
+                                       {"downscales", memory.downscales},
+                                       {"overcommits", memory.overcommits}});
+    return reply;
+}
@@ -0,0 +1,102 @@
+/*
+ * Module: OCR Statistics Implementation
+ *
+ * Per-stage aggregation of OCR pipeline metrics.
+ */
+
+#include "ocrstatistics.h"
+
+#include <QTextStream>
+
+namespace {
+
+QString formatDuration(qint64 ns) {
+    if (ns >= 1000000000LL) {
+        return QString::number(ns / 1e9, 'f', 2) + " s";
+    }
+    if (ns >= 1000000LL) {
+        return QString::number(ns / 1e6, 'f', 2) + " ms";
+    }
+    return QString::number(ns / 1e3, 'f', 1) + " us";
+}
+
+QString formatBytes(qint64 bytes) {
+    if (bytes >= 1024LL * 1024LL) {
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MiB";
+    }
+    if (bytes >= 1024LL) {
+        return QString::number(bytes / 1024.0, 'f', 1) + " KiB";
+    }
+    return QString::number(bytes) + " B";
+}
+
+}  // namespace
+
+/**
+ * @brief Add one page worth of stage metrics
+ */
+void OCRStageStatistics::add(const OCRProcessor::OCRResult& result) {
+    qint64 stagesNs = 0;
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        // A stage that did not run (cache hit, blank page, mode without it) is no sample
+        if (result.stages[i].durationNs <= 0) {
+            continue;
+        }
+        m_durations[i].record(result.stages[i].durationNs);
+        m_allocations[i].record(result.stages[i].bytesAllocated);
+        stagesNs += result.stages[i].durationNs;
+    }
+    // Overlapping stages (Mixed pages) and untimed work make the stage sum a poor total
+    m_total.record(result.processingTimeNs > 0 ? result.processingTimeNs : stagesNs);
+}
+
+void OCRStageStatistics::merge(const OCRStageStatistics& other) {
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        m_durations[i].merge(other.m_durations[i]);
+        m_allocations[i].merge(other.m_allocations[i]);
+    }
+    m_total.merge(other.m_total);
+}
+
+const LatencyHistogram& OCRStageStatistics::durations(OCRProcessor::Stage stage) const {
+    return m_durations[static_cast<int>(stage)];
+}
+
+const LatencyHistogram& OCRStageStatistics::allocations(OCRProcessor::Stage stage) const {
+    return m_allocations[static_cast<int>(stage)];
+}
+
+/**
+ * @brief Format per-stage percentiles as a plain-text table
+ */
+QString OCRStageStatistics::formatTable() const {
+    QString table;
+    QTextStream out(&table);
+
+    auto row = [&out](const QString& name, const QString& pages, const QString& p50,
+                      const QString& p95, const QString& p99, const QString& max,
+                      const QString& bytes) {
+        out << name.leftJustified(13) << pages.rightJustified(8) << p50.rightJustified(12)
+            << p95.rightJustified(12) << p99.rightJustified(12) << max.rightJustified(12)
+            << bytes.rightJustified(14) << "\n";
+    };
+
+    // Percentiles of a stage cover only the pages it ran on
+    out << "Stage breakdown over " << pageCount() << " page(s)\n";
+    row("stage", "pages", "p50", "p95", "p99", "max", "mean alloc");
+
+    for (int i = 0; i < OCRProcessor::kStageCount; ++i) {
+        const auto stage = static_cast<OCRProcessor::Stage>(i);
+        const LatencyHistogram& d = m_durations[i];
+        row(QString::fromLatin1(OCRProcessor::stageName(stage)), QString::number(d.count()),
+            formatDuration(d.percentile(50)), formatDuration(d.percentile(95)),
+            formatDuration(d.percentile(99)), formatDuration(d.max()),
+            formatBytes(static_cast<qint64>(m_allocations[i].mean())));
+    }
+
+    row("total", QString::number(m_total.count()), formatDuration(m_total.percentile(50)),
+        formatDuration(m_total.percentile(95)), formatDuration(m_total.percentile(99)),
+        formatDuration(m_total.max()), QString());
+
+    return table;
+}
@@ -0,0 +1,263 @@
+/*
+ * Module: OCRTestPages Implementation
+ *
+ * QPainter-based rendering of deterministic prose/equation test pages.
+ */
+
+#include "ocrtestpages.h"
+
+#include <QFont>
+#include <QFontMetrics>
+#include <QPainter>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief One run of equation glyphs at a fixed script level
+ */
+struct ScriptRun {
+    QString text;
+    int level;  ///< 0 = baseline, 1 = superscript, -1 = subscript
+};
+
+const QStringList& vocabulary() {
+    static const QStringList words = {
+        "the",      "of",       "and",       "a",        "to",        "in",       "is",
+        "that",     "for",      "it",        "as",       "was",       "with",     "be",
+        "by",       "on",       "not",       "this",     "are",       "or",       "from",
+        "value",    "function", "equation",  "solve",    "student",   "answer",   "problem",
+        "number",   "graph",    "result",    "method",   "example",   "integer",  "variable",
+        "constant", "therefore", "consider", "follows",  "because",   "product",  "sum",
+        "square",   "root",     "triangle",  "angle",    "length",    "area",     "volume",
+        "line",     "point",    "curve",     "slope",    "given",     "find",     "show",
+        "prove",    "each",     "every",     "first",    "second",    "final",    "simple"};
+    return words;
+}
+
+/**
+ * @brief Split ^{...} / _{...} markup into runs
+ */
+std::vector<ScriptRun> parseMarkup(const QString& markup) {
+    std::vector<ScriptRun> runs;
+    QString current;
+    int i = 0;
+    while (i < markup.size()) {
+        const QChar c = markup.at(i);
+        if ((c == '^' || c == '_') && i + 1 < markup.size() && markup.at(i + 1) == '{') {
+            const int close = markup.indexOf('}', i + 2);
+            if (close > 0) {
+                if (!current.isEmpty()) {
+                    runs.push_back({current, 0});
+                    current.clear();
+                }
+                runs.push_back({markup.mid(i + 2, close - i - 2), c == '^' ? 1 : -1});
+                i = close + 1;
+                continue;
+            }
+        }
+        current.append(c);
+        ++i;
+    }
+    if (!current.isEmpty()) {
+        runs.push_back({current, 0});
+    }
+    return runs;
+}
+
+QFont fontFor(int points, int dpi) {
+    QFont font("DejaVu Sans");
+    font.setStyleHint(QFont::SansSerif);
+    font.setPixelSize(std::max(6, points * dpi / 72));
+    return font;
+}
+
+/**
+ * @brief Draw an equation with raised/lowered script runs
+ * @return Horizontal advance of the drawn equation
+ */
+int drawEquation(QPainter& painter, const QString& markup, int x, int baseline,
+                 const QFont& baseFont) {
+    QFont scriptFont = baseFont;
+    scriptFont.setPixelSize(std::max(5, baseFont.pixelSize() * 7 / 10));
+    const QFontMetrics baseMetrics(baseFont);
+    const QFontMetrics scriptMetrics(scriptFont);
+
+    int cursor = x;
+    for (const ScriptRun& run : parseMarkup(markup)) {
+        if (run.level == 0) {
+            painter.setFont(baseFont);
+            painter.drawText(cursor, baseline, run.text);
+            cursor += baseMetrics.horizontalAdvance(run.text);
+        } else {
+            const int shift = run.level > 0 ? -baseMetrics.ascent() * 2 / 5
+                                            : baseMetrics.descent() + scriptMetrics.descent() / 2;
+            painter.setFont(scriptFont);
+            painter.drawText(cursor, baseline + shift, run.text);
+            cursor += scriptMetrics.horizontalAdvance(run.text);
+        }
+    }
+    return cursor - x;
+}
+
+/**
+ * @brief Produce one prose line that fits within maxWidth
+ */
+QString proseLine(std::mt19937& rng, const QFontMetrics& metrics, int maxWidth,
+                  bool& startSentence) {
+    const QStringList& words = vocabulary();
+    QString line;
+    int sentenceLength = 0;
+    for (;;) {
+        QString word = words.at(static_cast<int>(rng() % words.size()));
+        if (startSentence) {
+            word[0] = word.at(0).toUpper();
+            startSentence = false;
+            sentenceLength = 0;
+        }
+        ++sentenceLength;
+        if (sentenceLength >= 6 && rng() % 5 == 0) {
+            word += '.';
+            startSentence = true;
+        }
+        const QString candidate = line.isEmpty() ? word : line + ' ' + word;
+        if (metrics.horizontalAdvance(candidate) > maxWidth && !line.isEmpty()) {
+            return line;
+        }
+        line = candidate;
+    }
+}
+
+}  // namespace
+
+/**
+ * @brief Render a full synthetic page
+ */
+OCRTestPages::Page OCRTestPages::render(const PageSpec& spec) {
+    const int width = qRound(spec.sizeInches.width() * spec.dpi);
+    const int height = qRound(spec.sizeInches.height() * spec.dpi);
+    const int margin = std::min(spec.dpi, width / 10);
+
+    QImage canvas(width, height, QImage::Format_RGB32);
+    canvas.fill(Qt::white);
+
+    QPainter painter(&canvas);
+    painter.setRenderHint(QPainter::TextAntialiasing, true);
+    painter.setPen(Qt::black);
+
+    const QFont bodyFont = fontFor(spec.fontPoints, spec.dpi);
+    const QFontMetrics metrics(bodyFont);
+    const int lineStep = metrics.height() * 3 / 2;
+    const int textWidth = width - 2 * margin;
+
+    std::mt19937 rng(spec.seed);
+    const QStringList& equations = equationCorpus();
+    Page page;
+
+    bool startSentence = true;
+    int lineIndex = 0;
+    for (int baseline = margin + metrics.ascent(); baseline + metrics.descent() < height - margin;
+         baseline += lineStep, ++lineIndex) {
+        const bool equationLine = spec.kind == PageKind::Equations ||
+                                  (spec.kind == PageKind::Mixed && lineIndex % 4 == 3);
+
+        if (equationLine) {
+            const QString markup = equations.at(static_cast<int>(rng() % equations.size()));
+            const int indent = spec.kind == PageKind::Mixed ? textWidth / 8 : 0;
+            drawEquation(painter, markup, margin + indent, baseline, bodyFont);
+            page.groundTruth << plainText(markup);
+        } else {
+            const QString line = proseLine(rng, metrics, textWidth, startSentence);
+            painter.setFont(bodyFont);
+            painter.drawText(margin, baseline, line);
+            page.groundTruth << line;
+        }
+    }
+    painter.end();
+
+    page.image = canvas.convertToFormat(QImage::Format_Grayscale8);
+    return page;
+}
+
+/**
+ * @brief Render one equation on a tight canvas
+ */
+QImage OCRTestPages::renderEquation(const QString& markup, int dpi, int fontPoints) {
+    const QFont font = fontFor(fontPoints, dpi);
+    const QFontMetrics metrics(font);
+    const int padding = metrics.height();
+
+    // Base-font advance is an upper bound: script runs are drawn narrower
+    int advance = 0;
+    for (const ScriptRun& run : parseMarkup(markup)) {
+        advance += metrics.horizontalAdvance(run.text);
+    }
+
+    QImage canvas(advance + 2 * padding, metrics.height() * 2 + 2 * padding,
+                  QImage::Format_RGB32);
+    canvas.fill(Qt::white);
+
+    QPainter painter(&canvas);
+    painter.setRenderHint(QPainter::TextAntialiasing, true);
+    painter.setPen(Qt::black);
+    drawEquation(painter, markup, padding, padding + metrics.height() + metrics.ascent() / 2,
+                 font);
+    painter.end();
+
+    return canvas.convertToFormat(QImage::Format_Grayscale8);
+}
+
+/**
+ * @brief Equation corpus shared by the benchmark and the accuracy harness
+ */
+const QStringList& OCRTestPages::equationCorpus() {
+    static const QStringList corpus = {
+        "x + 5 = 12",
+        "2x - 7 = 3",
+        "3a + 4b = 24",
+        "x^{2} + 3x - 4 = 0",
+        "y = 2x + 1",
+        "a^{2} + b^{2} = c^{2}",
+        "(x + 1)(x - 1) = x^{2} - 1",
+        "f(x) = 4x^{3} - 2x + 9",
+        "5(y - 2) = 3y + 6",
+        "x_{1} + x_{2} = 10",
+        "2^{10} = 1024",
+        "E = mc^{2}",
+        "y = mx + b",
+        "a_{n} = a_{1} + (n - 1)d",
+        "7 * 8 = 56",
+        "144 / 12 = 12",
+        "[2x + 3] = 9",
+        "{x, y} = {3, 4}",
+        "z = x^{2} - y^{2}",
+        "p(q + r) = pq + pr",
+        "(a + b)^{2} = a^{2} + 2ab + b^{2}",
+        "g(t) = 16t^{2} + 4",
+        "k_{0} = 3.14",
+        "v = u + at",
+    };
+    return corpus;
+}
+
+QString OCRTestPages::plainText(const QString& markup) {
+    QString text;
+    for (const ScriptRun& run : parseMarkup(markup)) {
+        text += run.text;
+    }
+    return text;
+}
+
+QString OCRTestPages::kindName(PageKind kind) {
+    switch (kind) {
+        case PageKind::Paragraphs:
+            return "paragraphs";
+        case PageKind::Equations:
+            return "equations";
+        case PageKind::Mixed:
+            return "mixed";
+    }
+    return "unknown";
+}
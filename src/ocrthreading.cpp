@@ -0,0 +1,568 @@
+/*
+ * Module: OCR Threading Implementation
+ *
+ * CPU detection (affinity mask, cgroup quota, NUMA topology), the process-wide
+ * thread plan, OpenMP thread limiting, worker placement and the engine pool.
+ */
+
+#include "ocrthreading.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <numeric>
+#include <thread>
+#include <utility>
+
+#include "ocrtrace.h"
+
+#ifdef Q_OS_LINUX
+#include <dlfcn.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+Q_LOGGING_CATEGORY(ocrThreading, "ocr.threading")
+
+namespace {
+
+// Set in the environment of a re-executed program, so it cannot loop
+constexpr const char* kRestartMarker = "MATHSCAN_OMP_RESTARTED";
+
+QMutex s_planMutex;
+OCRThreading::Plan s_plan;
+
+#ifdef Q_OS_LINUX
+/**
+ * @brief Whole contents of a small /proc or /sys file (empty if unreadable)
+ */
+QByteArray readSmallFile(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+/**
+ * @brief Path of this process's cgroup for a controller ("" selects cgroup v2)
+ */
+QByteArray cgroupPath(const QByteArray& controller) {
+    for (const QByteArray& line : readSmallFile("/proc/self/cgroup").split('\n')) {
+        // hierarchy-id:controller-list:path
+        const QList<QByteArray> fields = line.split(':');
+        if (fields.size() < 3) {
+            continue;
+        }
+        const bool matches = controller.isEmpty()
+                                 ? fields[0] == "0" && fields[1].isEmpty()
+                                 : fields[1].split(',').contains(controller);
+        if (matches) {
+            return line.mid(fields[0].size() + fields[1].size() + 2);
+        }
+    }
+    return QByteArray();
+}
+
+/**
+ * @brief Smallest limit from a cgroup directory up to the mount root
+ *
+ * A nested cgroup is also limited by its parents, and inside a container the
+ * process often sees its own cgroup as the root.
+ *
+ * @param read Limit for one directory, e.g. a quota in CPUs (0 = none)
+ */
+double smallestLimit(const QString& mount, QByteArray path,
+                     const std::function<double(const QString&)>& read) {
+    double smallest = 0.0;
+    while (true) {
+        const double limit = read(mount + QString::fromUtf8(path));
+        if (limit > 0.0 && (smallest == 0.0 || limit < smallest)) {
+            smallest = limit;
+        }
+        if (path.isEmpty() || path == "/") {
+            break;
+        }
+        path.truncate(std::max<qsizetype>(0, path.lastIndexOf('/')));
+    }
+    return smallest;
+}
+
+/**
+ * @brief cgroup v2: cpu.max is "<quota> <period>" or "max <period>"
+ */
+double cgroupV2Quota(const QString& directory) {
+    const QList<QByteArray> fields = readSmallFile(directory + "/cpu.max").split(' ');
+    if (fields.size() != 2 || fields[0] == "max") {
+        return 0.0;
+    }
+    const double period = fields[1].toDouble();
+    return period > 0 ? fields[0].toDouble() / period : 0.0;
+}
+
+/**
+ * @brief cgroup v1: cpu.cfs_quota_us is -1 when unlimited
+ */
+double cgroupV1Quota(const QString& directory) {
+    const double quota = readSmallFile(directory + "/cpu.cfs_quota_us").toDouble();
+    const double period = readSmallFile(directory + "/cpu.cfs_period_us").toDouble();
+    return quota > 0 && period > 0 ? quota / period : 0.0;
+}
+
+double detectQuotaCpus() {
+    if (QFile::exists("/sys/fs/cgroup/cgroup.controllers")) {
+        return smallestLimit("/sys/fs/cgroup", cgroupPath(QByteArray()), cgroupV2Quota);
+    }
+    for (const char* mount : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+        if (QFile::exists(QString(mount) + "/cpu.cfs_quota_us")) {
+            return smallestLimit(mount, cgroupPath("cpu"), cgroupV1Quota);
+        }
+    }
+    return 0.0;
+}
+
+/**
+ * @brief cgroup v2: memory.max is a byte count or "max"
+ */
+double cgroupV2MemoryLimit(const QString& directory) {
+    const QByteArray limit = readSmallFile(directory + "/memory.max");
+    return limit == "max" ? 0.0 : limit.toDouble();
+}
+
+/**
+ * @brief cgroup v1: memory.limit_in_bytes is a huge page-rounded number when unlimited
+ */
+double cgroupV1MemoryLimit(const QString& directory) {
+    const double limit = readSmallFile(directory + "/memory.limit_in_bytes").toDouble();
+    return limit < 0x1p60 ? limit : 0.0;
+}
+
+/**
+ * @brief Parse a kernel CPU list such as "0-3,8-11"
+ */
+std::vector<int> parseCpuList(const QByteArray& list) {
+    std::vector<int> cpus;
+    for (const QByteArray& range : list.split(',')) {
+        const QList<QByteArray> bounds = range.split('-');
+        bool ok = false;
+        const int first = bounds[0].toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+        const int last = bounds.size() > 1 ? bounds[1].toInt() : first;
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief CPUs in the calling thread's affinity mask (empty if unreadable)
+ */
+std::vector<int> affinityCpus() {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &mask)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+bool setAffinityCpus(const std::vector<int>& cpus) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (const int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &mask);
+        }
+    }
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+
+/**
+ * @brief NUMA node of every CPU (empty on kernels without NUMA support)
+ */
+std::map<int, int> cpuNodes() {
+    std::map<int, int> nodes;
+    const QDir directory("/sys/devices/system/node");
+    for (const QString& entry : directory.entryList({"node*"}, QDir::Dirs)) {
+        bool ok = false;
+        const int node = entry.mid(4).toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+        for (const int cpu : parseCpuList(readSmallFile(directory.filePath(entry + "/cpulist")))) {
+            nodes[cpu] = node;
+        }
+    }
+    return nodes;
+}
+
+/**
+ * @brief 0 for the first hardware thread of a core, 1 for its sibling, and so on
+ */
+int siblingRank(int cpu) {
+    const QString topology = QString("/sys/devices/system/cpu/cpu%1/topology/").arg(cpu);
+    QByteArray siblings = readSmallFile(topology + "core_cpus_list");
+    if (siblings.isEmpty()) {
+        siblings = readSmallFile(topology + "thread_siblings_list");  // Before Linux 5.7
+    }
+    const std::vector<int> core = parseCpuList(siblings);
+    const auto it = std::find(core.begin(), core.end(), cpu);
+    return it == core.end() ? 0 : static_cast<int>(it - core.begin());
+}
+#endif
+
+}  // namespace
+
+OCRThreading::CpuInfo OCRThreading::detectCpus() {
+    CpuInfo cpus;
+    cpus.onlineCpus = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    cpus.affinityCpus = cpus.onlineCpus;
+#ifdef Q_OS_LINUX
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        cpus.affinityCpus = std::max(1, CPU_COUNT(&mask));
+    }
+    cpus.quotaCpus = detectQuotaCpus();
+
+    const std::map<int, int> nodeOf = cpuNodes();
+    std::vector<int> nodes;
+    for (const int cpu : affinityCpus()) {
+        const auto it = nodeOf.find(cpu);
+        if (it != nodeOf.end() &&
+            std::find(nodes.begin(), nodes.end(), it->second) == nodes.end()) {
+            nodes.push_back(it->second);
+        }
+    }
+    cpus.numaNodes = std::max(1, static_cast<int>(nodes.size()));
+#endif
+    cpus.usableCpus = cpus.affinityCpus;
+    if (cpus.quotaCpus > 0.0) {
+        // A quota of 1.5 CPUs still keeps two threads partly busy
+        cpus.usableCpus = std::min(cpus.usableCpus,
+                                   std::max(1, static_cast<int>(std::ceil(cpus.quotaCpus))));
+    }
+    return cpus;
+}
+
+qint64 OCRThreading::detectMemoryLimit() {
+#ifdef Q_OS_LINUX
+    double limit = 0.0;
+    if (QFile::exists("/sys/fs/cgroup/cgroup.controllers")) {
+        limit = smallestLimit("/sys/fs/cgroup", cgroupPath(QByteArray()), cgroupV2MemoryLimit);
+    } else if (QFile::exists("/sys/fs/cgroup/memory/memory.limit_in_bytes")) {
+        limit = smallestLimit("/sys/fs/cgroup/memory", cgroupPath("memory"), cgroupV1MemoryLimit);
+    }
+    return static_cast<qint64>(limit);
+#else
+    return 0;
+#endif
+}
+
+OCRThreading::Plan OCRThreading::makePlan(int workers, int engineThreads, const CpuInfo& cpus) {
+    const int usable = std::max(1, cpus.usableCpus);
+    if (engineThreads <= 0) {
+        engineThreads = std::max(0, qEnvironmentVariableIntValue("OMP_THREAD_LIMIT"));
+    }
+
+    Plan plan;
+    if (workers <= 0 && engineThreads <= 0) {
+        plan.workers = usable;
+        plan.engineThreads = 1;
+    } else if (workers <= 0) {
+        plan.engineThreads = engineThreads;
+        plan.workers = std::max(1, usable / engineThreads);
+    } else if (engineThreads <= 0) {
+        plan.workers = workers;
+        plan.engineThreads = std::max(1, usable / workers);
+    } else {
+        plan.workers = workers;
+        plan.engineThreads = engineThreads;
+    }
+    // The second region thread of a Mixed page is one more engine per worker
+    plan.overlapRegions = plan.workers * plan.engineThreads * 2 <= usable;
+
+    if (plan.workers * plan.engineThreads > usable) {
+        qCWarning(ocrThreading) << plan.workers << "workers x" << plan.engineThreads
+                                << "engine threads oversubscribe" << usable << "usable CPUs";
+    }
+    return plan;
+}
+
+void OCRThreading::setPlan(const Plan& plan) {
+    QMutexLocker locker(&s_planMutex);
+    s_plan = plan;
+}
+
+OCRThreading::Plan OCRThreading::plan() {
+    QMutexLocker locker(&s_planMutex);
+    return s_plan;
+}
+
+int OCRThreading::openMpThreadLimit() {
+#ifdef Q_OS_LINUX
+    // Looked up at run time: Tesseract may or may not have been built with OpenMP
+    using ThreadLimitFunction = int (*)();
+    auto threadLimit =
+        reinterpret_cast<ThreadLimitFunction>(dlsym(RTLD_DEFAULT, "omp_get_thread_limit"));
+    return threadLimit ? threadLimit() : 0;
+#else
+    return 0;
+#endif
+}
+
+bool OCRThreading::applyEngineThreads(int threads) {
+    threads = std::max(1, threads);
+    const QByteArray limit = QByteArray::number(threads);
+    qputenv("OMP_THREAD_LIMIT", limit);
+
+    const int current = openMpThreadLimit();
+    if (current == 0 || current == threads) {
+        return true;  // no OpenMP runtime, or it already uses this limit
+    }
+#ifdef Q_OS_LINUX
+    if (qgetenv(kRestartMarker) != limit) {
+        qCInfo(ocrThreading) << "Restarting with OMP_THREAD_LIMIT" << threads << "(runtime has"
+                             << current << ")";
+        qputenv(kRestartMarker, limit);
+
+        const QStringList arguments = QCoreApplication::arguments();
+        std::vector<QByteArray> storage;
+        std::vector<char*> argv;
+        for (const QString& argument : arguments) {
+            storage.push_back(argument.toLocal8Bit());
+        }
+        for (QByteArray& argument : storage) {
+            argv.push_back(argument.data());
+        }
+        argv.push_back(nullptr);
+        execv("/proc/self/exe", argv.data());
+        qCWarning(ocrThreading) << "Cannot restart the program:" << strerror(errno);
+    }
+#endif
+    qCWarning(ocrThreading) << "OpenMP keeps its thread limit of" << current << "instead of"
+                            << threads << "- set OMP_THREAD_LIMIT before starting";
+    return false;
+}
+
+QString OCRThreading::describe(const Plan& plan, const CpuInfo& cpus) {
+    QString text = QString("%1 worker%2 x %3 engine thread%4 on %5 of %6 CPUs")
+                       .arg(plan.workers)
+                       .arg(plan.workers == 1 ? "" : "s")
+                       .arg(plan.engineThreads)
+                       .arg(plan.engineThreads == 1 ? "" : "s")
+                       .arg(cpus.usableCpus)
+                       .arg(cpus.onlineCpus);
+    if (cpus.quotaCpus > 0.0) {
+        text += QString(" (cgroup quota %1)").arg(cpus.quotaCpus, 0, 'f', 2);
+    }
+    if (plan.pinWorkers) {
+        text += QString(", pinned across %1 NUMA node%2")
+                    .arg(cpus.numaNodes)
+                    .arg(cpus.numaNodes == 1 ? "" : "s");
+    }
+    return text;
+}
+
+std::vector<OCRThreading::Placement> OCRThreading::placeWorkers(int workers, int engineThreads) {
+    std::vector<Placement> placements;
+#ifdef Q_OS_LINUX
+    const std::vector<int> cpus = affinityCpus();
+    if (cpus.size() < 2 || workers < 1) {
+        return placements;
+    }
+
+    const std::map<int, int> nodeOf = cpuNodes();
+    std::map<int, std::vector<int>> nodeCpus;
+    for (const int cpu : cpus) {
+        const auto it = nodeOf.find(cpu);
+        nodeCpus[it == nodeOf.end() ? -1 : it->second].push_back(cpu);
+    }
+
+    // Cut every node into sets of engineThreads CPUs, whole cores before siblings;
+    // a remainder too small for a set joins the node's last set
+    const size_t setSize = static_cast<size_t>(std::max(1, engineThreads));
+    std::vector<std::vector<Placement>> nodeSets;
+    size_t setCount = 0;
+    for (const auto& [node, nodeList] : nodeCpus) {
+        std::vector<std::pair<int, int>> ranked;  // (sibling rank, cpu)
+        for (const int cpu : nodeList) {
+            ranked.emplace_back(siblingRank(cpu), cpu);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<Placement> sets;
+        for (size_t i = 0; i < ranked.size(); ++i) {
+            if (i % setSize == 0 && (sets.empty() || ranked.size() - i >= setSize)) {
+                sets.push_back(Placement{{}, node});
+            }
+            sets.back().cpus.push_back(ranked[i].second);
+        }
+        setCount += sets.size();
+        nodeSets.push_back(std::move(sets));
+    }
+
+    // Deal the sets node by node in turn
+    std::vector<Placement> dealt;
+    for (size_t round = 0; dealt.size() < setCount; ++round) {
+        for (const std::vector<Placement>& sets : nodeSets) {
+            if (round < sets.size()) {
+                dealt.push_back(sets[round]);
+            }
+        }
+    }
+    for (int worker = 0; worker < workers; ++worker) {
+        placements.push_back(dealt[static_cast<size_t>(worker) % dealt.size()]);
+    }
+#else
+    Q_UNUSED(workers);
+    Q_UNUSED(engineThreads);
+#endif
+    return placements;
+}
+
+OCRThreading::ThreadPin::ThreadPin(const Placement& placement) {
+#ifdef Q_OS_LINUX
+    if (placement.cpus.empty()) {
+        return;
+    }
+    std::vector<int> previous = affinityCpus();
+    if (setAffinityCpus(placement.cpus)) {
+        m_previous = std::move(previous);
+    } else {
+        const int error = errno;
+        qCWarning(ocrThreading) << "Cannot pin thread to CPUs" << placement.cpus << ":"
+                                << strerror(error);
+    }
+#else
+    Q_UNUSED(placement);
+#endif
+}
+
+OCRThreading::ThreadPin::~ThreadPin() {
+#ifdef Q_OS_LINUX
+    if (!m_previous.empty()) {
+        setAffinityCpus(m_previous);
+    }
+#endif
+}
+
+OCRWorkerPool::OCRWorkerPool(const OCRProcessor::OCRConfig& config, int workers)
+    : OCRWorkerPool(workers) {
+    const OCRThreading::Plan plan = OCRThreading::plan();
+    if (plan.pinWorkers) {
+        std::vector<OCRThreading::Placement> placements =
+            OCRThreading::placeWorkers(m_workers, plan.engineThreads);
+        if (!placements.empty()) {
+            m_placements = std::move(placements);
+        }
+    }
+
+    for (int i = 0; i < m_workers; ++i) {
+        const OCRThreading::Placement& placement = m_placements[i];
+        if (placement.cpus.empty()) {
+            m_engines.push_back(std::make_unique<OCRProcessor>(config));
+            continue;
+        }
+        // Initialized on a pinned thread, so first touch puts the models on the worker's
+        // node; one at a time, so each engine's resident-set growth is its own
+        std::unique_ptr<OCRProcessor> engine;
+        std::exception_ptr failure;
+        std::thread([&] {
+            const OCRThreading::ThreadPin pin(placement);
+            try {
+                engine = std::make_unique<OCRProcessor>(config);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }).join();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        m_engines.push_back(std::move(engine));
+        qCInfo(ocrThreading) << "Worker" << i << "pinned to CPUs" << placement.cpus << "on node"
+                             << placement.node;
+    }
+}
+
+OCRWorkerPool::OCRWorkerPool(int workers)
+    : m_placements(static_cast<size_t>(std::max(1, workers))), m_workers(std::max(1, workers)) {}
+
+void OCRWorkerPool::run(int count, const Task& task) {
+    std::vector<int> order(static_cast<size_t>(std::max(0, count)));
+    std::iota(order.begin(), order.end(), 0);
+    run(order, task);
+}
+
+void OCRWorkerPool::run(const std::vector<int>& order, const Task& task) {
+    run(order, [&](int worker, int index) { task(*m_engines[worker], index); });
+}
+
+void OCRWorkerPool::run(const std::vector<int>& order, const WorkerTask& task) {
+    const int count = static_cast<int>(order.size());
+    std::atomic<int> next(0);
+    auto work = [&](int worker) {
+        const OCRThreading::ThreadPin pin(m_placements[worker]);
+        for (int position = next.fetch_add(1); position < count; position = next.fetch_add(1)) {
+            task(worker, order[position]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const int helpers = std::min(size(), count) - 1;
+    for (int worker = 1; worker <= helpers; ++worker) {
+        threads.emplace_back([&work, worker] {
+            OCRTrace::setThreadName(QString("ocr worker %1").arg(worker));
+            work(worker);
+        });
+    }
+    work(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void OCRWorkerPool::serve(const Source& next, const Task& task) {
+    serve(next, [&](int worker, int index) { task(*m_engines[worker], index); });
+}
+
+void OCRWorkerPool::serve(const Source& next, const WorkerTask& task) {
+    auto work = [&](int worker) {
+        const OCRThreading::ThreadPin pin(m_placements[worker]);
+        int index = 0;
+        while (next(index)) {
+            task(worker, index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int worker = 1; worker < size(); ++worker) {
+        threads.emplace_back([&work, worker] {
+            OCRTrace::setThreadName(QString("ocr worker %1").arg(worker));
+            work(worker);
+        });
+    }
+    work(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ * Module: OCRTrace Implementation
+ *
+ * Per-thread event buffers and Chrome trace-event JSON export.
+ */
+
+#include "ocrtrace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QLoggingCategory>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+Q_LOGGING_CATEGORY(ocrTrace, "ocr.trace")
+
+#ifdef MATHSCAN_ENABLE_TRACING
+std::atomic<bool> OCRTrace::s_enabled{false};
+#endif
+
+namespace {
+
+struct TraceEvent {
+    char phase;
+    const char* name;
+    const char* category;
+    qint64 timestampUs;
+    qint64 durationUs;
+    qint64 value;
+    std::string detail;
+};
+
+/**
+ * @brief Events recorded by one thread
+ *
+ * The mutex is only contended while stop() drains the buffer, so appends
+ * from the owning thread stay cheap.
+ */
+struct ThreadBuffer {
+    std::mutex mutex;
+    int tid = 0;
+    std::string threadName;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceState {
+    std::mutex mutex;
+    // Never shrinks: threads keep raw pointers to their buffer
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    QString outputPath;
+    int nextTid = 1;
+    std::atomic<size_t> droppedEvents{0};
+};
+
+// Upper bound per thread so a forgotten trace cannot exhaust memory
+constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+TraceState& traceState() {
+    static TraceState state;
+    return state;
+}
+
+ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        TraceState& state = traceState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = state.buffers.back().get();
+        buffer->tid = state.nextTid++;
+    }
+    return *buffer;
+}
+
+void appendJsonString(std::string& out, const char* text) {
+    out += '"';
+    for (const char* p = text; *p; ++p) {
+        const char c = *p;
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+}  // namespace
+
+qint64 OCRTrace::nowUs() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - epoch)
+        .count();
+}
+
+/**
+ * @brief Begin recording events
+ */
+bool OCRTrace::start(const QString& outputPath) {
+#ifdef MATHSCAN_ENABLE_TRACING
+    TraceState& state = traceState();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (s_enabled.load()) {
+            qCWarning(ocrTrace) << "Tracing already active, writing to" << state.outputPath;
+            return false;
+        }
+        state.outputPath = outputPath;
+        state.droppedEvents.store(0);
+    }
+    nowUs();  // pin the epoch before the first event
+    s_enabled.store(true);
+    qCInfo(ocrTrace) << "Trace recording started, output:" << outputPath;
+    return true;
+#else
+    Q_UNUSED(outputPath);
+    qCWarning(ocrTrace) << "Tracing was disabled at compile time (MATHSCAN_ENABLE_TRACING)";
+    return false;
+#endif
+}
+
+bool OCRTrace::startFromEnvironment() {
+    const QString path = qEnvironmentVariable("MATHSCAN_TRACE");
+    return !path.isEmpty() && start(path);
+}
+
+/**
+ * @brief Stop recording and write the trace-event JSON file
+ */
+bool OCRTrace::stop() {
+#ifdef MATHSCAN_ENABLE_TRACING
+    if (!s_enabled.exchange(false)) {
+        return false;
+    }
+
+    TraceState& state = traceState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t eventCount = 0;
+
+    auto beginEvent = [&](char phase, const char* name, const char* category, int tid,
+                          qint64 ts) {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+        json += "{\"ph\":\"";
+        json += phase;
+        json += "\",\"name\":";
+        appendJsonString(json, name);
+        if (category) {
+            json += ",\"cat\":";
+            appendJsonString(json, category);
+        }
+        json += ",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(tid) +
+                ",\"ts\":" + std::to_string(ts);
+    };
+
+    for (const auto& buffer : state.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        if (!buffer->threadName.empty()) {
+            beginEvent('M', "thread_name", nullptr, buffer->tid, 0);
+            json += ",\"args\":{\"name\":";
+            appendJsonString(json, buffer->threadName.c_str());
+            json += "}}";
+        }
+
+        for (const TraceEvent& event : buffer->events) {
+            beginEvent(event.phase, event.name, event.category, buffer->tid, event.timestampUs);
+            if (event.phase == 'X') {
+                json += ",\"dur\":" + std::to_string(event.durationUs);
+                if (!event.detail.empty()) {
+                    json += ",\"args\":{\"detail\":";
+                    appendJsonString(json, event.detail.c_str());
+                    json += '}';
+                }
+            } else if (event.phase == 'C') {
+                json += ",\"args\":{\"value\":" + std::to_string(event.value) + '}';
+            }
+            json += '}';
+            ++eventCount;
+        }
+        buffer->events.clear();
+        buffer->events.shrink_to_fit();
+    }
+    json += "\n]}\n";
+
+    QFile file(state.outputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(ocrTrace) << "Cannot write trace file:" << state.outputPath;
+        return false;
+    }
+    file.write(json.data(), static_cast<qint64>(json.size()));
+
+    qCInfo(ocrTrace) << "Trace written:" << state.outputPath << "|" << eventCount << "events"
+                     << "|" << state.droppedEvents.load() << "dropped";
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OCRTrace::recordComplete(const char* name, const char* category, qint64 startUs,
+                              qint64 durationUs, const QString& detail) {
+    if (!isEnabled()) {
+        return;
+    }
+    appendEvent('X', name, category, startUs, durationUs, 0,
+                detail.isEmpty() ? std::string() : detail.toStdString());
+}
+
+void OCRTrace::recordEndingNow(const char* name, const char* category, qint64 durationNs) {
+    if (!isEnabled()) {
+        return;
+    }
+    const qint64 durationUs = durationNs / 1000;
+    appendEvent('X', name, category, nowUs() - durationUs, durationUs, 0, std::string());
+}
+
+void OCRTrace::recordCounter(const char* name, qint64 value) {
+    if (!isEnabled()) {
+        return;
+    }
+    appendEvent('C', name, "counter", nowUs(), 0, value, std::string());
+}
+
+void OCRTrace::setThreadName(const QString& name) {
+#ifdef MATHSCAN_ENABLE_TRACING
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.threadName = name.toStdString();
+#else
+    Q_UNUSED(name);
+#endif
+}
+
+void OCRTrace::appendEvent(char phase, const char* name, const char* category,
+                           qint64 timestampUs, qint64 durationUs, qint64 value,
+                           std::string detail) {
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() >= kMaxEventsPerThread) {
+        traceState().droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events.push_back(
+        TraceEvent{phase, name, category, timestampUs, durationUs, value, std::move(detail)});
+}
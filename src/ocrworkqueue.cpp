@@ -0,0 +1,411 @@
+/*
+ * Module: OCR Work Queue Implementation
+ *
+ * Manifest, lease and done-marker files, shard records and the final merge.
+ */
+
+#include "ocrworkqueue.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QSysInfo>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(ocrWorkQueue, "ocr.queue")
+
+namespace {
+
+QByteArray encode(const QString& path) {
+    return QFile::encodeName(path);
+}
+
+/**
+ * @brief Write `contents` to a new file and flush it to the server
+ */
+bool writeSynced(const QString& path, const QByteArray& contents) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        file.write(contents) != contents.size() || !file.flush()) {
+        return false;
+    }
+    return ::fsync(file.handle()) == 0;
+}
+
+/**
+ * @brief Create `path` with `contents` only if it does not exist yet
+ *
+ * The contents go to a private temporary file that is then hard-linked to
+ * `path`. link() fails atomically if `path` exists. On NFS a lost reply can
+ * make a successful link() report an error, so the temporary file's link
+ * count decides.
+ */
+bool createExclusive(const QString& path, const QByteArray& contents, const QByteArray& token) {
+    const QString temporary = path + ".tmp." + QString::fromLatin1(token);
+    if (!writeSynced(temporary, contents)) {
+        ::unlink(encode(temporary).constData());
+        return false;
+    }
+    ::link(encode(temporary).constData(), encode(path).constData());
+    struct stat status;
+    const bool created =
+        ::stat(encode(temporary).constData(), &status) == 0 && status.st_nlink == 2;
+    ::unlink(encode(temporary).constData());
+    return created;
+}
+
+/**
+ * @brief Replace `path` atomically with `contents`
+ */
+bool replace(const QString& path, const QByteArray& contents, const QByteArray& token) {
+    const QString temporary = path + ".tmp." + QString::fromLatin1(token);
+    if (!writeSynced(temporary, contents) ||
+        ::rename(encode(temporary).constData(), encode(path).constData()) != 0) {
+        ::unlink(encode(temporary).constData());
+        return false;
+    }
+    return true;
+}
+
+QJsonObject readObject(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+qint64 nowMs() {
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+}  // namespace
+
+QString OCRWorkQueue::defaultNode() {
+    return QString("%1-%2").arg(QSysInfo::machineHostName()).arg(::getpid());
+}
+
+OCRWorkQueue::OCRWorkQueue(const Options& options)
+    : m_directory(options.directory),
+      m_node(options.node.isEmpty() ? defaultNode() : options.node),
+      m_leaseSeconds(std::max(1, options.leaseSeconds)),
+      m_chunkSize(std::max(1, options.chunkSize)) {
+    // The node name becomes a file name
+    m_node.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    m_token = QString("%1-%2")
+                  .arg(m_node)
+                  .arg(QRandomGenerator::system()->generate64(), 16, 16, QChar('0'))
+                  .toLatin1();
+}
+
+OCRWorkQueue::~OCRWorkQueue() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    if (m_renewer.joinable()) {
+        m_renewer.join();
+    }
+    // Unfinished chunks go back to the queue now rather than when their leases expire
+    for (int chunk : m_held) {
+        if (ownsLease(chunk)) {
+            ::unlink(encode(leasePath(chunk)).constData());
+        }
+    }
+    if (m_shard.isOpen()) {
+        m_shard.flush();
+        ::fdatasync(m_shard.handle());
+    }
+}
+
+bool OCRWorkQueue::open(const QStringList& inputs, QString* error) {
+    auto fail = [&](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    };
+    for (const char* subdirectory : {"leases", "done", "shards"}) {
+        if (!m_directory.mkpath(subdirectory)) {
+            return fail(QString("Cannot create %1").arg(m_directory.filePath(subdirectory)));
+        }
+    }
+
+    // Whoever links the manifest first defines the batch; everyone else joins it
+    const QString manifestPath = m_directory.filePath("manifest.json");
+    if (!QFileInfo::exists(manifestPath)) {
+        if (inputs.isEmpty()) {
+            return fail(QString("No inputs and no queue in %1 to join").arg(m_directory.path()));
+        }
+        QJsonArray paths;
+        for (const QString& input : inputs) {
+            paths.append(QFileInfo(input).absoluteFilePath());
+        }
+        QJsonObject manifest;
+        manifest["chunkSize"] = m_chunkSize;
+        manifest["inputs"] = paths;
+        if (createExclusive(manifestPath, QJsonDocument(manifest).toJson(), m_token)) {
+            qCInfo(ocrWorkQueue) << "Created queue" << m_directory.path() << "with"
+                                 << inputs.size() << "inputs";
+        }
+    }
+
+    const QJsonObject manifest = readObject(manifestPath);
+    m_chunkSize = std::max(1, manifest.value("chunkSize").toInt());
+    m_inputs.clear();
+    for (const QJsonValue& path : manifest.value("inputs").toArray()) {
+        m_inputs << path.toString();
+    }
+    if (m_inputs.isEmpty()) {
+        return fail(QString("Unreadable or empty manifest %1").arg(manifestPath));
+    }
+    if (!inputs.isEmpty() && inputs.size() != m_inputs.size()) {
+        qCWarning(ocrWorkQueue) << "Joining the existing queue's" << m_inputs.size()
+                                << "inputs instead of the" << inputs.size() << "given";
+    }
+
+    m_shard.setFileName(m_directory.filePath(QString("shards/%1.jsonl").arg(m_node)));
+    if (!m_shard.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        return fail(QString("Cannot open shard %1: %2")
+                        .arg(m_shard.fileName(), m_shard.errorString()));
+    }
+    m_renewer = std::thread(&OCRWorkQueue::renewLeases, this);
+    return true;
+}
+
+OCRWorkQueue::Claim OCRWorkQueue::claim(int& chunk) {
+    bool othersHoldWork = false;
+    for (int candidate = 0; candidate < chunkCount(); ++candidate) {
+        {
+            // complete() updates m_done from worker threads
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_done.contains(candidate) || m_held.contains(candidate)) {
+                continue;
+            }
+        }
+        if (QFileInfo::exists(donePath(candidate))) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.insert(candidate);
+            continue;
+        }
+
+        if (!createExclusive(leasePath(candidate), leaseContents(), m_token)) {
+            const QJsonObject lease = readObject(leasePath(candidate));
+            const bool expired = lease.value("expires").toString().toLongLong() < nowMs();
+            if (!expired || !takeOver(candidate)) {
+                othersHoldWork = true;
+                continue;
+            }
+            ++m_takenOver;
+            qCInfo(ocrWorkQueue) << "Took over chunk" << candidate << "from"
+                                 << lease.value("node").toString();
+        }
+        // The previous holder may have finished it between our check and our lease
+        if (QFileInfo::exists(donePath(candidate))) {
+            ::unlink(encode(leasePath(candidate)).constData());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.insert(candidate);
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_held.insert(candidate);
+        chunk = candidate;
+        return Claim::Claimed;
+    }
+    return othersHoldWork ? Claim::Busy : Claim::Finished;
+}
+
+bool OCRWorkQueue::takeOver(int chunk) {
+    // Only one node can rename the expired lease away; the others get ENOENT
+    const QString lease = leasePath(chunk);
+    const QString stale = lease + ".stale." + QString::fromLatin1(m_token);
+    if (::rename(encode(lease).constData(), encode(stale).constData()) != 0) {
+        return false;
+    }
+    const bool expired =
+        readObject(stale).value("expires").toString().toLongLong() < nowMs();
+    if (!expired) {
+        // Renamed a lease someone took over just before us: put it back
+        ::link(encode(stale).constData(), encode(lease).constData());
+    }
+    ::unlink(encode(stale).constData());
+    return expired && createExclusive(lease, leaseContents(), m_token);
+}
+
+bool OCRWorkQueue::record(int page, const OCRProcessor::OCRResult& result) {
+    QJsonObject line;
+    line["page"] = page;
+    line["path"] = m_inputs.value(page);
+    line["node"] = m_node;
+    line["success"] = result.success;
+    line["blank"] = result.isBlankPage;
+    line["confidence"] = result.confidence;
+    line["text"] = result.text;
+    if (!result.success) {
+        line["error"] = result.errorMessage;
+    }
+    const QByteArray encoded = QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n';
+    return m_shard.write(encoded) == encoded.size();
+}
+
+bool OCRWorkQueue::complete(int chunk) {
+    // The chunk's records must be durable before anyone may rely on the marker
+    if (::fdatasync(m_shard.handle()) != 0) {
+        qCWarning(ocrWorkQueue) << "Cannot sync" << m_shard.fileName();
+        return false;
+    }
+    const bool marked = createExclusive(donePath(chunk), m_node.toUtf8(), m_token) ||
+                        QFileInfo::exists(donePath(chunk));
+    if (ownsLease(chunk)) {
+        ::unlink(encode(leasePath(chunk)).constData());
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_held.remove(chunk);
+    if (marked) {
+        m_done.insert(chunk);
+    }
+    return marked;
+}
+
+bool OCRWorkQueue::merge(MergeSummary& summary, QString* error) {
+    summary = MergeSummary();
+    if (QFileInfo::exists(resultsPath())) {
+        return true;  // Another node merged first
+    }
+    QHash<int, QString> finisher;  // Chunk -> node whose records count
+    for (int chunk = 0; chunk < chunkCount(); ++chunk) {
+        QFile marker(donePath(chunk));
+        if (!marker.open(QIODevice::ReadOnly)) {
+            if (error) {
+                *error = QString("Chunk %1 of %2 is not done yet").arg(chunk).arg(chunkCount());
+            }
+            return false;
+        }
+        finisher.insert(chunk, QString::fromUtf8(marker.readAll()));
+    }
+
+    std::vector<QJsonObject> pages(static_cast<size_t>(m_inputs.size()));
+    const QFileInfoList shards =
+        QDir(m_directory.filePath("shards")).entryInfoList({"*.jsonl"}, QDir::Files);
+    for (const QFileInfo& shardInfo : shards) {
+        QFile shard(shardInfo.absoluteFilePath());
+        if (!shard.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        ++summary.shards;
+        while (!shard.atEnd()) {
+            const QJsonObject line = QJsonDocument::fromJson(shard.readLine()).object();
+            const int page = line.value("page").toInt(-1);
+            if (page < 0 || page >= m_inputs.size()) {
+                continue;
+            }
+            QJsonObject& kept = pages[page];
+            if (!kept.isEmpty()) {
+                ++summary.duplicates;
+            }
+            // A page redone after a takeover: the node that finished the chunk wins
+            if (kept.isEmpty() || line.value("node").toString() == finisher.value(chunkOf(page))) {
+                kept = line;
+            }
+        }
+    }
+
+    QByteArray merged;
+    for (const QJsonObject& page : pages) {
+        if (!page.isEmpty()) {
+            merged += QJsonDocument(page).toJson(QJsonDocument::Compact) + '\n';
+            ++summary.pages;
+        }
+    }
+    // Every node that gets here writes the same file, so the last rename is as good as any
+    if (!replace(resultsPath(), merged, m_token)) {
+        if (error) {
+            *error = QString("Cannot write %1").arg(resultsPath());
+        }
+        return false;
+    }
+    summary.merged = true;
+    return true;
+}
+
+std::chrono::milliseconds OCRWorkQueue::pollInterval() const {
+    return std::chrono::milliseconds(std::min(5000, m_leaseSeconds * 1000 / 4));
+}
+
+QString OCRWorkQueue::leasePath(int chunk) const {
+    return m_directory.filePath(QString("leases/chunk-%1").arg(chunk, 6, 10, QChar('0')));
+}
+
+QString OCRWorkQueue::donePath(int chunk) const {
+    return m_directory.filePath(QString("done/chunk-%1").arg(chunk, 6, 10, QChar('0')));
+}
+
+QByteArray OCRWorkQueue::leaseContents() const {
+    QJsonObject lease;
+    lease["node"] = m_node;
+    lease["token"] = QString::fromLatin1(m_token);
+    // 64-bit values are strings: JSON numbers are doubles
+    lease["expires"] = QString::number(nowMs() + m_leaseSeconds * 1000LL);
+    return QJsonDocument(lease).toJson(QJsonDocument::Compact);
+}
+
+bool OCRWorkQueue::ownsLease(int chunk) const {
+    return readObject(leasePath(chunk)).value("token").toString().toLatin1() == m_token;
+}
+
+bool OCRWorkQueue::renewLease(int chunk) {
+    // Same rename-away as takeOver: a node taking the lease over concurrently gets ENOENT
+    const QString lease = leasePath(chunk);
+    const QString renewing = lease + ".renew." + QString::fromLatin1(m_token);
+    if (::rename(encode(lease).constData(), encode(renewing).constData()) != 0) {
+        return false;  // Already renamed away by a node taking it over
+    }
+    const bool ours = readObject(renewing).value("token").toString().toLatin1() == m_token;
+    if (!ours) {
+        // Taken over before we got here: put the new holder's lease back
+        ::link(encode(renewing).constData(), encode(lease).constData());
+    }
+    ::unlink(encode(renewing).constData());
+    if (!ours) {
+        return false;
+    }
+    if (QFileInfo::exists(donePath(chunk))) {
+        return true;  // complete() finished it meanwhile; a done chunk needs no lease
+    }
+    // Loses to any node that claimed the chunk in the moment it had no lease
+    return createExclusive(lease, leaseContents(), m_token);
+}
+
+void OCRWorkQueue::renewLeases() {
+    const auto period = std::chrono::milliseconds(m_leaseSeconds * 1000 / 3);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, period, [this] { return m_stopping; })) {
+        const QSet<int> held = m_held;
+        lock.unlock();
+        QSet<int> lost;
+        for (int chunk : held) {
+            // A node that stalled past its lease may find the chunk taken over
+            if (!renewLease(chunk)) {
+                lost.insert(chunk);
+            }
+        }
+        lock.lock();
+        for (int chunk : lost) {
+            // Pages in flight still finish and are recorded; the merge prefers the new holder
+            qCWarning(ocrWorkQueue) << "Lost chunk" << chunk << "to another node";
+            m_held.remove(chunk);
+            ++m_lost;
+        }
+    }
+}
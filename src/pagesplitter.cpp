@@ -0,0 +1,132 @@
+/*
+ * Module: Page Splitter Implementation
+ *
+ * Baseline-relative glyph placement classifier and region grouping.
+ */
+
+#include "pagesplitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Glyphs smaller than this in both directions (dots, commas, quotes) are ignored
+constexpr double kTinyGlyph = 0.3;
+// A glyph floats when its bottom is this far above the baseline
+constexpr double kRaisedBy = 0.25;
+// A glyph hangs when its bottom is this far below the baseline...
+constexpr double kLoweredBy = 0.2;
+// ...and its top stays below this height, unlike descenders of g, p and y
+constexpr double kLoweredTopBelow = 0.6;
+// Glyphs whose bottom is this close to the baseline sit on it
+constexpr double kOnBaseline = 0.12;
+
+}  // namespace
+
+/**
+ * @brief Baseline y at column x
+ */
+double PageSplitter::Line::baselineAt(int x) const {
+    if (box.width() <= 0) {
+        return baselineLeft;
+    }
+    const double t = static_cast<double>(x - box.left) / box.width();
+    return baselineLeft + t * (baselineRight - baselineLeft);
+}
+
+/**
+ * @brief Share of a line's glyphs placed like operators or scripts
+ */
+double PageSplitter::scriptGlyphRatio(const Line& line) {
+    if (line.glyphs.size() < static_cast<size_t>(kMinMeasurableGlyphs)) {
+        return -1.0;
+    }
+
+    // Reference height: median of the glyphs standing on the baseline
+    const double tolerance = std::max(1.0, kOnBaseline * line.box.height());
+    std::vector<int> heights;
+    heights.reserve(line.glyphs.size());
+    for (const Box& glyph : line.glyphs) {
+        const double baseline = line.baselineAt((glyph.left + glyph.right) / 2);
+        if (std::abs(glyph.bottom - baseline) <= tolerance) {
+            heights.push_back(glyph.height());
+        }
+    }
+    if (heights.empty()) {
+        return -1.0;
+    }
+    std::nth_element(heights.begin(), heights.begin() + heights.size() / 2, heights.end());
+    const double reference = std::max(1, heights[heights.size() / 2]);
+
+    int measured = 0;
+    int scripts = 0;
+    for (const Box& glyph : line.glyphs) {
+        if (glyph.width() < kTinyGlyph * reference && glyph.height() < kTinyGlyph * reference) {
+            continue;
+        }
+        ++measured;
+
+        const double baseline = line.baselineAt((glyph.left + glyph.right) / 2);
+        const bool raised = glyph.bottom < baseline - kRaisedBy * reference;
+        const bool lowered = glyph.bottom > baseline + kLoweredBy * reference &&
+                             glyph.top > baseline - kLoweredTopBelow * reference;
+        if (raised || lowered) {
+            ++scripts;
+        }
+    }
+    if (measured < kMinMeasurableGlyphs) {
+        return -1.0;
+    }
+    return static_cast<double>(scripts) / measured;
+}
+
+/**
+ * @brief Group lines into prose and math regions
+ */
+std::vector<PageSplitter::Region> PageSplitter::split(const std::vector<Line>& lines,
+                                                      double mathRatio) {
+    // Classify what can be measured; -1 marks lines that inherit a neighbour's kind
+    std::vector<int> kinds(lines.size(), -1);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const double ratio = scriptGlyphRatio(lines[i]);
+        if (ratio >= 0.0) {
+            kinds[i] = static_cast<int>(ratio >= mathRatio ? RegionKind::Math : RegionKind::Prose);
+        }
+    }
+    for (size_t i = 1; i < lines.size(); ++i) {
+        if (kinds[i] < 0 && lines[i].block == lines[i - 1].block) {
+            kinds[i] = kinds[i - 1];
+        }
+    }
+    for (size_t i = lines.size(); i-- > 1;) {
+        if (kinds[i - 1] < 0 && lines[i - 1].block == lines[i].block) {
+            kinds[i - 1] = kinds[i];
+        }
+    }
+
+    std::vector<Region> regions;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const RegionKind kind =
+            kinds[i] < 0 ? RegionKind::Prose : static_cast<RegionKind>(kinds[i]);
+        const Box& box = lines[i].box;
+        const bool extend = !regions.empty() && regions.back().kind == kind &&
+                            lines[regions.back().firstLine].block == lines[i].block;
+        if (extend) {
+            Region& region = regions.back();
+            region.box.left = std::min(region.box.left, box.left);
+            region.box.top = std::min(region.box.top, box.top);
+            region.box.right = std::max(region.box.right, box.right);
+            region.box.bottom = std::max(region.box.bottom, box.bottom);
+            ++region.lineCount;
+        } else {
+            Region region;
+            region.kind = kind;
+            region.box = box;
+            region.firstLine = static_cast<int>(i);
+            region.lineCount = 1;
+            regions.push_back(region);
+        }
+    }
+    return regions;
+}
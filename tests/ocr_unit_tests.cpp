@@ -0,0 +1,286 @@
+/*
+ * Module: OCR Unit Tests
+ *
+ * Objective:
+ * - Pin down the engine-independent parts of the OCR pipeline: batch
+ *   scheduling and band cuts, page measurements, the equation grammar and
+ *   parser, the columnar layout and the latency histogram.
+ * - Run without Tesseract, language data or a display, so `ctest` works on
+ *   any machine that builds the project.
+ *
+ * Each check that fails prints its expression and line; the exit code is
+ * the number of failures.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "imageanalysis.h"
+#include "latencyhistogram.h"
+#include "mathexpression.h"
+#include "mathgrammar.h"
+#include "ocrbatchplan.h"
+#include "ocrlayout.h"
+
+namespace {
+
+int s_failures = 0;
+
+#define CHECK(expression)                                                          \
+    do {                                                                           \
+        if (!(expression)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                         #expression);                                             \
+            ++s_failures;                                                          \
+        }                                                                          \
+    } while (false)
+
+/**
+ * @brief Gray page of `paper` with the given rows filled with `ink`
+ */
+std::vector<uint8_t> grayPage(int width, int height, uint8_t paper, uint8_t ink,
+                              const std::vector<std::pair<int, int>>& inkRows) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height, paper);
+    for (const auto& [first, last] : inkRows) {
+        for (int y = first; y <= last; ++y) {
+            // Glyph-like runs, not solid bars
+            for (int x = 0; x < width; x += 4) {
+                pixels[static_cast<size_t>(y) * width + x] = ink;
+                pixels[static_cast<size_t>(y) * width + x + 1] = ink;
+            }
+        }
+    }
+    return pixels;
+}
+
+void testLongestFirst() {
+    std::vector<OCRBatchPlan::WorkUnit> units(4);
+    const double costs[] = {1.0, 3.0, 2.0, 3.0};
+    for (int i = 0; i < 4; ++i) {
+        units[i].page = i;
+        units[i].cost = costs[i];
+    }
+    // Ties keep input order
+    CHECK((OCRBatchPlan::longestFirst(units) == std::vector<int>{1, 3, 2, 0}));
+    CHECK(OCRBatchPlan::longestFirst({}).empty());
+}
+
+void testSimulateMakespan() {
+    const std::vector<qint64> durations = {2, 2, 2, 5};
+    // FIFO leaves the long unit for last: one worker runs 2 + 5
+    CHECK(OCRBatchPlan::simulateMakespan(durations, {0, 1, 2, 3}, 2) == 7);
+    // Longest first: 5 on one worker, 2 + 2 + 2 on the other
+    CHECK(OCRBatchPlan::simulateMakespan(durations, {3, 0, 1, 2}, 2) == 6);
+    CHECK(OCRBatchPlan::simulateMakespan(durations, {0, 1, 2, 3}, 1) == 11);
+    CHECK(OCRBatchPlan::simulateMakespan(durations, {0, 1, 2, 3}, 8) == 5);
+    CHECK(OCRBatchPlan::simulateMakespan({}, {}, 2) == 0);
+}
+
+void testCutBands() {
+    const QSize page(1000, 2000);
+
+    // Dense rows everywhere except one gap near the middle
+    std::vector<int> rowInk(100, 50);
+    rowInk[47] = 0;
+    std::vector<QRect> bands = OCRBatchPlan::cutBands(rowInk, 0, page, 2);
+    CHECK(bands.size() == 2);
+    if (bands.size() == 2) {
+        CHECK(bands[0] == QRect(0, 0, 1000, 940));
+        CHECK(bands[1] == QRect(0, 940, 1000, 1060));
+    }
+
+    // Of two blank rows the one closer to the even split wins
+    rowInk[52] = 0;
+    bands = OCRBatchPlan::cutBands(rowInk, 0, page, 2);
+    CHECK(bands.size() == 2 && bands[0].height() == 1040);
+
+    // Specks up to maxInk still count as blank
+    rowInk[47] = rowInk[52] = 50;
+    rowInk[55] = 2;
+    CHECK(OCRBatchPlan::cutBands(rowInk, 1, page, 2).size() == 1);
+    CHECK(OCRBatchPlan::cutBands(rowInk, 2, page, 2).size() == 2);
+
+    // No blank row near a split: the bands on either side stay joined
+    std::vector<int> dense(120, 50);
+    dense[40] = 0;  // only the first of two splits (40, 80) has a gap
+    bands = OCRBatchPlan::cutBands(dense, 0, page, 3);
+    CHECK(bands.size() == 2);
+    if (bands.size() == 2) {
+        CHECK(bands[0].bottom() + 1 == bands[1].top());
+        CHECK(bands[1].bottom() == page.height() - 1);
+    }
+    CHECK(OCRBatchPlan::cutBands(std::vector<int>(120, 50), 0, page, 3).size() == 1);
+
+    // Bands always cover the page exactly
+    std::vector<int> gaps(300, 50);
+    for (int y = 0; y < 300; y += 10) {
+        gaps[y] = 0;
+    }
+    bands = OCRBatchPlan::cutBands(gaps, 0, page, 4);
+    CHECK(bands.size() == 4);
+    int covered = 0;
+    for (const QRect& band : bands) {
+        CHECK(band.top() == covered && band.width() == page.width());
+        covered += band.height();
+    }
+    CHECK(covered == page.height());
+
+    CHECK(OCRBatchPlan::cutBands(gaps, 0, page, 1).size() == 1);
+    CHECK(OCRBatchPlan::cutBands({}, 0, page, 4).size() == 1);
+}
+
+void testImageAnalysis() {
+    const int width = 400;
+    const int height = 200;
+    std::vector<uint8_t> pixels = grayPage(width, height, 230, 30, {{20, 35}, {60, 75}});
+    const GrayImageView view{pixels.data(), width, height, width};
+
+    const int otsu = ImageAnalysis::otsuThreshold(view, 1, 1);
+    CHECK(otsu >= 30 && otsu < 230);
+
+    const ImageAnalysis::InkStatistics ink = ImageAnalysis::measureInk(view, otsu + 1, 1);
+    CHECK(std::abs(ink.inkRatio - 32.0 * 200 / (width * height)) < 1e-9);
+    CHECK(!ink.isBlank(0.001));
+
+    // Faint pencil on white paper is ink; the noise of an empty page is not
+    std::vector<uint8_t> faint = grayPage(width, height, 240, 170, {{100, 101}});
+    const GrayImageView faintView{faint.data(), width, height, width};
+    const int level = ImageAnalysis::inkLevel(faintView);
+    CHECK(level > 170 && level <= 200);
+
+    std::vector<uint8_t> empty = grayPage(width, height, 240, 225, {{10, 10}});
+    const GrayImageView emptyView{empty.data(), width, height, width};
+    CHECK(ImageAnalysis::inkLevel(emptyView) <= 200);
+    CHECK(ImageAnalysis::measureInk(emptyView, ImageAnalysis::inkLevel(emptyView), 1)
+              .isBlank(0.00002));
+}
+
+/**
+ * @brief Run the grammar search over `text`, offering the usual look-alike
+ *        (l/I for 1, O for 0 and back) as a weaker second choice
+ */
+std::string searchWithLookalikes(const std::string& text, float confidence) {
+    MathBeamSearch search;
+    for (const char c : text) {
+        if (c == ' ') {
+            search.addSpace();
+            continue;
+        }
+        const char own[2] = {c, 0};
+        const char* lookalike = c == 'l' || c == 'I' ? "1"
+                                : c == 'O'           ? "0"
+                                : c == '1'           ? "l"
+                                : c == '0'           ? "O"
+                                                     : nullptr;
+        const char* const choices[2] = {own, lookalike};
+        const float confidences[2] = {confidence, 40.0f};
+        search.addSymbol(choices, confidences, lookalike ? 2 : 1);
+    }
+    std::string chosen;
+    return search.run(chosen).parsed ? chosen : std::string();
+}
+
+void testMathGrammar() {
+    CHECK(MathGrammar::parses("x2 + 1 = 5"));
+    CHECK(MathGrammar::parses("(a + b) / 2"));
+    CHECK(!MathGrammar::parses("= = 1"));
+    CHECK(!MathGrammar::parses("(a + b"));
+    CHECK(MathGrammar::isDigitLike('l') && MathGrammar::isDigitLike('O'));
+    CHECK(!MathGrammar::isDigitLike('x'));
+
+    // Correct equations are left alone, look-alike letters included
+    for (const std::string text : {"ln x = 2", "O(n) = n log n", "I = V / R", "l = 2a + b",
+                                   "10 = 2 * 5", "x2 + 1 = 5"}) {
+        CHECK(searchWithLookalikes(text, 90.0f) == text);
+    }
+    // A lone l read only a little more confidently than the 1 it stands for is corrected
+    CHECK(searchWithLookalikes("x2 + l = 5", 60.0f) == "x2 + 1 = 5");
+}
+
+void testMathExpression() {
+    MathExpression expression;
+    CHECK(expression.parse(std::string("x^2 + 1 = 5")));
+    CHECK(expression.toTree() == "(= (+ (^ x 2) 1) 5)");
+    CHECK(!expression.toLatex().empty());
+
+    CHECK(!expression.parse(std::string("+ = )")));
+    CHECK(!expression.isValid() && !expression.error().empty());
+}
+
+void testLayout() {
+    OCRLayout band;
+    const int line = band.append(OCRLayout::Level::Line, QRect(10, 5, 100, 20), 90.0f, -1,
+                                 "ab");
+    const int word = band.append(OCRLayout::Level::Word, QRect(10, 5, 40, 20), 85.0f, line,
+                                 "ab");
+    band.append(OCRLayout::Level::Symbol, QRect(10, 5, 20, 20), 80.0f, word, "a");
+    band.append(OCRLayout::Level::Symbol, QRect(30, 5, 20, 20), 90.0f, word, "b");
+
+    OCRLayout page;
+    page.append(OCRLayout::Level::Line, QRect(0, 0, 10, 10), 50.0f, -1, "z");
+    page.append(OCRLayout::Level::Word, QRect(0, 0, 10, 10), 50.0f, 0, "z");
+    page.appendLayout(band, QPoint(0, 1000));
+
+    CHECK(page.count(OCRLayout::Level::Line) == 2);
+    CHECK(page.count(OCRLayout::Level::Word) == 2);
+    CHECK(page.count(OCRLayout::Level::Symbol) == 2);
+    CHECK(page.boundingBox(OCRLayout::Level::Line, 1) == QRect(10, 1005, 100, 20));
+    CHECK(page.boundingBox(OCRLayout::Level::Symbol, 1) == QRect(30, 1005, 20, 20));
+    // Parents are rebased onto the appended elements
+    CHECK(page.parent(OCRLayout::Level::Word, 1) == 1);
+    CHECK(page.parent(OCRLayout::Level::Symbol, 0) == 1);
+    CHECK(page.text(OCRLayout::Level::Word, 1) == QString("ab"));
+    CHECK(page.text(OCRLayout::Level::Symbol, 1) == QString("b"));
+    CHECK(page.confidence(OCRLayout::Level::Symbol, 0) == 80.0f);
+}
+
+void testLatencyHistogram() {
+    LatencyHistogram histogram;
+    CHECK(histogram.percentile(50) == 0 && histogram.count() == 0);
+
+    for (qint64 value = 1; value <= 1000; ++value) {
+        histogram.record(value);
+    }
+    CHECK(histogram.count() == 1000);
+    CHECK(histogram.min() == 1 && histogram.max() == 1000);
+    CHECK(std::abs(histogram.mean() - 500.5) < 1e-9);
+    // Log-linear buckets: within about 3% of the exact rank
+    CHECK(std::abs(histogram.percentile(50) - 500) <= 500 * 0.035);
+    CHECK(std::abs(histogram.percentile(99) - 990) <= 990 * 0.035);
+    CHECK(histogram.percentile(100) == 1000);
+
+    // Small values are exact, negative ones clamp to zero
+    LatencyHistogram small;
+    small.record(-5);
+    small.record(7);
+    small.record(7);
+    CHECK(small.min() == 0 && small.percentile(50) == 7);
+
+    histogram.merge(small);
+    CHECK(histogram.count() == 1003 && histogram.min() == 0 && histogram.max() == 1000);
+}
+
+}  // namespace
+
+/**
+ * @brief Run every check; the exit code is the number of failures
+ */
+int main() {
+    testLongestFirst();
+    testSimulateMakespan();
+    testCutBands();
+    testImageAnalysis();
+    testMathGrammar();
+    testMathExpression();
+    testLayout();
+    testLatencyHistogram();
+
+    if (s_failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", s_failures);
+    } else {
+        std::printf("All checks passed\n");
+    }
+    return s_failures;
+}